@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <utility>
+
+// Per-call memory. Scratch containers inside a kernel (sort keys, heaps, seen sets) allocate from
+// a per-thread arena that a native call's Scope resets when it returns, so they cost no heap
+// allocation once the arena is warm. Result vectors still use the heap because the VM packs them
+// after the call, but they reserve the output size the function's observed selectivity predicts
+// instead of growing one push_back at a time.
+namespace skypal::arena {
+
+    // The arena starts at kInitialBytes and grows to what the last scope spilled to the heap, up to
+    // kMaxBytes, so a thread that keeps sorting big arrays stops spilling after its first call.
+    constexpr std::size_t kInitialBytes = 256 * 1024;
+    constexpr std::size_t kMaxBytes = 4 * 1024 * 1024;
+
+    // Read from [ARENA] in doticu_skypal.ini. Off, native calls open no scope and predict nothing,
+    // and kernels allocate from the heap.
+    inline std::atomic<bool> enabled = true;
+
+    // the heap behind the arena, counting what the arena needed beyond its buffer
+    class Spill : public std::pmr::memory_resource {
+    public:
+        std::size_t bytes = 0;
+
+    private:
+        void* do_allocate(std::size_t size, std::size_t alignment) override {
+            bytes += size;
+            return std::pmr::new_delete_resource()->allocate(size, alignment);
+        }
+
+        void do_deallocate(void* memory, std::size_t size, std::size_t alignment) override {
+            std::pmr::new_delete_resource()->deallocate(memory, size, alignment);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+    };
+
+    // the buffer is on the heap so threads that never run a kernel don't carry it in TLS
+    struct LocalState {
+        LocalState() { Grow(kInitialBytes); }
+
+        void Grow(std::size_t bytes) {
+            resource.reset();
+            buffer = std::make_unique_for_overwrite<std::byte[]>(bytes);
+            bufferBytes = bytes;
+            resource.emplace(buffer.get(), bufferBytes, &spill);
+        }
+
+        // frees everything the scope allocated, then grows if the scope spilled
+        void Reset() {
+            resource->release();
+            if (spill.bytes > 0 && bufferBytes < kMaxBytes) {
+                Grow(std::min(kMaxBytes, bufferBytes + spill.bytes));
+            }
+            spill.bytes = 0;
+            expectedOutput = 0;
+        }
+
+        Spill spill;
+        std::unique_ptr<std::byte[]> buffer;
+        std::size_t bufferBytes = 0;
+        std::optional<std::pmr::monotonic_buffer_resource> resource;
+        int depth = 0;
+        std::size_t expectedOutput = 0;
+    };
+
+    inline LocalState& Local() {
+        thread_local LocalState local;
+        return local;
+    }
+
+    // The arena inside a Scope, the heap outside one, so kernels run anywhere.
+    inline std::pmr::memory_resource* Resource() {
+        auto& local = Local();
+        return local.depth > 0 ? &*local.resource : std::pmr::new_delete_resource();
+    }
+
+    // Scopes nest, the outermost one frees everything allocated in it when it ends. Nothing
+    // allocated from Resource() may outlive it.
+    class Scope {
+    public:
+        Scope() { Local().depth++; }
+
+        ~Scope() {
+            auto& local = Local();
+            if (--local.depth == 0) {
+                local.Reset();
+            }
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    // how many refs the next result vector should reserve, 0 to let it grow
+    inline void ExpectOutput(std::size_t count) {
+        Local().expectedOutput = count;
+    }
+
+    // the expected output size, once, so a kernel's later vectors don't reserve for it too
+    inline std::size_t TakeExpectedOutput() {
+        return std::exchange(Local().expectedOutput, 0);
+    }
+
+    // A function's output / input ratio as a moving average over its calls. Racy updates from
+    // several threads only blur the average a little.
+    class Selectivity {
+    public:
+        void Observe(std::size_t input, std::size_t output) {
+            if (input == 0) {
+                return;
+            }
+            auto observed = static_cast<std::uint32_t>(std::min<std::uint64_t>(kOne, std::uint64_t(output) * kOne / input));
+            auto current = ratio.load(std::memory_order_relaxed);
+            auto next = current == kUnknown ? observed : current - current / kWeight + observed / kWeight;
+            ratio.store(next, std::memory_order_relaxed);
+        }
+
+        // the output size for input refs with an eighth more for noise, 0 before the first call
+        std::size_t Predict(std::size_t input) const {
+            auto current = ratio.load(std::memory_order_relaxed);
+            if (current == kUnknown || input == 0) {
+                return 0;
+            }
+            auto predicted = std::uint64_t(input) * current / kOne;
+            return static_cast<std::size_t>(std::min<std::uint64_t>(input, predicted + predicted / 8 + 1));
+        }
+
+    private:
+        static constexpr std::uint32_t kOne = 1 << 16;
+        static constexpr std::uint32_t kUnknown = UINT32_MAX;
+        static constexpr std::uint32_t kWeight = 8;
+
+        std::atomic<std::uint32_t> ratio = kUnknown;
+    };
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// The bookkeeping behind the bulk mutation natives, engine-free so the bench can drive it with
+// mock refs. Items are queued under a key and coalesce: a key queued again before it's applied
+// keeps its place and takes the newer item. Each enqueue call is a batch, which completes once
+// every key it queued has been applied or taken over by a later batch. Not thread safe, the
+// plugin calls it with its own mutex held.
+namespace skypal::bulk {
+
+    template <class Item>
+    class Queue {
+    public:
+        struct Entry {
+            Item item;
+            std::uint32_t batchId = 0;
+        };
+
+        struct Completed {
+            std::string name;
+            std::uint32_t batchId = 0;
+        };
+
+        std::uint32_t Begin(std::string name) {
+            auto batchId = ++lastBatchId;
+            batches[batchId].name = std::move(name);
+            return batchId;
+        }
+
+        // The item queued under key, for the caller to fill in; a default Item if key wasn't queued.
+        // A key batchId queued already only gets the newer item. One an older batch queued moves
+        // to batchId, which counts as applied for the older batch.
+        Item& Add(std::uint32_t batchId, std::uint64_t key) {
+            auto it = pending.find(key);
+            if (it == pending.end()) {
+                it = pending.emplace(key, Entry{ Item{}, batchId }).first;
+                order.push_back(key);
+            }
+            else if (it->second.batchId == batchId) {
+                return it->second.item;
+            }
+            else {
+                auto previous = it->second.batchId;
+                it->second.batchId = batchId;
+                Finish(previous);
+            }
+            batches[batchId].remaining += 1;
+            return it->second.item;
+        }
+
+        // after the last Add of batchId, completes it if it queued nothing
+        void End(std::uint32_t batchId) {
+            auto it = batches.find(batchId);
+            if (it != batches.end() && it->second.remaining == 0) {
+                completed.push_back({ std::move(it->second.name), batchId });
+                batches.erase(it);
+            }
+        }
+
+        // moves up to count queued entries to out, oldest first
+        void Take(std::size_t count, std::vector<Entry>& out) {
+            while (!order.empty() && count > 0) {
+                auto it = pending.find(order.front());
+                order.pop_front();
+                if (it != pending.end()) {
+                    out.push_back(std::move(it->second));
+                    pending.erase(it);
+                    count -= 1;
+                }
+            }
+        }
+
+        // one entry of batchId was applied
+        void Finish(std::uint32_t batchId) {
+            auto it = batches.find(batchId);
+            if (it == batches.end()) {
+                return;
+            }
+
+            it->second.remaining -= 1;
+            if (it->second.remaining <= 0) {
+                completed.push_back({ std::move(it->second.name), batchId });
+                batches.erase(it);
+            }
+        }
+
+        std::vector<Completed> TakeCompleted() {
+            std::vector<Completed> done;
+            done.swap(completed);
+            return done;
+        }
+
+        bool Idle() const { return order.empty() && completed.empty(); }
+        std::size_t Size() const { return order.size(); }
+        std::uint32_t LastBatchId() const { return lastBatchId; }
+
+    private:
+        struct Batch {
+            std::string name;
+            int remaining = 0;
+        };
+
+        std::uint32_t lastBatchId = 0;
+        std::unordered_map<std::uint64_t, Entry> pending;
+        std::deque<std::uint64_t> order;
+        std::unordered_map<std::uint32_t, Batch> batches;
+        std::vector<Completed> completed;
+    };
+}
@@ -0,0 +1,645 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "skypal/arena.h"
+
+// Engine-free filter, sort, ownership and keyword kernels.
+// Everything is templated on a "ref traits" type that says how to read a reference:
+// skypal::EngineTraits (engine_traits.h) binds the real game types for the plugin, and the
+// mock world in bench/ binds plain structs so the kernels can be built and profiled on Linux.
+//
+// Null refs in the input are always skipped, null keywords / owners never match.
+namespace skypal::core {
+
+    template <class T>
+    concept RefTraits = requires(
+        typename T::Ref ref,
+        typename T::Form form,
+        typename T::FormList list,
+        typename T::Keyword keyword,
+        typename T::Actor actor,
+        typename T::Faction faction,
+        typename T::Cell cell,
+        typename T::Worldspace worldspace,
+        typename T::EncounterZone zone) {
+        { T::GetBase(ref) } -> std::convertible_to<typename T::Form>;
+        { T::GetBaseFormType(ref) } -> std::convertible_to<int>;
+        { T::ListHasForm(list, form) } -> std::convertible_to<bool>;
+        { T::HasKeyword(ref, keyword) } -> std::convertible_to<bool>;
+        { T::GetPosition(ref).x } -> std::convertible_to<float>;
+        { T::IsDisabled(ref) } -> std::convertible_to<bool>;
+        { T::IsDeleted(ref) } -> std::convertible_to<bool>;
+        { T::Is3DLoaded(ref) } -> std::convertible_to<bool>;
+        { T::IsOffLimits(ref) } -> std::convertible_to<bool>;
+        { T::IsInventoryObject(ref) } -> std::convertible_to<bool>;
+        { T::IsPlayable(ref) } -> std::convertible_to<bool>;
+        { T::IsQuestObject(ref) } -> std::convertible_to<bool>;
+        { T::GetCollisionLayer(ref) } -> std::convertible_to<int>;
+        { T::GetParentCell(ref) } -> std::convertible_to<typename T::Cell>;
+        { T::IsAttached(cell) } -> std::convertible_to<bool>;
+        { T::GetWorldspace(ref) } -> std::convertible_to<typename T::Worldspace>;
+        { T::GetActorBase(actor) } -> std::convertible_to<typename T::Npc>;
+        { T::GetFactionRank(actor, faction) } -> std::convertible_to<int>;
+        { T::GetActorOwner(ref) } -> std::convertible_to<typename T::Npc>;
+        { T::GetFactionOwner(ref) } -> std::convertible_to<typename T::Faction>;
+        { T::GetEncounterZone(ref) } -> std::convertible_to<typename T::EncounterZone>;
+        { T::GetCellActorOwner(cell) } -> std::convertible_to<typename T::Npc>;
+        { T::GetCellFactionOwner(cell) } -> std::convertible_to<typename T::Faction>;
+        { T::GetCellEncounterZone(cell) } -> std::convertible_to<typename T::EncounterZone>;
+        { T::GetWorldspaceEncounterZone(worldspace) } -> std::convertible_to<typename T::EncounterZone>;
+        { T::GetZoneOwnerFaction(zone) } -> std::convertible_to<typename T::Faction>;
+        { T::GetZoneOwnerNpc(zone) } -> std::convertible_to<typename T::Npc>;
+        { T::ZoneHasOwner(zone) } -> std::convertible_to<bool>;
+        { T::GetZoneOwnerRank(zone) } -> std::convertible_to<int>;
+    };
+
+    template <RefTraits T>
+    using RefSpan = std::span<const typename T::Ref>;
+
+    template <RefTraits T>
+    using RefVector = std::vector<typename T::Ref>;
+
+    // keeps the refs that pred accepts, in input order, reserving the native's expected output
+    template <RefTraits T, class Pred>
+    RefVector<T> FilterIf(RefSpan<T> refs, Pred&& pred) {
+        RefVector<T> returnRefs;
+        returnRefs.reserve(std::min(refs.size(), arena::TakeExpectedOutput()));
+        for (auto ref : refs) {
+            if (ref && pred(ref)) {
+                returnRefs.push_back(ref);
+            }
+        }
+        return returnRefs;
+    }
+
+    // how many refs pred accepts, without building the array
+    template <RefTraits T, class Pred>
+    int CountIf(RefSpan<T> refs, Pred&& pred) {
+        int count = 0;
+        for (auto ref : refs) {
+            if (ref && pred(ref)) {
+                count += 1;
+            }
+        }
+        return count;
+    }
+
+    // whether pred accepts any ref, stops at the first one
+    template <RefTraits T, class Pred>
+    bool AnyIf(RefSpan<T> refs, Pred&& pred) {
+        for (auto ref : refs) {
+            if (ref && pred(ref)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // the first ref pred accepts in input order, or a null ref
+    template <RefTraits T, class Pred>
+    typename T::Ref FirstIf(RefSpan<T> refs, Pred&& pred) {
+        for (auto ref : refs) {
+            if (ref && pred(ref)) {
+                return ref;
+            }
+        }
+        return typename T::Ref{};
+    }
+
+    // Keeps the refs pred accepts at the front of refs in input order and drops the rest, reusing
+    // refs' own storage. Returns how many are left.
+    template <RefTraits T, class Pred>
+    std::size_t KeepIf(RefVector<T>& refs, Pred&& pred) {
+        std::erase_if(refs, [&](auto ref) { return !ref || !pred(ref); });
+        return refs.size();
+    }
+
+    // What a filter does with the refs it passes. Every filter below takes one as its Out
+    // parameter, so the Filter_, Count_, Any_ and First_ natives share the same predicates and
+    // modes. kShortCircuits policies stop at the first match.
+    struct Collect {
+        template <RefTraits T>
+        using Result = RefVector<T>;
+
+        static constexpr bool kShortCircuits = false;
+
+        template <RefTraits T, class Pred>
+        static Result<T> Scan(RefSpan<T> refs, Pred&& pred) { return FilterIf<T>(refs, pred); }
+    };
+
+    struct Count {
+        template <RefTraits T>
+        using Result = int;
+
+        static constexpr bool kShortCircuits = false;
+
+        template <RefTraits T, class Pred>
+        static Result<T> Scan(RefSpan<T> refs, Pred&& pred) { return CountIf<T>(refs, pred); }
+    };
+
+    struct Any {
+        template <RefTraits T>
+        using Result = bool;
+
+        static constexpr bool kShortCircuits = true;
+
+        template <RefTraits T, class Pred>
+        static Result<T> Scan(RefSpan<T> refs, Pred&& pred) { return AnyIf<T>(refs, pred); }
+    };
+
+    struct First {
+        template <RefTraits T>
+        using Result = typename T::Ref;
+
+        static constexpr bool kShortCircuits = true;
+
+        template <RefTraits T, class Pred>
+        static Result<T> Scan(RefSpan<T> refs, Pred&& pred) { return FirstIf<T>(refs, pred); }
+    };
+
+    template <class Out, RefTraits T>
+    using ResultOf = typename Out::template Result<T>;
+
+    // Modes are parsed once per call into an enum, then dispatched to a scan compiled for that
+    // mode, so the per-ref loop holds no mode checks.
+
+    // if (mode == "!") : Passes refs that don't match.
+    // else : Passes refs that match. //default
+    enum class Negate : std::uint8_t {
+        kMatch,
+        kNoMatch
+    };
+
+    constexpr Negate ParseNegate(std::string_view mode) {
+        return mode == "!" ? Negate::kNoMatch : Negate::kMatch;
+    }
+
+    // if (mode == "|") : Passes refs that match any. (OR Gate) //default
+    // if (mode == "&") : Passes refs that match all. (AND Gate)
+    // if (mode == "^") : Passes refs that match exactly one. (XOR Gate)
+    // if (mode == "!|") : Passes refs that match none. (NOR Gate)
+    // if (mode == "!&") : Passes refs that do not match all. (NAND Gate)
+    // if (mode == "!^") : Passes refs that match 0 or more than 1. (XNOR Gate)
+    enum class Gate : std::uint8_t {
+        kAny,
+        kAll,
+        kOne,
+        kNone,
+        kNotAll,
+        kNotOne
+    };
+
+    constexpr Gate ParseGate(std::string_view mode) {
+        if (mode == "&") {
+            return Gate::kAll;
+        }
+        else if (mode == "^") {
+            return Gate::kOne;
+        }
+        else if (mode == "!|") {
+            return Gate::kNone;
+        }
+        else if (mode == "!&") {
+            return Gate::kNotAll;
+        }
+        else if (mode == "!^") {
+            return Gate::kNotOne;
+        }
+        return Gate::kAny;
+    }
+
+    // calls fn(std::integral_constant<Gate, gate>{}), so fn can use the gate as a template argument
+    template <class Fn>
+    decltype(auto) WithGate(Gate gate, Fn&& fn) {
+        switch (gate) {
+        case Gate::kAll:
+            return fn(std::integral_constant<Gate, Gate::kAll>{});
+        case Gate::kOne:
+            return fn(std::integral_constant<Gate, Gate::kOne>{});
+        case Gate::kNone:
+            return fn(std::integral_constant<Gate, Gate::kNone>{});
+        case Gate::kNotAll:
+            return fn(std::integral_constant<Gate, Gate::kNotAll>{});
+        case Gate::kNotOne:
+            return fn(std::integral_constant<Gate, Gate::kNotOne>{});
+        default:
+            return fn(std::integral_constant<Gate, Gate::kAny>{});
+        }
+    }
+
+    // Whether G passes for a ref that matches items through match, null items never match. Stops
+    // as soon as the answer is known: any at the first match, all at the first miss and exactly
+    // one at the second match.
+    template <Gate G, class Item, class Match>
+    bool PassesGate(std::span<const Item> items, Match&& match) {
+        auto matches = [&](const Item& item) { return item && match(item); };
+        if constexpr (G == Gate::kAny || G == Gate::kNone) {
+            bool any = std::any_of(items.begin(), items.end(), matches);
+            return (G == Gate::kAny) == any;
+        }
+        else if constexpr (G == Gate::kAll || G == Gate::kNotAll) {
+            bool all = std::all_of(items.begin(), items.end(), matches);
+            return (G == Gate::kAll) == all;
+        }
+        else {
+            std::size_t matched = 0;
+            for (const auto& item : items) {
+                if (matches(item) && ++matched > 1) {
+                    break;
+                }
+            }
+            return (G == Gate::kOne) == (matched == 1);
+        }
+    }
+
+    template <RefTraits T, class Out = Collect, class Pred>
+    ResultOf<Out, T> FilterMode(RefSpan<T> refs, std::string_view mode, Pred&& pred) {
+        if (ParseNegate(mode) == Negate::kNoMatch) {
+            return Out::template Scan<T>(refs, [&](auto ref) { return !pred(ref); });
+        }
+        return Out::template Scan<T>(refs, pred);
+    }
+
+    // Gate filter over a list: match(ref, item) says whether a ref matches one item, and every
+    // gate mode comes from that.
+    template <RefTraits T, class Out = Collect, class Item, class Match>
+    ResultOf<Out, T> FilterGate(RefSpan<T> refs, std::span<const Item> items, std::string_view mode, Match&& match) {
+        return WithGate(ParseGate(mode), [&](auto gate) {
+            return Out::template Scan<T>(refs, [&](auto ref) {
+                return PassesGate<gate()>(items, [&](const Item& item) { return match(ref, item); });
+            });
+        });
+    }
+
+    template <RefTraits T>
+    int CountDisabled(RefSpan<T> refs) {
+        return CountIf<T>(refs, [](auto ref) { return T::IsDisabled(ref); });
+    }
+
+    template <RefTraits T>
+    int CountEnabled(RefSpan<T> refs) {
+        return CountIf<T>(refs, [](auto ref) { return !T::IsDisabled(ref); });
+    }
+
+    // bases
+
+    template <RefTraits T>
+    bool BaseIsIn(typename T::Ref ref, std::span<const typename T::Form> bases) {
+        return std::find(bases.begin(), bases.end(), T::GetBase(ref)) != bases.end();
+    }
+
+    template <RefTraits T, class Out = Collect>
+    ResultOf<Out, T> FilterBases(RefSpan<T> refs, std::span<const typename T::Form> bases, std::string_view mode) {
+        return FilterMode<T, Out>(refs, mode, [&](auto ref) { return BaseIsIn<T>(ref, bases); });
+    }
+
+    template <RefTraits T, class Out = Collect>
+    ResultOf<Out, T> FilterBasesFormList(RefSpan<T> refs, typename T::FormList list, std::string_view mode) {
+        return FilterMode<T, Out>(refs, mode, [&](auto ref) { return T::ListHasForm(list, T::GetBase(ref)); });
+    }
+
+    template <RefTraits T, class Out = Collect>
+    ResultOf<Out, T> FilterFormTypes(RefSpan<T> refs, std::span<const int> formTypes, std::string_view mode) {
+        return FilterMode<T, Out>(refs, mode, [&](auto ref) {
+            return std::find(formTypes.begin(), formTypes.end(), T::GetBaseFormType(ref)) != formTypes.end();
+        });
+    }
+
+    // unique bases in first seen order, or every base if (mode == "...")
+    template <RefTraits T>
+    std::vector<typename T::Form> FromReferences(RefSpan<T> refs, std::string_view mode) {
+        std::vector<typename T::Form> returnForms;
+        std::pmr::unordered_set<typename T::Form> seen(arena::Resource());
+        for (auto ref : refs) {
+            if (!ref) {
+                continue;
+            }
+
+            auto base = T::GetBase(ref);
+            if (base && (mode == "..." || seen.insert(base).second)) {
+                returnForms.push_back(base);
+            }
+        }
+        return returnForms;
+    }
+
+    // flags
+
+    template <RefTraits T, class Out = Collect>
+    ResultOf<Out, T> FilterEnabled(RefSpan<T> refs, std::string_view mode) {
+        return FilterMode<T, Out>(refs, mode, [](auto ref) { return !T::IsDisabled(ref); });
+    }
+
+    template <RefTraits T, class Out = Collect>
+    ResultOf<Out, T> FilterDeleted(RefSpan<T> refs, std::string_view mode) {
+        return FilterMode<T, Out>(refs, mode, [](auto ref) { return T::IsDeleted(ref); });
+    }
+
+    template <RefTraits T, class Out = Collect>
+    ResultOf<Out, T> Filter3DLoaded(RefSpan<T> refs, std::string_view mode) {
+        return FilterMode<T, Out>(refs, mode, [](auto ref) { return T::Is3DLoaded(ref); });
+    }
+
+    template <RefTraits T, class Out = Collect>
+    ResultOf<Out, T> FilterOffLimits(RefSpan<T> refs, std::string_view mode) {
+        return FilterMode<T, Out>(refs, mode, [](auto ref) { return T::IsOffLimits(ref); });
+    }
+
+    template <RefTraits T, class Out = Collect>
+    ResultOf<Out, T> FilterInventoryObjects(RefSpan<T> refs, std::string_view mode) {
+        return FilterMode<T, Out>(refs, mode, [](auto ref) { return T::IsInventoryObject(ref); });
+    }
+
+    template <RefTraits T, class Out = Collect>
+    ResultOf<Out, T> FilterPlayableObjects(RefSpan<T> refs, std::string_view mode) {
+        return FilterMode<T, Out>(refs, mode, [](auto ref) { return T::IsPlayable(ref); });
+    }
+
+    template <RefTraits T, class Out = Collect>
+    ResultOf<Out, T> FilterQuestObjects(RefSpan<T> refs, std::string_view mode) {
+        return FilterMode<T, Out>(refs, mode, [](auto ref) { return T::IsQuestObject(ref); });
+    }
+
+    template <RefTraits T, class Out = Collect>
+    ResultOf<Out, T> FilterCollisionLayerTypes(RefSpan<T> refs, std::span<const int> layerTypes, std::string_view mode) {
+        return FilterMode<T, Out>(refs, mode, [&](auto ref) {
+            return std::find(layerTypes.begin(), layerTypes.end(), T::GetCollisionLayer(ref)) != layerTypes.end();
+        });
+    }
+
+    // refs without a worldspace only pass with (mode == "!")
+    template <RefTraits T, class Out = Collect>
+    ResultOf<Out, T> FilterWorldspace(RefSpan<T> refs, typename T::Worldspace worldspace, std::string_view mode) {
+        return FilterMode<T, Out>(refs, mode, [&](auto ref) {
+            auto refWorldspace = T::GetWorldspace(ref);
+            return refWorldspace && refWorldspace == worldspace;
+        });
+    }
+
+    // distance
+
+    template <class A, class B>
+    float DistanceSquared(const A& a, const B& b) {
+        float dx = a.x - b.x;
+        float dy = a.y - b.y;
+        float dz = a.z - b.z;
+        return (dx * dx) + (dy * dy) + (dz * dz);
+    }
+
+    // if (mode == ">") : Passes refs farther than distance.
+    // else : Passes refs closer than distance. //default
+    template <RefTraits T, class Out = Collect>
+    ResultOf<Out, T> FilterDistance(RefSpan<T> refs, float distance, typename T::Ref from, std::string_view mode) {
+        auto fromPosition = T::GetPosition(from);
+        float distanceSquared = distance * distance;
+        if (mode == ">") {
+            return Out::template Scan<T>(refs, [&](auto ref) { return DistanceSquared(T::GetPosition(ref), fromPosition) > distanceSquared; });
+        }
+        return Out::template Scan<T>(refs, [&](auto ref) { return DistanceSquared(T::GetPosition(ref), fromPosition) < distanceSquared; });
+    }
+
+    // if (mode == ">") : farthest first.
+    // else : closest first. //default
+    // refs at the same distance keep their input order.
+    template <RefTraits T>
+    RefVector<T> SortDistance(RefSpan<T> refs, typename T::Ref from, std::string_view mode) {
+        auto fromPosition = T::GetPosition(from);
+
+        // sorting on (distance, input index) keeps ties in input order without stable_sort's buffer
+        std::pmr::vector<std::pair<float, std::uint32_t>> sorted(arena::Resource());
+        sorted.reserve(refs.size());
+        for (std::size_t i = 0; i < refs.size(); i++) {
+            if (refs[i]) {
+                sorted.emplace_back(DistanceSquared(T::GetPosition(refs[i]), fromPosition), static_cast<std::uint32_t>(i));
+            }
+        }
+
+        if (mode == ">") {
+            std::sort(sorted.begin(), sorted.end(), [](auto& a, auto& b) { return a.first != b.first ? a.first > b.first : a.second < b.second; });
+        }
+        else {
+            std::sort(sorted.begin(), sorted.end());
+        }
+
+        RefVector<T> returnRefs;
+        returnRefs.reserve(sorted.size());
+        for (auto& [distance, index] : sorted) {
+            returnRefs.push_back(refs[index]);
+        }
+        return returnRefs;
+    }
+
+    // The closest ref to from that pred accepts, or with (mode == ">") the farthest; a null ref if
+    // none does. Refs are popped off a heap in distance order, so the scan ends at the first match
+    // instead of sorting everything. Refs at the same distance go in input order, like SortDistance.
+    template <RefTraits T, class Pred>
+    typename T::Ref FindClosest(RefSpan<T> refs, typename T::Ref from, std::string_view mode, Pred&& pred) {
+        auto fromPosition = T::GetPosition(from);
+        bool farthestFirst = (mode == ">");
+
+        std::pmr::vector<std::pair<float, std::size_t>> heap(arena::Resource());
+        heap.reserve(refs.size());
+        for (std::size_t i = 0; i < refs.size(); i++) {
+            if (refs[i]) {
+                float distance = DistanceSquared(T::GetPosition(refs[i]), fromPosition);
+                heap.emplace_back(farthestFirst ? -distance : distance, i);
+            }
+        }
+
+        // a min heap on (distance, input index)
+        auto after = [](const auto& a, const auto& b) { return a > b; };
+        std::make_heap(heap.begin(), heap.end(), after);
+        while (!heap.empty()) {
+            std::pop_heap(heap.begin(), heap.end(), after);
+            auto ref = refs[heap.back().second];
+            if (pred(ref)) {
+                return ref;
+            }
+            heap.pop_back();
+        }
+        return typename T::Ref{};
+    }
+
+    // keywords
+
+    template <RefTraits T>
+    int CountKeywords(typename T::Ref ref, std::span<const typename T::Keyword> keywords) {
+        int count = 0;
+        for (auto keyword : keywords) {
+            if (keyword && T::HasKeyword(ref, keyword)) {
+                count += 1;
+            }
+        }
+        return count;
+    }
+
+    template <RefTraits T>
+    bool HasAnyKeyword(typename T::Ref ref, std::span<const typename T::Keyword> keywords) {
+        for (auto keyword : keywords) {
+            if (keyword && T::HasKeyword(ref, keyword)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <RefTraits T>
+    bool HasAllKeywords(typename T::Ref ref, std::span<const typename T::Keyword> keywords) {
+        for (auto keyword : keywords) {
+            if (!keyword || !T::HasKeyword(ref, keyword)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template <RefTraits T, class Out = Collect>
+    ResultOf<Out, T> FilterKeywords(RefSpan<T> refs, std::span<const typename T::Keyword> keywords, std::string_view mode) {
+        return FilterGate<T, Out>(refs, keywords, mode, [](auto ref, auto keyword) { return T::HasKeyword(ref, keyword); });
+    }
+
+    // ownership
+
+    enum class Ownership {
+        kNoOwner,
+        kOwner,       // the actor owns the ref through the ref, its cell or an encounter zone
+        kOtherOwner   // the ref has an owner, but it isn't the actor
+    };
+
+    template <RefTraits T>
+    bool ActorOwnsZone(typename T::Actor actor, typename T::EncounterZone zone, bool& hasOwner) {
+        if (!zone || !T::ZoneHasOwner(zone)) {
+            return false;
+        }
+
+        hasOwner = true;
+        if (auto faction = T::GetZoneOwnerFaction(zone)) {
+            return T::GetFactionRank(actor, faction) >= T::GetZoneOwnerRank(zone);
+        }
+        if (auto npc = T::GetZoneOwnerNpc(zone)) {
+            return npc == T::GetActorBase(actor);
+        }
+        return false;
+    }
+
+    // Checks the ref owner, its encounter zone, its cell owner and zone, then its worldspace zone.
+    template <RefTraits T>
+    Ownership GetOwnership(typename T::Ref ref, typename T::Actor actor) {
+        if (!ref || !actor) {
+            return Ownership::kNoOwner;
+        }
+
+        bool hasOwner = false;
+        auto actorBase = T::GetActorBase(actor);
+
+        if (auto npcOwner = T::GetActorOwner(ref)) {
+            if (npcOwner == actorBase) {
+                return Ownership::kOwner;
+            }
+            hasOwner = true;
+        }
+
+        if (auto factionOwner = T::GetFactionOwner(ref)) {
+            if (T::GetFactionRank(actor, factionOwner) > -1) {
+                return Ownership::kOwner;
+            }
+            hasOwner = true;
+        }
+
+        if (ActorOwnsZone<T>(actor, T::GetEncounterZone(ref), hasOwner)) {
+            return Ownership::kOwner;
+        }
+
+        if (auto cell = T::GetParentCell(ref)) {
+            if (auto cellOwner = T::GetCellActorOwner(cell)) {
+                if (cellOwner == actorBase) {
+                    return Ownership::kOwner;
+                }
+                hasOwner = true;
+            }
+
+            if (auto cellFactionOwner = T::GetCellFactionOwner(cell)) {
+                if (T::GetFactionRank(actor, cellFactionOwner) > -1) {
+                    return Ownership::kOwner;
+                }
+                hasOwner = true;
+            }
+
+            if (ActorOwnsZone<T>(actor, T::GetCellEncounterZone(cell), hasOwner)) {
+                return Ownership::kOwner;
+            }
+        }
+
+        if (auto worldspace = T::GetWorldspace(ref)) {
+            if (ActorOwnsZone<T>(actor, T::GetWorldspaceEncounterZone(worldspace), hasOwner)) {
+                return Ownership::kOwner;
+            }
+        }
+
+        return hasOwner ? Ownership::kOtherOwner : Ownership::kNoOwner;
+    }
+
+    template <RefTraits T>
+    bool ActorIsOwner(typename T::Ref ref, typename T::Actor actor) {
+        return GetOwnership<T>(ref, actor) == Ownership::kOwner;
+    }
+
+    // the ref has an owner and it isn't the actor
+    template <RefTraits T>
+    bool ActorIsPotentialThief(typename T::Ref ref, typename T::Actor actor) {
+        return GetOwnership<T>(ref, actor) == Ownership::kOtherOwner;
+    }
+
+    template <RefTraits T, class Match>
+    int CountActors(std::span<const typename T::Actor> actors, Match&& match) {
+        int count = 0;
+        for (auto actor : actors) {
+            if (actor && match(actor)) {
+                count += 1;
+            }
+        }
+        return count;
+    }
+
+    template <RefTraits T, class Match>
+    bool AnyActor(std::span<const typename T::Actor> actors, Match&& match) {
+        for (auto actor : actors) {
+            if (actor && match(actor)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <RefTraits T>
+    int CountOwners(typename T::Ref ref, std::span<const typename T::Actor> owners) {
+        return CountActors<T>(owners, [&](auto actor) { return ActorIsOwner<T>(ref, actor); });
+    }
+
+    template <RefTraits T>
+    int CountPotentialThieves(typename T::Ref ref, std::span<const typename T::Actor> thieves) {
+        return CountActors<T>(thieves, [&](auto actor) { return ActorIsPotentialThief<T>(ref, actor); });
+    }
+
+    template <RefTraits T, class Out = Collect>
+    ResultOf<Out, T> FilterOwners(RefSpan<T> refs, std::span<const typename T::Actor> owners, std::string_view mode) {
+        return FilterGate<T, Out>(refs, owners, mode, [](auto ref, auto actor) { return ActorIsOwner<T>(ref, actor); });
+    }
+
+    template <RefTraits T, class Out = Collect>
+    ResultOf<Out, T> FilterPotentialThieves(RefSpan<T> refs, std::span<const typename T::Actor> thieves, std::string_view mode) {
+        return FilterGate<T, Out>(refs, thieves, mode, [](auto ref, auto actor) { return ActorIsPotentialThief<T>(ref, actor); });
+    }
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+#include "skypal/core.h"
+#include "skypal/names.h"
+#include "skypal/plugins.h"
+#include "skypal/snapshot.h"
+
+// Binds skypal::core to the game types. Needs CommonLibSSE, which comes in through PCH.h.
+namespace skypal {
+
+    struct EngineTraits {
+        using Ref = RE::TESObjectREFR*;
+        using Form = RE::TESForm*;
+        using FormList = RE::BGSListForm*;
+        using Keyword = RE::BGSKeyword*;
+        using Actor = RE::Actor*;
+        using Npc = RE::TESNPC*;
+        using Faction = RE::TESFaction*;
+        using Cell = RE::TESObjectCELL*;
+        using Worldspace = RE::TESWorldSpace*;
+        using EncounterZone = RE::BGSEncounterZone*;
+
+        static Form GetBase(Ref ref) {
+            return ref->GetBaseObject();
+        }
+
+        static int GetBaseFormType(Ref ref) {
+            auto* base = ref->GetBaseObject();
+            return base ? static_cast<int>(base->GetFormType()) : 0;
+        }
+
+        static bool ListHasForm(FormList list, Form form) {
+            return list->HasForm(form);
+        }
+
+        static bool HasKeyword(Ref ref, Keyword keyword) {
+            //hasKeyword function is missing, using this function as workaround
+            thread_local std::vector<RE::BGSKeyword*> single(1);
+            single[0] = keyword;
+            return ref->HasKeywordInArray(single, true);
+        }
+
+        // actors also match their race's keywords, so they get a set of their own
+        static const void* KeywordSetKey(Ref ref) {
+            if (ref->As<RE::Actor>()) {
+                return ref;
+            }
+            return ref->GetBaseObject();
+        }
+
+        template <class Visit>
+        static void ForEachKeyword(Ref ref, Visit&& visit) {
+            auto visitForm = [&](RE::BGSKeywordForm* keywordForm) {
+                if (!keywordForm) {
+                    return;
+                }
+                for (std::uint32_t i = 0; i < keywordForm->numKeywords; i++) {
+                    if (keywordForm->keywords[i]) {
+                        visit(keywordForm->keywords[i]);
+                    }
+                }
+            };
+
+            auto* base = ref->GetBaseObject();
+            if (base) {
+                visitForm(base->As<RE::BGSKeywordForm>());
+            }
+            if (auto* actor = ref->As<RE::Actor>()) {
+                visitForm(actor->GetRace());
+            }
+        }
+
+        static std::uint32_t GetFormId(Ref ref) {
+            return ref->GetFormID();
+        }
+
+        // Renamed refs (quest items, named containers) carry their name in ExtraTextDisplayData,
+        // every other ref shows its base's name.
+        static const void* NameKey(Ref ref) {
+            if (ref->extraList.HasType<RE::ExtraTextDisplayData>()) {
+                return nullptr;
+            }
+            return ref->GetBaseObject();
+        }
+
+        static std::string_view GetName(Ref ref) {
+            std::string_view name = ref->GetDisplayFullName();
+            if (name.empty()) {
+                auto* base = ref->GetBaseObject();
+                name = base ? base->GetName() : "";
+            }
+            return name;
+        }
+
+        static RE::NiPoint3 GetPosition(Ref ref) {
+            return ref->GetPosition();
+        }
+
+        static bool IsDisabled(Ref ref) {
+            return ref->IsDisabled();
+        }
+
+        static bool IsDeleted(Ref ref) {
+            return ref->IsDeleted();
+        }
+
+        static bool Is3DLoaded(Ref ref) {
+            return ref->Is3DLoaded();
+        }
+
+        static bool IsOffLimits(Ref ref) {
+            return ref->IsOffLimits();
+        }
+
+        static bool IsInventoryObject(Ref ref) {
+            return ref->IsInventoryObject();
+        }
+
+        static bool IsPlayable(Ref ref) {
+            return ref->GetPlayable();
+        }
+
+        static bool IsQuestObject(Ref ref) {
+            auto* refAliases = ref->extraList.GetByType<RE::ExtraAliasInstanceArray>();
+            if (refAliases) {
+                for (auto* instance : refAliases->aliases) {
+                    if (instance && instance->alias && instance->alias->IsQuestObject()) {
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+        static int GetCollisionLayer(Ref ref) {
+            auto* nav = ref->Get3D();
+            if (!nav) {
+                return 0;
+            }
+            return static_cast<int>(nav->GetCollisionLayer());
+        }
+
+        static Cell GetParentCell(Ref ref) {
+            return ref->GetParentCell();
+        }
+
+        static bool IsAttached(Cell cell) {
+            return cell->IsAttached();
+        }
+
+        static Worldspace GetWorldspace(Ref ref) {
+            return ref->GetWorldspace();
+        }
+
+        static Npc GetActorBase(Actor actor) {
+            return actor->GetActorBase();
+        }
+
+        // -2 if the actor isn't in the faction
+        static int GetFactionRank(Actor actor, Faction faction) {
+            int returnRank = -2;
+            actor->VisitFactions([&](RE::TESFaction* akfaction, int8_t rank) -> bool {
+                if (akfaction == faction) {
+                    returnRank = rank;
+                    return true;
+                }
+                return true;
+            });
+            return returnRank;
+        }
+
+        static Npc GetActorOwner(Ref ref) {
+            return ref->GetActorOwner();
+        }
+
+        static Faction GetFactionOwner(Ref ref) {
+            return ref->GetFactionOwner();
+        }
+
+        static EncounterZone GetEncounterZone(Ref ref) {
+            return ref->extraList.GetEncounterZone();
+        }
+
+        static Npc GetCellActorOwner(Cell cell) {
+            return cell->GetActorOwner();
+        }
+
+        static Faction GetCellFactionOwner(Cell cell) {
+            return cell->GetFactionOwner();
+        }
+
+        static EncounterZone GetCellEncounterZone(Cell cell) {
+            return cell->extraList.GetEncounterZone();
+        }
+
+        static EncounterZone GetWorldspaceEncounterZone(Worldspace worldspace) {
+            return worldspace->encounterZone;
+        }
+
+        static bool ZoneHasOwner(EncounterZone zone) {
+            return zone->data.zoneOwner != nullptr;
+        }
+
+        static Faction GetZoneOwnerFaction(EncounterZone zone) {
+            return zone->data.zoneOwner ? zone->data.zoneOwner->As<RE::TESFaction>() : nullptr;
+        }
+
+        static Npc GetZoneOwnerNpc(EncounterZone zone) {
+            return zone->data.zoneOwner ? zone->data.zoneOwner->As<RE::TESNPC>() : nullptr;
+        }
+
+        static int GetZoneOwnerRank(EncounterZone zone) {
+            return zone->data.ownerRank;
+        }
+    };
+
+    static_assert(core::RefTraits<EngineTraits>);
+    static_assert(snapshot::SnapshotTraits<EngineTraits>);
+    static_assert(names::NameTraits<EngineTraits>);
+    static_assert(plugins::PluginTraits<EngineTraits>);
+}
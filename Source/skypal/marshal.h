@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+// Unpacking Papyrus array arguments without a std::vector per call. The VM stores object handles,
+// not pointers, so every element still has to be unpacked once; it goes into a per-thread buffer
+// that is reused across calls instead of a fresh vector. Engine-free: papyrus.h binds it to
+// BSScript::Array for the plugin and the bench binds it to a mock VM array.
+namespace skypal::marshal {
+
+    // buffers bigger than this are freed when their lease ends, so one huge call doesn't pin memory
+    constexpr std::size_t kMaxRetained = 1 << 18;
+
+    // The reusable buffer for argument Slot of a native on this thread. A lease that finds the
+    // buffer already leased gets one of its own, so nothing breaks if a native is ever reached
+    // again while its arguments are still alive.
+    template <class T, std::size_t Slot>
+    class Lease {
+    public:
+        Lease() {
+            auto& local = Local();
+            if (!local.leased) {
+                local.leased = true;
+                buffer = &local.buffer;
+            }
+        }
+
+        ~Lease() {
+            if (buffer != &owned) {
+                if (buffer->capacity() > kMaxRetained) {
+                    std::vector<T>().swap(*buffer);
+                }
+                Local().leased = false;
+            }
+        }
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        std::vector<T>& operator*() { return *buffer; }
+
+    private:
+        struct LocalState {
+            std::vector<T> buffer;
+            bool leased = false;
+        };
+
+        static LocalState& Local() {
+            thread_local LocalState local;
+            return local;
+        }
+
+        std::vector<T> owned;
+        std::vector<T>* buffer = &owned;
+    };
+
+    // fills buffer with unpack(element) for every element of array
+    template <class T, class Array, class Unpack>
+    std::span<const T> UnpackInto(const Array& array, std::vector<T>& buffer, Unpack&& unpack) {
+        buffer.clear();
+        buffer.reserve(array.size());
+        for (const auto& element : array) {
+            buffer.push_back(unpack(element));
+        }
+        return buffer;
+    }
+}
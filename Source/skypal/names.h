@@ -0,0 +1,353 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SKYPAL_NAMES_SSE2 1
+#endif
+
+#include "skypal/core.h"
+
+// Name matching for Filter_Name and All_Named. Names are compared lowercased, so matching is
+// case-insensitive for ASCII; other bytes have to match as they are.
+//
+// A NameTable interns the lowercased name of every base once, so a filter matches the pattern
+// against each distinct name a single time, with one vectorized pass over all of them, and then
+// only looks refs up by base. Its optional trigram index finds the names containing a pattern
+// without that pass, for lookups over the whole game.
+namespace skypal::names {
+
+    // NameKey is what a ref's name comes from, usually its base, and null when the ref has a name
+    // of its own; GetName is the name the game shows for the ref.
+    template <class T>
+    concept NameTraits = core::RefTraits<T> && requires(typename T::Ref ref) {
+        { T::NameKey(ref) } -> std::convertible_to<const void*>;
+        { T::GetName(ref) } -> std::convertible_to<std::string_view>;
+    };
+
+    // text may be lowered itself
+    inline void LowerInto(std::string_view text, std::string& lowered) {
+        lowered.resize(text.size());
+        std::transform(text.begin(), text.end(), lowered.begin(), [](char c) {
+            return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+        });
+    }
+
+    inline std::string Lower(std::string_view text) {
+        std::string lowered;
+        LowerInto(text, lowered);
+        return lowered;
+    }
+
+    // The first position of needle in haystack, or npos. With SSE2, 16 positions are tested at once
+    // on the needle's first and last bytes, and only the positions where both match are compared.
+    inline std::size_t Find(std::string_view haystack, std::string_view needle) {
+        if (needle.size() > haystack.size()) {
+            return std::string_view::npos;
+        }
+#ifdef SKYPAL_NAMES_SSE2
+        if (needle.size() >= 2) {
+            const auto first = _mm_set1_epi8(needle.front());
+            const auto last = _mm_set1_epi8(needle.back());
+            const std::size_t starts = haystack.size() - needle.size() + 1;
+            std::size_t i = 0;
+            for (; i + 16 <= starts; i += 16) {
+                auto firstBlock = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack.data() + i));
+                auto lastBlock = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack.data() + i + needle.size() - 1));
+                auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, firstBlock), _mm_cmpeq_epi8(last, lastBlock))));
+                while (mask) {
+                    auto position = i + static_cast<std::size_t>(std::countr_zero(mask));
+                    if (std::memcmp(haystack.data() + position + 1, needle.data() + 1, needle.size() - 2) == 0) {
+                        return position;
+                    }
+                    mask &= mask - 1;
+                }
+            }
+            auto rest = haystack.substr(i).find(needle);
+            return rest == std::string_view::npos ? rest : i + rest;
+        }
+#endif
+        return haystack.find(needle);
+    }
+
+    enum class Match : std::uint8_t {
+        kContains,
+        kPrefix,
+        kWhole
+    };
+
+    struct Pattern {
+        std::string text;  // lowercased
+        Match match = Match::kContains;
+        bool negate = false;
+
+        // lowered is a lowercased name
+        bool Matches(std::string_view lowered) const {
+            bool matched;
+            if (match == Match::kPrefix) {
+                matched = lowered.starts_with(text);
+            }
+            else if (match == Match::kWhole) {
+                matched = (lowered == text);
+            }
+            else {
+                matched = Find(lowered, text) != std::string_view::npos;
+            }
+            return matched != negate;
+        }
+    };
+
+    // if (mode == "^") : Passes refs whose name starts with pattern.
+    // if (mode == "=") : Passes refs whose name is pattern.
+    // else : Passes refs whose name contains pattern. //default
+    // A "!" in front passes the refs that don't: "!", "!^", "!=".
+    inline Pattern ParsePattern(std::string_view pattern, std::string_view mode) {
+        Pattern parsed;
+        parsed.text = Lower(pattern);
+        if (mode.starts_with("!")) {
+            parsed.negate = true;
+            mode.remove_prefix(1);
+        }
+        if (mode == "^") {
+            parsed.match = Match::kPrefix;
+        }
+        else if (mode == "=") {
+            parsed.match = Match::kWhole;
+        }
+        return parsed;
+    }
+
+    using NameId = std::uint32_t;
+
+    constexpr NameId kNoName = UINT32_MAX;
+
+    // Immutable once built, so VM threads share one through rcu::Published.
+    class NameTable {
+    public:
+        // (key, name) pairs, names as the game has them; empty names are left out
+        static NameTable Build(std::vector<std::pair<const void*, std::string>> named, bool withTrigrams) {
+            NameTable table;
+            for (auto& [key, name] : named) {
+                LowerInto(name, name);
+            }
+            std::erase_if(named, [](const auto& entry) { return entry.second.empty(); });
+            std::sort(named.begin(), named.end(), [](const auto& a, const auto& b) { return a.second < b.second; });
+
+            // names are stored once each, in sorted order, every one followed by a 0 byte so no
+            // match found in the pool can run from one name into the next
+            table.keys.reserve(named.size());
+            table.keysByName.reserve(named.size());
+            const std::string* previous = nullptr;
+            for (auto& [key, name] : named) {
+                if (!previous || *previous != name) {
+                    previous = &name;
+                    table.starts.push_back(static_cast<std::uint32_t>(table.pool.size()));
+                    table.keyStarts.push_back(static_cast<std::uint32_t>(table.keysByName.size()));
+                    table.pool += name;
+                    table.pool += '\0';
+                }
+                auto id = static_cast<NameId>(table.starts.size() - 1);
+                if (table.keys.emplace(key, id).second) {
+                    table.keysByName.push_back(key);
+                }
+            }
+            table.starts.push_back(static_cast<std::uint32_t>(table.pool.size()));
+            table.keyStarts.push_back(static_cast<std::uint32_t>(table.keysByName.size()));
+
+            if (withTrigrams) {
+                table.BuildTrigrams();
+            }
+            return table;
+        }
+
+        std::size_t NameCount() const { return starts.empty() ? 0 : starts.size() - 1; }
+        std::size_t PoolBytes() const { return pool.size(); }
+        bool HasTrigrams() const { return !trigramStarts.empty(); }
+
+        // lowercased
+        std::string_view Name(NameId id) const {
+            return std::string_view(pool).substr(starts[id], starts[id + 1] - starts[id] - 1);
+        }
+
+        NameId Find(const void* key) const {
+            auto it = keys.find(key);
+            return it == keys.end() ? kNoName : it->second;
+        }
+
+        // the keys that have name id
+        std::span<const void* const> KeysOf(NameId id) const {
+            return std::span<const void* const>(keysByName).subspan(keyStarts[id], keyStarts[id + 1] - keyStarts[id]);
+        }
+
+        // One flag per name, whether pattern passes it, negation included. Contains runs one
+        // vectorized search over the whole pool instead of one per name.
+        std::vector<std::uint8_t> MatchNames(const Pattern& pattern) const {
+            std::vector<std::uint8_t> matched(NameCount(), 0);
+            if (pattern.match == Match::kContains && !pattern.text.empty()) {
+                std::string_view rest = pool;
+                std::size_t offset = 0;
+                while (true) {
+                    auto found = names::Find(rest, pattern.text);
+                    if (found == std::string_view::npos) {
+                        break;
+                    }
+                    auto id = IdAt(offset + found);
+                    matched[id] = 1;
+                    auto next = starts[id + 1] - offset;
+                    rest.remove_prefix(next);
+                    offset += next;
+                }
+            }
+            else {
+                for (NameId id = 0; id < matched.size(); id++) {
+                    matched[id] = Pattern{ pattern.text, pattern.match, false }.Matches(Name(id)) ? 1 : 0;
+                }
+            }
+            if (pattern.negate) {
+                for (auto& flag : matched) {
+                    flag ^= 1;
+                }
+            }
+            return matched;
+        }
+
+        // The names pattern passes, ignoring negation. Patterns of 3 bytes or more are looked up
+        // in the trigram index when there is one: only names holding every trigram of the pattern
+        // are compared.
+        std::vector<NameId> Lookup(const Pattern& pattern) const {
+            std::vector<NameId> found;
+            if (!HasTrigrams() || pattern.text.size() < 3) {
+                auto matched = MatchNames(Pattern{ pattern.text, pattern.match, false });
+                for (NameId id = 0; id < matched.size(); id++) {
+                    if (matched[id]) {
+                        found.push_back(id);
+                    }
+                }
+                return found;
+            }
+
+            std::vector<std::span<const NameId>> postings;
+            for (std::size_t i = 0; i + 3 <= pattern.text.size(); i++) {
+                postings.push_back(Postings(Trigram(pattern.text, i)));
+                if (postings.back().empty()) {
+                    return found;
+                }
+            }
+            std::sort(postings.begin(), postings.end(), [](auto a, auto b) { return a.size() < b.size(); });
+
+            found.assign(postings[0].begin(), postings[0].end());
+            std::vector<NameId> both;
+            for (std::size_t i = 1; i < postings.size() && !found.empty(); i++) {
+                both.clear();
+                std::set_intersection(found.begin(), found.end(), postings[i].begin(), postings[i].end(), std::back_inserter(both));
+                found.swap(both);
+            }
+            Pattern plain{ pattern.text, pattern.match, false };
+            std::erase_if(found, [&](NameId id) { return !plain.Matches(Name(id)); });
+            return found;
+        }
+
+    private:
+        static std::uint32_t Trigram(std::string_view text, std::size_t at) {
+            return std::uint32_t(std::uint8_t(text[at])) << 16 | std::uint32_t(std::uint8_t(text[at + 1])) << 8 | std::uint8_t(text[at + 2]);
+        }
+
+        NameId IdAt(std::size_t offset) const {
+            return static_cast<NameId>(std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin() - 1);
+        }
+
+        // (trigram, name) pairs sorted, then split into a sorted name list per trigram
+        void BuildTrigrams() {
+            std::vector<std::pair<std::uint32_t, NameId>> pairs;
+            for (NameId id = 0; id < NameCount(); id++) {
+                auto name = Name(id);
+                for (std::size_t i = 0; i + 3 <= name.size(); i++) {
+                    pairs.emplace_back(Trigram(name, i), id);
+                }
+            }
+            std::sort(pairs.begin(), pairs.end());
+            pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+            trigramNames.reserve(pairs.size());
+            for (auto [trigram, id] : pairs) {
+                if (trigrams.empty() || trigrams.back() != trigram) {
+                    trigrams.push_back(trigram);
+                    trigramStarts.push_back(static_cast<std::uint32_t>(trigramNames.size()));
+                }
+                trigramNames.push_back(id);
+            }
+            trigramStarts.push_back(static_cast<std::uint32_t>(trigramNames.size()));
+        }
+
+        std::span<const NameId> Postings(std::uint32_t trigram) const {
+            auto it = std::lower_bound(trigrams.begin(), trigrams.end(), trigram);
+            if (it == trigrams.end() || *it != trigram) {
+                return {};
+            }
+            auto i = static_cast<std::size_t>(it - trigrams.begin());
+            return std::span<const NameId>(trigramNames).subspan(trigramStarts[i], trigramStarts[i + 1] - trigramStarts[i]);
+        }
+
+        std::string pool;
+        std::vector<std::uint32_t> starts;  // of each name in pool, and the end
+        std::unordered_map<const void*, NameId> keys;
+        std::vector<const void*> keysByName;
+        std::vector<std::uint32_t> keyStarts;  // of each name's keys in keysByName, and the end
+        std::vector<std::uint32_t> trigrams;  // sorted
+        std::vector<std::uint32_t> trigramStarts;
+        std::vector<NameId> trigramNames;
+    };
+
+    // Whether a ref's name passes pattern. Built once per call: names in the table are matched
+    // up front, refs with a name of their own or a base the table doesn't have are matched one by
+    // one.
+    template <NameTraits T>
+    class RefMatcher {
+    public:
+        RefMatcher(const NameTable& table, Pattern pattern) : table(table), pattern(std::move(pattern)), matched(table.MatchNames(this->pattern)) {}
+
+        // with the names pattern passes already looked up, as Lookup returns them
+        RefMatcher(const NameTable& table, Pattern pattern, std::span<const NameId> passing) :
+            table(table), pattern(std::move(pattern)), matched(table.NameCount(), this->pattern.negate ? 1 : 0) {
+            for (auto id : passing) {
+                matched[id] ^= 1;
+            }
+        }
+
+        bool operator()(typename T::Ref ref) {
+            if (auto* key = T::NameKey(ref)) {
+                auto id = table.Find(key);
+                if (id != kNoName) {
+                    return matched[id] != 0;
+                }
+            }
+            LowerInto(T::GetName(ref), lowered);
+            return pattern.Matches(lowered);
+        }
+
+    private:
+        const NameTable& table;
+        Pattern pattern;
+        std::vector<std::uint8_t> matched;
+        std::string lowered;
+    };
+
+    template <NameTraits T, class Out = core::Collect>
+    core::ResultOf<Out, T> FilterName(core::RefSpan<T> refs, const NameTable& table, std::string_view pattern, std::string_view mode) {
+        RefMatcher<T> matcher(table, ParsePattern(pattern, mode));
+        return Out::template Scan<T>(refs, matcher);
+    }
+}
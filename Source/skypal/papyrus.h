@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "skypal/marshal.h"
+
+// A native binding that hands array arguments to natives as views instead of std::vectors.
+// Needs CommonLibSSE, which comes in through PCH.h.
+//
+// CommonLibSSE's binding copies every array argument into a new std::vector before the native
+// runs. ArrayFunction is the same native function with its own MarshallAndDispatch: Array<T>
+// arguments are unpacked straight from the VM's BSScript::Array into a per-thread buffer
+// (marshal.h), every other argument and the result go through CommonLibSSE as before.
+namespace skypal::papyrus {
+
+    // A native argument declared as std::vector<T> in Papyrus. Only valid during the call.
+    template <class T>
+    class Array : public std::span<const T> {
+    public:
+        using std::span<const T>::span;
+
+        Array(std::span<const T> values) : std::span<const T>(values) {}
+    };
+
+    template <class T>
+    struct IsArray : std::false_type {};
+
+    template <class T>
+    struct IsArray<Array<T>> : std::true_type {};
+
+    template <class... Args>
+    constexpr bool kTakesArray = (IsArray<Args>::value || ...);
+
+    // Papyrus sees an Array<T> as the std::vector<T> it replaces
+    template <class T>
+    RE::BSScript::TypeInfo::RawType RawTypeOf() {
+        if constexpr (IsArray<T>::value) {
+            return RE::BSScript::GetRawType<std::vector<typename T::value_type>>();
+        }
+        else {
+            return RE::BSScript::GetRawType<T>();
+        }
+    }
+
+    // Holds argument Slot for the length of the call. An Array's buffer is leased for that long.
+    template <class T, std::size_t Slot>
+    class Argument {
+    public:
+        explicit Argument(const RE::BSScript::Variable& variable) : value(variable.Unpack<T>()) {}
+
+        T Get() { return std::move(value); }
+
+    private:
+        T value;
+    };
+
+    template <class T, std::size_t Slot>
+    class Argument<Array<T>, Slot> {
+    public:
+        explicit Argument(const RE::BSScript::Variable& variable) {
+            if (auto array = variable.GetArray()) {
+                values = marshal::UnpackInto(*array, *buffer, [](const RE::BSScript::Variable& element) { return element.Unpack<T>(); });
+            }
+        }
+
+        Array<T> Get() { return values; }
+
+    private:
+        marshal::Lease<T, Slot> buffer;
+        std::span<const T> values;
+    };
+
+    template <auto Fn>
+    class ArrayFunction;
+
+    template <class R, class... Args, R (*Fn)(RE::StaticFunctionTag*, Args...)>
+    class ArrayFunction<Fn> : public RE::BSScript::NF_util::NativeFunctionBase {
+    public:
+        ArrayFunction(std::string_view name, std::string_view className) :
+            NativeFunctionBase(name, className, true, static_cast<std::uint16_t>(sizeof...(Args))) {
+            std::size_t i = 0;
+            ((_descTable.entries[i++].second = RawTypeOf<Args>()), ...);
+            _retType = RE::BSScript::GetRawType<R>();
+        }
+
+        bool HasStub() const override { return true; }
+
+        bool MarshallAndDispatch(RE::BSScript::Variable&, RE::BSScript::Internal::VirtualMachine&, RE::VMStackID, RE::BSScript::Variable& result, const RE::BSScript::StackFrame& frame) const override {
+            result.reset();
+            Dispatch(result, frame, std::index_sequence_for<Args...>{});
+            return true;
+        }
+
+    private:
+        template <std::size_t... I>
+        static void Dispatch(RE::BSScript::Variable& result, const RE::BSScript::StackFrame& frame, std::index_sequence<I...>) {
+            auto page = frame.GetPageForFrame();
+            std::tuple<Argument<Args, I>...> arguments(frame.GetStackFrameVariable(static_cast<std::uint32_t>(I), page)...);
+            if constexpr (std::is_void_v<R>) {
+                Fn(nullptr, std::get<I>(arguments).Get()...);
+            }
+            else {
+                result.Pack(Fn(nullptr, std::get<I>(arguments).Get()...));
+            }
+        }
+    };
+}
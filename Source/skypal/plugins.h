@@ -0,0 +1,108 @@
+#pragma once
+
+#include <concepts>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "skypal/core.h"
+#include "skypal/names.h"
+
+// Which plugin added a ref, from its form id alone. A full plugin's forms carry its compile index
+// in the top byte; light plugins share 0xFE and carry a 12 bit light index below it. Plugin names
+// are resolved to those slots once per load order, and a set of plugins becomes a bitmask of 256
+// full and 4096 light slots, so testing a ref is a shift and a mask instead of a string compare.
+// Forms made in game (0xFF) belong to no plugin.
+namespace skypal::plugins {
+
+    template <class T>
+    concept PluginTraits = core::RefTraits<T> && requires(typename T::Ref ref) {
+        { T::GetFormId(ref) } -> std::convertible_to<std::uint32_t>;
+    };
+
+    constexpr std::uint32_t kLightTop = 0xFE;
+    constexpr std::uint32_t kDynamicTop = 0xFF;
+    constexpr std::size_t kFullSlots = 256;
+    constexpr std::size_t kLightSlots = 4096;
+
+    struct Slot {
+        bool light = false;
+        std::uint16_t index = 0;  // compile index, or light index when light
+    };
+
+    class Mask {
+    public:
+        void Add(Slot slot) {
+            if (slot.light) {
+                light[(slot.index & 0xFFF) >> 6] |= std::uint64_t(1) << (slot.index & 63);
+                empty = false;
+            }
+            else if (slot.index < kLightTop) {
+                full[slot.index >> 6] |= std::uint64_t(1) << (slot.index & 63);
+                empty = false;
+            }
+        }
+
+        bool Contains(std::uint32_t formId) const {
+            auto top = formId >> 24;
+            if (top == kLightTop) {
+                auto index = (formId >> 12) & 0xFFF;
+                return (light[index >> 6] >> (index & 63)) & 1;
+            }
+            return (full[top >> 6] >> (top & 63)) & 1;
+        }
+
+        bool Empty() const { return empty; }
+
+    private:
+        std::uint64_t full[kFullSlots / 64] = {};
+        std::uint64_t light[kLightSlots / 64] = {};
+        bool empty = true;
+    };
+
+    // plugin file names to their slots, names compared ignoring case like the file system does
+    class LoadOrder {
+    public:
+        void Add(std::string_view fileName, Slot slot) { slots.insert_or_assign(names::Lower(fileName), slot); }
+
+        std::optional<Slot> Find(std::string_view fileName) const {
+            auto it = slots.find(names::Lower(fileName));
+            if (it == slots.end()) {
+                return std::nullopt;
+            }
+            return it->second;
+        }
+
+        std::size_t Size() const { return slots.size(); }
+
+        // The mask of fileNames. Names that aren't loaded are added to unknown.
+        template <class Names>
+        Mask Resolve(const Names& fileNames, std::vector<std::string_view>& unknown) const {
+            Mask mask;
+            for (std::string_view fileName : fileNames) {
+                if (auto slot = Find(fileName)) {
+                    mask.Add(*slot);
+                }
+                else {
+                    unknown.push_back(fileName);
+                }
+            }
+            return mask;
+        }
+
+    private:
+        std::unordered_map<std::string, Slot> slots;
+    };
+
+    // if (mode == "!") : Passes refs that none of the plugins added.
+    // else : Passes refs that one of the plugins added. //default
+    template <PluginTraits T, class Out = core::Collect>
+    core::ResultOf<Out, T> FilterPlugins(core::RefSpan<T> refs, const Mask& mask, std::string_view mode) {
+        bool negate = (core::ParseNegate(mode) == core::Negate::kNoMatch);
+        return Out::template Scan<T>(refs, [&](typename T::Ref ref) { return mask.Contains(T::GetFormId(ref)) != negate; });
+    }
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Read-copy-update for indexes that many VM threads read while event sinks rebuild them.
+//
+// Readers pin the current epoch in a per-thread slot, load the published pointer and read an
+// immutable version with no lock. Writers build a new version, swap it in and retire the old
+// one, which is freed once every reader that could still see it has left its read section.
+//
+// A reader stores its epoch, then loads the pointer; a writer swaps the pointer, then reads the
+// slots. With a fence on both sides, either the reader sees the new version or the writer sees
+// the reader's epoch and keeps the old one alive.
+namespace skypal::rcu {
+
+    class Epochs {
+    public:
+        static Epochs* GetSingleton() {
+            static Epochs singleton;
+            return &singleton;
+        }
+
+        // read sections nest, only the outermost one pins
+        void Enter() {
+            auto& local = Local();
+            if (local.depth++ > 0) {
+                return;
+            }
+            if (!local.slot) {
+                local.slot = Claim();
+            }
+            if (local.slot) {
+                local.slot->epoch.store(epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+            }
+            else {
+                overflowReaders.fetch_add(1, std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+
+        void Exit() {
+            auto& local = Local();
+            if (--local.depth > 0) {
+                return;
+            }
+            if (local.slot) {
+                local.slot->epoch.store(kIdle, std::memory_order_release);
+            }
+            else {
+                overflowReaders.fetch_sub(1, std::memory_order_release);
+            }
+        }
+
+        // call after the pointer to value has been swapped out
+        template <class T>
+        void Retire(const T* value) {
+            std::lock_guard lock(mutex);
+            auto retireEpoch = epoch.fetch_add(1, std::memory_order_acq_rel);
+            retired.push_back({ retireEpoch, value, [](const void* retiredValue) { delete static_cast<const T*>(retiredValue); } });
+            ReclaimLocked();
+        }
+
+        // frees what no reader can still see, returns how many versions are still waiting
+        std::size_t Reclaim() {
+            std::lock_guard lock(mutex);
+            ReclaimLocked();
+            return retired.size();
+        }
+
+    private:
+        static constexpr std::uint64_t kIdle = 0;
+        static constexpr std::size_t kSlots = 128;
+
+        struct alignas(64) Slot {
+            std::atomic<std::uint64_t> epoch = kIdle;
+            std::atomic<bool> owned = false;
+        };
+
+        struct Retired {
+            std::uint64_t epoch;
+            const void* value;
+            void (*destroy)(const void*);
+        };
+
+        // gives the slot back when the thread exits
+        struct LocalState {
+            Slot* slot = nullptr;
+            int depth = 0;
+
+            ~LocalState() {
+                if (slot) {
+                    slot->owned.store(false, std::memory_order_release);
+                }
+            }
+        };
+
+        Epochs() = default;
+
+        static LocalState& Local() {
+            thread_local LocalState local;
+            return local;
+        }
+
+        // null once every slot is owned, those threads fall back to the overflow count
+        Slot* Claim() {
+            for (auto& slot : slots) {
+                bool expected = false;
+                if (!slot.owned.load(std::memory_order_relaxed) && slot.owned.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                    return &slot;
+                }
+            }
+            return nullptr;
+        }
+
+        // A version retired at epoch e is safe once no reader pinned an epoch at or below e.
+        void ReclaimLocked() {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (overflowReaders.load(std::memory_order_acquire) > 0) {
+                return;
+            }
+
+            auto oldestReader = UINT64_MAX;
+            for (auto& slot : slots) {
+                auto pinned = slot.epoch.load(std::memory_order_acquire);
+                if (pinned != kIdle) {
+                    oldestReader = std::min(oldestReader, pinned);
+                }
+            }
+
+            auto safe = std::partition(retired.begin(), retired.end(), [&](const Retired& entry) { return entry.epoch >= oldestReader; });
+            for (auto it = safe; it != retired.end(); it++) {
+                it->destroy(it->value);
+            }
+            retired.erase(safe, retired.end());
+        }
+
+        std::array<Slot, kSlots> slots;
+        std::atomic<std::uint64_t> epoch = 1;
+        std::atomic<int> overflowReaders = 0;
+        std::mutex mutex;
+        std::vector<Retired> retired;
+    };
+
+    class ReadGuard {
+    public:
+        ReadGuard() { Epochs::GetSingleton()->Enter(); }
+        ~ReadGuard() { Epochs::GetSingleton()->Exit(); }
+
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+    };
+
+    // One published version of T. Reads never block; Update copies the current version, lets fn
+    // change the copy and publishes it, one writer at a time.
+    template <class T>
+    class Published {
+    public:
+        // keeps the version it read alive for as long as it lives, so don't hold one across frames
+        class Reader {
+        public:
+            explicit Reader(const std::atomic<const T*>& current) : value(current.load(std::memory_order_acquire)) {}
+
+            Reader(const Reader&) = delete;
+            Reader& operator=(const Reader&) = delete;
+
+            const T& operator*() const { return *value; }
+            const T* operator->() const { return value; }
+            const T* get() const { return value; }
+
+        private:
+            ReadGuard guard;
+            const T* value;
+        };
+
+        Published() : current(new T()) {}
+        explicit Published(std::unique_ptr<T> initial) : current(initial.release()) {}
+
+        ~Published() { delete current.load(std::memory_order_relaxed); }
+
+        Published(const Published&) = delete;
+        Published& operator=(const Published&) = delete;
+
+        Reader Read() const { return Reader(current); }
+
+        void Publish(std::unique_ptr<T> next) {
+            std::lock_guard lock(writerMutex);
+            PublishLocked(std::move(next));
+        }
+
+        template <class Fn>
+        void Update(Fn&& fn) {
+            std::lock_guard lock(writerMutex);
+            auto next = std::make_unique<T>(*current.load(std::memory_order_relaxed));
+            fn(*next);
+            PublishLocked(std::move(next));
+        }
+
+    private:
+        void PublishLocked(std::unique_ptr<T> next) {
+            auto* previous = current.exchange(next.release(), std::memory_order_acq_rel);
+            Epochs::GetSingleton()->Retire(previous);
+        }
+
+        std::atomic<const T*> current;
+        std::mutex writerMutex;
+    };
+}
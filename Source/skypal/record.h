@@ -0,0 +1,285 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <ranges>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Records every native call into a binary file that bench/skypal_replay can run against the mock
+// world: the function, each argument (forms as form ids, arrays in full), when it was called and
+// how long it took.
+//
+// File layout, little endian:
+//   header    "SKPR" u32 version
+//   function  u8 kFunction, u16 id, u16 length, name
+//   call      u8 kCall, u16 function id, u32 thread, u64 start ns, u64 duration ns, u32 output size,
+//             u8 argument count, then per argument u8 ArgType and its value:
+//               kInt i32 | kFloat f32 | kBool u8 | kString u32 length, bytes | kForm u32 form id
+//               arrays: u32 count, then count values of the element type
+//
+// Functions are written once each, before the first call that uses them.
+namespace skypal::record {
+
+    inline std::atomic<bool> enabled = false;
+
+    constexpr char kMagic[4] = { 'S', 'K', 'P', 'R' };
+    constexpr std::uint32_t kVersion = 1;
+
+    enum class RecordType : std::uint8_t {
+        kFunction = 1,
+        kCall = 2,
+    };
+
+    enum class ArgType : std::uint8_t {
+        kInt = 1,
+        kFloat,
+        kBool,
+        kString,
+        kForm,
+        kIntArray,
+        kFloatArray,
+        kBoolArray,
+        kStringArray,
+        kFormArray,
+    };
+
+    // anything with a form id: TESForm and everything derived from it
+    template <class T>
+    concept FormPointer = std::is_pointer_v<T> && requires(T form) {
+        { form->GetFormID() } -> std::convertible_to<std::uint32_t>;
+    };
+
+    template <class T>
+    concept StringLike = std::convertible_to<const T&, std::string_view>;
+
+    // Appends one call to a byte buffer. The header is written up front and its duration and
+    // output size are patched in once the call returns.
+    class CallWriter {
+    public:
+        void Begin(std::uint16_t functionId, std::uint64_t startNs) {
+            bytes.clear();
+            Put(RecordType::kCall);
+            Put(functionId);
+            Put(ThreadId());
+            Put(startNs);
+            durationOffset = bytes.size();
+            Put(std::uint64_t(0));
+            Put(std::uint32_t(0));
+            argCountOffset = bytes.size();
+            Put(std::uint8_t(0));
+        }
+
+        template <class T>
+        void Arg(const T& value) {
+            PutValue(value);
+            bytes[argCountOffset]++;
+        }
+
+        void End(std::uint64_t durationNs, std::size_t outputSize) {
+            std::memcpy(bytes.data() + durationOffset, &durationNs, sizeof(durationNs));
+            auto output = static_cast<std::uint32_t>(outputSize);
+            std::memcpy(bytes.data() + durationOffset + sizeof(durationNs), &output, sizeof(output));
+        }
+
+        const std::vector<char>& Bytes() const { return bytes; }
+
+    private:
+        template <class T>
+        void Put(const T& value) {
+            auto* raw = reinterpret_cast<const char*>(&value);
+            bytes.insert(bytes.end(), raw, raw + sizeof(T));
+        }
+
+        void PutString(std::string_view string) {
+            Put(static_cast<std::uint32_t>(string.size()));
+            bytes.insert(bytes.end(), string.begin(), string.end());
+        }
+
+        template <class T>
+        void PutElement(const T& value) {
+            if constexpr (FormPointer<T>) {
+                Put(static_cast<std::uint32_t>(value ? value->GetFormID() : 0));
+            }
+            else if constexpr (std::same_as<T, bool>) {
+                Put(static_cast<std::uint8_t>(value));
+            }
+            else if constexpr (std::integral<T>) {
+                Put(static_cast<std::int32_t>(value));
+            }
+            else if constexpr (std::floating_point<T>) {
+                Put(static_cast<float>(value));
+            }
+            else {
+                static_assert(StringLike<T>, "no record encoding for this native argument type");
+                PutString(std::string_view(value));
+            }
+        }
+
+        template <class T>
+        static constexpr ArgType TypeOf() {
+            if constexpr (FormPointer<T>) {
+                return ArgType::kForm;
+            }
+            else if constexpr (std::same_as<T, bool>) {
+                return ArgType::kBool;
+            }
+            else if constexpr (std::integral<T>) {
+                return ArgType::kInt;
+            }
+            else if constexpr (std::floating_point<T>) {
+                return ArgType::kFloat;
+            }
+            else {
+                return ArgType::kString;
+            }
+        }
+
+        template <class T>
+            requires(!std::ranges::contiguous_range<T> || StringLike<T>)
+        void PutValue(const T& value) {
+            Put(TypeOf<T>());
+            PutElement(value);
+        }
+
+        // the array tags follow the scalar ones in the same order
+        template <class T>
+        void PutValue(const std::vector<T>& values) {
+            PutArray(std::span<const T>(values));
+        }
+
+        // papyrus::Array arguments
+        template <class T>
+        void PutValue(const std::span<const T>& values) {
+            PutArray(values);
+        }
+
+        template <class T>
+        void PutArray(std::span<const T> values) {
+            constexpr auto arrayType = static_cast<ArgType>(static_cast<std::uint8_t>(TypeOf<T>()) + 5);
+            Put(arrayType);
+            Put(static_cast<std::uint32_t>(values.size()));
+            for (const auto& value : values) {
+                PutElement(value);
+            }
+        }
+
+        static std::uint32_t ThreadId() {
+            thread_local std::uint32_t id = static_cast<std::uint32_t>(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+            return id;
+        }
+
+        std::vector<char> bytes;
+        std::size_t durationOffset = 0;
+        std::size_t argCountOffset = 0;
+    };
+
+    // natives don't call each other, so one writer per thread is enough
+    inline CallWriter& LocalWriter() {
+        thread_local CallWriter writer;
+        return writer;
+    }
+
+    class Recorder {
+    public:
+        static Recorder* GetSingleton() {
+            static Recorder singleton;
+            return &singleton;
+        }
+
+        // ids are handed out at registration, recorded or not
+        std::uint16_t RegisterFunction(std::string_view name) {
+            std::lock_guard lock(mutex);
+            functions.emplace_back(name);
+            written.push_back(false);
+            return static_cast<std::uint16_t>(functions.size() - 1);
+        }
+
+        // truncates path, returns false if it can't be opened
+        bool Start(const std::string& path) {
+            std::lock_guard lock(mutex);
+            file.close();
+            file.open(path, std::ios::binary | std::ios::trunc);
+            if (!file.is_open()) {
+                return false;
+            }
+            file.write(kMagic, sizeof(kMagic));
+            file.write(reinterpret_cast<const char*>(&kVersion), sizeof(kVersion));
+            written.assign(functions.size(), false);
+            buffer.clear();
+            calls = 0;
+            origin = std::chrono::steady_clock::now();
+            enabled.store(true, std::memory_order_release);
+            return true;
+        }
+
+        // returns the number of calls recorded
+        std::uint64_t Stop() {
+            enabled.store(false, std::memory_order_release);
+            std::lock_guard lock(mutex);
+            if (file.is_open()) {
+                Flush();
+                file.close();
+            }
+            return calls;
+        }
+
+        std::uint64_t Now() const {
+            return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count());
+        }
+
+        void Write(std::uint16_t functionId, const CallWriter& call) {
+            std::lock_guard lock(mutex);
+            if (!file.is_open()) {
+                return;
+            }
+            if (!written[functionId]) {
+                written[functionId] = true;
+                auto& name = functions[functionId];
+                buffer.push_back(static_cast<char>(RecordType::kFunction));
+                AppendRaw(functionId);
+                AppendRaw(static_cast<std::uint16_t>(name.size()));
+                buffer.insert(buffer.end(), name.begin(), name.end());
+            }
+            auto& bytes = call.Bytes();
+            buffer.insert(buffer.end(), bytes.begin(), bytes.end());
+            calls++;
+            if (buffer.size() >= kFlushBytes) {
+                Flush();
+            }
+        }
+
+    private:
+        static constexpr std::size_t kFlushBytes = 1 << 20;
+
+        Recorder() = default;
+
+        template <class T>
+        void AppendRaw(const T& value) {
+            auto* raw = reinterpret_cast<const char*>(&value);
+            buffer.insert(buffer.end(), raw, raw + sizeof(T));
+        }
+
+        void Flush() {
+            file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            buffer.clear();
+        }
+
+        std::mutex mutex;
+        std::ofstream file;
+        std::vector<std::string> functions;
+        std::vector<bool> written;
+        std::vector<char> buffer;
+        std::uint64_t calls = 0;
+        std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    };
+}
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// The base -> refs index behind All_Filter_Bases, by form id, and the compact form it's kept in
+// the SKSE co-save as. Engine-free: the plugin fills it from the form map, the bench from a mock
+// world.
+//
+// Saved form: the format version, a hash of the load order the ids belong to, then every base
+// with its refs. Bases and each base's refs are sorted, so both go out as LEB128 deltas; refs a
+// plugin places sit close together in its id range, so most deltas take one or two bytes.
+namespace skypal::ref_index {
+
+    using FormID = std::uint32_t;
+
+    constexpr std::uint32_t kVersion = 1;
+
+    // The refs of bases[i] are refs[offsets[i]] to refs[offsets[i + 1]], each run sorted.
+    struct Index {
+        std::vector<FormID> bases;  // sorted
+        std::vector<std::uint32_t> offsets;  // bases.size() + 1 once there is a base
+        std::vector<FormID> refs;
+
+        // (base, ref) pairs in any order, a pair listed twice is kept once
+        static Index Build(std::vector<std::pair<FormID, FormID>> pairs) {
+            std::sort(pairs.begin(), pairs.end());
+            pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+            Index index;
+            index.refs.reserve(pairs.size());
+            for (auto [base, ref] : pairs) {
+                if (index.bases.empty() || index.bases.back() != base) {
+                    index.bases.push_back(base);
+                    index.offsets.push_back(static_cast<std::uint32_t>(index.refs.size()));
+                }
+                index.refs.push_back(ref);
+            }
+            if (!index.bases.empty()) {
+                index.offsets.push_back(static_cast<std::uint32_t>(index.refs.size()));
+            }
+            return index;
+        }
+
+        // the sorted refs of base, empty when it has none
+        std::span<const FormID> RefsOf(FormID base) const {
+            auto it = std::lower_bound(bases.begin(), bases.end(), base);
+            if (it == bases.end() || *it != base) {
+                return {};
+            }
+            auto i = static_cast<std::size_t>(it - bases.begin());
+            return std::span<const FormID>(refs).subspan(offsets[i], offsets[i + 1] - offsets[i]);
+        }
+
+        bool Contains(FormID base, FormID ref) const {
+            auto baseRefs = RefsOf(base);
+            return std::binary_search(baseRefs.begin(), baseRefs.end(), ref);
+        }
+
+        // fn(base, ref) for every pair, by base then ref
+        template <class Fn>
+        void ForEach(Fn&& fn) const {
+            for (std::size_t i = 0; i < bases.size(); i++) {
+                for (auto j = offsets[i]; j < offsets[i + 1]; j++) {
+                    fn(bases[i], refs[j]);
+                }
+            }
+        }
+    };
+
+    // The plugin a form id belongs to: its top byte, or for a light plugin (0xFE) the top byte and
+    // its light index together. Forms made in game have kDynamicKey.
+    inline std::uint32_t PluginKey(FormID id) {
+        return (id >> 24) == 0xFE ? id >> 12 : id >> 24;
+    }
+
+    constexpr std::uint32_t kDynamicKey = 0xFF;
+
+    // how many refs of one plugin there are, and the highest id among them
+    struct PluginRefs {
+        std::uint32_t count = 0;
+        FormID last = 0;
+
+        void Add(FormID ref) {
+            count += 1;
+            last = std::max(last, ref);
+        }
+    };
+
+    // PluginRefs by PluginKey
+    using Census = std::unordered_map<std::uint32_t, PluginRefs>;
+
+    // Whether index can hold every ref census counted in the form map: each plugin has at least as
+    // many refs in index, up to an id at least as high. Refs index has beyond that unloaded or were
+    // deleted, which lookups skip. Fewer, or a higher id, means refs it never saw, like those a
+    // plugin updated in place added. It's a count, not a check of each ref, so a plugin that lost
+    // as many refs as it gained below its old highest id passes. Refs made in game reuse freed ids
+    // below the highest, so they're left out of census and looked up in index one by one instead.
+    inline bool Covers(const Index& index, const Census& census) {
+        Census indexed;
+        for (auto ref : index.refs) {
+            indexed[PluginKey(ref)].Add(ref);
+        }
+        return std::all_of(census.begin(), census.end(), [&](const auto& entry) {
+            auto it = indexed.find(entry.first);
+            return it != indexed.end() && it->second.count >= entry.second.count && it->second.last >= entry.second.last;
+        });
+    }
+
+    inline void PutVarint(std::vector<std::uint8_t>& out, std::uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<std::uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<std::uint8_t>(value));
+    }
+
+    // false if in ends first or the value runs past 64 bits
+    inline bool GetVarint(std::span<const std::uint8_t>& in, std::uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64 && !in.empty(); shift += 7) {
+            auto byte = in.front();
+            in = in.subspan(1);
+            value |= std::uint64_t(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // FNV-1a over the file names in load order, each one ended by a 0 byte, so a save only
+    // restores ids as they are if the plugins and their order are the same
+    inline std::uint64_t HashLoadOrder(std::span<const std::string_view> files) {
+        std::uint64_t hash = 0xCBF29CE484222325;
+        for (auto file : files) {
+            for (auto c : file) {
+                hash = (hash ^ static_cast<std::uint8_t>(c)) * 0x100000001B3;
+            }
+            hash *= 0x100000001B3;
+        }
+        return hash;
+    }
+
+    inline std::vector<std::uint8_t> Encode(const Index& index, std::uint64_t loadOrder) {
+        std::vector<std::uint8_t> out;
+        out.reserve(16 + index.bases.size() * 4 + index.refs.size() * 2);
+        PutVarint(out, kVersion);
+        PutVarint(out, loadOrder);
+        PutVarint(out, index.bases.size());
+        PutVarint(out, index.refs.size());
+
+        FormID previousBase = 0;
+        for (std::size_t i = 0; i < index.bases.size(); i++) {
+            PutVarint(out, index.bases[i] - previousBase);
+            previousBase = index.bases[i];
+            PutVarint(out, index.offsets[i + 1] - index.offsets[i]);
+
+            FormID previousRef = 0;
+            for (auto j = index.offsets[i]; j < index.offsets[i + 1]; j++) {
+                PutVarint(out, index.refs[j] - previousRef);
+                previousRef = index.refs[j];
+            }
+        }
+        return out;
+    }
+
+    // Reads what Encode wrote. Anything malformed, out of order or from another format version
+    // fails and leaves index as it was.
+    inline bool Decode(std::span<const std::uint8_t> in, Index& index, std::uint64_t& loadOrder) {
+        std::uint64_t version = 0;
+        std::uint64_t baseCount = 0;
+        std::uint64_t refCount = 0;
+        if (!GetVarint(in, version) || version != kVersion || !GetVarint(in, loadOrder) ||
+            !GetVarint(in, baseCount) || !GetVarint(in, refCount) || baseCount > in.size() || refCount > in.size()) {
+            return false;
+        }
+
+        Index decoded;
+        decoded.bases.reserve(baseCount);
+        decoded.offsets.reserve(baseCount + 1);
+        decoded.refs.reserve(refCount);
+
+        // deltas after the first one of a run must be positive, so the runs stay sorted
+        auto next = [&](std::uint64_t previous, bool first, FormID& id) {
+            std::uint64_t delta = 0;
+            if (!GetVarint(in, delta) || (!first && delta == 0) || delta > UINT32_MAX - previous) {
+                return false;
+            }
+            id = static_cast<FormID>(previous + delta);
+            return true;
+        };
+
+        for (std::uint64_t i = 0; i < baseCount; i++) {
+            FormID base = 0;
+            std::uint64_t count = 0;
+            if (!next(i == 0 ? 0 : decoded.bases.back(), i == 0, base) || !GetVarint(in, count) || count == 0 ||
+                count > refCount - decoded.refs.size()) {
+                return false;
+            }
+            decoded.bases.push_back(base);
+            decoded.offsets.push_back(static_cast<std::uint32_t>(decoded.refs.size()));
+
+            FormID ref = 0;
+            for (std::uint64_t j = 0; j < count; j++) {
+                if (!next(j == 0 ? 0 : ref, j == 0, ref)) {
+                    return false;
+                }
+                decoded.refs.push_back(ref);
+            }
+        }
+        if (!in.empty() || decoded.refs.size() != refCount) {
+            return false;
+        }
+        if (!decoded.bases.empty()) {
+            decoded.offsets.push_back(static_cast<std::uint32_t>(decoded.refs.size()));
+        }
+
+        index = std::move(decoded);
+        return true;
+    }
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <algorithm>
+#include <concepts>
+#include <cstdint>
+#include <memory_resource>
+#include <unordered_map>
+
+#include "skypal/core.h"
+#include "skypal/thread_pool.h"
+
+// Two-phase versions of the read-only filters. Capture copies what the filters read (position,
+// base form type, keywords) out of the refs on the calling thread, the only one allowed to touch
+// game objects. The kernels then evaluate the copy on a ThreadPool and never touch a ref.
+// Results match the core kernels, in the same order.
+namespace skypal::snapshot {
+
+    // Keyword sets are captured once per key, the base for most refs, so the skewed base
+    // popularity of real worlds makes keyword capture cheap.
+    template <class T>
+    concept SnapshotTraits = core::RefTraits<T> && requires(typename T::Ref ref, void (*visit)(typename T::Keyword)) {
+        { T::KeywordSetKey(ref) } -> std::convertible_to<const void*>;
+        T::ForEachKeyword(ref, visit);
+    };
+
+    enum Field : std::uint8_t {
+        kPosition = 1 << 0,
+        kFormType = 1 << 1,
+        kKeywords = 1 << 2,
+    };
+
+    template <SnapshotTraits T>
+    struct Snapshot {
+        struct Entry {
+            typename T::Ref ref;
+            float x = 0.0f;
+            float y = 0.0f;
+            float z = 0.0f;
+            int formType = 0;
+            std::uint32_t keywordBegin = 0;
+            std::uint32_t keywordCount = 0;
+        };
+
+        std::vector<Entry> entries;
+        std::vector<typename T::Keyword> keywords;  // every captured set, each one sorted
+
+        bool HasKeyword(const Entry& entry, typename T::Keyword keyword) const {
+            auto begin = keywords.begin() + entry.keywordBegin;
+            return std::binary_search(begin, begin + entry.keywordCount, keyword);
+        }
+    };
+
+    // null refs are left out
+    template <SnapshotTraits T>
+    Snapshot<T> Capture(core::RefSpan<T> refs, std::uint8_t fields) {
+        Snapshot<T> snapshot;
+        snapshot.entries.reserve(refs.size());
+        std::pmr::unordered_map<const void*, std::pair<std::uint32_t, std::uint32_t>> keywordSets(arena::Resource());
+
+        for (auto ref : refs) {
+            if (!ref) {
+                continue;
+            }
+
+            auto& entry = snapshot.entries.emplace_back();
+            entry.ref = ref;
+            if (fields & kPosition) {
+                auto position = T::GetPosition(ref);
+                entry.x = position.x;
+                entry.y = position.y;
+                entry.z = position.z;
+            }
+            if (fields & kFormType) {
+                entry.formType = T::GetBaseFormType(ref);
+            }
+            if (fields & kKeywords) {
+                auto [it, added] = keywordSets.try_emplace(T::KeywordSetKey(ref));
+                if (added) {
+                    auto begin = static_cast<std::uint32_t>(snapshot.keywords.size());
+                    T::ForEachKeyword(ref, [&](typename T::Keyword keyword) { snapshot.keywords.push_back(keyword); });
+                    std::sort(snapshot.keywords.begin() + begin, snapshot.keywords.end());
+                    it->second = { begin, static_cast<std::uint32_t>(snapshot.keywords.size()) - begin };
+                }
+                entry.keywordBegin = it->second.first;
+                entry.keywordCount = it->second.second;
+            }
+        }
+        return snapshot;
+    }
+
+    // small inputs run as one chunk on the calling thread
+    constexpr std::size_t kChunkSize = 4096;
+
+    inline std::size_t ChunkCount(std::size_t size) {
+        return (size + kChunkSize - 1) / kChunkSize;
+    }
+
+    // keeps the entries pred accepts, chunks filtered in parallel and joined in input order
+    template <SnapshotTraits T, class Pred>
+    core::RefVector<T> FilterIf(const Snapshot<T>& snapshot, ThreadPool& pool, Pred&& pred) {
+        auto& entries = snapshot.entries;
+        std::vector<core::RefVector<T>> chunks(ChunkCount(entries.size()));
+        pool.ParallelFor(chunks.size(), [&](std::size_t chunk) {
+            auto end = std::min(entries.size(), (chunk + 1) * kChunkSize);
+            for (auto i = chunk * kChunkSize; i < end; i++) {
+                if (pred(entries[i])) {
+                    chunks[chunk].push_back(entries[i].ref);
+                }
+            }
+        });
+
+        core::RefVector<T> returnRefs;
+        std::size_t total = 0;
+        for (auto& chunk : chunks) {
+            total += chunk.size();
+        }
+        returnRefs.reserve(total);
+        for (auto& chunk : chunks) {
+            returnRefs.insert(returnRefs.end(), chunk.begin(), chunk.end());
+        }
+        return returnRefs;
+    }
+
+    // how many entries pred accepts, chunks counted in parallel
+    template <SnapshotTraits T, class Pred>
+    int CountIf(const Snapshot<T>& snapshot, ThreadPool& pool, Pred&& pred) {
+        auto& entries = snapshot.entries;
+        std::vector<int> counts(ChunkCount(entries.size()));
+        pool.ParallelFor(counts.size(), [&](std::size_t chunk) {
+            auto end = std::min(entries.size(), (chunk + 1) * kChunkSize);
+            for (auto i = chunk * kChunkSize; i < end; i++) {
+                counts[chunk] += pred(entries[i]) ? 1 : 0;
+            }
+        });
+
+        int total = 0;
+        for (auto count : counts) {
+            total += count;
+        }
+        return total;
+    }
+
+    // Runs pred the way core's Out policy would. The short-circuiting ones scan in order on the
+    // calling thread, the capture already cost more than they save.
+    template <SnapshotTraits T, class Out, class Pred>
+    core::ResultOf<Out, T> Scan(const Snapshot<T>& snapshot, ThreadPool& pool, Pred&& pred) {
+        if constexpr (std::same_as<Out, core::Count>) {
+            return CountIf(snapshot, pool, pred);
+        }
+        else if constexpr (Out::kShortCircuits) {
+            for (auto& entry : snapshot.entries) {
+                if (pred(entry)) {
+                    if constexpr (std::same_as<Out, core::Any>) {
+                        return true;
+                    }
+                    else {
+                        return entry.ref;
+                    }
+                }
+            }
+            return core::ResultOf<Out, T>{};
+        }
+        else {
+            static_assert(std::same_as<Out, core::Collect>, "no snapshot scan for this Out");
+            return FilterIf(snapshot, pool, pred);
+        }
+    }
+
+    // Same modes as core::FilterFormTypes.
+    template <SnapshotTraits T, class Out = core::Collect>
+    core::ResultOf<Out, T> FilterFormTypes(const Snapshot<T>& snapshot, ThreadPool& pool, std::span<const int> formTypes, std::string_view mode) {
+        bool negate = (core::ParseNegate(mode) == core::Negate::kNoMatch);
+        return Scan<T, Out>(snapshot, pool, [&](const auto& entry) {
+            return (std::find(formTypes.begin(), formTypes.end(), entry.formType) != formTypes.end()) != negate;
+        });
+    }
+
+    // Same modes as core::FilterDistance.
+    template <SnapshotTraits T, class Out = core::Collect>
+    core::ResultOf<Out, T> FilterDistance(const Snapshot<T>& snapshot, ThreadPool& pool, float distance, typename T::Ref from, std::string_view mode) {
+        auto fromPosition = T::GetPosition(from);
+        float distanceSquared = distance * distance;
+        if (mode == ">") {
+            return Scan<T, Out>(snapshot, pool, [&](const auto& entry) { return core::DistanceSquared(entry, fromPosition) > distanceSquared; });
+        }
+        return Scan<T, Out>(snapshot, pool, [&](const auto& entry) { return core::DistanceSquared(entry, fromPosition) < distanceSquared; });
+    }
+
+    // Same modes as core::FilterKeywords.
+    template <SnapshotTraits T, class Out = core::Collect>
+    core::ResultOf<Out, T> FilterKeywords(const Snapshot<T>& snapshot, ThreadPool& pool, std::span<const typename T::Keyword> keywords, std::string_view mode) {
+        return core::WithGate(core::ParseGate(mode), [&](auto gate) {
+            return Scan<T, Out>(snapshot, pool, [&](const auto& entry) {
+                return core::PassesGate<gate()>(keywords, [&](auto keyword) { return snapshot.HasKeyword(entry, keyword); });
+            });
+        });
+    }
+
+    // Same modes as core::SortDistance. Chunks are stable sorted in parallel, then merged in
+    // pairs, which keeps refs at the same distance in input order.
+    template <SnapshotTraits T>
+    core::RefVector<T> SortDistance(const Snapshot<T>& snapshot, ThreadPool& pool, typename T::Ref from, std::string_view mode) {
+        auto fromPosition = T::GetPosition(from);
+        auto& entries = snapshot.entries;
+
+        std::pmr::vector<std::pair<float, typename T::Ref>> sorted(entries.size(), arena::Resource());
+        bool farthestFirst = (mode == ">");
+        auto less = [farthestFirst](const auto& a, const auto& b) { return farthestFirst ? a.first > b.first : a.first < b.first; };
+
+        std::size_t chunkCount = ChunkCount(entries.size());
+        pool.ParallelFor(chunkCount, [&](std::size_t chunk) {
+            auto begin = chunk * kChunkSize;
+            auto end = std::min(entries.size(), begin + kChunkSize);
+            for (auto i = begin; i < end; i++) {
+                sorted[i] = { core::DistanceSquared(entries[i], fromPosition), entries[i].ref };
+            }
+            std::stable_sort(sorted.begin() + begin, sorted.begin() + end, less);
+        });
+
+        for (std::size_t width = kChunkSize; width < sorted.size(); width *= 2) {
+            std::size_t pairs = (sorted.size() + 2 * width - 1) / (2 * width);
+            pool.ParallelFor(pairs, [&](std::size_t pair) {
+                auto begin = pair * 2 * width;
+                auto middle = std::min(sorted.size(), begin + width);
+                auto end = std::min(sorted.size(), begin + 2 * width);
+                std::inplace_merge(sorted.begin() + begin, sorted.begin() + middle, sorted.begin() + end, less);
+            });
+        }
+
+        core::RefVector<T> returnRefs;
+        returnRefs.reserve(sorted.size());
+        for (auto& [distance, ref] : sorted) {
+            returnRefs.push_back(ref);
+        }
+        return returnRefs;
+    }
+}
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "skypal/rcu.h"
+
+// Per native function call statistics: call count, input / output array sizes and a latency histogram.
+// Everything here is lock free on the recording side, natives can be called from several VM threads.
+namespace skypal::stats {
+
+    // recording is off unless [STATS] bEnabled is set, a disabled call costs one relaxed load
+    inline std::atomic<bool> enabled = false;
+
+    // Log-linear histogram of nanoseconds: 4 sub buckets per power of two, so any reported
+    // percentile is within 25% of the real value.
+    class Histogram {
+    public:
+        static constexpr int kSubBucketBits = 2;
+        static constexpr int kSubBuckets = 1 << kSubBucketBits;
+        static constexpr int kBuckets = 256;
+
+        void Record(std::uint64_t nanoseconds) {
+            counts[BucketIndex(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+
+            std::uint64_t currentMax = max.load(std::memory_order_relaxed);
+            while (nanoseconds > currentMax && !max.compare_exchange_weak(currentMax, nanoseconds, std::memory_order_relaxed)) {
+            }
+        }
+
+        // upper bound of the bucket holding the given percentile (0.0 - 1.0), clamped to the max seen
+        std::uint64_t Percentile(double percentile) const {
+            std::uint64_t total = 0;
+            for (auto& count : counts) {
+                total += count.load(std::memory_order_relaxed);
+            }
+            if (total == 0) {
+                return 0;
+            }
+
+            std::uint64_t target = static_cast<std::uint64_t>(percentile * static_cast<double>(total));
+            if (target == 0) {
+                target = 1;
+            }
+
+            std::uint64_t seen = 0;
+            for (int i = 0; i < kBuckets; i++) {
+                seen += counts[i].load(std::memory_order_relaxed);
+                if (seen >= target) {
+                    return std::min(BucketUpperBound(i), Max());
+                }
+            }
+            return Max();
+        }
+
+        std::uint64_t Max() const {
+            return max.load(std::memory_order_relaxed);
+        }
+
+        void Reset() {
+            for (auto& count : counts) {
+                count.store(0, std::memory_order_relaxed);
+            }
+            max.store(0, std::memory_order_relaxed);
+        }
+
+        static int BucketIndex(std::uint64_t value) {
+            if (value < kSubBuckets) {
+                return static_cast<int>(value);
+            }
+            int msb = 63 - std::countl_zero(value);
+            int sub = static_cast<int>((value >> (msb - kSubBucketBits)) & (kSubBuckets - 1));
+            return kSubBuckets + ((msb - kSubBucketBits) * kSubBuckets) + sub;
+        }
+
+        static std::uint64_t BucketUpperBound(int index) {
+            if (index < kSubBuckets) {
+                return static_cast<std::uint64_t>(index);
+            }
+            int shift = (index - kSubBuckets) / kSubBuckets;
+            std::uint64_t sub = static_cast<std::uint64_t>((index - kSubBuckets) % kSubBuckets);
+            std::uint64_t lower = (kSubBuckets | sub) << shift;
+            return lower + ((std::uint64_t(1) << shift) - 1);
+        }
+
+    private:
+        std::array<std::atomic<std::uint64_t>, kBuckets> counts{};
+        std::atomic<std::uint64_t> max = 0;
+    };
+
+    struct FunctionStats {
+        std::string name;
+        std::atomic<std::uint64_t> calls = 0;
+        std::atomic<std::uint64_t> inputElements = 0;
+        std::atomic<std::uint64_t> outputElements = 0;
+        std::atomic<std::uint64_t> totalNanoseconds = 0;
+        Histogram latency;
+
+        void Record(std::uint64_t nanoseconds, std::size_t inputSize, std::size_t outputSize) {
+            calls.fetch_add(1, std::memory_order_relaxed);
+            inputElements.fetch_add(inputSize, std::memory_order_relaxed);
+            outputElements.fetch_add(outputSize, std::memory_order_relaxed);
+            totalNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+            latency.Record(nanoseconds);
+        }
+
+        void Reset() {
+            calls.store(0, std::memory_order_relaxed);
+            inputElements.store(0, std::memory_order_relaxed);
+            outputElements.store(0, std::memory_order_relaxed);
+            totalNanoseconds.store(0, std::memory_order_relaxed);
+            latency.Reset();
+        }
+    };
+
+    // plain copy of a FunctionStats, times in microseconds
+    struct Summary {
+        std::string name;
+        std::uint64_t calls = 0;
+        float meanUs = 0.0f;
+        float p50Us = 0.0f;
+        float p95Us = 0.0f;
+        float p99Us = 0.0f;
+        float maxUs = 0.0f;
+        float averageInput = 0.0f;
+        float averageOutput = 0.0f;
+    };
+
+    inline Summary Summarize(const FunctionStats& stats) {
+        Summary summary;
+        summary.name = stats.name;
+        summary.calls = stats.calls.load(std::memory_order_relaxed);
+        if (summary.calls == 0) {
+            return summary;
+        }
+
+        auto calls = static_cast<float>(summary.calls);
+        summary.meanUs = static_cast<float>(stats.totalNanoseconds.load(std::memory_order_relaxed)) / calls / 1000.0f;
+        summary.p50Us = static_cast<float>(stats.latency.Percentile(0.50)) / 1000.0f;
+        summary.p95Us = static_cast<float>(stats.latency.Percentile(0.95)) / 1000.0f;
+        summary.p99Us = static_cast<float>(stats.latency.Percentile(0.99)) / 1000.0f;
+        summary.maxUs = static_cast<float>(stats.latency.Max()) / 1000.0f;
+        summary.averageInput = static_cast<float>(stats.inputElements.load(std::memory_order_relaxed)) / calls;
+        summary.averageOutput = static_cast<float>(stats.outputElements.load(std::memory_order_relaxed)) / calls;
+        return summary;
+    }
+
+    // Owns one FunctionStats per registered native. Entries are created at bind time and never
+    // removed, so the pointers handed out stay valid for the life of the plugin. Lookups by name
+    // read a published copy of the index and don't take the mutex.
+    class Registry {
+    public:
+        static Registry* GetSingleton() {
+            static Registry singleton;
+            return &singleton;
+        }
+
+        FunctionStats* Get(std::string_view name) {
+            if (auto* stats = Find(name)) {
+                return stats;
+            }
+
+            std::lock_guard lock(mutex);
+            if (auto* stats = Find(name)) {
+                return stats;
+            }
+            auto& stats = entries.emplace_back();
+            stats.name = name;
+            byName.Update([&](Index& index) { index[stats.name] = &stats; });
+            return &stats;
+        }
+
+        FunctionStats* Find(std::string_view name) {
+            auto index = byName.Read();
+            auto it = index->find(name);
+            return it != index->end() ? it->second : nullptr;
+        }
+
+        std::vector<Summary> Summaries() {
+            std::vector<Summary> summaries;
+            std::lock_guard lock(mutex);
+            summaries.reserve(entries.size());
+            for (auto& stats : entries) {
+                summaries.push_back(Summarize(stats));
+            }
+            return summaries;
+        }
+
+        void Reset() {
+            std::lock_guard lock(mutex);
+            for (auto& stats : entries) {
+                stats.Reset();
+            }
+        }
+
+        bool WriteCsv(const std::string& path) {
+            std::ofstream file(path, std::ios::trunc);
+            if (!file.is_open()) {
+                return false;
+            }
+
+            file << "name,calls,mean_us,p50_us,p95_us,p99_us,max_us,avg_input,avg_output\n";
+            for (auto& summary : Summaries()) {
+                file << summary.name << ',' << summary.calls << ',' << summary.meanUs << ',' << summary.p50Us << ','
+                     << summary.p95Us << ',' << summary.p99Us << ',' << summary.maxUs << ',' << summary.averageInput << ','
+                     << summary.averageOutput << '\n';
+            }
+            return true;
+        }
+
+    private:
+        Registry() = default;
+
+        struct NameHash {
+            using is_transparent = void;
+            std::size_t operator()(std::string_view name) const { return std::hash<std::string_view>{}(name); }
+        };
+        using Index = std::unordered_map<std::string, FunctionStats*, NameHash, std::equal_to<>>;
+
+        std::mutex mutex;  // entries
+        std::deque<FunctionStats> entries;
+        rcu::Published<Index> byName;
+    };
+}
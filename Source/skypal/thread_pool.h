@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads for the parallel half of the two-phase kernels (snapshot.h).
+// ParallelFor hands chunks out from a shared counter; the calling thread works on its own job
+// too, so a call never waits on a pool that is busy with other callers' work.
+namespace skypal {
+
+    class ThreadPool {
+    public:
+        explicit ThreadPool(std::size_t threadCount) {
+            for (std::size_t i = 0; i < threadCount; i++) {
+                workers.emplace_back([this]() { WorkLoop(); });
+            }
+        }
+
+        ~ThreadPool() {
+            {
+                std::lock_guard lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (auto& worker : workers) {
+                worker.join();
+            }
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        std::size_t ThreadCount() const { return workers.size(); }
+
+        // calls fn(chunk) for every chunk in [0, chunkCount), returns once all of them have run
+        void ParallelFor(std::size_t chunkCount, const std::function<void(std::size_t)>& fn) {
+            if (chunkCount == 0) {
+                return;
+            }
+            if (chunkCount == 1 || workers.empty()) {
+                for (std::size_t chunk = 0; chunk < chunkCount; chunk++) {
+                    fn(chunk);
+                }
+                return;
+            }
+
+            auto job = std::make_shared<Job>(fn, chunkCount);
+            {
+                std::lock_guard lock(mutex);
+                jobs.push_back(job);
+            }
+            wake.notify_all();
+
+            job->RunChunks();
+
+            std::unique_lock lock(job->mutex);
+            job->finished.wait(lock, [&]() { return job->done.load(std::memory_order_acquire) == chunkCount; });
+        }
+
+    private:
+        struct Job {
+            Job(const std::function<void(std::size_t)>& fn, std::size_t chunkCount) : fn(fn), chunkCount(chunkCount) {}
+
+            // returns once no chunks are left to start
+            void RunChunks() {
+                while (true) {
+                    std::size_t chunk = next.fetch_add(1, std::memory_order_relaxed);
+                    if (chunk >= chunkCount) {
+                        return;
+                    }
+                    fn(chunk);
+                    if (done.fetch_add(1, std::memory_order_acq_rel) + 1 == chunkCount) {
+                        std::lock_guard lock(mutex);
+                        finished.notify_all();
+                    }
+                }
+            }
+
+            bool Exhausted() const { return next.load(std::memory_order_relaxed) >= chunkCount; }
+
+            const std::function<void(std::size_t)>& fn;
+            std::size_t chunkCount;
+            std::atomic<std::size_t> next = 0;
+            std::atomic<std::size_t> done = 0;
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+
+        void WorkLoop() {
+            while (true) {
+                std::shared_ptr<Job> job;
+                {
+                    std::unique_lock lock(mutex);
+                    wake.wait(lock, [this]() {
+                        while (!jobs.empty() && jobs.front()->Exhausted()) {
+                            jobs.pop_front();
+                        }
+                        return stopping || !jobs.empty();
+                    });
+                    if (stopping) {
+                        return;
+                    }
+                    job = jobs.front();
+                }
+                job->RunChunks();
+            }
+        }
+
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::deque<std::shared_ptr<Job>> jobs;
+        bool stopping = false;
+    };
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Begin / end events for native calls, written out as Chrome trace_event JSON
+// (chrome://tracing, Perfetto, Tracy's import-chrome).
+// Each thread appends to its own fixed size buffer, so recording never takes a lock.
+namespace skypal::trace {
+
+    inline std::atomic<bool> enabled = false;
+
+    // the OS thread id, as debuggers and other profilers show it
+    inline std::uint32_t CurrentThreadId() {
+#ifdef _WIN32
+        return static_cast<std::uint32_t>(::GetCurrentThreadId());
+#else
+        return static_cast<std::uint32_t>(::syscall(SYS_gettid));
+#endif
+    }
+
+    struct Event {
+        const char* name;
+        std::uint64_t timestampNs;
+        std::uint64_t size;
+        char phase;
+    };
+
+    // Only the owning thread writes events, count and session; the writer of the JSON reads
+    // session, then count, with acquire and never looks past count.
+    struct ThreadBuffer {
+        static constexpr std::size_t kCapacity = 1 << 16;
+
+        std::uint32_t threadId = 0;  // set before the buffer is shared
+        std::atomic<std::uint32_t> session = 0;
+        std::atomic<std::size_t> count = 0;
+        std::atomic<std::size_t> dropped = 0;
+        std::unique_ptr<Event[]> events = std::make_unique<Event[]>(kCapacity);
+    };
+
+    class Tracer {
+    public:
+        static Tracer* GetSingleton() {
+            static Tracer singleton;
+            return &singleton;
+        }
+
+        void Start() {
+            origin = std::chrono::steady_clock::now();
+            session.fetch_add(1, std::memory_order_acq_rel);
+            enabled.store(true, std::memory_order_release);
+        }
+
+        void Stop() {
+            enabled.store(false, std::memory_order_release);
+        }
+
+        void Begin(const char* name, std::size_t inputSize) {
+            Append({ name, Now(), inputSize, 'B' });
+        }
+
+        void End(const char* name, std::size_t outputSize) {
+            Append({ name, Now(), outputSize, 'E' });
+        }
+
+        // writes every event of the current session, returns false if the file can't be opened
+        bool WriteJson(const std::string& path) {
+            std::ofstream file(path, std::ios::trunc);
+            if (!file.is_open()) {
+                return false;
+            }
+
+            std::uint32_t currentSession = session.load(std::memory_order_acquire);
+            bool first = true;
+            file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+            std::lock_guard lock(mutex);
+            for (auto& buffer : buffers) {
+                if (buffer->session.load(std::memory_order_acquire) != currentSession) {
+                    continue;
+                }
+
+                if (!first) {
+                    file << ',';
+                }
+                first = false;
+                file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId
+                     << ",\"args\":{\"name\":\"skypal thread " << buffer->threadId << "\"}}";
+
+                std::size_t count = buffer->count.load(std::memory_order_acquire);
+                for (std::size_t i = 0; i < count; i++) {
+                    auto& event = buffer->events[i];
+                    file << ",{\"name\":\"" << event.name << "\",\"cat\":\"native\",\"ph\":\"" << event.phase
+                         << "\",\"ts\":" << (event.timestampNs / 1000) << '.' << (event.timestampNs % 1000 / 100)
+                         << ",\"pid\":1,\"tid\":" << buffer->threadId << ",\"args\":{\""
+                         << (event.phase == 'B' ? "input" : "output") << "\":" << event.size << "}}";
+                }
+            }
+            file << "]}\n";
+            return true;
+        }
+
+        std::size_t DroppedEvents() {
+            std::size_t dropped = 0;
+            std::lock_guard lock(mutex);
+            for (auto& buffer : buffers) {
+                dropped += buffer->dropped.load(std::memory_order_relaxed);
+            }
+            return dropped;
+        }
+
+    private:
+        Tracer() = default;
+
+        std::uint64_t Now() const {
+            return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count());
+        }
+
+        void Append(const Event& event) {
+            ThreadBuffer* buffer = LocalBuffer();
+
+            // A new session clears the buffer, done by the owning thread so count has a single
+            // writer. The session is published last, so a reader that sees it sees the cleared count.
+            std::uint32_t currentSession = session.load(std::memory_order_acquire);
+            if (buffer->session.load(std::memory_order_relaxed) != currentSession) {
+                buffer->count.store(0, std::memory_order_relaxed);
+                buffer->dropped.store(0, std::memory_order_relaxed);
+                buffer->session.store(currentSession, std::memory_order_release);
+            }
+
+            std::size_t index = buffer->count.load(std::memory_order_relaxed);
+            if (index >= ThreadBuffer::kCapacity) {
+                buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            buffer->events[index] = event;
+            buffer->count.store(index + 1, std::memory_order_release);
+        }
+
+        ThreadBuffer* LocalBuffer() {
+            thread_local ThreadBuffer* localBuffer = nullptr;
+            if (!localBuffer) {
+                std::lock_guard lock(mutex);
+                auto& buffer = buffers.emplace_back(std::make_unique<ThreadBuffer>());
+                buffer->threadId = CurrentThreadId();
+                localBuffer = buffer.get();
+            }
+            return localBuffer;
+        }
+
+        std::mutex mutex;
+        std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+        std::atomic<std::uint32_t> session = 0;
+        std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    };
+}
@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+"""Compares skypal_bench runs against a stored baseline.
+
+  compare_bench.py update <run.json> <baseline.json>
+      condenses a --benchmark_out run into a baseline: per case, the fastest repetition and
+      the noise (1.4826 * median absolute deviation) over the repetitions
+
+  compare_bench.py check <baseline.json> <run.json> [--threshold 0.10] [--sigmas 3] [--worst 15]
+      fails when a case got slower than the baseline by more than the threshold, and the
+      slowdown is also outside the noise band of both runs
+
+Run the benchmark with --benchmark_repetitions so there is noise to measure; a single
+repetition gets a zero band and only the threshold applies. Only the standard library is used.
+"""
+
+import argparse
+import json
+import math
+import statistics
+import sys
+
+BASELINE_VERSION = 1
+
+
+def load_run(path):
+    """name -> list of real times in ns, one per repetition"""
+    with open(path) as file:
+        run = json.load(file)
+
+    scale = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+    times = {}
+    for case in run.get("benchmarks", []):
+        if case.get("run_type", "iteration") != "iteration" or case.get("error_occurred"):
+            continue
+        name = case.get("run_name", case["name"])
+        times.setdefault(name, []).append(case["real_time"] * scale[case.get("time_unit", "ns")])
+    return run.get("context", {}), times
+
+
+def summarize(samples):
+    # other processes only ever add time, so the fastest repetition is the least disturbed
+    median = statistics.median(samples)
+    mad = statistics.median(abs(sample - median) for sample in samples)
+    return {"best_ns": min(samples), "noise_ns": 1.4826 * mad, "repetitions": len(samples)}
+
+
+def update(args):
+    context, times = load_run(args.run)
+    baseline = {
+        "version": BASELINE_VERSION,
+        "context": {key: context.get(key) for key in ("host_name", "num_cpus", "mhz_per_cpu", "library_build_type")},
+        "cases": {name: summarize(samples) for name, samples in sorted(times.items())},
+    }
+    with open(args.baseline, "w") as file:
+        json.dump(baseline, file, indent=1, sort_keys=True)
+        file.write("\n")
+    print(f"wrote {len(baseline['cases'])} cases to {args.baseline}")
+    return 0
+
+
+def check(args):
+    with open(args.baseline) as file:
+        baseline = json.load(file)
+    if baseline.get("version") != BASELINE_VERSION:
+        print(f"{args.baseline} is baseline version {baseline.get('version')}, expected {BASELINE_VERSION}")
+        return 2
+
+    context, times = load_run(args.run)
+    base_cases = baseline["cases"]
+
+    base_host = baseline.get("context", {}).get("host_name")
+    if base_host != context.get("host_name"):
+        print(f"warning: the baseline was recorded on {base_host}, this run is from {context.get('host_name')}")
+
+    rows = []
+    for name, samples in times.items():
+        base = base_cases.get(name)
+        if not base or base["best_ns"] <= 0:
+            continue
+        current = summarize(samples)
+        change = current["best_ns"] / base["best_ns"] - 1.0
+        band = args.sigmas * math.hypot(base["noise_ns"], current["noise_ns"]) / base["best_ns"]
+        regressed = change > args.threshold and change > band
+        rows.append((change, band, regressed, name, base["best_ns"], current["best_ns"]))
+
+    rows.sort(reverse=True)
+    regressions = [row for row in rows if row[2]]
+
+    print(f"{len(rows)} cases compared, threshold +{args.threshold:.0%}, noise band {args.sigmas:g} sigma")
+    print(f"{'change':>9} {'noise':>8}  {'baseline':>12} {'current':>12}  case")
+    for change, band, regressed, name, base_ns, current_ns in rows[: args.worst]:
+        flag = "  REGRESSED" if regressed else ""
+        print(f"{change:+9.1%} {band:>7.1%}  {base_ns / 1e3:>10.1f}us {current_ns / 1e3:>10.1f}us  {name}{flag}")
+
+    missing = sorted(set(base_cases) - set(times))
+    added = sorted(set(times) - set(base_cases))
+    if missing:
+        print(f"{len(missing)} baseline cases didn't run, e.g. {missing[0]}")
+    if added:
+        print(f"{len(added)} cases have no baseline yet, e.g. {added[0]}")
+
+    if regressions:
+        print(f"FAILED: {len(regressions)} cases regressed")
+        return 1
+    print("passed")
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    update_parser = commands.add_parser("update")
+    update_parser.add_argument("run")
+    update_parser.add_argument("baseline")
+    update_parser.set_defaults(handler=update)
+
+    check_parser = commands.add_parser("check")
+    check_parser.add_argument("baseline")
+    check_parser.add_argument("run")
+    check_parser.add_argument("--threshold", type=float, default=0.10)
+    check_parser.add_argument("--sigmas", type=float, default=3.0)
+    check_parser.add_argument("--worst", type=int, default=15)
+    check_parser.set_defaults(handler=check)
+
+    args = parser.parse_args()
+    return args.handler(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,51 @@
+#include "mock_world.h"
+
+// Instantiates every core kernel with the mock traits, so the library alone proves the core
+// builds without the game and gives perf / valgrind one set of symbols to attribute to.
+namespace skypal::core {
+    using skypal::mock::Traits;
+
+    template int CountDisabled<Traits>(RefSpan<Traits>);
+    template int CountEnabled<Traits>(RefSpan<Traits>);
+    template RefVector<Traits> FilterBases<Traits>(RefSpan<Traits>, std::span<const Traits::Form>, std::string_view);
+    template RefVector<Traits> FilterBasesFormList<Traits>(RefSpan<Traits>, Traits::FormList, std::string_view);
+    template RefVector<Traits> FilterFormTypes<Traits>(RefSpan<Traits>, std::span<const int>, std::string_view);
+    template std::vector<Traits::Form> FromReferences<Traits>(RefSpan<Traits>, std::string_view);
+    template RefVector<Traits> FilterEnabled<Traits>(RefSpan<Traits>, std::string_view);
+    template RefVector<Traits> FilterDeleted<Traits>(RefSpan<Traits>, std::string_view);
+    template RefVector<Traits> Filter3DLoaded<Traits>(RefSpan<Traits>, std::string_view);
+    template RefVector<Traits> FilterOffLimits<Traits>(RefSpan<Traits>, std::string_view);
+    template RefVector<Traits> FilterInventoryObjects<Traits>(RefSpan<Traits>, std::string_view);
+    template RefVector<Traits> FilterPlayableObjects<Traits>(RefSpan<Traits>, std::string_view);
+    template RefVector<Traits> FilterQuestObjects<Traits>(RefSpan<Traits>, std::string_view);
+    template RefVector<Traits> FilterCollisionLayerTypes<Traits>(RefSpan<Traits>, std::span<const int>, std::string_view);
+    template RefVector<Traits> FilterWorldspace<Traits>(RefSpan<Traits>, Traits::Worldspace, std::string_view);
+    template RefVector<Traits> FilterDistance<Traits>(RefSpan<Traits>, float, Traits::Ref, std::string_view);
+    template RefVector<Traits> SortDistance<Traits>(RefSpan<Traits>, Traits::Ref, std::string_view);
+    template RefVector<Traits> FilterKeywords<Traits>(RefSpan<Traits>, std::span<const Traits::Keyword>, std::string_view);
+    template RefVector<Traits> FilterOwners<Traits>(RefSpan<Traits>, std::span<const Traits::Actor>, std::string_view);
+    template RefVector<Traits> FilterPotentialThieves<Traits>(RefSpan<Traits>, std::span<const Traits::Actor>, std::string_view);
+
+    // the Count_ natives
+    template int FilterBases<Traits, Count>(RefSpan<Traits>, std::span<const Traits::Form>, std::string_view);
+    template int FilterBasesFormList<Traits, Count>(RefSpan<Traits>, Traits::FormList, std::string_view);
+    template int FilterFormTypes<Traits, Count>(RefSpan<Traits>, std::span<const int>, std::string_view);
+    template int FilterEnabled<Traits, Count>(RefSpan<Traits>, std::string_view);
+    template int FilterDeleted<Traits, Count>(RefSpan<Traits>, std::string_view);
+    template int Filter3DLoaded<Traits, Count>(RefSpan<Traits>, std::string_view);
+    template int FilterOffLimits<Traits, Count>(RefSpan<Traits>, std::string_view);
+    template int FilterInventoryObjects<Traits, Count>(RefSpan<Traits>, std::string_view);
+    template int FilterPlayableObjects<Traits, Count>(RefSpan<Traits>, std::string_view);
+    template int FilterQuestObjects<Traits, Count>(RefSpan<Traits>, std::string_view);
+    template int FilterCollisionLayerTypes<Traits, Count>(RefSpan<Traits>, std::span<const int>, std::string_view);
+    template int FilterWorldspace<Traits, Count>(RefSpan<Traits>, Traits::Worldspace, std::string_view);
+    template int FilterDistance<Traits, Count>(RefSpan<Traits>, float, Traits::Ref, std::string_view);
+    template int FilterKeywords<Traits, Count>(RefSpan<Traits>, std::span<const Traits::Keyword>, std::string_view);
+    template int FilterOwners<Traits, Count>(RefSpan<Traits>, std::span<const Traits::Actor>, std::string_view);
+    template int FilterPotentialThieves<Traits, Count>(RefSpan<Traits>, std::span<const Traits::Actor>, std::string_view);
+
+    // the Any_ and First_ natives the benchmarks cover
+    template bool FilterKeywords<Traits, Any>(RefSpan<Traits>, std::span<const Traits::Keyword>, std::string_view);
+    template Traits::Ref FilterOwners<Traits, First>(RefSpan<Traits>, std::span<const Traits::Actor>, std::string_view);
+    template Traits::Ref FilterDistance<Traits, First>(RefSpan<Traits>, float, Traits::Ref, std::string_view);
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "skypal/core.h"
+#include "skypal/names.h"
+#include "skypal/plugins.h"
+#include "skypal/snapshot.h"
+
+// Plain structs standing in for the game types, so skypal::core can be built and profiled
+// without Skyrim. Field names follow the engine getters that EngineTraits calls.
+namespace skypal::mock {
+
+    struct Keyword {
+        std::uint32_t formId = 0;
+    };
+
+    struct Faction {
+        std::uint32_t formId = 0;
+    };
+
+    struct Npc {
+        std::uint32_t formId = 0;
+    };
+
+    // a base object
+    struct Form {
+        std::uint32_t formId = 0;
+        int formType = 0;
+        std::vector<const Keyword*> keywords;
+        std::string name;
+    };
+
+    // the name the name benchmarks look for, which shares no word with NameFor's other names
+    constexpr std::string_view kTargetName = "Sanguine Rose";
+
+    // A made-up display name that only depends on the form id, so world files don't store names.
+    // About one form in eight has none, like the game's statics and markers, and one in 128 of the
+    // others is kTargetName.
+    inline std::string NameFor(std::uint32_t formId) {
+        static constexpr const char* kAdjectives[] = { "Iron", "Steel", "Elven", "Glass", "Ebony", "Daedric", "Ancient Nord",
+            "Dwarven", "Orcish", "Imperial", "Stormcloak", "Fine", "Hide", "Leather", "Silver", "Gilded" };
+        static constexpr const char* kNouns[] = { "Sword", "Dagger", "War Axe", "Mace", "Greatsword", "Bow", "Helmet", "Gauntlets",
+            "Boots", "Shield", "Cuirass", "Arrow", "Ring", "Necklace", "Tankard", "Goblet", "Bowl", "Basket", "Cabbage", "Potion",
+            "Chest", "Barrel", "Sack", "Bedroll", "Lantern", "Book", "Soul Gem", "Ingot", "Ore", "Pelt", "Tapestry" };
+        auto hash = formId * 0x9E3779B1u;
+        if ((hash >> 29) == 0) {
+            return {};
+        }
+        if (((hash >> 22) & 0x7F) == 1) {
+            return std::string(kTargetName);
+        }
+        return std::string(kAdjectives[(hash >> 8) % std::size(kAdjectives)]) + " " + kNouns[(hash >> 16) % std::size(kNouns)];
+    }
+
+    struct FormList {
+        std::vector<const Form*> forms;
+        std::vector<const FormList*> lists;  // nested formlists are searched too, like BGSListForm::HasForm
+
+        bool HasForm(const Form* form) const {
+            for (auto* listForm : forms) {
+                if (listForm == form) {
+                    return true;
+                }
+            }
+            for (auto* list : lists) {
+                if (list->HasForm(form)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    struct EncounterZone {
+        const Faction* ownerFaction = nullptr;
+        const Npc* ownerNpc = nullptr;
+        int ownerRank = 0;
+    };
+
+    struct Worldspace {
+        const EncounterZone* encounterZone = nullptr;
+    };
+
+    struct Cell {
+        bool attached = false;
+        const Npc* actorOwner = nullptr;
+        const Faction* factionOwner = nullptr;
+        const EncounterZone* encounterZone = nullptr;
+        const Worldspace* worldspace = nullptr;
+    };
+
+    struct Position {
+        float x = 0.0f;
+        float y = 0.0f;
+        float z = 0.0f;
+    };
+
+    struct Ref {
+        std::uint32_t formId = 0;
+        const Form* base = nullptr;
+        const Cell* cell = nullptr;
+        Position position;
+        bool disabled = false;
+        bool deleted = false;
+        bool loaded3D = false;
+        bool offLimits = false;
+        bool inventoryObject = false;
+        bool playable = false;
+        bool questObject = false;
+        int collisionLayer = 0;
+        const Npc* actorOwner = nullptr;
+        const Faction* factionOwner = nullptr;
+        const EncounterZone* encounterZone = nullptr;
+    };
+
+    struct Actor {
+        const Npc* base = nullptr;
+        std::vector<std::pair<const Faction*, int>> factions;
+    };
+
+    // Owns everything the refs point at; deques keep the addresses stable while it grows.
+    struct World {
+        std::deque<Keyword> keywords;
+        std::deque<Faction> factions;
+        std::deque<Npc> npcs;
+        std::deque<Form> forms;
+        std::deque<FormList> formLists;
+        std::deque<EncounterZone> encounterZones;
+        std::deque<Worldspace> worldspaces;
+        std::deque<Cell> cells;
+        std::deque<Ref> refs;
+        std::deque<Actor> actors;
+        Ref player;  // the default "from" ref of the distance filters, at the origin
+
+        std::vector<const Ref*> AllRefs() const {
+            std::vector<const Ref*> all;
+            all.reserve(refs.size());
+            for (auto& ref : refs) {
+                all.push_back(&ref);
+            }
+            return all;
+        }
+
+        std::vector<const Ref*> GridRefs() const {
+            std::vector<const Ref*> grid;
+            for (auto& ref : refs) {
+                if (ref.cell && ref.cell->attached) {
+                    grid.push_back(&ref);
+                }
+            }
+            return grid;
+        }
+    };
+
+    struct Traits {
+        using Ref = const mock::Ref*;
+        using Form = const mock::Form*;
+        using FormList = const mock::FormList*;
+        using Keyword = const mock::Keyword*;
+        using Actor = const mock::Actor*;
+        using Npc = const mock::Npc*;
+        using Faction = const mock::Faction*;
+        using Cell = const mock::Cell*;
+        using Worldspace = const mock::Worldspace*;
+        using EncounterZone = const mock::EncounterZone*;
+
+        static Form GetBase(Ref ref) { return ref->base; }
+        static int GetBaseFormType(Ref ref) { return ref->base ? ref->base->formType : 0; }
+        static bool ListHasForm(FormList list, Form form) { return list->HasForm(form); }
+
+        static bool HasKeyword(Ref ref, Keyword keyword) {
+            if (!ref->base) {
+                return false;
+            }
+            for (auto* baseKeyword : ref->base->keywords) {
+                if (baseKeyword == keyword) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // keywords only come from the base here
+        static const void* KeywordSetKey(Ref ref) { return ref->base; }
+
+        template <class Visit>
+        static void ForEachKeyword(Ref ref, Visit&& visit) {
+            if (ref->base) {
+                for (auto* keyword : ref->base->keywords) {
+                    visit(keyword);
+                }
+            }
+        }
+
+        static std::uint32_t GetFormId(Ref ref) { return ref->formId; }
+
+        // refs here are always named after their base
+        static const void* NameKey(Ref ref) { return ref->base; }
+        static std::string_view GetName(Ref ref) { return ref->base ? std::string_view(ref->base->name) : std::string_view(); }
+
+        static Position GetPosition(Ref ref) { return ref->position; }
+        static bool IsDisabled(Ref ref) { return ref->disabled; }
+        static bool IsDeleted(Ref ref) { return ref->deleted; }
+        static bool Is3DLoaded(Ref ref) { return ref->loaded3D; }
+        static bool IsOffLimits(Ref ref) { return ref->offLimits; }
+        static bool IsInventoryObject(Ref ref) { return ref->inventoryObject; }
+        static bool IsPlayable(Ref ref) { return ref->playable; }
+        static bool IsQuestObject(Ref ref) { return ref->questObject; }
+        static int GetCollisionLayer(Ref ref) { return ref->collisionLayer; }
+        static Cell GetParentCell(Ref ref) { return ref->cell; }
+        static bool IsAttached(Cell cell) { return cell->attached; }
+        static Worldspace GetWorldspace(Ref ref) { return ref->cell ? ref->cell->worldspace : nullptr; }
+        static Npc GetActorBase(Actor actor) { return actor->base; }
+
+        static int GetFactionRank(Actor actor, Faction faction) {
+            for (auto& [actorFaction, rank] : actor->factions) {
+                if (actorFaction == faction) {
+                    return rank;
+                }
+            }
+            return -2;
+        }
+
+        static Npc GetActorOwner(Ref ref) { return ref->actorOwner; }
+        static Faction GetFactionOwner(Ref ref) { return ref->factionOwner; }
+        static EncounterZone GetEncounterZone(Ref ref) { return ref->encounterZone; }
+        static Npc GetCellActorOwner(Cell cell) { return cell->actorOwner; }
+        static Faction GetCellFactionOwner(Cell cell) { return cell->factionOwner; }
+        static EncounterZone GetCellEncounterZone(Cell cell) { return cell->encounterZone; }
+        static EncounterZone GetWorldspaceEncounterZone(Worldspace worldspace) { return worldspace->encounterZone; }
+        static bool ZoneHasOwner(EncounterZone zone) { return zone->ownerFaction || zone->ownerNpc; }
+        static Faction GetZoneOwnerFaction(EncounterZone zone) { return zone->ownerFaction; }
+        static Npc GetZoneOwnerNpc(EncounterZone zone) { return zone->ownerNpc; }
+        static int GetZoneOwnerRank(EncounterZone zone) { return zone->ownerRank; }
+    };
+
+    static_assert(core::RefTraits<Traits>);
+    static_assert(snapshot::SnapshotTraits<Traits>);
+    static_assert(names::NameTraits<Traits>);
+    static_assert(plugins::PluginTraits<Traits>);
+}
@@ -0,0 +1,591 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "mock_world.h"
+#include "skypal/record.h"
+#include "world_file.h"
+#include "world_generator.h"
+
+// skypal_replay <recording> [--profile=<name> | --world=<file>] [--repeat=<n>]
+//
+// Runs the native calls of a recording made with SkyPal.Start_Recording() against the core on a
+// mock world, one after the other on this thread, and compares each function's time with the
+// game's. Form ids are mapped onto the world's entities in order of first use, so different ids
+// stay different refs, bases or keywords, but what passes a filter depends on the mock world, not
+// the game. Calls that change the world (Disable, Enable, Change_Collision_Layer_Type) are counted
+// and skipped. Run it under perf or VTune to profile a session's workload.
+namespace {
+    using skypal::mock::Traits;
+    using skypal::record::ArgType;
+    using skypal::record::RecordType;
+    namespace core = skypal::core;
+    namespace mock = skypal::mock;
+
+    // scalars are stored as arrays of one
+    struct Arg {
+        ArgType type{};
+        std::vector<std::uint32_t> forms;
+        std::vector<std::int32_t> ints;
+        std::vector<float> floats;
+        std::vector<std::string> strings;
+    };
+
+    struct Call {
+        std::uint16_t functionId = 0;
+        std::uint32_t thread = 0;
+        std::uint64_t startNs = 0;
+        std::uint64_t durationNs = 0;
+        std::uint32_t outputSize = 0;
+        std::vector<Arg> args;
+    };
+
+    struct Recording {
+        std::unordered_map<std::uint16_t, std::string> functions;
+        std::vector<Call> calls;
+    };
+
+    class Reader {
+    public:
+        explicit Reader(const char* path) : in(path, std::ios::binary) {}
+
+        template <class T>
+        T Get() {
+            T value{};
+            in.read(reinterpret_cast<char*>(&value), sizeof(T));
+            return value;
+        }
+
+        std::string GetString(std::size_t size) {
+            std::string string(size, '\0');
+            in.read(string.data(), static_cast<std::streamsize>(size));
+            return string;
+        }
+
+        bool Ok() const { return static_cast<bool>(in); }
+        bool AtEnd() { return in.peek() == std::char_traits<char>::eof(); }
+
+    private:
+        std::ifstream in;
+    };
+
+    bool ReadArg(Reader& in, Arg& arg) {
+        arg.type = in.Get<ArgType>();
+        auto raw = static_cast<std::uint8_t>(arg.type);
+        if (raw < static_cast<std::uint8_t>(ArgType::kInt) || raw > static_cast<std::uint8_t>(ArgType::kFormArray)) {
+            return false;
+        }
+
+        bool isArray = raw >= static_cast<std::uint8_t>(ArgType::kIntArray);
+        auto element = static_cast<ArgType>(isArray ? raw - 5 : raw);
+        std::uint32_t count = isArray ? in.Get<std::uint32_t>() : 1;
+        for (std::uint32_t i = 0; i < count && in.Ok(); i++) {
+            switch (element) {
+            case ArgType::kInt:
+                arg.ints.push_back(in.Get<std::int32_t>());
+                break;
+            case ArgType::kFloat:
+                arg.floats.push_back(in.Get<float>());
+                break;
+            case ArgType::kBool:
+                arg.ints.push_back(in.Get<std::uint8_t>());
+                break;
+            case ArgType::kString:
+                arg.strings.push_back(in.GetString(in.Get<std::uint32_t>()));
+                break;
+            default:
+                arg.forms.push_back(in.Get<std::uint32_t>());
+                break;
+            }
+        }
+        return in.Ok();
+    }
+
+    bool ReadRecording(const char* path, Recording& recording) {
+        Reader in(path);
+        auto magic = in.Get<std::array<char, 4>>();
+        if (!in.Ok() || std::memcmp(magic.data(), skypal::record::kMagic, 4) != 0 ||
+            in.Get<std::uint32_t>() != skypal::record::kVersion) {
+            std::fprintf(stderr, "%s isn't a skypal recording of version %u\n", path, skypal::record::kVersion);
+            return false;
+        }
+
+        while (!in.AtEnd()) {
+            auto type = in.Get<RecordType>();
+            if (type == RecordType::kFunction) {
+                auto id = in.Get<std::uint16_t>();
+                recording.functions[id] = in.GetString(in.Get<std::uint16_t>());
+            }
+            else if (type == RecordType::kCall) {
+                Call call;
+                call.functionId = in.Get<std::uint16_t>();
+                call.thread = in.Get<std::uint32_t>();
+                call.startNs = in.Get<std::uint64_t>();
+                call.durationNs = in.Get<std::uint64_t>();
+                call.outputSize = in.Get<std::uint32_t>();
+                auto argCount = in.Get<std::uint8_t>();
+                call.args.resize(argCount);
+                for (auto& arg : call.args) {
+                    if (!ReadArg(in, arg)) {
+                        break;
+                    }
+                }
+                if (!in.Ok()) {
+                    // a recording cut short by a crash still replays up to the last whole call
+                    std::fprintf(stderr, "recording ends mid call after %zu calls\n", recording.calls.size());
+                    break;
+                }
+                recording.calls.push_back(std::move(call));
+            }
+            else {
+                std::fprintf(stderr, "unknown record type %u after %zu calls\n", static_cast<unsigned>(type), recording.calls.size());
+                break;
+            }
+        }
+
+        // calls from several threads are written as they finish, replay them as they started
+        std::stable_sort(recording.calls.begin(), recording.calls.end(), [](const Call& a, const Call& b) { return a.startNs < b.startNs; });
+        return true;
+    }
+
+    // Hands out the world's entities to form ids in order of first use.
+    template <class T>
+    class IdMap {
+    public:
+        const T* Get(std::uint32_t formId, const std::deque<T>& items) {
+            if (formId == 0 || items.empty()) {
+                return nullptr;
+            }
+            auto [it, added] = mapped.try_emplace(formId, nullptr);
+            if (added) {
+                it->second = &items[next++ % items.size()];
+            }
+            return it->second;
+        }
+
+    private:
+        std::unordered_map<std::uint32_t, const T*> mapped;
+        std::size_t next = 0;
+    };
+
+    class Mapper {
+    public:
+        explicit Mapper(const mock::World& world) : world(world) {}
+
+        const mock::Ref* Ref(std::uint32_t formId) {
+            return formId == mock::kPlayerFormId ? &world.player : refs.Get(formId, world.refs);
+        }
+
+        const mock::Form* Form(std::uint32_t formId) { return forms.Get(formId, world.forms); }
+        const mock::Keyword* Keyword(std::uint32_t formId) { return keywords.Get(formId, world.keywords); }
+        const mock::Actor* Actor(std::uint32_t formId) { return actors.Get(formId, world.actors); }
+        const mock::Worldspace* Worldspace(std::uint32_t formId) { return worldspaces.Get(formId, world.worldspaces); }
+
+        // uniform worlds have no formlists, those get one made of the first bases
+        const mock::FormList* FormList(std::uint32_t formId) {
+            if (world.formLists.empty()) {
+                if (fallbackLists.empty()) {
+                    auto& list = fallbackLists.emplace_back();
+                    for (std::size_t i = 0; i < 16 && i < world.forms.size(); i++) {
+                        list.forms.push_back(&world.forms[i]);
+                    }
+                }
+                return formId ? &fallbackLists.front() : nullptr;
+            }
+            return formLists.Get(formId, world.formLists);
+        }
+
+        template <class T, class Lookup>
+        std::vector<const T*> Array(const Arg& arg, Lookup lookup) {
+            std::vector<const T*> mapped;
+            mapped.reserve(arg.forms.size());
+            for (auto formId : arg.forms) {
+                mapped.push_back((this->*lookup)(formId));
+            }
+            return mapped;
+        }
+
+        std::vector<const mock::Ref*> Refs(const Arg& arg) { return Array<mock::Ref>(arg, &Mapper::Ref); }
+        std::vector<const mock::Form*> Forms(const Arg& arg) { return Array<mock::Form>(arg, &Mapper::Form); }
+        std::vector<const mock::Keyword*> Keywords(const Arg& arg) { return Array<mock::Keyword>(arg, &Mapper::Keyword); }
+        std::vector<const mock::Actor*> Actors(const Arg& arg) { return Array<mock::Actor>(arg, &Mapper::Actor); }
+
+        const mock::World& world;
+
+    private:
+        IdMap<mock::Ref> refs;
+        IdMap<mock::Form> forms;
+        IdMap<mock::Keyword> keywords;
+        IdMap<mock::Actor> actors;
+        IdMap<mock::Worldspace> worldspaces;
+        IdMap<mock::FormList> formLists;
+        std::deque<mock::FormList> fallbackLists;
+    };
+
+    // a recorded call's arguments, ready for the core, prepared outside the timed region
+    using Prepared = std::function<std::size_t()>;
+    using Preparer = std::function<Prepared(const Call&, Mapper&)>;
+
+    const std::string& Mode(const Call& call, std::size_t index) {
+        static const std::string empty;
+        return index < call.args.size() && !call.args[index].strings.empty() ? call.args[index].strings[0] : empty;
+    }
+
+    std::uint32_t FormArg(const Call& call, std::size_t index) {
+        return index < call.args.size() && !call.args[index].forms.empty() ? call.args[index].forms[0] : 0;
+    }
+
+    const Arg& ArrayArg(const Call& call, std::size_t index) {
+        static const Arg empty;
+        return index < call.args.size() ? call.args[index] : empty;
+    }
+
+    // an array's size, a Count_ native's count, or 1 if an Any_ or First_ native found a ref
+    template <class Result>
+    std::size_t OutputSize(const Result& result) {
+        if constexpr (requires { result.size(); }) {
+            return result.size();
+        }
+        else if constexpr (std::is_pointer_v<Result>) {
+            return result ? 1 : 0;
+        }
+        else {
+            return static_cast<std::size_t>(result);
+        }
+    }
+
+    // refs, mode
+    template <auto Kernel>
+    Preparer RefsMode() {
+        return [](const Call& call, Mapper& map) -> Prepared {
+            return [refs = map.Refs(ArrayArg(call, 0)), mode = Mode(call, 1)]() { return OutputSize(Kernel(refs, mode)); };
+        };
+    }
+
+    // refs, list, mode
+    template <class MapList, class Kernel>
+    Preparer RefsListMode(MapList mapList, Kernel kernel) {
+        return [mapList, kernel](const Call& call, Mapper& map) -> Prepared {
+            return [refs = map.Refs(ArrayArg(call, 0)), list = mapList(map, ArrayArg(call, 1)), mode = Mode(call, 2), kernel]() {
+                return OutputSize(kernel(refs, list, mode));
+            };
+        };
+    }
+
+    std::map<std::string, Preparer, std::less<>> MakePreparers() {
+        auto forms = [](Mapper& map, const Arg& arg) { return map.Forms(arg); };
+        auto keywords = [](Mapper& map, const Arg& arg) { return map.Keywords(arg); };
+        auto actors = [](Mapper& map, const Arg& arg) { return map.Actors(arg); };
+        auto ints = [](Mapper&, const Arg& arg) { return std::vector<int>(arg.ints.begin(), arg.ints.end()); };
+
+        std::map<std::string, Preparer, std::less<>> preparers;
+
+        preparers["All"] = [](const Call&, Mapper& map) -> Prepared {
+            return [&map]() { return map.world.AllRefs().size(); };
+        };
+        preparers["Grid"] = [](const Call&, Mapper& map) -> Prepared {
+            return [&map]() { return map.world.GridRefs().size(); };
+        };
+        preparers["All_Filter_Bases"] = [](const Call& call, Mapper& map) -> Prepared {
+            return [&map, bases = map.Forms(ArrayArg(call, 0)), mode = Mode(call, 1)]() {
+                return core::FilterBases<Traits>(map.world.AllRefs(), bases, mode).size();
+            };
+        };
+        preparers["Grid_Filter_Bases"] = [](const Call& call, Mapper& map) -> Prepared {
+            return [&map, bases = map.Forms(ArrayArg(call, 0)), mode = Mode(call, 1)]() {
+                return core::FilterBases<Traits>(map.world.GridRefs(), bases, mode).size();
+            };
+        };
+        preparers["All_Filter_Bases_Form_List"] = [](const Call& call, Mapper& map) -> Prepared {
+            return [&map, list = map.FormList(FormArg(call, 0)), mode = Mode(call, 1)]() {
+                return list ? core::FilterBasesFormList<Traits>(map.world.AllRefs(), list, mode).size() : 0;
+            };
+        };
+        preparers["Grid_Filter_Bases_Form_List"] = [](const Call& call, Mapper& map) -> Prepared {
+            return [&map, list = map.FormList(FormArg(call, 0)), mode = Mode(call, 1)]() {
+                return list ? core::FilterBasesFormList<Traits>(map.world.GridRefs(), list, mode).size() : 0;
+            };
+        };
+
+        preparers["Count_Disabled"] = [](const Call& call, Mapper& map) -> Prepared {
+            return [refs = map.Refs(ArrayArg(call, 0))]() { return static_cast<std::size_t>(core::CountDisabled<Traits>(refs)); };
+        };
+        preparers["Count_Enabled"] = [](const Call& call, Mapper& map) -> Prepared {
+            return [refs = map.Refs(ArrayArg(call, 0))]() { return static_cast<std::size_t>(core::CountEnabled<Traits>(refs)); };
+        };
+
+        preparers["Filter_Bases"] = RefsListMode(forms, [](auto& refs, auto& bases, auto& mode) { return core::FilterBases<Traits>(refs, bases, mode); });
+        preparers["Filter_Form_Types"] = RefsListMode(ints, [](auto& refs, auto& types, auto& mode) { return core::FilterFormTypes<Traits>(refs, types, mode); });
+        preparers["Filter_Base_Form_Types"] = preparers["Filter_Form_Types"];
+        preparers["Filter_Collision_Layer_Types"] = RefsListMode(ints, [](auto& refs, auto& layers, auto& mode) { return core::FilterCollisionLayerTypes<Traits>(refs, layers, mode); });
+        preparers["Filter_Keywords"] = RefsListMode(keywords, [](auto& refs, auto& list, auto& mode) { return core::FilterKeywords<Traits>(refs, list, mode); });
+        preparers["Filter_Owners"] = RefsListMode(actors, [](auto& refs, auto& list, auto& mode) { return core::FilterOwners<Traits>(refs, list, mode); });
+        preparers["Filter_Potential_Thieves"] = RefsListMode(actors, [](auto& refs, auto& list, auto& mode) { return core::FilterPotentialThieves<Traits>(refs, list, mode); });
+
+        preparers["Filter_Bases_Form_List"] = [](const Call& call, Mapper& map) -> Prepared {
+            return [refs = map.Refs(ArrayArg(call, 0)), list = map.FormList(FormArg(call, 1)), mode = Mode(call, 2)]() {
+                return list ? core::FilterBasesFormList<Traits>(refs, list, mode).size() : 0;
+            };
+        };
+        preparers["Filter_WorldSpace"] = [](const Call& call, Mapper& map) -> Prepared {
+            return [refs = map.Refs(ArrayArg(call, 0)), worldspace = map.Worldspace(FormArg(call, 1)), mode = Mode(call, 2)]() {
+                return worldspace ? core::FilterWorldspace<Traits>(refs, worldspace, mode).size() : 0;
+            };
+        };
+        preparers["Filter_Distance"] = [](const Call& call, Mapper& map) -> Prepared {
+            float distance = ArrayArg(call, 1).floats.empty() ? 0.0f : ArrayArg(call, 1).floats[0];
+            return [refs = map.Refs(ArrayArg(call, 0)), distance, from = map.Ref(FormArg(call, 2)), mode = Mode(call, 3)]() {
+                return from ? core::FilterDistance<Traits>(refs, distance, from, mode).size() : 0;
+            };
+        };
+        preparers["Sort_Distance"] = [](const Call& call, Mapper& map) -> Prepared {
+            return [refs = map.Refs(ArrayArg(call, 0)), from = map.Ref(FormArg(call, 1)), mode = Mode(call, 2)]() {
+                return from ? core::SortDistance<Traits>(refs, from, mode).size() : 0;
+            };
+        };
+
+        preparers["Filter_Enabled"] = RefsMode<core::FilterEnabled<Traits>>();
+        preparers["Filter_Deleted"] = RefsMode<core::FilterDeleted<Traits>>();
+        preparers["Filter_3dLoaded"] = RefsMode<core::Filter3DLoaded<Traits>>();
+        preparers["Filter_OffLimits"] = RefsMode<core::FilterOffLimits<Traits>>();
+        preparers["Filter_InventoryObjects"] = RefsMode<core::FilterInventoryObjects<Traits>>();
+        preparers["Filter_PlayableObjects"] = RefsMode<core::FilterPlayableObjects<Traits>>();
+        preparers["Filter_QuestObjects"] = RefsMode<core::FilterQuestObjects<Traits>>();
+        preparers["From_References"] = RefsMode<core::FromReferences<Traits>>();
+
+        // the Count_ natives take the same arguments as their Filter_ natives
+        preparers["Count_Bases"] = RefsListMode(forms, [](auto& refs, auto& bases, auto& mode) { return core::FilterBases<Traits, core::Count>(refs, bases, mode); });
+        preparers["Count_Form_Types"] = RefsListMode(ints, [](auto& refs, auto& types, auto& mode) { return core::FilterFormTypes<Traits, core::Count>(refs, types, mode); });
+        preparers["Count_Base_Form_Types"] = preparers["Count_Form_Types"];
+        preparers["Count_Collision_Layer_Types"] = RefsListMode(ints, [](auto& refs, auto& layers, auto& mode) { return core::FilterCollisionLayerTypes<Traits, core::Count>(refs, layers, mode); });
+        preparers["Count_Keywords"] = RefsListMode(keywords, [](auto& refs, auto& list, auto& mode) { return core::FilterKeywords<Traits, core::Count>(refs, list, mode); });
+        preparers["Count_Owners"] = RefsListMode(actors, [](auto& refs, auto& list, auto& mode) { return core::FilterOwners<Traits, core::Count>(refs, list, mode); });
+        preparers["Count_Potential_Thieves"] = RefsListMode(actors, [](auto& refs, auto& list, auto& mode) { return core::FilterPotentialThieves<Traits, core::Count>(refs, list, mode); });
+        preparers["Count_Bases_Form_List"] = [](const Call& call, Mapper& map) -> Prepared {
+            return [refs = map.Refs(ArrayArg(call, 0)), list = map.FormList(FormArg(call, 1)), mode = Mode(call, 2)]() {
+                return list ? static_cast<std::size_t>(core::FilterBasesFormList<Traits, core::Count>(refs, list, mode)) : 0;
+            };
+        };
+        preparers["Count_WorldSpace"] = [](const Call& call, Mapper& map) -> Prepared {
+            return [refs = map.Refs(ArrayArg(call, 0)), worldspace = map.Worldspace(FormArg(call, 1)), mode = Mode(call, 2)]() {
+                return worldspace ? static_cast<std::size_t>(core::FilterWorldspace<Traits, core::Count>(refs, worldspace, mode)) : 0;
+            };
+        };
+        preparers["Count_Distance"] = [](const Call& call, Mapper& map) -> Prepared {
+            float distance = ArrayArg(call, 1).floats.empty() ? 0.0f : ArrayArg(call, 1).floats[0];
+            return [refs = map.Refs(ArrayArg(call, 0)), distance, from = map.Ref(FormArg(call, 2)), mode = Mode(call, 3)]() {
+                return from ? static_cast<std::size_t>(core::FilterDistance<Traits, core::Count>(refs, distance, from, mode)) : 0;
+            };
+        };
+        preparers["Count_Deleted"] = RefsMode<core::FilterDeleted<Traits, core::Count>>();
+        preparers["Count_3dLoaded"] = RefsMode<core::Filter3DLoaded<Traits, core::Count>>();
+        preparers["Count_OffLimits"] = RefsMode<core::FilterOffLimits<Traits, core::Count>>();
+        preparers["Count_InventoryObjects"] = RefsMode<core::FilterInventoryObjects<Traits, core::Count>>();
+        preparers["Count_PlayableObjects"] = RefsMode<core::FilterPlayableObjects<Traits, core::Count>>();
+        preparers["Count_QuestObjects"] = RefsMode<core::FilterQuestObjects<Traits, core::Count>>();
+
+        // so do the Any_ and First_ natives
+        preparers["Any_Form_Types"] = RefsListMode(ints, [](auto& refs, auto& types, auto& mode) { return core::FilterFormTypes<Traits, core::Any>(refs, types, mode); });
+        preparers["Any_Keywords"] = RefsListMode(keywords, [](auto& refs, auto& list, auto& mode) { return core::FilterKeywords<Traits, core::Any>(refs, list, mode); });
+        preparers["Any_Owners"] = RefsListMode(actors, [](auto& refs, auto& list, auto& mode) { return core::FilterOwners<Traits, core::Any>(refs, list, mode); });
+        preparers["First_Bases"] = RefsListMode(forms, [](auto& refs, auto& bases, auto& mode) { return core::FilterBases<Traits, core::First>(refs, bases, mode); });
+        preparers["First_Form_Types"] = RefsListMode(ints, [](auto& refs, auto& types, auto& mode) { return core::FilterFormTypes<Traits, core::First>(refs, types, mode); });
+        preparers["First_Keywords"] = RefsListMode(keywords, [](auto& refs, auto& list, auto& mode) { return core::FilterKeywords<Traits, core::First>(refs, list, mode); });
+        preparers["First_Owners"] = RefsListMode(actors, [](auto& refs, auto& list, auto& mode) { return core::FilterOwners<Traits, core::First>(refs, list, mode); });
+
+        // single ref natives, ref then array
+        preparers["CountNumberOfKeywordsRefHas"] = [](const Call& call, Mapper& map) -> Prepared {
+            return [ref = map.Ref(FormArg(call, 0)), list = map.Keywords(ArrayArg(call, 1))]() {
+                return ref ? static_cast<std::size_t>(core::CountKeywords<Traits>(ref, list)) : 0;
+            };
+        };
+        preparers["refHasAtLeastOneKeyword"] = [](const Call& call, Mapper& map) -> Prepared {
+            return [ref = map.Ref(FormArg(call, 0)), list = map.Keywords(ArrayArg(call, 1))]() {
+                return ref ? static_cast<std::size_t>(core::HasAnyKeyword<Traits>(ref, list)) : 0;
+            };
+        };
+        preparers["filter_keywordsOnRef"] = [](const Call& call, Mapper& map) -> Prepared {
+            return [ref = map.Ref(FormArg(call, 0)), list = map.Keywords(ArrayArg(call, 1)), negate = Mode(call, 2) == "!"]() {
+                std::size_t kept = 0;
+                for (auto* keyword : list) {
+                    kept += ref && keyword && Traits::HasKeyword(ref, keyword) != negate;
+                }
+                return kept;
+            };
+        };
+        preparers["ActorIsOwnerOfRef"] = [](const Call& call, Mapper& map) -> Prepared {
+            return [ref = map.Ref(FormArg(call, 0)), actor = map.Actor(FormArg(call, 1))]() {
+                return ref && actor ? static_cast<std::size_t>(core::ActorIsOwner<Traits>(ref, actor)) : 0;
+            };
+        };
+        preparers["ActorIsPotentialThiefOfRef"] = [](const Call& call, Mapper& map) -> Prepared {
+            return [ref = map.Ref(FormArg(call, 0)), actor = map.Actor(FormArg(call, 1))]() {
+                return ref && actor ? static_cast<std::size_t>(core::ActorIsPotentialThief<Traits>(ref, actor)) : 0;
+            };
+        };
+        preparers["CountOwnersForRef"] = [](const Call& call, Mapper& map) -> Prepared {
+            return [ref = map.Ref(FormArg(call, 0)), list = map.Actors(ArrayArg(call, 1))]() {
+                return ref ? static_cast<std::size_t>(core::CountOwners<Traits>(ref, list)) : 0;
+            };
+        };
+        preparers["CountPotentialThievesForRef"] = [](const Call& call, Mapper& map) -> Prepared {
+            return [ref = map.Ref(FormArg(call, 0)), list = map.Actors(ArrayArg(call, 1))]() {
+                return ref ? static_cast<std::size_t>(core::CountPotentialThieves<Traits>(ref, list)) : 0;
+            };
+        };
+        preparers["RefHasAtLeastOneOwner"] = [](const Call& call, Mapper& map) -> Prepared {
+            return [ref = map.Ref(FormArg(call, 0)), list = map.Actors(ArrayArg(call, 1))]() {
+                return ref ? static_cast<std::size_t>(core::AnyActor<Traits>(list, [&](auto actor) { return core::ActorIsOwner<Traits>(ref, actor); })) : 0;
+            };
+        };
+        preparers["RefHasAtLeastOnePotentialThief"] = [](const Call& call, Mapper& map) -> Prepared {
+            return [ref = map.Ref(FormArg(call, 0)), list = map.Actors(ArrayArg(call, 1))]() {
+                return ref ? static_cast<std::size_t>(core::AnyActor<Traits>(list, [&](auto actor) { return core::ActorIsPotentialThief<Traits>(ref, actor); })) : 0;
+            };
+        };
+        preparers["filter_OwnersOnRef"] = [](const Call& call, Mapper& map) -> Prepared {
+            return [ref = map.Ref(FormArg(call, 0)), list = map.Actors(ArrayArg(call, 1)), negate = Mode(call, 2) == "!"]() {
+                std::size_t kept = 0;
+                for (auto* actor : list) {
+                    kept += ref && actor && core::ActorIsOwner<Traits>(ref, actor) != negate;
+                }
+                return kept;
+            };
+        };
+        preparers["filter_PotentialThievesOnRef"] = [](const Call& call, Mapper& map) -> Prepared {
+            return [ref = map.Ref(FormArg(call, 0)), list = map.Actors(ArrayArg(call, 1)), negate = Mode(call, 2) == "!"]() {
+                std::size_t kept = 0;
+                for (auto* actor : list) {
+                    kept += ref && actor && core::ActorIsPotentialThief<Traits>(ref, actor) != negate;
+                }
+                return kept;
+            };
+        };
+
+        return preparers;
+    }
+
+    struct FunctionTotals {
+        std::size_t calls = 0;
+        std::size_t skipped = 0;
+        std::uint64_t inputElements = 0;
+        std::uint64_t recordedNs = 0;
+        std::uint64_t replayedNs = 0;
+        std::uint64_t worstRecordedNs = 0;
+    };
+
+    std::size_t FirstArraySize(const Call& call) {
+        for (auto& arg : call.args) {
+            auto raw = static_cast<std::uint8_t>(arg.type);
+            if (raw >= static_cast<std::uint8_t>(ArgType::kIntArray)) {
+                return std::max({ arg.forms.size(), arg.ints.size(), arg.floats.size(), arg.strings.size() });
+            }
+        }
+        return 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <recording> [--profile=<name> | --world=<file>] [--repeat=<n>]\n", argv[0]);
+        return 1;
+    }
+
+    std::string_view profileName = "vanilla";
+    const char* worldPath = nullptr;
+    int repeat = 1;
+    for (int i = 2; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg.starts_with("--profile=")) {
+            profileName = arg.substr(10);
+        }
+        else if (arg.starts_with("--world=")) {
+            worldPath = argv[i] + 8;
+        }
+        else if (arg.starts_with("--repeat=")) {
+            repeat = std::max(1, std::atoi(argv[i] + 9));
+        }
+        else {
+            std::fprintf(stderr, "unknown argument %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    Recording recording;
+    if (!ReadRecording(argv[1], recording)) {
+        return 1;
+    }
+
+    mock::World world;
+    if (worldPath) {
+        if (!mock::LoadWorld(world, worldPath)) {
+            std::fprintf(stderr, "couldn't load world %s\n", worldPath);
+            return 1;
+        }
+    }
+    else {
+        auto* profile = mock::FindProfile(profileName);
+        if (!profile) {
+            std::fprintf(stderr, "unknown profile %.*s\n", static_cast<int>(profileName.size()), profileName.data());
+            return 1;
+        }
+        mock::GenerateProfile(world, *profile, 1);
+    }
+
+    auto preparers = MakePreparers();
+    Mapper map(world);
+
+    std::map<std::string, FunctionTotals, std::less<>> totals;
+    std::size_t checksum = 0;
+    for (auto& call : recording.calls) {
+        auto name = recording.functions.contains(call.functionId) ? recording.functions[call.functionId] : "unknown";
+        auto& function = totals[name];
+        function.calls++;
+        function.inputElements += FirstArraySize(call);
+        function.recordedNs += call.durationNs;
+        function.worstRecordedNs = std::max(function.worstRecordedNs, call.durationNs);
+
+        auto preparer = preparers.find(name);
+        if (preparer == preparers.end()) {
+            function.skipped++;
+            continue;
+        }
+
+        auto prepared = preparer->second(call, map);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repeat; i++) {
+            checksum += prepared();
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        function.replayedNs += static_cast<std::uint64_t>(elapsed) / static_cast<std::uint64_t>(repeat);
+    }
+
+    std::printf("%zu calls, %zu functions, world of %zu refs\n", recording.calls.size(), totals.size(), world.refs.size());
+    std::printf("%-32s %8s %8s %10s %12s %12s %12s\n", "function", "calls", "skipped", "avg input", "game avg us", "game max us", "replay avg us");
+    std::uint64_t recordedTotal = 0;
+    std::uint64_t replayedTotal = 0;
+    for (auto& [name, function] : totals) {
+        auto replayed = function.calls - function.skipped;
+        std::printf("%-32s %8zu %8zu %10.1f %12.1f %12.1f %12.1f\n", name.c_str(), function.calls, function.skipped,
+            static_cast<double>(function.inputElements) / static_cast<double>(function.calls),
+            static_cast<double>(function.recordedNs) / 1e3 / static_cast<double>(function.calls),
+            static_cast<double>(function.worstRecordedNs) / 1e3,
+            replayed ? static_cast<double>(function.replayedNs) / 1e3 / static_cast<double>(replayed) : 0.0);
+        recordedTotal += function.recordedNs;
+        replayedTotal += function.replayedNs;
+    }
+    std::printf("total: game %.3f ms, replay %.3f ms (checksum %zu)\n", static_cast<double>(recordedTotal) / 1e6,
+        static_cast<double>(replayedTotal) / 1e6, checksum);
+    return 0;
+}
@@ -0,0 +1,1081 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <concepts>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "mock_world.h"
+#include "skypal/arena.h"
+#include "skypal/bulk.h"
+#include "skypal/marshal.h"
+#include "skypal/names.h"
+#include "skypal/plugins.h"
+#include "skypal/rcu.h"
+#include "skypal/ref_index.h"
+#include "skypal/thread_pool.h"
+#include "world_file.h"
+#include "world_generator.h"
+
+// One benchmark per SkyPal_References native and mode, run on mock worlds.
+// Uniform worlds take {ref count, selectivity %} or {ref count, selectivity %, list size}.
+// The same benchmarks run once more on each profile world, named .../world:<profile>, with
+// {list size} when they take a list.
+//
+//   skypal_bench --benchmark_out=results.json --benchmark_out_format=json
+//   skypal_bench --skypal_world=saved.world    adds a world saved by skypal_worldgen
+namespace {
+    using skypal::mock::Traits;
+    namespace core = skypal::core;
+    namespace mock = skypal::mock;
+
+    using Refs = std::vector<const mock::Ref*>;
+
+    struct BenchWorld {
+        mock::World world;
+        Refs all;
+    };
+
+    // worlds are expensive at 1M refs, so each (count, selectivity) pair is built once
+    const BenchWorld& GetWorld(std::int64_t refCount, std::int64_t selectivity) {
+        static std::map<std::pair<std::int64_t, std::int64_t>, std::unique_ptr<BenchWorld>> worlds;
+        auto& entry = worlds[{ refCount, selectivity }];
+        if (!entry) {
+            entry = std::make_unique<BenchWorld>();
+            mock::UniformParams params;
+            params.refCount = static_cast<std::size_t>(refCount);
+            params.selectivity = static_cast<float>(selectivity) / 100.0f;
+            mock::GenerateUniform(entry->world, params);
+            entry->all = entry->world.AllRefs();
+        }
+        return *entry;
+    }
+
+    // a profile or a saved world, built the first time a benchmark asks for it
+    struct WorldSource {
+        std::string name;
+        std::function<void(mock::World&)> build;
+        std::unique_ptr<BenchWorld> world = nullptr;
+
+        const BenchWorld& Get() {
+            if (!world) {
+                world = std::make_unique<BenchWorld>();
+                build(world->world);
+                world->all = world->world.AllRefs();
+            }
+            return *world;
+        }
+    };
+
+    // a deque so the sources stay put while benchmarks hold pointers to them
+    std::deque<WorldSource> worldSources;
+
+    constexpr std::uint32_t kProfileSeed = 1;
+
+    const std::vector<std::int64_t> kRefCounts = { 1 << 10, 1 << 14, 1 << 17, 1 << 20 };
+    const std::vector<std::int64_t> kSelectivities = { 10, 50, 90 };
+    const std::vector<std::int64_t> kListSizes = { 1, 16 };
+
+    const std::vector<std::string> kNegateModes = { "", "!" };
+    const std::vector<std::string> kGateModes = { "|", "&", "^", "!|", "!&", "!^" };
+
+    // Every heap allocation in the process, for the allocs counter. Google benchmark's own are
+    // outside the timed loop, so the counter only sees the kernel's.
+    std::atomic<std::uint64_t> allocations = 0;
+
+    // With kAsNative each iteration runs like Native<Fn>::Call in the plugin: inside an arena scope
+    // with the result reserved from the selectivity of the iterations before it.
+    template <bool kAsNative = false, class Fn>
+    void Run(benchmark::State& state, const BenchWorld& bench, Fn&& fn) {
+        std::size_t outputSize = 0;
+        skypal::arena::Selectivity selectivity;
+        auto allocationsBefore = allocations.load(std::memory_order_relaxed);
+        for (auto _ : state) {
+            std::optional<skypal::arena::Scope> scope;
+            if constexpr (kAsNative) {
+                scope.emplace();
+                skypal::arena::ExpectOutput(selectivity.Predict(bench.all.size()));
+            }
+            auto result = fn(bench);
+            if constexpr (requires { result.size(); }) {
+                outputSize = result.size();
+            }
+            else if constexpr (std::integral<decltype(result)>) {
+                outputSize = static_cast<std::size_t>(result);
+            }
+            else if constexpr (std::is_pointer_v<decltype(result)>) {
+                outputSize = result ? 1 : 0;
+            }
+            if constexpr (kAsNative) {
+                selectivity.Observe(bench.all.size(), outputSize);
+            }
+            benchmark::DoNotOptimize(result);
+        }
+        state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(bench.all.size()));
+        state.counters["output"] = static_cast<double>(outputSize);
+        state.counters["allocs"] = benchmark::Counter(static_cast<double>(allocations.load(std::memory_order_relaxed) - allocationsBefore), benchmark::Counter::kAvgIterations);
+    }
+
+    std::string Name(const std::string& function, const std::string& mode) {
+        return mode.empty() ? function : function + "/mode:" + mode;
+    }
+
+    template <class Fn>
+    void Register(const std::string& name, Fn fn) {
+        benchmark::RegisterBenchmark(name.c_str(), [fn](benchmark::State& state) {
+            Run(state, GetWorld(state.range(0), state.range(1)), fn);
+        })
+            ->ArgsProduct({ kRefCounts, kSelectivities })
+            ->ArgNames({ "refs", "sel" })
+            ->Unit(benchmark::kMicrosecond);
+
+        for (auto& source : worldSources) {
+            benchmark::RegisterBenchmark((name + "/world:" + source.name).c_str(), [fn, &source](benchmark::State& state) {
+                Run(state, source.Get(), fn);
+            })
+                ->Unit(benchmark::kMicrosecond);
+        }
+    }
+
+    // the same benchmark run as a native call, see Run, on uniform worlds
+    template <class Fn>
+    void RegisterAsNative(const std::string& name, Fn fn) {
+        benchmark::RegisterBenchmark((name + "/call:native").c_str(), [fn](benchmark::State& state) {
+            Run<true>(state, GetWorld(state.range(0), state.range(1)), fn);
+        })
+            ->ArgsProduct({ kRefCounts, kSelectivities })
+            ->ArgNames({ "refs", "sel" })
+            ->Unit(benchmark::kMicrosecond);
+    }
+
+    // the list is rebuilt outside the timed loop from the last argument
+    template <class MakeList, class Fn>
+    void RegisterWithList(const std::string& name, MakeList makeList, Fn fn) {
+        benchmark::RegisterBenchmark(name.c_str(), [makeList, fn](benchmark::State& state) {
+            const auto& bench = GetWorld(state.range(0), state.range(1));
+            auto list = makeList(bench.world, static_cast<std::size_t>(state.range(2)));
+            Run(state, bench, [&](const BenchWorld& world) { return fn(world, list); });
+        })
+            ->ArgsProduct({ kRefCounts, kSelectivities, kListSizes })
+            ->ArgNames({ "refs", "sel", "list" })
+            ->Unit(benchmark::kMicrosecond);
+
+        for (auto& source : worldSources) {
+            benchmark::RegisterBenchmark((name + "/world:" + source.name).c_str(), [makeList, fn, &source](benchmark::State& state) {
+                const auto& bench = source.Get();
+                auto list = makeList(bench.world, static_cast<std::size_t>(state.range(0)));
+                Run(state, bench, [&](const BenchWorld& world) { return fn(world, list); });
+            })
+                ->ArgsProduct({ kListSizes })
+                ->ArgNames({ "list" })
+                ->Unit(benchmark::kMicrosecond);
+        }
+    }
+
+    // prepare(world) builds what the plugin would have built before the call, outside the timed
+    // loop, and fn(bench, prepared) runs on it
+    template <class Prepare, class Fn>
+    void RegisterPrepared(const std::string& name, Prepare prepare, Fn fn) {
+        benchmark::RegisterBenchmark(name.c_str(), [prepare, fn](benchmark::State& state) {
+            const auto& bench = GetWorld(state.range(0), state.range(1));
+            const auto& prepared = prepare(bench.world);
+            Run(state, bench, [&](const BenchWorld& world) { return fn(world, prepared); });
+        })
+            ->ArgsProduct({ kRefCounts, kSelectivities })
+            ->ArgNames({ "refs", "sel" })
+            ->Unit(benchmark::kMicrosecond);
+
+        for (auto& source : worldSources) {
+            benchmark::RegisterBenchmark((name + "/world:" + source.name).c_str(), [prepare, fn, &source](benchmark::State& state) {
+                const auto& bench = source.Get();
+                const auto& prepared = prepare(bench.world);
+                Run(state, bench, [&](const BenchWorld& world) { return fn(world, prepared); });
+            })
+                ->Unit(benchmark::kMicrosecond);
+        }
+    }
+
+    std::vector<const mock::Form*> MakeBases(const mock::World& world, std::size_t size) {
+        std::vector<const mock::Form*> bases;
+        for (std::size_t i = 0; i < size && i < world.forms.size(); i++) {
+            bases.push_back(&world.forms[i]);
+        }
+        return bases;
+    }
+
+    std::vector<int> MakeFormTypes(const mock::World&, std::size_t size) {
+        std::vector<int> formTypes = { mock::kTargetFormType };
+        for (std::size_t i = 1; i < size; i++) {
+            formTypes.push_back(300 + static_cast<int>(i));
+        }
+        return formTypes;
+    }
+
+    std::vector<int> MakeLayers(const mock::World&, std::size_t size) {
+        std::vector<int> layers = { mock::kTargetCollisionLayer };
+        for (std::size_t i = 1; i < size; i++) {
+            layers.push_back(100 + static_cast<int>(i));
+        }
+        return layers;
+    }
+
+    std::vector<const mock::Keyword*> MakeKeywords(const mock::World& world, std::size_t size) {
+        std::vector<const mock::Keyword*> keywords;
+        for (std::size_t i = 0; i < size && i < world.keywords.size(); i++) {
+            keywords.push_back(&world.keywords[i]);
+        }
+        return keywords;
+    }
+
+    std::vector<const mock::Actor*> MakeActors(const mock::World& world, std::size_t size) {
+        std::vector<const mock::Actor*> actors;
+        for (std::size_t i = 0; i < size && i < world.actors.size(); i++) {
+            actors.push_back(&world.actors[i]);
+        }
+        return actors;
+    }
+
+    struct FormListHolder {
+        mock::FormList list;
+    };
+
+    // profile worlds have nested lists, those are searched through their top level
+    std::shared_ptr<FormListHolder> MakeFormList(const mock::World& world, std::size_t size) {
+        auto holder = std::make_shared<FormListHolder>();
+        if (world.formLists.empty()) {
+            holder->list.forms = MakeBases(world, size);
+        }
+        else {
+            for (std::size_t i = 0; i < size && i < world.formLists.size(); i++) {
+                holder->list.lists.push_back(&world.formLists[world.formLists.size() - 1 - i]);
+            }
+        }
+        return holder;
+    }
+
+    skypal::ThreadPool& Pool() {
+        static skypal::ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+        return pool;
+    }
+
+    using Snapshot = skypal::snapshot::Snapshot<Traits>;
+
+    // Two phase kernels: Snapshot_Capture times the calling thread's copy, .../two_phase the
+    // parallel evaluation of a copy made outside the timed loop. Uniform worlds only.
+    void RegisterCapture(const std::string& fieldName, std::uint8_t fields) {
+        benchmark::RegisterBenchmark(("Snapshot_Capture/fields:" + fieldName).c_str(), [fields](benchmark::State& state) {
+            Run(state, GetWorld(state.range(0), state.range(1)), [&](const BenchWorld& bench) {
+                return skypal::snapshot::Capture<Traits>(bench.all, fields).entries;
+            });
+        })
+            ->ArgsProduct({ kRefCounts, kSelectivities })
+            ->ArgNames({ "refs", "sel" })
+            ->Unit(benchmark::kMicrosecond);
+    }
+
+    template <class MakeList, class Eval>
+    void RegisterTwoPhase(const std::string& name, std::uint8_t fields, MakeList makeList, Eval eval, std::vector<std::int64_t> listSizes = kListSizes) {
+        benchmark::RegisterBenchmark((name + "/two_phase").c_str(), [fields, makeList, eval](benchmark::State& state) {
+            const auto& bench = GetWorld(state.range(0), state.range(1));
+            auto snapshot = skypal::snapshot::Capture<Traits>(bench.all, fields);
+            auto list = makeList(bench.world, static_cast<std::size_t>(state.range(2)));
+            Run(state, bench, [&](const BenchWorld& world) { return eval(world, snapshot, list, state.range(1)); });
+        })
+            ->ArgsProduct({ kRefCounts, kSelectivities, listSizes })
+            ->ArgNames({ "refs", "sel", "list" })
+            ->Unit(benchmark::kMicrosecond)
+            ->UseRealTime();
+    }
+
+    void RegisterTwoPhaseAll() {
+        RegisterCapture("keywords", skypal::snapshot::kKeywords);
+        RegisterCapture("form_type", skypal::snapshot::kFormType);
+        RegisterCapture("position", skypal::snapshot::kPosition);
+
+        auto noList = [](const mock::World&, std::size_t) { return 0; };
+        for (auto& mode : kGateModes) {
+            RegisterTwoPhase(Name("Filter_Keywords", mode), skypal::snapshot::kKeywords, MakeKeywords, [mode](const BenchWorld&, const Snapshot& snapshot, auto& keywords, std::int64_t) {
+                return skypal::snapshot::FilterKeywords<Traits>(snapshot, Pool(), keywords, mode);
+            });
+        }
+        for (auto& mode : kNegateModes) {
+            RegisterTwoPhase(Name("Filter_Form_Types", mode), skypal::snapshot::kFormType, MakeFormTypes, [mode](const BenchWorld&, const Snapshot& snapshot, auto& formTypes, std::int64_t) {
+                return skypal::snapshot::FilterFormTypes<Traits>(snapshot, Pool(), formTypes, mode);
+            });
+        }
+        for (std::string mode : { "", ">" }) {
+            RegisterTwoPhase(Name("Filter_Distance", mode), skypal::snapshot::kPosition, noList, [mode](const BenchWorld& bench, const Snapshot& snapshot, int, std::int64_t selectivity) {
+                float distance = static_cast<float>(selectivity) / 100.0f * mock::kMaxDistance;
+                return skypal::snapshot::FilterDistance<Traits>(snapshot, Pool(), distance, &bench.world.player, mode);
+            }, { 1 });
+            RegisterTwoPhase(Name("Sort_Distance", mode), skypal::snapshot::kPosition, noList, [mode](const BenchWorld& bench, const Snapshot& snapshot, int, std::int64_t) {
+                return skypal::snapshot::SortDistance<Traits>(snapshot, Pool(), &bench.world.player, mode);
+            }, { 1 });
+        }
+    }
+
+    // Contention on a shared index: reader threads look bases up in a base -> refs index kept
+    // behind a mutex, a shared_mutex or rcu::Published. The /writer variants add one more thread
+    // that replaces one base's refs per iteration, like an event sink would.
+    using BaseIndex = std::unordered_map<const mock::Form*, Refs>;
+
+    constexpr int kReaderThreads = 8;
+    constexpr int kLookupsPerIteration = 64;
+
+    struct ContentionWorld {
+        const BenchWorld& bench = GetWorld(1 << 14, 50);
+        BaseIndex index;
+        std::vector<const mock::Form*> bases;
+
+        ContentionWorld() {
+            for (auto* ref : bench.all) {
+                index[ref->base].push_back(ref);
+            }
+            for (auto& [base, refs] : index) {
+                bases.push_back(base);
+            }
+        }
+
+        static const ContentionWorld& Get() {
+            static ContentionWorld world;
+            return world;
+        }
+    };
+
+    // Each lock is {Read(base, fn), Write(base, refs)} over its own copy of the index.
+    struct MutexIndex {
+        std::mutex mutex;
+        BaseIndex index = ContentionWorld::Get().index;
+
+        template <class Fn>
+        void Read(const mock::Form* base, Fn&& fn) {
+            std::lock_guard lock(mutex);
+            fn(index.find(base)->second);
+        }
+
+        void Write(const mock::Form* base, const Refs& refs) {
+            std::lock_guard lock(mutex);
+            index[base] = refs;
+        }
+    };
+
+    struct SharedMutexIndex {
+        std::shared_mutex mutex;
+        BaseIndex index = ContentionWorld::Get().index;
+
+        template <class Fn>
+        void Read(const mock::Form* base, Fn&& fn) {
+            std::shared_lock lock(mutex);
+            fn(index.find(base)->second);
+        }
+
+        void Write(const mock::Form* base, const Refs& refs) {
+            std::unique_lock lock(mutex);
+            index[base] = refs;
+        }
+    };
+
+    struct RcuIndex {
+        skypal::rcu::Published<BaseIndex> index{ std::make_unique<BaseIndex>(ContentionWorld::Get().index) };
+
+        template <class Fn>
+        void Read(const mock::Form* base, Fn&& fn) {
+            auto current = index.Read();
+            fn(current->find(base)->second);
+        }
+
+        void Write(const mock::Form* base, const Refs& refs) {
+            index.Update([&](BaseIndex& next) { next[base] = refs; });
+        }
+    };
+
+    // the last thread is the writer when there is one, the others only read
+    template <class Index>
+    void RunContention(benchmark::State& state, bool withWriter) {
+        static Index shared;
+        const auto& world = ContentionWorld::Get();
+        auto& bases = world.bases;
+        bool writer = withWriter && state.thread_index() == state.threads() - 1;
+        std::size_t next = static_cast<std::size_t>(state.thread_index()) * 7919;
+
+        std::size_t found = 0;
+        for (auto _ : state) {
+            if (writer) {
+                auto* base = bases[next++ % bases.size()];
+                shared.Write(base, world.index.at(base));
+                continue;
+            }
+            for (int i = 0; i < kLookupsPerIteration; i++) {
+                shared.Read(bases[next++ % bases.size()], [&](const Refs& refs) { found += refs.size(); });
+            }
+        }
+        benchmark::DoNotOptimize(found);
+        if (!writer) {
+            state.SetItemsProcessed(state.iterations() * kLookupsPerIteration);
+        }
+    }
+
+    template <class Index>
+    void RegisterContention(const std::string& lock) {
+        for (bool withWriter : { false, true }) {
+            auto name = "Index_Read/lock:" + lock + (withWriter ? "/writer" : "");
+            benchmark::RegisterBenchmark(name.c_str(), [withWriter](benchmark::State& state) { RunContention<Index>(state, withWriter); })
+                ->Threads(withWriter ? kReaderThreads + 1 : kReaderThreads)
+                ->UseRealTime();
+        }
+    }
+
+    void RegisterContentionAll() {
+        RegisterContention<MutexIndex>("mutex");
+        RegisterContention<SharedMutexIndex>("shared_mutex");
+        RegisterContention<RcuIndex>("rcu");
+    }
+
+    // The ref index (ref_index.h). Ref_Index/step:build indexes every ref of a uniform world, the
+    // cost the first All_Filter_Bases pays without a saved index; step:save and step:load are the
+    // co-save round trip that replaces it after a load, with bytes_per_ref for the saved size, and
+    // step:verify the check of a loaded index against every ref before it's used.
+    // All_Filter_Bases/source:index always answers from the index through a form id map; the
+    // native scans instead once the bases hold more than an eighth of the refs.
+    using FormMap = std::unordered_map<std::uint32_t, const mock::Ref*>;
+
+    struct IndexedWorld {
+        skypal::ref_index::Index index;
+        std::vector<std::uint8_t> bytes;
+        FormMap forms;
+    };
+
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> IndexPairs(const mock::World& world) {
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> pairs;
+        pairs.reserve(world.refs.size());
+        for (auto& ref : world.refs) {
+            pairs.emplace_back(ref.base->formId, ref.formId);
+        }
+        return pairs;
+    }
+
+    const IndexedWorld& GetIndexedWorld(const mock::World& world) {
+        static std::map<const mock::World*, std::unique_ptr<IndexedWorld>> worlds;
+        auto& entry = worlds[&world];
+        if (!entry) {
+            entry = std::make_unique<IndexedWorld>();
+            entry->index = skypal::ref_index::Index::Build(IndexPairs(world));
+            entry->bytes = skypal::ref_index::Encode(entry->index, 0);
+            for (auto& ref : world.refs) {
+                entry->forms.emplace(ref.formId, &ref);
+            }
+        }
+        return *entry;
+    }
+
+    void RegisterRefIndex(const std::string& step, std::function<void(benchmark::State&, const BenchWorld&, const IndexedWorld&)> run) {
+        benchmark::RegisterBenchmark(("Ref_Index/step:" + step).c_str(), [run](benchmark::State& state) {
+            const auto& bench = GetWorld(state.range(0), 50);
+            const auto& indexed = GetIndexedWorld(bench.world);
+            run(state, bench, indexed);
+            state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(bench.all.size()));
+            state.counters["bytes_per_ref"] = static_cast<double>(indexed.bytes.size()) / static_cast<double>(bench.all.size());
+        })
+            ->Arg(1 << 10)->Arg(1 << 14)->Arg(1 << 17)->Arg(1 << 20)
+            ->ArgName("refs")
+            ->Unit(benchmark::kMicrosecond);
+    }
+
+    void RegisterRefIndexAll() {
+        RegisterRefIndex("build", [](benchmark::State& state, const BenchWorld& bench, const IndexedWorld&) {
+            for (auto _ : state) {
+                auto index = skypal::ref_index::Index::Build(IndexPairs(bench.world));
+                benchmark::DoNotOptimize(index);
+            }
+        });
+        RegisterRefIndex("verify", [](benchmark::State& state, const BenchWorld& bench, const IndexedWorld& indexed) {
+            for (auto _ : state) {
+                skypal::ref_index::Census census;
+                bool covers = true;
+                for (auto& ref : bench.world.refs) {
+                    auto key = skypal::ref_index::PluginKey(ref.formId);
+                    if (key != skypal::ref_index::kDynamicKey) {
+                        census[key].Add(ref.formId);
+                    }
+                    else if (!indexed.index.Contains(ref.base->formId, ref.formId)) {
+                        covers = false;
+                        break;
+                    }
+                }
+                covers = covers && skypal::ref_index::Covers(indexed.index, census);
+                benchmark::DoNotOptimize(covers);
+            }
+        });
+        RegisterRefIndex("save", [](benchmark::State& state, const BenchWorld&, const IndexedWorld& indexed) {
+            for (auto _ : state) {
+                auto bytes = skypal::ref_index::Encode(indexed.index, 0);
+                benchmark::DoNotOptimize(bytes);
+            }
+        });
+        RegisterRefIndex("load", [](benchmark::State& state, const BenchWorld&, const IndexedWorld& indexed) {
+            for (auto _ : state) {
+                skypal::ref_index::Index index;
+                std::uint64_t loadOrder = 0;
+                if (!skypal::ref_index::Decode(indexed.bytes, index, loadOrder)) {
+                    state.SkipWithError("the saved index didn't decode");
+                    break;
+                }
+                benchmark::DoNotOptimize(index);
+            }
+        });
+
+        // the index is built with the list, outside the timed loop
+        auto makeIndexedBases = [](const mock::World& world, std::size_t size) {
+            GetIndexedWorld(world);
+            return MakeBases(world, size);
+        };
+        RegisterWithList("All_Filter_Bases/source:index", makeIndexedBases, [](const BenchWorld& bench, auto& bases) {
+            const auto& indexed = GetIndexedWorld(bench.world);
+            std::vector<std::uint32_t> baseIds;
+            for (auto* base : bases) {
+                baseIds.push_back(base->formId);
+            }
+            std::sort(baseIds.begin(), baseIds.end());
+            baseIds.erase(std::unique(baseIds.begin(), baseIds.end()), baseIds.end());
+
+            Refs refs;
+            for (auto baseId : baseIds) {
+                for (auto refId : indexed.index.RefsOf(baseId)) {
+                    auto it = indexed.forms.find(refId);
+                    if (it != indexed.forms.end() && it->second->base->formId == baseId) {
+                        refs.push_back(it->second);
+                    }
+                }
+            }
+            return refs;
+        });
+    }
+
+    // Names: source:table matches against the world's NameTable, source:direct lowers and matches
+    // every ref's name like a table miss does. All_Named looks the names up with and without the
+    // trigram index and takes their refs from the ref index. The patterns all match kTargetName, so on uniform worlds sel of the refs pass.
+    // Tables are built before the timed loop, like the plugin's warm-up does.
+    const skypal::names::NameTable& GetNameTable(const mock::World& world, bool withTrigrams) {
+        static std::map<std::pair<const mock::World*, bool>, std::unique_ptr<skypal::names::NameTable>> tables;
+        auto& entry = tables[{ &world, withTrigrams }];
+        if (!entry) {
+            std::vector<std::pair<const void*, std::string>> named;
+            for (auto& form : world.forms) {
+                named.emplace_back(&form, form.name);
+            }
+            entry = std::make_unique<skypal::names::NameTable>(skypal::names::NameTable::Build(std::move(named), withTrigrams));
+        }
+        return *entry;
+    }
+
+    void RegisterNamesAll() {
+        const std::vector<std::pair<std::string, std::string>> patterns = { { "", "rose" }, { "^", "sanguine" }, { "=", "sanguine rose" }, { "!", "rose" } };
+        auto table = [](const mock::World& world) -> const skypal::names::NameTable& { return GetNameTable(world, false); };
+        for (auto& [mode, pattern] : patterns) {
+            RegisterPrepared(Name("Filter_Name", mode) + "/source:table", table, [mode, pattern](const BenchWorld& bench, const skypal::names::NameTable& names) {
+                return skypal::names::FilterName<Traits>(bench.all, names, pattern, mode);
+            });
+            Register(Name("Filter_Name", mode) + "/source:direct", [mode, pattern](const BenchWorld& bench) {
+                auto parsed = skypal::names::ParsePattern(pattern, mode);
+                std::string lowered;
+                return core::FilterIf<Traits>(bench.all, [&](const mock::Ref* ref) {
+                    skypal::names::LowerInto(Traits::GetName(ref), lowered);
+                    return parsed.Matches(lowered);
+                });
+            });
+        }
+
+        // like the native: the matching names' bases, then their refs from the ref index
+        using NamedWorld = std::pair<const skypal::names::NameTable*, const IndexedWorld*>;
+        for (bool withTrigrams : { false, true }) {
+            auto prepare = [withTrigrams](const mock::World& world) { return NamedWorld(&GetNameTable(world, withTrigrams), &GetIndexedWorld(world)); };
+            RegisterPrepared(std::string("All_Named/source:") + (withTrigrams ? "trigrams" : "pool"), prepare, [](const BenchWorld&, const NamedWorld& named) {
+                auto& [names, indexed] = named;
+                Refs refs;
+                for (auto nameId : names->Lookup(skypal::names::ParsePattern("rose", ""))) {
+                    for (auto* key : names->KeysOf(nameId)) {
+                        auto baseId = static_cast<const mock::Form*>(key)->formId;
+                        for (auto refId : indexed->index.RefsOf(baseId)) {
+                            auto it = indexed->forms.find(refId);
+                            if (it != indexed->forms.end() && it->second->base->formId == baseId) {
+                                refs.push_back(it->second);
+                            }
+                        }
+                    }
+                }
+                return refs;
+            });
+        }
+    }
+
+    // Plugins: the worlds' plugins are named Plugin<i>.esp, or Light<i>.esl past 0xFE (see
+    // MakeFormId). Uniform worlds put sel of the refs in mock::kTargetPlugin, which is plugin1.esp.
+    // source:mask tests form ids against the resolved mask, source:names looks up each ref's
+    // plugin name and compares it to the requested ones, like Papyrus would.
+    struct MockLoadOrder {
+        skypal::plugins::LoadOrder loadOrder;
+        std::vector<std::string> fullNames = std::vector<std::string>(skypal::plugins::kFullSlots);
+        std::vector<std::string> lightNames = std::vector<std::string>(skypal::plugins::kLightSlots);
+
+        MockLoadOrder() {
+            for (std::uint16_t i = 0; i < skypal::plugins::kLightTop; i++) {
+                fullNames[i] = "Plugin" + std::to_string(i) + ".esp";
+                loadOrder.Add(fullNames[i], { false, i });
+            }
+            for (std::uint16_t i = 0; i < skypal::plugins::kLightSlots; i++) {
+                lightNames[i] = "Light" + std::to_string(i) + ".esl";
+                loadOrder.Add(lightNames[i], { true, i });
+            }
+        }
+
+        std::string_view NameOf(std::uint32_t formId) const {
+            auto top = formId >> 24;
+            return top == skypal::plugins::kLightTop ? lightNames[(formId >> 12) & 0xFFF] : fullNames[top];
+        }
+    };
+
+    bool EqualsIgnoringCase(std::string_view a, std::string_view b) {
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+            return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+        });
+    }
+
+    void RegisterPluginsAll() {
+        static const MockLoadOrder mockLoadOrder;
+        static const std::vector<std::string> plugins = { "plugin1.esp", "Plugin2.esp", "Plugin7.esp", "Light3.esl" };
+        for (auto& mode : kNegateModes) {
+            Register(Name("Filter_Plugins", mode) + "/source:mask", [mode](const BenchWorld& bench) {
+                std::vector<std::string_view> unknown;
+                auto mask = mockLoadOrder.loadOrder.Resolve(plugins, unknown);
+                return skypal::plugins::FilterPlugins<Traits>(bench.all, mask, mode);
+            });
+            Register(Name("Filter_Plugins", mode) + "/source:names", [mode](const BenchWorld& bench) {
+                bool negate = (core::ParseNegate(mode) == core::Negate::kNoMatch);
+                return core::FilterIf<Traits>(bench.all, [&](const mock::Ref* ref) {
+                    auto name = mockLoadOrder.NameOf(ref->formId);
+                    bool found = std::any_of(plugins.begin(), plugins.end(), [&](const std::string& plugin) { return EqualsIgnoringCase(name, plugin); });
+                    return found != negate;
+                });
+            });
+        }
+    }
+
+    // Bulk mutations (bulk.h): one batch queues every ref twice in a row, like a script passing
+    // the same ref more than once, then a second batch takes over the first half before the queue
+    // drains in the plugin's chunks of 32. A batch that completes before its refs are applied, or
+    // more than once, fails the benchmark with an error.
+    void RegisterBulkAll() {
+        benchmark::RegisterBenchmark("Bulk_Queue", [](benchmark::State& state) {
+            const auto& bench = GetWorld(state.range(0), 50);
+            std::vector<skypal::bulk::Queue<const mock::Ref*>::Entry> chunk;
+            for (auto _ : state) {
+                skypal::bulk::Queue<const mock::Ref*> queue;
+                auto enqueue = [&](std::span<const mock::Ref* const> refs, int times) {
+                    auto batchId = queue.Begin("Disable");
+                    for (auto* ref : refs) {
+                        for (int i = 0; i < times; i++) {
+                            queue.Add(batchId, ref->formId) = ref;
+                        }
+                    }
+                    queue.End(batchId);
+                    return batchId;
+                };
+                auto first = enqueue(bench.all, 2);
+                auto second = enqueue(std::span(bench.all).first(bench.all.size() / 2), 1);
+                if (!queue.TakeCompleted().empty()) {
+                    state.SkipWithError("a batch completed before its refs were applied");
+                    break;
+                }
+
+                std::size_t applied = 0;
+                std::vector<std::uint32_t> done;
+                do {
+                    chunk.clear();
+                    queue.Take(32, chunk);
+                    applied += chunk.size();
+                    for (auto& entry : chunk) {
+                        queue.Finish(entry.batchId);
+                    }
+                    for (auto& completed : queue.TakeCompleted()) {
+                        done.push_back(completed.batchId);
+                    }
+                } while (!chunk.empty());
+
+                std::sort(done.begin(), done.end());
+                if (applied != bench.all.size() || done != std::vector<std::uint32_t>{ first, second }) {
+                    state.SkipWithError("the batches didn't complete once each after their refs were applied");
+                    break;
+                }
+            }
+            state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(bench.all.size()));
+        })
+            ->Arg(1 << 10)->Arg(1 << 14)->Arg(1 << 17)
+            ->ArgName("refs")
+            ->Unit(benchmark::kMicrosecond);
+    }
+
+    // Marshalling: a mock VM array of object handles, resolved through a handle table like the
+    // VM's handle policy. binding:vector unpacks it into a new std::vector per call, like
+    // CommonLibSSE's binding; binding:view into a leased marshal.h buffer, like
+    // papyrus::ArrayFunction. Either way the result is packed into a new VM array.
+    struct MockVariable {
+        std::uint64_t handle = 0;
+    };
+
+    struct MarshalWorld {
+        std::vector<MockVariable> array;
+        std::unordered_map<std::uint64_t, const mock::Ref*> handles;
+    };
+
+    constexpr std::uint64_t kHandleTag = std::uint64_t(0xFFFF) << 32;
+
+    const MarshalWorld& GetMarshalWorld(std::int64_t refCount) {
+        static std::map<std::int64_t, std::unique_ptr<MarshalWorld>> worlds;
+        auto& entry = worlds[refCount];
+        if (!entry) {
+            entry = std::make_unique<MarshalWorld>();
+            for (auto* ref : GetWorld(refCount, 50).all) {
+                entry->array.push_back({ kHandleTag | ref->formId });
+                entry->handles.emplace(kHandleTag | ref->formId, ref);
+            }
+        }
+        return *entry;
+    }
+
+    std::vector<MockVariable> Pack(std::span<const mock::Ref* const> refs) {
+        std::vector<MockVariable> array;
+        array.reserve(refs.size());
+        for (auto* ref : refs) {
+            array.push_back({ kHandleTag | ref->formId });
+        }
+        return array;
+    }
+
+    template <class Kernel>
+    void RegisterMarshal(const std::string& name, Kernel kernel) {
+        benchmark::RegisterBenchmark((name + "/binding:vector").c_str(), [kernel](benchmark::State& state) {
+            auto& marshal = GetMarshalWorld(state.range(0));
+            auto unpack = [&](const MockVariable& variable) { return marshal.handles.find(variable.handle)->second; };
+            for (auto _ : state) {
+                Refs refs;
+                refs.reserve(marshal.array.size());
+                for (auto& variable : marshal.array) {
+                    refs.push_back(unpack(variable));
+                }
+                auto result = Pack(kernel(std::span<const mock::Ref* const>(refs)));
+                benchmark::DoNotOptimize(result);
+            }
+            state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(marshal.array.size()));
+        })
+            ->Arg(1 << 10)->Arg(1 << 14)->Arg(1 << 17)->Arg(1 << 20)
+            ->ArgName("refs")
+            ->Unit(benchmark::kMicrosecond);
+
+        benchmark::RegisterBenchmark((name + "/binding:view").c_str(), [kernel](benchmark::State& state) {
+            auto& marshal = GetMarshalWorld(state.range(0));
+            auto unpack = [&](const MockVariable& variable) { return marshal.handles.find(variable.handle)->second; };
+            for (auto _ : state) {
+                skypal::marshal::Lease<const mock::Ref*, 0> buffer;
+                auto refs = skypal::marshal::UnpackInto(marshal.array, *buffer, unpack);
+                auto result = Pack(kernel(refs));
+                benchmark::DoNotOptimize(result);
+            }
+            state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(marshal.array.size()));
+        })
+            ->Arg(1 << 10)->Arg(1 << 14)->Arg(1 << 17)->Arg(1 << 20)
+            ->ArgName("refs")
+            ->Unit(benchmark::kMicrosecond);
+    }
+
+    void RegisterMarshalAll() {
+        RegisterMarshal("Marshal", [](std::span<const mock::Ref* const> refs) { return refs; });
+        RegisterMarshal("Marshal_Filter_Enabled", [](std::span<const mock::Ref* const> refs) { return core::FilterEnabled<Traits>(refs, ""); });
+    }
+
+    void RegisterAll() {
+        // scans
+        Register("All", [](const BenchWorld& bench) { return bench.world.AllRefs(); });
+        Register("Grid", [](const BenchWorld& bench) { return bench.world.GridRefs(); });
+        for (auto& mode : kNegateModes) {
+            RegisterWithList(Name("All_Filter_Bases", mode), MakeBases, [mode](const BenchWorld& bench, auto& bases) {
+                return core::FilterBases<Traits>(bench.world.AllRefs(), bases, mode);
+            });
+            RegisterWithList(Name("All_Filter_Bases_Form_List", mode), MakeFormList, [mode](const BenchWorld& bench, auto& holder) {
+                return core::FilterBasesFormList<Traits>(bench.world.AllRefs(), &holder->list, mode);
+            });
+            RegisterWithList(Name("Grid_Filter_Bases", mode), MakeBases, [mode](const BenchWorld& bench, auto& bases) {
+                return core::FilterBases<Traits>(bench.world.GridRefs(), bases, mode);
+            });
+            RegisterWithList(Name("Grid_Filter_Bases_Form_List", mode), MakeFormList, [mode](const BenchWorld& bench, auto& holder) {
+                return core::FilterBasesFormList<Traits>(bench.world.GridRefs(), &holder->list, mode);
+            });
+        }
+
+        // counts
+        Register("Count_Disabled", [](const BenchWorld& bench) { return core::CountDisabled<Traits>(bench.all); });
+        Register("Count_Enabled", [](const BenchWorld& bench) { return core::CountEnabled<Traits>(bench.all); });
+        for (auto& mode : kNegateModes) {
+            RegisterWithList(Name("Count_Form_Types", mode), MakeFormTypes, [mode](const BenchWorld& bench, auto& formTypes) {
+                return core::FilterFormTypes<Traits, core::Count>(bench.all, formTypes, mode);
+            });
+        }
+        for (std::string mode : { "", ">" }) {
+            benchmark::RegisterBenchmark(Name("Count_Distance", mode).c_str(), [mode](benchmark::State& state) {
+                float distance = static_cast<float>(state.range(1)) / 100.0f * mock::kMaxDistance;
+                Run(state, GetWorld(state.range(0), state.range(1)), [&](const BenchWorld& bench) {
+                    return core::FilterDistance<Traits, core::Count>(bench.all, distance, &bench.world.player, mode);
+                });
+            })
+                ->ArgsProduct({ kRefCounts, kSelectivities })
+                ->ArgNames({ "refs", "sel" })
+                ->Unit(benchmark::kMicrosecond);
+        }
+        for (auto& mode : kGateModes) {
+            RegisterWithList(Name("Count_Keywords", mode), MakeKeywords, [mode](const BenchWorld& bench, auto& keywords) {
+                return core::FilterKeywords<Traits, core::Count>(bench.all, keywords, mode);
+            });
+            RegisterWithList(Name("Count_Owners", mode), MakeActors, [mode](const BenchWorld& bench, auto& owners) {
+                return core::FilterOwners<Traits, core::Count>(bench.all, owners, mode);
+            });
+        }
+
+        // short-circuiting, on uniform worlds the first match is about 100 / sel refs in
+        for (auto& mode : kGateModes) {
+            RegisterWithList(Name("Any_Keywords", mode), MakeKeywords, [mode](const BenchWorld& bench, auto& keywords) {
+                return core::FilterKeywords<Traits, core::Any>(bench.all, keywords, mode);
+            });
+            RegisterWithList(Name("First_Owners", mode), MakeActors, [mode](const BenchWorld& bench, auto& owners) {
+                return core::FilterOwners<Traits, core::First>(bench.all, owners, mode);
+            });
+        }
+        for (std::string mode : { "", ">" }) {
+            benchmark::RegisterBenchmark(Name("First_Distance", mode).c_str(), [mode](benchmark::State& state) {
+                float distance = static_cast<float>(state.range(1)) / 100.0f * mock::kMaxDistance;
+                Run(state, GetWorld(state.range(0), state.range(1)), [&](const BenchWorld& bench) {
+                    return core::FilterDistance<Traits, core::First>(bench.all, distance, &bench.world.player, mode);
+                });
+            })
+                ->ArgsProduct({ kRefCounts, kSelectivities })
+                ->ArgNames({ "refs", "sel" })
+                ->Unit(benchmark::kMicrosecond);
+
+            // the closest enabled ref, against sorting everything and taking the first enabled one
+            Register(Name("Find_Closest", mode), [mode](const BenchWorld& bench) {
+                return core::FindClosest<Traits>(bench.all, &bench.world.player, mode, [](auto ref) { return !Traits::IsDisabled(ref); });
+            });
+            RegisterAsNative(Name("Find_Closest", mode), [mode](const BenchWorld& bench) {
+                return core::FindClosest<Traits>(bench.all, &bench.world.player, mode, [](auto ref) { return !Traits::IsDisabled(ref); });
+            });
+            Register(Name("Find_Closest", mode) + "/sort", [mode](const BenchWorld& bench) {
+                auto sorted = core::SortDistance<Traits>(bench.all, &bench.world.player, mode);
+                return core::FilterEnabled<Traits, core::First>(sorted, "");
+            });
+        }
+
+        // five filters in a row, as Filter_ natives that each return a new array or as a working
+        // set that Keep_ natives compact in place
+        RegisterWithList("Chain/api:filter", MakeKeywords, [](const BenchWorld& bench, auto& keywords) {
+            auto refs = core::FilterEnabled<Traits>(bench.all, "");
+            refs = core::Filter3DLoaded<Traits>(refs, "");
+            refs = core::FilterKeywords<Traits>(refs, keywords, "");
+            refs = core::FilterDistance<Traits>(refs, mock::kMaxDistance / 2.0f, &bench.world.player, "");
+            return core::FilterPlayableObjects<Traits>(refs, "");
+        });
+        RegisterWithList("Chain/api:keep", MakeKeywords, [](const BenchWorld& bench, auto& keywords) {
+            auto keep = [](Refs& refs, auto kernel) {
+                core::KeepIf<Traits>(refs, [&](const mock::Ref* ref) { return kernel(core::RefSpan<Traits>(&ref, 1)); });
+            };
+            Refs refs(bench.all.begin(), bench.all.end());
+            keep(refs, [](auto ref) { return core::FilterEnabled<Traits, core::Any>(ref, ""); });
+            keep(refs, [](auto ref) { return core::Filter3DLoaded<Traits, core::Any>(ref, ""); });
+            keep(refs, [&](auto ref) { return core::FilterKeywords<Traits, core::Any>(ref, keywords, ""); });
+            keep(refs, [&](auto ref) { return core::FilterDistance<Traits, core::Any>(ref, mock::kMaxDistance / 2.0f, &bench.world.player, ""); });
+            keep(refs, [](auto ref) { return core::FilterPlayableObjects<Traits, core::Any>(ref, ""); });
+            return refs;
+        });
+
+        // list filters
+        for (auto& mode : kNegateModes) {
+            RegisterWithList(Name("Filter_Bases", mode), MakeBases, [mode](const BenchWorld& bench, auto& bases) {
+                return core::FilterBases<Traits>(bench.all, bases, mode);
+            });
+            RegisterWithList(Name("Filter_Bases_Form_List", mode), MakeFormList, [mode](const BenchWorld& bench, auto& holder) {
+                return core::FilterBasesFormList<Traits>(bench.all, &holder->list, mode);
+            });
+            RegisterWithList(Name("Filter_Form_Types", mode), MakeFormTypes, [mode](const BenchWorld& bench, auto& formTypes) {
+                return core::FilterFormTypes<Traits>(bench.all, formTypes, mode);
+            });
+            RegisterWithList(Name("Filter_Collision_Layer_Types", mode), MakeLayers, [mode](const BenchWorld& bench, auto& layers) {
+                return core::FilterCollisionLayerTypes<Traits>(bench.all, layers, mode);
+            });
+        }
+
+        // flag filters
+        for (auto& mode : kNegateModes) {
+            Register(Name("Filter_Enabled", mode), [mode](const BenchWorld& bench) { return core::FilterEnabled<Traits>(bench.all, mode); });
+            RegisterAsNative(Name("Filter_Enabled", mode), [mode](const BenchWorld& bench) { return core::FilterEnabled<Traits>(bench.all, mode); });
+            Register(Name("Filter_Deleted", mode), [mode](const BenchWorld& bench) { return core::FilterDeleted<Traits>(bench.all, mode); });
+            Register(Name("Filter_3dLoaded", mode), [mode](const BenchWorld& bench) { return core::Filter3DLoaded<Traits>(bench.all, mode); });
+            Register(Name("Filter_OffLimits", mode), [mode](const BenchWorld& bench) { return core::FilterOffLimits<Traits>(bench.all, mode); });
+            Register(Name("Filter_InventoryObjects", mode), [mode](const BenchWorld& bench) { return core::FilterInventoryObjects<Traits>(bench.all, mode); });
+            Register(Name("Filter_PlayableObjects", mode), [mode](const BenchWorld& bench) { return core::FilterPlayableObjects<Traits>(bench.all, mode); });
+            Register(Name("Filter_QuestObjects", mode), [mode](const BenchWorld& bench) { return core::FilterQuestObjects<Traits>(bench.all, mode); });
+            Register(Name("Filter_WorldSpace", mode), [mode](const BenchWorld& bench) {
+                return core::FilterWorldspace<Traits>(bench.all, &bench.world.worldspaces[0], mode);
+            });
+        }
+
+        // distance, on uniform worlds the threshold is picked so about sel % of the refs are closer,
+        // on profile worlds it's the loaded grid around the player
+        for (std::string mode : { "", ">" }) {
+            benchmark::RegisterBenchmark(Name("Filter_Distance", mode).c_str(), [mode](benchmark::State& state) {
+                float distance = static_cast<float>(state.range(1)) / 100.0f * mock::kMaxDistance;
+                Run(state, GetWorld(state.range(0), state.range(1)), [&](const BenchWorld& bench) {
+                    return core::FilterDistance<Traits>(bench.all, distance, &bench.world.player, mode);
+                });
+            })
+                ->ArgsProduct({ kRefCounts, kSelectivities })
+                ->ArgNames({ "refs", "sel" })
+                ->Unit(benchmark::kMicrosecond);
+
+            for (auto& source : worldSources) {
+                benchmark::RegisterBenchmark((Name("Filter_Distance", mode) + "/world:" + source.name).c_str(), [mode, &source](benchmark::State& state) {
+                    Run(state, source.Get(), [&](const BenchWorld& bench) {
+                        return core::FilterDistance<Traits>(bench.all, mock::kCellSize * 2.5f, &bench.world.player, mode);
+                    });
+                })
+                    ->Unit(benchmark::kMicrosecond);
+            }
+
+            Register(Name("Sort_Distance", mode), [mode](const BenchWorld& bench) { return core::SortDistance<Traits>(bench.all, &bench.world.player, mode); });
+            RegisterAsNative(Name("Sort_Distance", mode), [mode](const BenchWorld& bench) { return core::SortDistance<Traits>(bench.all, &bench.world.player, mode); });
+        }
+
+        for (std::string mode : { "", "..." }) {
+            Register(Name("From_References", mode), [mode](const BenchWorld& bench) { return core::FromReferences<Traits>(bench.all, mode); });
+            RegisterAsNative(Name("From_References", mode), [mode](const BenchWorld& bench) { return core::FromReferences<Traits>(bench.all, mode); });
+        }
+
+        // gate filters
+        for (auto& mode : kGateModes) {
+            RegisterWithList(Name("Filter_Keywords", mode), MakeKeywords, [mode](const BenchWorld& bench, auto& keywords) {
+                return core::FilterKeywords<Traits>(bench.all, keywords, mode);
+            });
+            RegisterWithList(Name("Filter_Owners", mode), MakeActors, [mode](const BenchWorld& bench, auto& owners) {
+                return core::FilterOwners<Traits>(bench.all, owners, mode);
+            });
+            RegisterWithList(Name("Filter_Potential_Thieves", mode), MakeActors, [mode](const BenchWorld& bench, auto& thieves) {
+                return core::FilterPotentialThieves<Traits>(bench.all, thieves, mode);
+            });
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    for (auto& profile : mock::kProfiles) {
+        worldSources.push_back({ std::string(profile.name), [&profile](mock::World& world) {
+            mock::GenerateProfile(world, profile, kProfileSeed);
+        } });
+    }
+
+    // pulled out before benchmark::Initialize, which rejects flags it doesn't know
+    constexpr std::string_view kWorldFlag = "--skypal_world=";
+    int kept = 1;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg.starts_with(kWorldFlag)) {
+            std::string path(arg.substr(kWorldFlag.size()));
+            worldSources.push_back({ "file", [path](mock::World& world) {
+                if (!mock::LoadWorld(world, path)) {
+                    std::fprintf(stderr, "couldn't load world %s\n", path.c_str());
+                    std::exit(1);
+                }
+            } });
+        }
+        else {
+            argv[kept++] = argv[i];
+        }
+    }
+    argc = kept;
+
+    RegisterAll();
+    RegisterTwoPhaseAll();
+    RegisterContentionAll();
+    RegisterMarshalAll();
+    RegisterRefIndexAll();
+    RegisterNamesAll();
+    RegisterPluginsAll();
+    RegisterBulkAll();
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
+
+// Counts every allocation for the allocs counter. Every new below is paired with the deletes
+// that free what it returns, but GCC inlines the replaced operators into their callers and then
+// sees std::free on a pointer that came from operator new; that's this replacement working, so
+// -Wmismatched-new-delete is off for these definitions only.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto* memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+// std::pmr::new_delete_resource allocates through these
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    auto align = static_cast<std::size_t>(alignment);
+    if (auto* memory = std::aligned_alloc(align, (std::max<std::size_t>(size, 1) + align - 1) / align * align)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept {
+    std::free(memory);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
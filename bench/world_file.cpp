@@ -0,0 +1,313 @@
+#include "world_file.h"
+
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+namespace skypal::mock {
+    namespace {
+        constexpr char kMagic[4] = { 'S', 'K', 'P', 'W' };
+        constexpr std::uint32_t kVersion = 1;
+
+        // pointer -> 1-based index, built once per deque
+        template <class T>
+        class IndexOf {
+        public:
+            explicit IndexOf(const std::deque<T>& items) {
+                indices.reserve(items.size());
+                std::uint32_t index = 1;
+                for (auto& item : items) {
+                    indices.emplace(&item, index++);
+                }
+            }
+
+            std::uint32_t operator()(const T* item) const {
+                if (!item) {
+                    return 0;
+                }
+                auto it = indices.find(item);
+                return it == indices.end() ? 0 : it->second;
+            }
+
+        private:
+            std::unordered_map<const T*, std::uint32_t> indices;
+        };
+
+        class Writer {
+        public:
+            explicit Writer(const std::filesystem::path& path) : out(path, std::ios::binary) {}
+
+            template <class T>
+            void Put(const T& value) {
+                out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+            }
+
+            bool Ok() const { return static_cast<bool>(out); }
+
+        private:
+            std::ofstream out;
+        };
+
+        class Reader {
+        public:
+            explicit Reader(const std::filesystem::path& path) : in(path, std::ios::binary) {}
+
+            template <class T>
+            T Get() {
+                T value{};
+                in.read(reinterpret_cast<char*>(&value), sizeof(T));
+                return value;
+            }
+
+            // null on index 0 or an index past the end, the caller checks Ok() at the end
+            template <class T>
+            const T* Resolve(std::deque<T>& items) {
+                auto index = Get<std::uint32_t>();
+                if (index == 0 || index > items.size()) {
+                    if (index > items.size()) {
+                        in.setstate(std::ios::failbit);
+                    }
+                    return nullptr;
+                }
+                return &items[index - 1];
+            }
+
+            bool Ok() const { return static_cast<bool>(in); }
+
+        private:
+            std::ifstream in;
+        };
+
+        struct Indices {
+            IndexOf<Keyword> keywords;
+            IndexOf<Faction> factions;
+            IndexOf<Npc> npcs;
+            IndexOf<Form> forms;
+            IndexOf<FormList> formLists;
+            IndexOf<EncounterZone> encounterZones;
+            IndexOf<Worldspace> worldspaces;
+            IndexOf<Cell> cells;
+
+            explicit Indices(const World& world) :
+                keywords(world.keywords),
+                factions(world.factions),
+                npcs(world.npcs),
+                forms(world.forms),
+                formLists(world.formLists),
+                encounterZones(world.encounterZones),
+                worldspaces(world.worldspaces),
+                cells(world.cells) {}
+        };
+
+        enum RefFlags : std::uint8_t {
+            kDisabled = 1 << 0,
+            kDeleted = 1 << 1,
+            kLoaded3D = 1 << 2,
+            kOffLimits = 1 << 3,
+            kInventoryObject = 1 << 4,
+            kPlayable = 1 << 5,
+            kQuestObject = 1 << 6,
+        };
+
+        void PutRef(Writer& out, const Indices& indices, const Ref& ref) {
+            out.Put(ref.formId);
+            out.Put(indices.forms(ref.base));
+            out.Put(indices.cells(ref.cell));
+            out.Put(ref.position);
+            std::uint8_t flags = (ref.disabled ? kDisabled : 0) | (ref.deleted ? kDeleted : 0) |
+                (ref.loaded3D ? kLoaded3D : 0) | (ref.offLimits ? kOffLimits : 0) |
+                (ref.inventoryObject ? kInventoryObject : 0) | (ref.playable ? kPlayable : 0) |
+                (ref.questObject ? kQuestObject : 0);
+            out.Put(flags);
+            out.Put(static_cast<std::int32_t>(ref.collisionLayer));
+            out.Put(indices.npcs(ref.actorOwner));
+            out.Put(indices.factions(ref.factionOwner));
+            out.Put(indices.encounterZones(ref.encounterZone));
+        }
+
+        Ref GetRef(Reader& in, World& world) {
+            Ref ref;
+            ref.formId = in.Get<std::uint32_t>();
+            ref.base = in.Resolve(world.forms);
+            ref.cell = in.Resolve(world.cells);
+            ref.position = in.Get<Position>();
+            auto flags = in.Get<std::uint8_t>();
+            ref.disabled = flags & kDisabled;
+            ref.deleted = flags & kDeleted;
+            ref.loaded3D = flags & kLoaded3D;
+            ref.offLimits = flags & kOffLimits;
+            ref.inventoryObject = flags & kInventoryObject;
+            ref.playable = flags & kPlayable;
+            ref.questObject = flags & kQuestObject;
+            ref.collisionLayer = in.Get<std::int32_t>();
+            ref.actorOwner = in.Resolve(world.npcs);
+            ref.factionOwner = in.Resolve(world.factions);
+            ref.encounterZone = in.Resolve(world.encounterZones);
+            return ref;
+        }
+    }
+
+    bool SaveWorld(const World& world, const std::filesystem::path& path) {
+        Writer out(path);
+        Indices indices(world);
+
+        out.Put(kMagic);
+        out.Put(kVersion);
+        for (std::size_t size : { world.keywords.size(), world.factions.size(), world.npcs.size(), world.forms.size(),
+                 world.formLists.size(), world.encounterZones.size(), world.worldspaces.size(), world.cells.size(),
+                 world.refs.size(), world.actors.size() }) {
+            out.Put(static_cast<std::uint32_t>(size));
+        }
+
+        for (auto& keyword : world.keywords) {
+            out.Put(keyword.formId);
+        }
+        for (auto& faction : world.factions) {
+            out.Put(faction.formId);
+        }
+        for (auto& npc : world.npcs) {
+            out.Put(npc.formId);
+        }
+
+        for (auto& form : world.forms) {
+            out.Put(form.formId);
+            out.Put(static_cast<std::int32_t>(form.formType));
+            out.Put(static_cast<std::uint32_t>(form.keywords.size()));
+            for (auto* keyword : form.keywords) {
+                out.Put(indices.keywords(keyword));
+            }
+        }
+
+        for (auto& list : world.formLists) {
+            out.Put(static_cast<std::uint32_t>(list.forms.size()));
+            for (auto* form : list.forms) {
+                out.Put(indices.forms(form));
+            }
+            out.Put(static_cast<std::uint32_t>(list.lists.size()));
+            for (auto* nested : list.lists) {
+                out.Put(indices.formLists(nested));
+            }
+        }
+
+        for (auto& zone : world.encounterZones) {
+            out.Put(indices.factions(zone.ownerFaction));
+            out.Put(indices.npcs(zone.ownerNpc));
+            out.Put(static_cast<std::int32_t>(zone.ownerRank));
+        }
+
+        for (auto& worldspace : world.worldspaces) {
+            out.Put(indices.encounterZones(worldspace.encounterZone));
+        }
+
+        for (auto& cell : world.cells) {
+            out.Put(static_cast<std::uint8_t>(cell.attached));
+            out.Put(indices.npcs(cell.actorOwner));
+            out.Put(indices.factions(cell.factionOwner));
+            out.Put(indices.encounterZones(cell.encounterZone));
+            out.Put(indices.worldspaces(cell.worldspace));
+        }
+
+        for (auto& ref : world.refs) {
+            PutRef(out, indices, ref);
+        }
+
+        for (auto& actor : world.actors) {
+            out.Put(indices.npcs(actor.base));
+            out.Put(static_cast<std::uint32_t>(actor.factions.size()));
+            for (auto& [faction, rank] : actor.factions) {
+                out.Put(indices.factions(faction));
+                out.Put(static_cast<std::int32_t>(rank));
+            }
+        }
+
+        PutRef(out, indices, world.player);
+        return out.Ok();
+    }
+
+    bool LoadWorld(World& world, const std::filesystem::path& path) {
+        Reader in(path);
+
+        auto magic = in.Get<std::array<char, 4>>();
+        if (!in.Ok() || std::memcmp(magic.data(), kMagic, sizeof(kMagic)) != 0 || in.Get<std::uint32_t>() != kVersion) {
+            return false;
+        }
+
+        // everything is sized up front so indices can point forward, nested lists do
+        world.keywords.resize(in.Get<std::uint32_t>());
+        world.factions.resize(in.Get<std::uint32_t>());
+        world.npcs.resize(in.Get<std::uint32_t>());
+        world.forms.resize(in.Get<std::uint32_t>());
+        world.formLists.resize(in.Get<std::uint32_t>());
+        world.encounterZones.resize(in.Get<std::uint32_t>());
+        world.worldspaces.resize(in.Get<std::uint32_t>());
+        world.cells.resize(in.Get<std::uint32_t>());
+        auto refCount = in.Get<std::uint32_t>();
+        world.actors.resize(in.Get<std::uint32_t>());
+
+        for (auto& keyword : world.keywords) {
+            keyword.formId = in.Get<std::uint32_t>();
+        }
+        for (auto& faction : world.factions) {
+            faction.formId = in.Get<std::uint32_t>();
+        }
+        for (auto& npc : world.npcs) {
+            npc.formId = in.Get<std::uint32_t>();
+        }
+
+        for (auto& form : world.forms) {
+            form.formId = in.Get<std::uint32_t>();
+            form.formType = in.Get<std::int32_t>();
+            form.name = NameFor(form.formId);
+            auto keywordCount = in.Get<std::uint32_t>();
+            for (std::uint32_t i = 0; i < keywordCount && in.Ok(); i++) {
+                form.keywords.push_back(in.Resolve(world.keywords));
+            }
+        }
+
+        for (auto& list : world.formLists) {
+            auto formCount = in.Get<std::uint32_t>();
+            for (std::uint32_t i = 0; i < formCount && in.Ok(); i++) {
+                list.forms.push_back(in.Resolve(world.forms));
+            }
+            auto listCount = in.Get<std::uint32_t>();
+            for (std::uint32_t i = 0; i < listCount && in.Ok(); i++) {
+                list.lists.push_back(in.Resolve(world.formLists));
+            }
+        }
+
+        for (auto& zone : world.encounterZones) {
+            zone.ownerFaction = in.Resolve(world.factions);
+            zone.ownerNpc = in.Resolve(world.npcs);
+            zone.ownerRank = in.Get<std::int32_t>();
+        }
+
+        for (auto& worldspace : world.worldspaces) {
+            worldspace.encounterZone = in.Resolve(world.encounterZones);
+        }
+
+        for (auto& cell : world.cells) {
+            cell.attached = in.Get<std::uint8_t>() != 0;
+            cell.actorOwner = in.Resolve(world.npcs);
+            cell.factionOwner = in.Resolve(world.factions);
+            cell.encounterZone = in.Resolve(world.encounterZones);
+            cell.worldspace = in.Resolve(world.worldspaces);
+        }
+
+        for (std::uint32_t i = 0; i < refCount && in.Ok(); i++) {
+            world.refs.push_back(GetRef(in, world));
+        }
+
+        for (auto& actor : world.actors) {
+            actor.base = in.Resolve(world.npcs);
+            auto factionCount = in.Get<std::uint32_t>();
+            for (std::uint32_t i = 0; i < factionCount && in.Ok(); i++) {
+                auto* faction = in.Resolve(world.factions);
+                actor.factions.push_back({ faction, in.Get<std::int32_t>() });
+            }
+        }
+
+        world.player = GetRef(in, world);
+        return in.Ok();
+    }
+}
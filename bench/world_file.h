@@ -0,0 +1,16 @@
+#pragma once
+
+#include <filesystem>
+
+#include "mock_world.h"
+
+// Saves a generated world so a benchmark run can be repeated on exactly the same data, even
+// after the generator changes. Pointers are stored as 1-based indices into the owning deque,
+// 0 for null. Both return false on an I/O error or a file that isn't a world of this version.
+namespace skypal::mock {
+
+    bool SaveWorld(const World& world, const std::filesystem::path& path);
+
+    // world should be empty
+    bool LoadWorld(World& world, const std::filesystem::path& path);
+}
@@ -0,0 +1,403 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mock_world.h"
+
+// Builds mock worlds for the benchmarks. GenerateUniform sets every flag a filter looks at on
+// roughly `selectivity` of the refs, names that share of the bases kTargetName and places that
+// share of the refs in kTargetPlugin, so a sweep over selectivity sweeps how many refs pass.
+// GenerateProfile builds worlds shaped like real load orders instead: a few clutter bases with
+// thousands of copies, refs clustered inside cells, deep faction lists and nested formlists.
+namespace skypal::mock {
+
+    // the ids the benchmarks filter on
+    constexpr int kTargetFormType = 100;
+    constexpr int kTargetCollisionLayer = 5;
+    constexpr float kMaxDistance = 100000.0f;
+    constexpr float kCellSize = 4096.0f;
+    constexpr std::uint32_t kPlayerFormId = 0x14;
+    constexpr std::size_t kTargetPlugin = 1;  // uniform worlds' other forms are all in plugin 0
+
+    struct UniformParams {
+        std::size_t refCount = 1000;
+        float selectivity = 0.5f;
+        std::size_t keywordCount = 64;
+        std::size_t actorCount = 16;
+        std::size_t cellCount = 256;
+        std::uint32_t seed = 1;
+    };
+
+    // Full plugins get the top byte, light plugins share 0xFE with a 12 bit slot.
+    inline std::uint32_t MakeFormId(std::size_t plugin, std::uint32_t local) {
+        if (plugin < 0xFE) {
+            return (static_cast<std::uint32_t>(plugin) << 24) | (local & 0x00FFFFFF);
+        }
+        auto light = static_cast<std::uint32_t>(plugin - 0xFE) & 0xFFF;
+        return 0xFE000000 | (light << 12) | (local & 0xFFF);
+    }
+
+    // bases are spread evenly over the refs, one base per 64 refs
+    inline void GenerateUniform(World& world, const UniformParams& params) {
+        std::mt19937 rng(params.seed);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        auto chance = [&]() { return unit(rng) < params.selectivity; };
+        auto pick = [&](std::size_t size) { return std::uniform_int_distribution<std::size_t>(0, size - 1)(rng); };
+
+        std::uint32_t nextFormId = 0x00000800;
+
+        for (std::size_t i = 0; i < params.keywordCount; i++) {
+            world.keywords.push_back({ nextFormId++ });
+        }
+
+        for (std::size_t i = 0; i < 8; i++) {
+            world.factions.push_back({ nextFormId++ });
+        }
+
+        for (std::size_t i = 0; i < params.actorCount * 2; i++) {
+            world.npcs.push_back({ nextFormId++ });
+        }
+
+        // the first half of the npcs are actors, the rest only own things
+        for (std::size_t i = 0; i < params.actorCount; i++) {
+            Actor actor;
+            actor.base = &world.npcs[i];
+            actor.factions.push_back({ &world.factions[i % world.factions.size()], static_cast<int>(i % 4) });
+            world.actors.push_back(actor);
+        }
+
+        std::size_t baseCount = std::max<std::size_t>(16, params.refCount / 64);
+        for (std::size_t i = 0; i < baseCount; i++) {
+            Form form;
+            form.formId = nextFormId++;
+            form.formType = chance() ? kTargetFormType : 200 + static_cast<int>(pick(20));
+            form.name = chance() ? std::string(kTargetName) : NameFor(form.formId);
+            if (chance()) {
+                form.keywords.push_back(&world.keywords[0]);
+            }
+            for (std::size_t k = 0; k < 3; k++) {
+                form.keywords.push_back(&world.keywords[1 + pick(params.keywordCount - 1)]);
+            }
+            world.forms.push_back(std::move(form));
+        }
+
+        auto& zone = world.encounterZones.emplace_back();
+        zone.ownerFaction = &world.factions[1];
+        zone.ownerRank = 2;
+
+        world.worldspaces.push_back({ &zone });
+        world.worldspaces.push_back({ nullptr });
+
+        for (std::size_t i = 0; i < params.cellCount; i++) {
+            Cell cell;
+            cell.attached = chance();
+            cell.worldspace = &world.worldspaces[chance() ? 0 : 1];
+            world.cells.push_back(cell);
+        }
+
+        for (std::size_t i = 0; i < params.refCount; i++) {
+            Ref ref;
+            ref.formId = MakeFormId(chance() ? kTargetPlugin : 0, nextFormId++);
+            ref.base = &world.forms[pick(world.forms.size())];
+            ref.cell = &world.cells[pick(world.cells.size())];
+
+            // uniform distance from the origin, so "closer than selectivity * kMaxDistance" hits selectivity
+            float distance = unit(rng) * kMaxDistance;
+            float angle = unit(rng) * 6.2831853f;
+            ref.position = { distance * std::cos(angle), distance * std::sin(angle), 0.0f };
+
+            ref.disabled = chance();
+            ref.deleted = chance();
+            ref.loaded3D = chance();
+            ref.offLimits = chance();
+            ref.inventoryObject = chance();
+            ref.playable = chance();
+            ref.questObject = chance();
+            ref.collisionLayer = chance() ? kTargetCollisionLayer : 1 + static_cast<int>(pick(40));
+
+            // owned by the first actor, otherwise by someone else about half the time
+            if (chance()) {
+                ref.actorOwner = world.actors[0].base;
+            }
+            else if (unit(rng) < 0.5f) {
+                ref.actorOwner = &world.npcs[params.actorCount + pick(params.actorCount)];
+            }
+
+            world.refs.push_back(ref);
+        }
+
+        world.player.formId = kPlayerFormId;
+    }
+
+    // Everything a profile world is shaped by. Skews are zipf exponents, 0 is uniform.
+    struct WorldProfile {
+        std::string_view name;
+        std::size_t refCount = 0;
+        std::size_t cellCount = 0;
+        std::size_t attachedCells = 0;  // the loaded grid, from the start of the cell list
+        float cellSkew = 0.0f;          // how unevenly the refs spread over the cells
+        std::size_t baseCount = 0;
+        float baseSkew = 0.0f;          // how often the popular bases are reused
+        std::size_t keywordCount = 0;
+        std::size_t minKeywordsPerBase = 0;
+        std::size_t maxKeywordsPerBase = 0;
+        std::size_t pluginCount = 1;    // past 0xFE the plugins are light, like .esl files
+        std::size_t npcCount = 0;
+        std::size_t actorCount = 0;
+        std::size_t factionCount = 0;
+        std::size_t factionsPerActor = 0;
+        std::size_t zoneCount = 0;
+        float ownedCellChance = 0.0f;   // the cell has an actor or faction owner
+        float zonedCellChance = 0.0f;   // the cell has an encounter zone
+        float ownedRefChance = 0.0f;    // the ref has its own owner
+        std::size_t formListCount = 0;  // per nesting level
+        std::size_t formListDepth = 0;
+        std::size_t formsPerList = 0;
+    };
+
+    inline constexpr WorldProfile kProfiles[] = {
+        // Skyrim.esm plus the DLCs and the creation club basics
+        { .name = "vanilla",
+          .refCount = 250000, .cellCount = 12000, .attachedCells = 25, .cellSkew = 0.6f,
+          .baseCount = 20000, .baseSkew = 1.1f,
+          .keywordCount = 600, .minKeywordsPerBase = 0, .maxKeywordsPerBase = 4,
+          .pluginCount = 5,
+          .npcCount = 3000, .actorCount = 600, .factionCount = 900, .factionsPerActor = 4,
+          .zoneCount = 400, .ownedCellChance = 0.15f, .zonedCellChance = 0.4f, .ownedRefChance = 0.05f,
+          .formListCount = 200, .formListDepth = 2, .formsPerList = 12 },
+        // a heavy modded load order, lots of light plugins each adding a little
+        { .name = "400-plugin",
+          .refCount = 1500000, .cellCount = 40000, .attachedCells = 49, .cellSkew = 0.8f,
+          .baseCount = 120000, .baseSkew = 1.0f,
+          .keywordCount = 3000, .minKeywordsPerBase = 1, .maxKeywordsPerBase = 8,
+          .pluginCount = 400,
+          .npcCount = 12000, .actorCount = 2000, .factionCount = 4000, .factionsPerActor = 8,
+          .zoneCount = 1500, .ownedCellChance = 0.2f, .zonedCellChance = 0.5f, .ownedRefChance = 0.08f,
+          .formListCount = 800, .formListDepth = 4, .formsPerList = 24 },
+        // a few crowded interiors and exteriors, everything owned and everyone in many factions
+        { .name = "city-dense",
+          .refCount = 60000, .cellCount = 120, .attachedCells = 49, .cellSkew = 0.3f,
+          .baseCount = 4000, .baseSkew = 1.2f,
+          .keywordCount = 400, .minKeywordsPerBase = 1, .maxKeywordsPerBase = 6,
+          .pluginCount = 20,
+          .npcCount = 1500, .actorCount = 1500, .factionCount = 300, .factionsPerActor = 24,
+          .zoneCount = 40, .ownedCellChance = 0.8f, .zonedCellChance = 0.9f, .ownedRefChance = 0.4f,
+          .formListCount = 100, .formListDepth = 3, .formsPerList = 16 },
+    };
+
+    inline const WorldProfile* FindProfile(std::string_view name) {
+        for (auto& profile : kProfiles) {
+            if (profile.name == name) {
+                return &profile;
+            }
+        }
+        return nullptr;
+    }
+
+    // Draws indices in [0, size) with weight 1 / (i + 1)^skew.
+    class ZipfIndex {
+    public:
+        ZipfIndex(std::size_t size, float skew) {
+            cumulative.reserve(size);
+            double total = 0.0;
+            for (std::size_t i = 0; i < size; i++) {
+                total += 1.0 / std::pow(static_cast<double>(i + 1), skew);
+                cumulative.push_back(total);
+            }
+        }
+
+        template <class Rng>
+        std::size_t operator()(Rng& rng) const {
+            double draw = std::uniform_real_distribution<double>(0.0, cumulative.back())(rng);
+            auto it = std::upper_bound(cumulative.begin(), cumulative.end(), draw);
+            return std::min<std::size_t>(it - cumulative.begin(), cumulative.size() - 1);
+        }
+
+    private:
+        std::vector<double> cumulative;
+    };
+
+    inline void GenerateProfile(World& world, const WorldProfile& profile, std::uint32_t seed) {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        auto chance = [&](float p) { return unit(rng) < p; };
+        auto pick = [&](std::size_t size) { return std::uniform_int_distribution<std::size_t>(0, size - 1)(rng); };
+
+        // the master holds most records, later plugins fewer and fewer
+        ZipfIndex pluginIndex(profile.pluginCount, 1.0f);
+        std::vector<std::uint32_t> nextLocalId(profile.pluginCount, 0x800);
+        auto nextFormId = [&]() {
+            auto plugin = pluginIndex(rng);
+            return MakeFormId(plugin, nextLocalId[plugin]++);
+        };
+
+        for (std::size_t i = 0; i < profile.keywordCount; i++) {
+            world.keywords.push_back({ nextFormId() });
+        }
+        for (std::size_t i = 0; i < profile.factionCount; i++) {
+            world.factions.push_back({ nextFormId() });
+        }
+        for (std::size_t i = 0; i < profile.npcCount; i++) {
+            world.npcs.push_back({ nextFormId() });
+        }
+
+        // crime and town factions are shared by many actors, so faction membership is skewed too
+        ZipfIndex factionIndex(profile.factionCount, 0.8f);
+        for (std::size_t i = 0; i < profile.actorCount; i++) {
+            Actor actor;
+            actor.base = &world.npcs[i % world.npcs.size()];
+            for (std::size_t f = 0; f < profile.factionsPerActor; f++) {
+                actor.factions.push_back({ &world.factions[factionIndex(rng)], static_cast<int>(pick(5)) - 1 });
+            }
+            world.actors.push_back(std::move(actor));
+        }
+
+        // statics dominate, then clutter; kTargetFormType plays the misc item
+        constexpr std::pair<int, float> kFormTypes[] = {
+            { 34, 0.45f }, { kTargetFormType, 0.15f }, { 28, 0.05f }, { 29, 0.03f }, { 31, 0.07f },
+            { 39, 0.05f }, { 38, 0.05f }, { 40, 0.05f }, { 26, 0.05f }, { 41, 0.05f },
+        };
+        auto pickFormType = [&]() {
+            float draw = unit(rng);
+            for (auto [formType, weight] : kFormTypes) {
+                if (draw < weight) {
+                    return formType;
+                }
+                draw -= weight;
+            }
+            return kFormTypes[0].first;
+        };
+
+        ZipfIndex keywordIndex(profile.keywordCount, 1.0f);
+        for (std::size_t i = 0; i < profile.baseCount; i++) {
+            Form form;
+            form.formId = nextFormId();
+            form.formType = pickFormType();
+            form.name = NameFor(form.formId);
+            std::size_t keywordCount = profile.minKeywordsPerBase +
+                pick(profile.maxKeywordsPerBase - profile.minKeywordsPerBase + 1);
+            for (std::size_t k = 0; k < keywordCount; k++) {
+                form.keywords.push_back(&world.keywords[keywordIndex(rng)]);
+            }
+            world.forms.push_back(std::move(form));
+        }
+
+        // the deepest lists hold forms, each level above holds the level below
+        std::size_t levelStart = 0;
+        for (std::size_t level = 0; level < profile.formListDepth; level++) {
+            std::size_t childStart = levelStart;
+            std::size_t childCount = level == 0 ? 0 : profile.formListCount;
+            levelStart = world.formLists.size();
+            for (std::size_t i = 0; i < profile.formListCount; i++) {
+                FormList list;
+                for (std::size_t f = 0; f < profile.formsPerList; f++) {
+                    list.forms.push_back(&world.forms[pick(world.forms.size())]);
+                }
+                for (std::size_t c = 0; c < childCount && c < 2; c++) {
+                    list.lists.push_back(&world.formLists[childStart + pick(childCount)]);
+                }
+                world.formLists.push_back(std::move(list));
+            }
+        }
+
+        for (std::size_t i = 0; i < profile.zoneCount; i++) {
+            auto& zone = world.encounterZones.emplace_back();
+            if (chance(0.3f)) {
+                zone.ownerFaction = &world.factions[factionIndex(rng)];
+                zone.ownerRank = static_cast<int>(pick(4));
+            }
+            else if (chance(0.1f)) {
+                zone.ownerNpc = &world.npcs[pick(world.npcs.size())];
+            }
+        }
+        auto pickZone = [&]() -> const EncounterZone* {
+            return world.encounterZones.empty() ? nullptr : &world.encounterZones[pick(world.encounterZones.size())];
+        };
+
+        // Tamriel and a few smaller worldspaces, interiors have none
+        world.worldspaces.push_back({ pickZone() });
+        for (std::size_t i = 0; i < 7; i++) {
+            world.worldspaces.push_back({ pickZone() });
+        }
+        ZipfIndex worldspaceIndex(world.worldspaces.size(), 2.0f);
+
+        // cells sit on a square grid, the attached ones around the first cell
+        auto gridSide = static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<double>(profile.cellCount))));
+        std::vector<Position> cellOrigins;
+        for (std::size_t i = 0; i < profile.cellCount; i++) {
+            Cell cell;
+            cell.attached = i < profile.attachedCells;
+            cell.worldspace = chance(0.7f) ? &world.worldspaces[worldspaceIndex(rng)] : nullptr;
+            if (chance(profile.ownedCellChance)) {
+                if (chance(0.5f)) {
+                    cell.factionOwner = &world.factions[factionIndex(rng)];
+                }
+                else {
+                    cell.actorOwner = &world.npcs[pick(world.npcs.size())];
+                }
+            }
+            if (chance(profile.zonedCellChance)) {
+                cell.encounterZone = pickZone();
+            }
+            world.cells.push_back(cell);
+            cellOrigins.push_back({ static_cast<float>(i % gridSide) * kCellSize, static_cast<float>(i / gridSide) * kCellSize, 0.0f });
+        }
+
+        // refs gather around a few clusters in each cell, a room, a market stall, a camp
+        std::vector<std::array<Position, 4>> clusters(profile.cellCount);
+        for (std::size_t i = 0; i < profile.cellCount; i++) {
+            for (auto& cluster : clusters[i]) {
+                cluster = { cellOrigins[i].x + unit(rng) * kCellSize, cellOrigins[i].y + unit(rng) * kCellSize, unit(rng) * 512.0f };
+            }
+        }
+
+        ZipfIndex cellIndex(profile.cellCount, profile.cellSkew);
+        ZipfIndex baseIndex(profile.baseCount, profile.baseSkew);
+        std::normal_distribution<float> spread(0.0f, 256.0f);
+        for (std::size_t i = 0; i < profile.refCount; i++) {
+            Ref ref;
+            ref.formId = nextFormId();
+            ref.base = &world.forms[baseIndex(rng)];
+
+            // the popular cells are shuffled over the grid so the attached ones aren't always the busiest
+            auto cell = (cellIndex(rng) * 7919) % profile.cellCount;
+            ref.cell = &world.cells[cell];
+            auto& cluster = clusters[cell][pick(4)];
+            ref.position = { cluster.x + spread(rng), cluster.y + spread(rng), cluster.z + spread(rng) * 0.25f };
+
+            ref.disabled = chance(0.03f);
+            ref.deleted = chance(0.01f);
+            ref.loaded3D = ref.cell->attached && !ref.disabled;
+            ref.offLimits = ref.cell->actorOwner || ref.cell->factionOwner;
+            ref.inventoryObject = ref.base->formType == kTargetFormType || ref.base->formType == 26 || ref.base->formType == 41;
+            ref.playable = ref.inventoryObject && chance(0.95f);
+            ref.questObject = chance(0.005f);
+            ref.collisionLayer = ref.inventoryObject ? kTargetCollisionLayer : (ref.base->formType == 34 ? 1 : 4);
+
+            if (chance(profile.ownedRefChance)) {
+                if (chance(0.6f)) {
+                    ref.actorOwner = &world.npcs[pick(world.npcs.size())];
+                }
+                else {
+                    ref.factionOwner = &world.factions[factionIndex(rng)];
+                }
+            }
+            if (chance(0.02f)) {
+                ref.encounterZone = pickZone();
+            }
+
+            world.refs.push_back(ref);
+        }
+
+        world.player.formId = kPlayerFormId;
+        world.player.cell = world.cells.empty() ? nullptr : &world.cells[0];
+        world.player.position = { kCellSize * 0.5f, kCellSize * 0.5f, 0.0f };
+    }
+}
@@ -0,0 +1,38 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "world_file.h"
+#include "world_generator.h"
+
+// skypal_worldgen <profile> <out file> [seed]
+// Writes a profile world for skypal_bench --skypal_world=<out file>.
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::fprintf(stderr, "usage: %s <profile> <out file> [seed]\nprofiles:", argv[0]);
+        for (auto& profile : skypal::mock::kProfiles) {
+            std::fprintf(stderr, " %.*s", static_cast<int>(profile.name.size()), profile.name.data());
+        }
+        std::fprintf(stderr, "\n");
+        return 1;
+    }
+
+    auto* profile = skypal::mock::FindProfile(argv[1]);
+    if (!profile) {
+        std::fprintf(stderr, "unknown profile %s\n", argv[1]);
+        return 1;
+    }
+
+    std::uint32_t seed = argc > 3 ? static_cast<std::uint32_t>(std::strtoul(argv[3], nullptr, 0)) : 1;
+
+    skypal::mock::World world;
+    skypal::mock::GenerateProfile(world, *profile, seed);
+    if (!skypal::mock::SaveWorld(world, argv[2])) {
+        std::fprintf(stderr, "couldn't write %s\n", argv[2]);
+        return 1;
+    }
+
+    std::printf("%s seed %u: %zu refs, %zu bases, %zu cells -> %s\n", argv[1], seed, world.refs.size(),
+        world.forms.size(), world.cells.size(), argv[2]);
+    return 0;
+}
@@ -1,12 +1,82 @@
 #include <Windows.h>
+#include <spdlog/async.h>
 #include <spdlog/sinks/basic_file_sink.h>
 #include <iostream>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include "mini/ini.h"
+#include "skypal/stats.h"
+#include "skypal/trace.h"
+#include "skypal/record.h"
+#include "skypal/arena.h"
+#include "skypal/bulk.h"
+#include "skypal/core.h"
+#include "skypal/engine_traits.h"
+#include "skypal/names.h"
+#include "skypal/papyrus.h"
+#include "skypal/plugins.h"
+#include "skypal/rcu.h"
+#include "skypal/ref_index.h"
+#include "skypal/snapshot.h"
+#include "skypal/thread_pool.h"
 
 std::chrono::steady_clock::time_point pluginStartTimePoint;
 
+// bulk mutation settings, read from [BULK] in doticu_skypal.ini
+float bulkFrameBudgetMs = 2.0f;
+int bulkQueueThreshold = 128;
+int bulkDrainIntervalMs = 16;
+int asyncTimeoutMs = 10000;
+float asyncFrameBudgetMs = 2.0f;
+int asyncSliceIntervalMs = 16;
+bool twoPhaseEnabled = false;
+int twoPhaseMinRefs = 4096;
+int twoPhaseThreads = 0;
+bool refIndexEnabled = true;
+bool nameTrigramsEnabled = true;
+
 namespace logger = SKSE::log;
+namespace core = skypal::core;
+using Engine = skypal::EngineTraits;
+using RefArray = skypal::papyrus::Array<RE::TESObjectREFR*>;
+
+int GetIniInt(mINI::INIStructure& ini, std::string section, std::string key, int defaultValue) {
+    std::string value = ini.get(section).get(key);
+    if (value == "") {
+        return defaultValue;
+    }
+
+    try {
+        return std::stoi(value);
+    }
+    catch (...) {
+        logger::error("{} [{}] {} = {} is not a number, using {}", __func__, section, key, value, defaultValue);
+        return defaultValue;
+    }
+}
+
+float GetIniFloat(mINI::INIStructure& ini, std::string section, std::string key, float defaultValue) {
+    std::string value = ini.get(section).get(key);
+    if (value == "") {
+        return defaultValue;
+    }
+
+    try {
+        return std::stof(value);
+    }
+    catch (...) {
+        logger::error("{} [{}] {} = {} is not a number, using {}", __func__, section, key, value, defaultValue);
+        return defaultValue;
+    }
+}
 
 void SetupLog() {
     // first, create a file instance
@@ -18,22 +88,105 @@ void SetupLog() {
     // now we can read the file
     file.read(ini);
 
-    std::string akLevel = ini["LOG"]["iMinLevel"];
-    spdlog::level::level_enum iLevel = static_cast<spdlog::level::level_enum>(std::stoi(akLevel));
+    spdlog::level::level_enum iLevel = static_cast<spdlog::level::level_enum>(GetIniInt(ini, "LOG", "iMinLevel", spdlog::level::info));
+
+    // messages are formatted on the calling thread and written by one background thread,
+    // the file is flushed every iFlushIntervalSeconds and on errors.
+    int queueSize = GetIniInt(ini, "LOG", "iQueueSize", 8192);
+    int flushIntervalSeconds = GetIniInt(ini, "LOG", "iFlushIntervalSeconds", 3);
+    if (queueSize < 64) {
+        queueSize = 64;
+    }
+    if (flushIntervalSeconds < 1) {
+        flushIntervalSeconds = 1;
+    }
 
     auto logsFolder = SKSE::log::log_directory();
     if (!logsFolder) SKSE::stl::report_and_fail("SKSE log_directory not provided, logs disabled.");
     auto pluginName = SKSE::PluginDeclaration::GetSingleton()->GetName();
     auto logFilePath = *logsFolder / std::format("{}.log", pluginName);
     auto fileLoggerPtr = std::make_shared<spdlog::sinks::basic_file_sink_mt>(logFilePath.string(), true);
-    auto loggerPtr = std::make_shared<spdlog::logger>("log", std::move(fileLoggerPtr));
+    spdlog::init_thread_pool(queueSize, 1);
+    auto loggerPtr = std::make_shared<spdlog::async_logger>("log", std::move(fileLoggerPtr), spdlog::thread_pool(), spdlog::async_overflow_policy::overrun_oldest);
     spdlog::set_default_logger(std::move(loggerPtr));
-    spdlog::set_level(spdlog::level::level_enum::trace);
-    spdlog::flush_on(spdlog::level::trace);
-    logger::trace("{} level set to {}", __func__, iLevel);
     spdlog::set_level(iLevel);
-    
-} 
+    spdlog::flush_on(spdlog::level::err);
+    spdlog::flush_every(std::chrono::seconds(flushIntervalSeconds));
+    logger::info("{} level set to {}, queue size {}, flush interval {}s", __func__, static_cast<int>(iLevel), queueSize, flushIntervalSeconds);
+}
+
+std::string GetRecordingPath() {
+    auto logsFolder = SKSE::log::log_directory();
+    if (!logsFolder) {
+        return "";
+    }
+    return (*logsFolder / "doticu_skypal_calls.skpr").string();
+}
+
+void LoadSettings() {
+    mINI::INIFile file("Data/SKSE/Plugins/doticu_skypal.ini");
+    mINI::INIStructure ini;
+    file.read(ini);
+
+    bulkFrameBudgetMs = GetIniFloat(ini, "BULK", "fFrameBudgetMs", bulkFrameBudgetMs);
+    bulkQueueThreshold = GetIniInt(ini, "BULK", "iQueueThreshold", bulkQueueThreshold);
+    bulkDrainIntervalMs = GetIniInt(ini, "BULK", "iDrainIntervalMs", bulkDrainIntervalMs);
+
+    if (bulkFrameBudgetMs <= 0.0f) {
+        bulkFrameBudgetMs = 0.1f;
+    }
+    if (bulkDrainIntervalMs < 1) {
+        bulkDrainIntervalMs = 1;
+    }
+
+    logger::info("{} bulk budget {}ms, threshold {}, interval {}ms", __func__, bulkFrameBudgetMs, bulkQueueThreshold, bulkDrainIntervalMs);
+
+    asyncTimeoutMs = GetIniInt(ini, "ASYNC", "iTimeoutMs", asyncTimeoutMs);
+    asyncFrameBudgetMs = GetIniFloat(ini, "ASYNC", "fFrameBudgetMs", asyncFrameBudgetMs);
+    asyncSliceIntervalMs = GetIniInt(ini, "ASYNC", "iSliceIntervalMs", asyncSliceIntervalMs);
+    if (asyncTimeoutMs < 1) {
+        asyncTimeoutMs = 1;
+    }
+    if (asyncFrameBudgetMs <= 0.0f) {
+        asyncFrameBudgetMs = 0.1f;
+    }
+    if (asyncSliceIntervalMs < 1) {
+        asyncSliceIntervalMs = 1;
+    }
+    logger::info("{} async budget {}ms, interval {}ms, timeout {}ms", __func__, asyncFrameBudgetMs, asyncSliceIntervalMs, asyncTimeoutMs);
+
+    twoPhaseEnabled = (GetIniInt(ini, "PARALLEL", "bEnabled", 0) != 0);
+    twoPhaseMinRefs = GetIniInt(ini, "PARALLEL", "iMinRefs", twoPhaseMinRefs);
+    twoPhaseThreads = GetIniInt(ini, "PARALLEL", "iThreads", twoPhaseThreads);
+    logger::info("{} two phase filters enabled: {}, from {} refs", __func__, twoPhaseEnabled, twoPhaseMinRefs);
+
+    refIndexEnabled = (GetIniInt(ini, "INDEX", "bEnabled", 1) != 0);
+    logger::info("{} ref index enabled: {}", __func__, refIndexEnabled);
+
+    nameTrigramsEnabled = (GetIniInt(ini, "NAMES", "bTrigramIndex", 1) != 0);
+    logger::info("{} name trigram index enabled: {}", __func__, nameTrigramsEnabled);
+
+    skypal::arena::enabled = (GetIniInt(ini, "ARENA", "bEnabled", 1) != 0);
+    logger::info("{} per-call arena enabled: {}", __func__, skypal::arena::enabled.load());
+
+    skypal::stats::enabled = (GetIniInt(ini, "STATS", "bEnabled", 0) != 0);
+    logger::info("{} native call stats enabled: {}", __func__, skypal::stats::enabled.load());
+
+    if (GetIniInt(ini, "TRACE", "bEnabled", 0) != 0) {
+        skypal::trace::Tracer::GetSingleton()->Start();
+        logger::info("{} native call tracing started, call SkyPal.Stop_Trace() to write it", __func__);
+    }
+
+    if (GetIniInt(ini, "RECORD", "bEnabled", 0) != 0) {
+        auto recordPath = GetRecordingPath();
+        if (recordPath != "" && skypal::record::Recorder::GetSingleton()->Start(recordPath)) {
+            logger::info("{} native call recording started, call SkyPal.Stop_Recording() to finish it", __func__);
+        }
+        else {
+            logger::error("{} couldn't start native call recording", __func__);
+        }
+    }
+}
 
 template< typename T >
 std::string IntToHex(T i)
@@ -73,21 +226,6 @@ RE::BSFixedString GetFormName(RE::TESForm* akForm, RE::BSFixedString nullString
     return name;
 }
 
-int GetIndexInVector(std::vector<int>& v, int element) {
-    if (v.size() == 0) {
-        return -1;
-    }
-
-    int m = v.size();
-    for (int i = 0; i < m; i++) {
-        if (v[i] == element) {
-            return i;
-        }
-    }
-
-    return -1;
-}
-
 
 static inline void CompileAndRunImpl(RE::Script* script, RE::ScriptCompiler* compiler, RE::COMPILER_NAME name, RE::TESObjectREFR* targetRef) {
     using func_t = decltype(CompileAndRunImpl);
@@ -131,1479 +269,2860 @@ static inline void ExecuteConsoleCommand(std::string a_command, RE::TESObjectREF
     }
 }
 
-std::vector<RE::TESObjectREFR*> All(RE::StaticFunctionTag*) {
-    std::vector<RE::TESObjectREFR*> refs;
-    const auto& [allForms, lock] = RE::TESForm::GetAllForms();
-    for (auto& [id, form] : *allForms) {
-        auto* ref = form->AsReference();
-        if (ref) {
-            refs.push_back(ref);
-        }
-    }
+void ApplyCollisionLayerType(RE::TESObjectREFR* ref, RE::COL_LAYER coLayer);
 
-    return refs;
-}
+// Queues Disable / Enable / collision layer changes and applies them on the main thread,
+// a slice per frame, so mass toggles don't land in a single frame (bookkeeping in skypal/bulk.h).
+// Operations on the same ref coalesce: the last enable state and the last collision layer win.
+// When every ref of a batch has been applied, a "SkyPal_Bulk_Complete" mod event is sent with
+// the operation name as strArg and the batch id as numArg.
+class BulkMutationQueue {
+public:
+    enum class Operation : std::uint8_t {
+        kDisable,
+        kEnable,
+        kCollisionLayer
+    };
 
-std::vector<RE::TESObjectREFR*> Grid(RE::StaticFunctionTag*) {
-    std::vector<RE::TESObjectREFR*> refs;
-    const auto& [allForms, lock] = RE::TESForm::GetAllForms();
-    for (auto& [id, form] : *allForms) {
-        auto* ref = form->AsReference();
-        if (ref) {
-            auto* cell = ref->GetParentCell();
-            if (cell) {
-                if (cell->IsAttached()) {
-                    refs.push_back(ref);
-                }
-            }
-        }
+    static BulkMutationQueue* GetSingleton() {
+        static BulkMutationQueue singleton;
+        return &singleton;
     }
 
-    return refs;
-}
+    std::uint32_t Enqueue(std::vector<RE::TESObjectREFR*>& refs, Operation op, int value, std::string name) {
+        std::uint32_t batchId;
+        {
+            std::lock_guard lock(mutex);
+            batchId = queue.Begin(std::move(name));
+            for (auto* ref : refs) {
+                if (!ref) {
+                    continue;
+                }
 
-std::vector<RE::TESObjectREFR*> All_Filter_Bases(RE::StaticFunctionTag*, std::vector<RE::TESForm*> bases, std::string mode) {
-    std::vector<RE::TESObjectREFR*> refs;
-    const auto& [allForms, lock] = RE::TESForm::GetAllForms();
-    if (mode == "!") {
-        for (auto& [id, form] : *allForms) {
-            auto* ref = form->AsReference();
-            if (ref) {
-                if (std::find(bases.begin(), bases.end(), ref->GetBaseObject()) == bases.end()) {
-                    refs.push_back(ref);
+                // enable and disable share a slot, so the last enable state wins
+                std::uint64_t slot = (op == Operation::kCollisionLayer) ? 1 : 0;
+                std::uint64_t key = (static_cast<std::uint64_t>(ref->GetFormID()) << 1) | slot;
+
+                auto& mutation = queue.Add(batchId, key);
+                if (!mutation.handle) {
+                    mutation.handle = ref->CreateRefHandle();
                 }
+                mutation.op = op;
+                mutation.value = value;
             }
+            queue.End(batchId);
         }
-    }
-    else {
-        for (auto& [id, form] : *allForms) {
-            auto* ref = form->AsReference();
-            if (ref) {
-                if (std::find(bases.begin(), bases.end(), ref->GetBaseObject()) != bases.end()) {
-                    refs.push_back(ref);
-                }
-            }
+
+        if (!drainThreadStarted.exchange(true)) {
+            std::thread(&BulkMutationQueue::DrainLoop, this).detach();
         }
-    }
+        wakeDrain.notify_one();
 
-    return refs;
-}
+        return batchId;
+    }
 
-std::vector<RE::TESObjectREFR*> All_Filter_Bases_Form_List(RE::StaticFunctionTag*, RE::BGSListForm* akFormlist, std::string mode) {
-    std::vector<RE::TESObjectREFR*> refs;
-    const auto& [allForms, lock] = RE::TESForm::GetAllForms();
-    if (mode == "!") {
-        for (auto& [id, form] : *allForms) {
-            auto* ref = form->AsReference();
-            if (ref) {
-                if (!akFormlist->HasForm(ref->GetBaseObject())) {
-                    refs.push_back(ref);
-                }
-            }
-        }
+    std::uint32_t GetLastBatchId() {
+        std::lock_guard lock(mutex);
+        return queue.LastBatchId();
     }
-    else {
-        for (auto& [id, form] : *allForms) {
-            auto* ref = form->AsReference();
-            if (ref) {
-                if (akFormlist->HasForm(ref->GetBaseObject())) {
-                    refs.push_back(ref);
-                }
-            }
-        }
+
+    int GetPendingCount() {
+        std::lock_guard lock(mutex);
+        return static_cast<int>(queue.Size());
     }
 
-    return refs;
-}
+private:
+    struct Mutation {
+        RE::ObjectRefHandle handle;
+        Operation op = Operation::kDisable;
+        int value = 0;
+    };
 
-std::vector<RE::TESObjectREFR*> Grid_Filter_Bases(RE::StaticFunctionTag*, std::vector<RE::TESForm*> bases, std::string mode) {
-    std::vector<RE::TESObjectREFR*> refs;
+    using Queue = skypal::bulk::Queue<Mutation>;
 
-    auto* tes = RE::TES::GetSingleton();
-    if (!tes) {
-        logger::error("{} couldn't get TES singleton", __func__);
-        return refs;
-    }
+    BulkMutationQueue() = default;
 
-    if (mode == "!") {
-        tes->ForEachReference([&](RE::TESObjectREFR& akRef) {
-            RE::TESObjectREFR* ref = &akRef;
-            if (ref) {
-                if (std::find(bases.begin(), bases.end(), ref->GetBaseObject()) == bases.end()) {
-                    refs.push_back(ref);
-                }
+    // The task interface runs everything queued before it returns, so the next slice is only
+    // queued once the previous one has run and the drain interval has passed.
+    void DrainLoop() {
+        while (true) {
+            {
+                std::unique_lock lock(mutex);
+                wakeDrain.wait(lock, [this]() { return !queue.Idle(); });
+                sliceDone = false;
             }
-            return RE::BSContainer::ForEachResult::kContinue;
-            });
-    }
-    else {
-        tes->ForEachReference([&](RE::TESObjectREFR& akRef) {
-            RE::TESObjectREFR* ref = &akRef;
-            if (ref) {
-                if (std::find(bases.begin(), bases.end(), ref->GetBaseObject()) != bases.end()) {
-                    refs.push_back(ref);
+
+            SKSE::GetTaskInterface()->AddTask([this]() {
+                DrainSlice();
+                {
+                    std::lock_guard lock(mutex);
+                    sliceDone = true;
                 }
-            }
-            return RE::BSContainer::ForEachResult::kContinue;
+                wakeDrain.notify_one();
             });
-    }
 
-    return refs;
-}
-
-std::vector<RE::TESObjectREFR*> Grid_Filter_Bases_Form_List(RE::StaticFunctionTag*, RE::BGSListForm* bases, std::string mode) {
-    std::vector<RE::TESObjectREFR*> refs;
+            {
+                std::unique_lock lock(mutex);
+                wakeDrain.wait(lock, [this]() { return sliceDone; });
+            }
 
-    auto* tes = RE::TES::GetSingleton();
-    if (!tes) {
-        logger::error("{} couldn't get TES singleton", __func__);
-        return refs;
+            std::this_thread::sleep_for(std::chrono::milliseconds(bulkDrainIntervalMs));
+        }
     }
 
-    if (mode == "!") {
-        tes->ForEachReference([&](RE::TESObjectREFR& akRef) {
-            RE::TESObjectREFR* ref = &akRef;
-            if (ref) {
-                if (!bases->HasForm(ref->GetBaseObject())) {
-                    refs.push_back(ref);
-                }
-            }
-            return RE::BSContainer::ForEachResult::kContinue;
-            });
-    }
-    else {
-        tes->ForEachReference([&](RE::TESObjectREFR& akRef) {
-            RE::TESObjectREFR* ref = &akRef;
-            if (ref) {
-                if (bases->HasForm(ref->GetBaseObject())) {
-                    refs.push_back(ref);
-                }
+    // main thread only
+    void DrainSlice() {
+        auto start = std::chrono::steady_clock::now();
+        auto budget = std::chrono::duration<float, std::milli>(bulkFrameBudgetMs);
+        int applied = 0;
+
+        while (std::chrono::steady_clock::now() - start < budget) {
+            std::vector<Queue::Entry> chunk;
+            {
+                std::lock_guard lock(mutex);
+                queue.Take(32, chunk);
             }
-            return RE::BSContainer::ForEachResult::kContinue;
-            });
-    }
 
-    return refs;
-}
+            if (chunk.empty()) {
+                break;
+            }
 
-int Count_Disabled(RE::StaticFunctionTag*, std::vector<RE::TESObjectREFR*> refs) {
-    int count = 0;
-    for (int i = 0; i < refs.size(); i++) {
-        if (refs[i]) {
-            if (refs[i]->IsDisabled()) {
-                count += 1;
+            for (auto& entry : chunk) {
+                Apply(entry.item);
             }
-        }
-    }
-    return count;
-}
+            applied += static_cast<int>(chunk.size());
 
-int Count_Enabled(RE::StaticFunctionTag*, std::vector<RE::TESObjectREFR*> refs) {
-    int count = 0;
-    for (int i = 0; i < refs.size(); i++) {
-        if (refs[i]) {
-            if (!refs[i]->IsDisabled()) {
-                count += 1;
+            std::lock_guard lock(mutex);
+            for (auto& entry : chunk) {
+                queue.Finish(entry.batchId);
             }
         }
-    }
-    return count;
-}
 
-void Disable(RE::StaticFunctionTag*, std::vector<RE::TESObjectREFR*> refs) {
-    for (int i = 0; i < refs.size(); i++) {
-        if (refs[i]) {
-            refs[i]->Disable();
+        std::vector<Queue::Completed> done;
+        {
+            std::lock_guard lock(mutex);
+            done = queue.TakeCompleted();
         }
-    }
-}
 
-void Enable(RE::StaticFunctionTag*, std::vector<RE::TESObjectREFR*> refs) {
-    for (int i = 0; i < refs.size(); i++) {
-        if (refs[i]) {
-            //didn't see an Enable function in TESObjectREFR, so using console command as workaround.
-            ExecuteConsoleCommand("enable", refs[i]);
+        auto* eventSource = SKSE::GetModCallbackEventSource();
+        for (auto& batch : done) {
+            SPDLOG_DEBUG("{} batch {} ({}) complete", __func__, batch.batchId, batch.name);
+            if (eventSource) {
+                SKSE::ModCallbackEvent modEvent{ "SkyPal_Bulk_Complete", RE::BSFixedString(batch.name), static_cast<float>(batch.batchId), nullptr };
+                eventSource->SendEvent(&modEvent);
+            }
         }
-    }
-}
-
-std::vector<RE::TESObjectREFR*> Filter_Base_Form_Types(RE::StaticFunctionTag*, std::vector<RE::TESObjectREFR*> refs, std::vector<int> formTypes, std::string mode) {
-    std::vector<RE::TESObjectREFR*> returnRefs;
-
-    int refsSize = refs.size();
-    if (refsSize == 0) {
-        logger::warn("{} no refs passed in", __func__);
-        return returnRefs;
-    }
 
-    if (formTypes.size() == 0) {
-        logger::warn("{} no formTypes passed in", __func__);
-        return returnRefs;
+        if (applied > 0) {
+            SPDLOG_DEBUG("{} applied {} mutations in {}ms", __func__, applied, std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
     }
 
-    if (mode == "!") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                int formType = static_cast<int>(refs[i]->GetBaseObject()->GetFormType());
-                if (GetIndexInVector(formTypes, formType) == -1) {
-                    returnRefs.push_back(refs[i]);
-                }
-            }
+    void Apply(Mutation& mutation) {
+        auto refPtr = mutation.handle.get();
+        auto* ref = refPtr.get();
+        if (!ref) {
+            return;
         }
-    }
-    else {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                int formType = static_cast<int>(refs[i]->GetBaseObject()->GetFormType());
-                if (GetIndexInVector(formTypes, formType) != -1) {
-                    returnRefs.push_back(refs[i]);
-                }
-            }
+
+        switch (mutation.op) {
+            case Operation::kDisable:
+                ref->Disable();
+                break;
+            case Operation::kEnable:
+                //didn't see an Enable function in TESObjectREFR, so using console command as workaround.
+                ExecuteConsoleCommand("enable", ref);
+                break;
+            case Operation::kCollisionLayer:
+                ApplyCollisionLayerType(ref, static_cast<RE::COL_LAYER>(mutation.value));
+                break;
         }
     }
 
-    return returnRefs;
-}
+    std::mutex mutex;
+    std::condition_variable wakeDrain;
+    std::atomic<bool> drainThreadStarted = false;
+    bool sliceDone = false;
+    Queue queue;
+};
 
-std::vector<RE::TESObjectREFR*> Filter_Bases(RE::StaticFunctionTag*, std::vector<RE::TESObjectREFR*> refs, std::vector<RE::TESForm*> bases, std::string mode) {
-    std::vector<RE::TESObjectREFR*> returnRefs;
+// Runs filter queries later so the calling script gets a ticket back straight away. Filters read
+// game objects, which is only safe on the main thread, so a query runs there in slices of
+// Query::kSliceSize refs, as many as fit in fFrameBudgetMs per slice task (an All_ or Grid_
+// query's form map scan, and Sort_Distance, run in one piece). A pacing thread queues the next
+// task iSliceIntervalMs after the last one ran and never touches a game object itself.
+// Results are kept as handles until Take_Async_Result, and each query is announced when it ends
+// (done, cancelled, timeout or failed) on the callback form's script, or as a mod event.
+// A query spec names a native and its mode, like "Filter_Keywords:&" or "Sort_Distance:>", and
+// carries the arguments it needs, so it can run later or more than once: Query_Async, Watch.
+// forms is the native's array argument (bases, keywords, actors), or its single form in forms[0]
+// (the formlist, or the ref to measure distance from, which defaults to the player).
+struct Query {
+    std::string function;
+    std::string mode;
+    std::vector<RE::TESForm*> forms;
+    float distance = 0.0f;
 
-    int refsSize = refs.size();
-    if (refsSize == 0) {
-        logger::warn("{} no refs passed in", __func__);
-        return returnRefs;
+    static bool IsSupported(std::string_view function) {
+        static const std::unordered_set<std::string_view> supported = {
+            "All", "Grid", "All_Filter_Bases", "Grid_Filter_Bases", "All_Filter_Bases_Form_List", "Grid_Filter_Bases_Form_List",
+            "Filter_Bases", "Filter_Bases_Form_List", "Filter_Keywords", "Filter_Owners", "Filter_Potential_Thieves",
+            "Filter_Distance", "Sort_Distance", "Filter_Enabled", "Filter_Deleted", "Filter_3dLoaded", "Filter_OffLimits",
+            "Filter_InventoryObjects", "Filter_PlayableObjects", "Filter_QuestObjects"
+        };
+        return supported.contains(function);
     }
 
-    if (bases.size() == 0) {
-        logger::warn("{} no bases passed in", __func__);
-        return returnRefs;
+    // nullopt if spec doesn't name a supported native
+    static std::optional<Query> Parse(std::string_view spec, std::vector<RE::TESForm*> forms, float distance) {
+        auto separator = spec.find(':');
+        Query query;
+        query.function = spec.substr(0, separator);
+        query.mode = separator == std::string_view::npos ? "" : spec.substr(separator + 1);
+        if (!IsSupported(query.function)) {
+            return std::nullopt;
+        }
+        query.forms = std::move(forms);
+        query.distance = distance;
+        return query;
     }
 
-
-    if (mode == "!") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (std::find(bases.begin(), bases.end(), refs[i]->GetBaseObject()) == bases.end()) {
-                    returnRefs.push_back(refs[i]);
-                }
+    // All_ and Grid_ queries scan the world instead of taking refs
+    bool ScansWorld() const { return function.starts_with("All") || function.starts_with("Grid"); }
+    bool ScansGridOnly() const { return function.starts_with("Grid"); }
+
+    static std::vector<RE::TESObjectREFR*> Scan(bool gridOnly) {
+        std::vector<RE::TESObjectREFR*> refs;
+        const auto& [allForms, lock] = RE::TESForm::GetAllForms();
+        RE::BSReadLockGuard formsLock(lock.get());
+        for (auto& [id, form] : *allForms) {
+            auto* ref = form->AsReference();
+            if (ref && (!gridOnly || (ref->GetParentCell() && ref->GetParentCell()->IsAttached()))) {
+                refs.push_back(ref);
             }
         }
+        return refs;
     }
-    else {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (std::find(bases.begin(), bases.end(), refs[i]->GetBaseObject()) != bases.end()) {
-                    returnRefs.push_back(refs[i]);
-                }
+
+    template <class T>
+    static std::vector<T*> FormsAs(const std::vector<RE::TESForm*>& forms) {
+        std::vector<T*> cast;
+        for (auto* form : forms) {
+            if (auto* typed = form ? form->As<T>() : nullptr) {
+                cast.push_back(typed);
             }
         }
+        return cast;
     }
 
-    return returnRefs;
-}
-
-int GetFormlistSize(RE::BGSListForm* akFormList) {
-    if (!akFormList) {
-        return 0;
-    }
-    return(akFormList->forms.size() + akFormList->scriptAddedFormCount);
-}
+    // Runs the query's filter on refs with one of core's Out policies. All and Grid pass every
+    // ref, Sort_Distance passes them closest or farthest first. Returns false if the query's
+    // arguments don't fit it.
+    template <class Out>
+    bool Filter(std::span<RE::TESObjectREFR* const> refs, core::ResultOf<Out, Engine>& result) const {
+        auto passAll = [](auto) { return true; };
+        if (function == "All" || function == "Grid") {
+            result = Out::template Scan<Engine>(refs, passAll);
+            return true;
+        }
 
-std::vector<RE::TESObjectREFR*> Filter_Bases_Form_List(RE::StaticFunctionTag*, std::vector<RE::TESObjectREFR*> refs, RE::BGSListForm* akFormlist, std::string mode) {
-    std::vector<RE::TESObjectREFR*> returnRefs;
+        if (function.ends_with("Filter_Bases")) {
+            result = core::FilterBases<Engine, Out>(refs, forms, mode);
+            return true;
+        }
+        if (function.ends_with("Filter_Bases_Form_List")) {
+            auto* formList = forms.empty() || !forms[0] ? nullptr : forms[0]->As<RE::BGSListForm>();
+            if (!formList) {
+                return false;
+            }
+            result = core::FilterBasesFormList<Engine, Out>(refs, formList, mode);
+            return true;
+        }
+        if (function == "Filter_Keywords") {
+            result = core::FilterKeywords<Engine, Out>(refs, FormsAs<RE::BGSKeyword>(forms), mode);
+            return true;
+        }
+        if (function == "Filter_Owners") {
+            result = core::FilterOwners<Engine, Out>(refs, FormsAs<RE::Actor>(forms), mode);
+            return true;
+        }
+        if (function == "Filter_Potential_Thieves") {
+            result = core::FilterPotentialThieves<Engine, Out>(refs, FormsAs<RE::Actor>(forms), mode);
+            return true;
+        }
 
-    int refsSize = refs.size();
-    if (refsSize == 0) {
-        logger::warn("{} no refs passed in", __func__);
-        return returnRefs;
-    }
+        if (function == "Filter_Distance" || function == "Sort_Distance") {
+            auto* from = From();
+            if (function == "Filter_Distance") {
+                result = core::FilterDistance<Engine, Out>(refs, distance, from, mode);
+            }
+            else {
+                auto sorted = core::SortDistance<Engine>(refs, from, mode);
+                result = Out::template Scan<Engine>(sorted, passAll);
+            }
+            return true;
+        }
 
-    if (GetFormlistSize(akFormlist) == 0) {
-        logger::warn("{} no bases passed in", __func__);
-        return returnRefs;
+        if (function == "Filter_Enabled") {
+            result = core::FilterEnabled<Engine, Out>(refs, mode);
+        }
+        else if (function == "Filter_Deleted") {
+            result = core::FilterDeleted<Engine, Out>(refs, mode);
+        }
+        else if (function == "Filter_3dLoaded") {
+            result = core::Filter3DLoaded<Engine, Out>(refs, mode);
+        }
+        else if (function == "Filter_OffLimits") {
+            result = core::FilterOffLimits<Engine, Out>(refs, mode);
+        }
+        else if (function == "Filter_InventoryObjects") {
+            result = core::FilterInventoryObjects<Engine, Out>(refs, mode);
+        }
+        else if (function == "Filter_PlayableObjects") {
+            result = core::FilterPlayableObjects<Engine, Out>(refs, mode);
+        }
+        else if (function == "Filter_QuestObjects") {
+            result = core::FilterQuestObjects<Engine, Out>(refs, mode);
+        }
+        else {
+            return false;
+        }
+        return true;
     }
 
-    if (mode == "!") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (!akFormlist->HasForm(refs[i]->GetBaseObject())) {
-                    returnRefs.push_back(refs[i]);
-                }
-            }
+    // Filters slice by slice, so each slice's kernel works on a short array. Returns false if the
+    // query's arguments don't fit it.
+    bool Run(std::span<RE::TESObjectREFR* const> input, std::vector<RE::TESObjectREFR*>& output) const {
+        if (function == "Sort_Distance") {
+            return Filter<core::Collect>(input, output);
         }
-    }
-    else {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (akFormlist->HasForm(refs[i]->GetBaseObject())) {
-                    returnRefs.push_back(refs[i]);
-                }
+
+        std::vector<RE::TESObjectREFR*> kept;
+        for (std::size_t begin = 0; begin < input.size(); begin += kSliceSize) {
+            if (!Filter<core::Collect>(input.subspan(begin, std::min(kSliceSize, input.size() - begin)), kept)) {
+                return false;
             }
+            output.insert(output.end(), kept.begin(), kept.end());
         }
+        return true;
     }
 
-    return returnRefs;
-}
-
-int GetCollisionLayerType(RE::TESObjectREFR* ref) {
-    if (!ref) {
-        //logger::warn("{} ref doesn't exist", __func__);
-        return 0;
+    // whether ref passes the query's filter
+    bool Test(RE::TESObjectREFR* ref) const {
+        bool passed = false;
+        return Filter<core::Any>(std::span(&ref, 1), passed) && passed;
     }
 
-    int type = 0;
-
-    auto* nav = ref->Get3D();
-    if (!nav) {
-        //logger::warn("{} 3d for ref {} Id {:x} not found", __func__, GetFormName(ref), ref->GetFormID());
-        return 0;
+    // the ref the distance queries measure from, forms[0] or the player
+    RE::TESObjectREFR* From() const {
+        RE::TESObjectREFR* from = forms.empty() || !forms[0] ? nullptr : forms[0]->AsReference();
+        return from ? from : RE::PlayerCharacter::GetSingleton();
     }
 
-    return static_cast<int>(nav->GetCollisionLayer());
-
-}
+    static constexpr std::size_t kSliceSize = 4096;
+};
 
-void SetCollisionLayerType(RE::TESObjectREFR* ref, int collision_layer_type) {
-    logger::info("{} called {}", __func__, collision_layer_type);
+// Sends event to the scripts on callbackFormId's form with args, or when there's no callback form,
+// as a mod event with strArg and numArg. Main thread only.
+template <class... Args>
+void SendCallbackEvent(RE::FormID callbackFormId, const RE::BSFixedString& event, const RE::BSFixedString& strArg, float numArg, Args... args) {
+    auto* callbackForm = callbackFormId ? RE::TESForm::LookupByID(callbackFormId) : nullptr;
 
-    if (!ref) {
-        //logger::warn("{} ref doesn't exist", __func__);
+    if (callbackForm) {
+        auto* vm = RE::BSScript::Internal::VirtualMachine::GetSingleton();
+        auto* policy = vm ? vm->GetObjectHandlePolicy() : nullptr;
+        if (policy) {
+            auto handle = policy->GetHandleForObject(callbackForm->GetFormType(), callbackForm);
+            vm->SendEvent(handle, event, RE::MakeFunctionArguments(std::move(args)...));
+        }
         return;
     }
 
-    if (collision_layer_type < 1 || collision_layer_type > 46) {
-        logger::error("{} collision_layer_type {} is invalid", __func__, collision_layer_type);
-        return;
+    auto* eventSource = SKSE::GetModCallbackEventSource();
+    if (eventSource) {
+        SKSE::ModCallbackEvent modEvent{ event, strArg, numArg, nullptr };
+        eventSource->SendEvent(&modEvent);
     }
+}
 
-    RE::NiAVObject* nav = ref->Get3D();
-    if (!nav) {
-        logger::warn("{} 3d for ref {} Id {:x} not found", __func__, GetFormName(ref), ref->GetFormID());
-        return;
-    }
+class AsyncQueryQueue {
+public:
+    enum class Status : std::uint8_t {
+        kPending,
+        kRunning,
+        kDone,
+        kCancelled,
+        kTimeout,
+        kFailed
+    };
 
-    logger::info("{} current collision layer is {}", __func__, int(nav->GetCollisionLayer()));
+    // everything Query_Async was passed, refs as handles since the query runs later
+    struct Request {
+        Query query;
+        std::vector<RE::ObjectRefHandle> refs;
+        RE::FormID callbackFormId = 0;
+        std::string eventName;
+    };
 
-    RE::Actor* akActor = ref->As<RE::Actor>();
-    if (akActor) {
-        RE::COL_LAYER coLayer = static_cast<RE::COL_LAYER>(collision_layer_type);
-        std::string node = "";
-        SKSE::GetTaskInterface()->AddTask([node, nav, coLayer, akActor]() {
-            uint32_t filter;
-            akActor->GetCollisionFilterInfo(filter);
-            nav->SetCollisionLayerAndGroup(coLayer, filter);
-            nav->UpdateRigidConstraints(true);
-            logger::info("collision layer set on actor");
-            });
-    }
-    else {
-        RE::COL_LAYER coLayer = static_cast<RE::COL_LAYER>(collision_layer_type);
-        std::string node = "";
-        SKSE::GetTaskInterface()->AddTask([node, nav, coLayer]() {
-            nav->SetCollisionLayer(coLayer);
-            logger::info("collision layer set");
-            //nav->SetCollisionLayerAndGroup(coLayer, filterInfo + 1);
-            //nav->UpdateRigidConstraints(true);
-            });
+    static AsyncQueryQueue* GetSingleton() {
+        static AsyncQueryQueue singleton;
+        return &singleton;
     }
-}
 
-std::vector<RE::TESObjectREFR*> Filter_Collision_Layer_Types(RE::StaticFunctionTag*, std::vector<RE::TESObjectREFR*> refs, std::vector<int> collision_layer_types, std::string mode) {
-    std::vector<RE::TESObjectREFR*> returnRefs;
+    std::uint32_t Enqueue(Request request) {
+        std::uint32_t ticket;
+        {
+            std::lock_guard lock(mutex);
+            ticket = ++lastTicket;
+            auto& job = jobs[ticket];
+            job.request = std::move(request);
+            job.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(asyncTimeoutMs);
+            order.push_back(ticket);
+        }
 
-    int refsSize = refs.size();
-    if (refsSize == 0) {
-        logger::warn("{} no refs passed in", __func__);
-        return returnRefs;
+        if (!pacerStarted.exchange(true)) {
+            std::thread(&AsyncQueryQueue::PaceLoop, this).detach();
+        }
+        wakePacer.notify_one();
+        return ticket;
     }
 
-    if (collision_layer_types.size() == 0) {
-        logger::warn("{} no collision_layer_types passed in", __func__);
-        return returnRefs;
+    // a running query stops before its next slice
+    bool Cancel(std::uint32_t ticket) {
+        std::lock_guard lock(mutex);
+        auto it = jobs.find(ticket);
+        if (it == jobs.end() || (it->second.status != Status::kPending && it->second.status != Status::kRunning)) {
+            return false;
+        }
+        it->second.cancelled = true;
+        return true;
     }
 
-    if (mode == "!") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                int type = GetCollisionLayerType(refs[i]);
-                if (std::find(collision_layer_types.begin(), collision_layer_types.end(), type) == collision_layer_types.end()) {
-                    returnRefs.push_back(refs[i]);
-                }
-            }
-        }
+    std::string GetStatus(std::uint32_t ticket) {
+        std::lock_guard lock(mutex);
+        auto it = jobs.find(ticket);
+        return it == jobs.end() ? "unknown" : StatusName(it->second.status);
     }
-    else {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                int type = GetCollisionLayerType(refs[i]);
-                if (std::find(collision_layer_types.begin(), collision_layer_types.end(), type) != collision_layer_types.end()) {
-                    returnRefs.push_back(refs[i]);
-                }
+
+    // hands over and forgets the result of a done query
+    std::vector<RE::TESObjectREFR*> Take(std::uint32_t ticket) {
+        std::vector<RE::ObjectRefHandle> handles;
+        {
+            std::lock_guard lock(mutex);
+            auto it = jobs.find(ticket);
+            if (it == jobs.end() || it->second.status != Status::kDone) {
+                return {};
             }
+            handles.swap(it->second.result);
+            jobs.erase(it);
         }
-    }
-    return returnRefs;
-}
 
-void Change_Collision_Layer_Type(RE::StaticFunctionTag*, std::vector<RE::TESObjectREFR*> refs, int collision_layer_type) {
-    if (collision_layer_type < 1 || collision_layer_type > 46) {
-        logger::error("{} collision_layer_type {} is invalid", __func__, collision_layer_type);
-        return;
+        std::vector<RE::TESObjectREFR*> refs;
+        refs.reserve(handles.size());
+        for (auto& handle : handles) {
+            auto refPtr = handle.get();
+            if (refPtr) {
+                refs.push_back(refPtr.get());
+            }
+        }
+        return refs;
     }
 
-    int refsSize = refs.size();
-    if (refsSize == 0) {
-        logger::warn("{} no refs passed in", __func__);
-        return;
-    }
+private:
+    // finished queries whose results were never taken are dropped past this many, oldest first
+    static constexpr std::size_t kMaxFinished = 64;
+
+    struct Job {
+        Request request;
+        Status status = Status::kPending;
+        bool cancelled = false;
+        std::chrono::steady_clock::time_point deadline;
+        std::vector<RE::ObjectRefHandle> result;
+    };
+
+    AsyncQueryQueue() = default;
+
+    static const char* StatusName(Status status) {
+        switch (status) {
+            case Status::kPending:
+                return "pending";
+            case Status::kRunning:
+                return "running";
+            case Status::kDone:
+                return "done";
+            case Status::kCancelled:
+                return "cancelled";
+            case Status::kTimeout:
+                return "timeout";
+            default:
+                return "failed";
+        }
+    }
+
+    // with mutex held
+    std::optional<Status> StopReason(std::uint32_t ticket) {
+        auto& job = jobs[ticket];
+        if (job.cancelled) {
+            return Status::kCancelled;
+        }
+        if (std::chrono::steady_clock::now() > job.deadline) {
+            return Status::kTimeout;
+        }
+        return std::nullopt;
+    }
+
+    // the query running on the main thread, between its slices
+    struct Active {
+        std::uint32_t ticket = 0;
+        Request request;
+        std::vector<RE::FormID> input;
+        std::size_t next = 0;
+        std::vector<RE::ObjectRefHandle> result;
+    };
+
+    // Like BulkMutationQueue::DrainLoop: the next slice is only queued once the previous one has
+    // run and the interval has passed.
+    void PaceLoop() {
+        while (true) {
+            {
+                std::unique_lock lock(mutex);
+                wakePacer.wait(lock, [this]() { return !order.empty() || hasActive; });
+                sliceDone = false;
+            }
+
+            SKSE::GetTaskInterface()->AddTask([this]() {
+                RunSlice();
+                {
+                    std::lock_guard lock(mutex);
+                    sliceDone = true;
+                }
+                wakePacer.notify_one();
+            });
 
-    RE::COL_LAYER akLayer = static_cast<RE::COL_LAYER>(collision_layer_type);
+            {
+                std::unique_lock lock(mutex);
+                wakePacer.wait(lock, [this]() { return sliceDone; });
+            }
 
-    for (int i = 0; i < refsSize; i++) {
-        if (refs[i]) {
-            SetCollisionLayerType(refs[i], collision_layer_type);
+            std::this_thread::sleep_for(std::chrono::milliseconds(asyncSliceIntervalMs));
         }
     }
-}
 
-std::vector<RE::TESObjectREFR*> Filter_Deleted(RE::StaticFunctionTag*, std::vector<RE::TESObjectREFR*> refs, std::string mode) {
-    std::vector<RE::TESObjectREFR*> returnRefs;
+    // main thread only
+    void RunSlice() {
+        auto start = std::chrono::steady_clock::now();
+        auto budget = std::chrono::duration<float, std::milli>(asyncFrameBudgetMs);
 
-    int refsSize = refs.size();
-    if (refsSize == 0) {
-        logger::warn("{} no refs passed in", __func__);
-        return returnRefs;
-    }
+        while (std::chrono::steady_clock::now() - start < budget) {
+            if (!active) {
+                std::uint32_t ticket;
+                {
+                    std::lock_guard lock(mutex);
+                    if (order.empty()) {
+                        break;
+                    }
+                    ticket = order.front();
+                    order.pop_front();
+                    if (auto reason = StopReason(ticket)) {
+                        Finish(ticket, *reason, {});
+                        continue;
+                    }
+                    jobs[ticket].status = Status::kRunning;
+                    active.emplace();
+                    active->ticket = ticket;
+                    active->request = jobs[ticket].request;
+                    hasActive = true;
+                }
+                Prepare(*active);
+                continue;
+            }
 
-    if (mode == "!") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (!refs[i]->IsDeleted()) {
-                    returnRefs.push_back(refs[i]);
+            {
+                std::lock_guard lock(mutex);
+                if (auto reason = StopReason(active->ticket)) {
+                    End(*reason);
+                    continue;
+                }
+            }
+
+            // Sort_Distance orders the whole input, so it runs in one piece
+            auto& query = active->request.query;
+            std::size_t count = query.function == "Sort_Distance" ? active->input.size() : Query::kSliceSize;
+            auto end = std::min(active->input.size(), active->next + count);
+            std::vector<RE::TESObjectREFR*> slice;
+            slice.reserve(end - active->next);
+            for (auto i = active->next; i < end; i++) {
+                if (auto* ref = RE::TESForm::LookupByID<RE::TESObjectREFR>(active->input[i])) {
+                    slice.push_back(ref);
                 }
             }
+            active->next = end;
+
+            std::vector<RE::TESObjectREFR*> kept;
+            bool ran = query.Run(slice, kept);
+            for (auto* ref : kept) {
+                active->result.push_back(ref->CreateRefHandle());
+            }
+            if (!ran || active->next >= active->input.size()) {
+                std::lock_guard lock(mutex);
+                End(ran ? Status::kDone : Status::kFailed);
+            }
         }
     }
-    else {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (refs[i]->IsDeleted()) {
-                    returnRefs.push_back(refs[i]);
+
+    // main thread only, the query's input as form ids so refs unloaded between slices drop out
+    static void Prepare(Active& job) {
+        if (job.request.query.ScansWorld()) {
+            auto refs = Query::Scan(job.request.query.ScansGridOnly());
+            job.input.reserve(refs.size());
+            for (auto* ref : refs) {
+                job.input.push_back(ref->GetFormID());
+            }
+        }
+        else {
+            job.input.reserve(job.request.refs.size());
+            for (auto& handle : job.request.refs) {
+                auto refPtr = handle.get();
+                if (refPtr) {
+                    job.input.push_back(refPtr->GetFormID());
                 }
             }
         }
     }
 
-    return returnRefs;
-}
+    // main thread only, with mutex held, finishes the active query
+    void End(Status status) {
+        SPDLOG_DEBUG("{} ticket {} {} {} -> {} refs", __func__, active->ticket, active->request.query.function, StatusName(status), active->result.size());
 
-std::vector<RE::TESObjectREFR*> Filter_Distance(RE::StaticFunctionTag*, std::vector<RE::TESObjectREFR*> refs, float distance, RE::TESObjectREFR* from, std::string mode) {
-    std::vector<RE::TESObjectREFR*> returnRefs;
-    int refsSize = refs.size();
-    if (refsSize == 0) {
-        logger::warn("{} no refs passed in", __func__);
-        return returnRefs;
+        std::vector<RE::ObjectRefHandle> result;
+        if (status == Status::kDone) {
+            result = std::move(active->result);
+        }
+        Finish(active->ticket, status, std::move(result));
+        hasActive = false;
+        active.reset();
     }
 
-    if (!from) {
-        from = RE::TESForm::LookupByID<RE::TESForm>(20)->As<RE::TESObjectREFR>();
-    }
+    // with mutex held, queues the callback for the main thread
+    void Finish(std::uint32_t ticket, Status status, std::vector<RE::ObjectRefHandle> result) {
+        auto& job = jobs[ticket];
+        job.status = status;
+        job.result = std::move(result);
+        finished.push_back(ticket);
 
-    if (!from) {
-        logger::error("{} from ref is none and couldn't find playerRef", __func__);
-        return returnRefs;
-    }
+        while (finished.size() > kMaxFinished) {
+            auto oldest = jobs.find(finished.front());
+            if (oldest != jobs.end() && oldest->second.status != Status::kPending && oldest->second.status != Status::kRunning) {
+                jobs.erase(oldest);
+            }
+            finished.pop_front();
+        }
 
-    if (distance < 0.0) {
-        distance = 0.0;
+        SKSE::GetTaskInterface()->AddTask([ticket, status, count = static_cast<int>(job.result.size()),
+                                              callbackFormId = job.request.callbackFormId, eventName = job.request.eventName]() {
+            Notify(ticket, status, count, callbackFormId, eventName);
+        });
     }
 
-    if (mode == ">") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (refs[i]->GetPosition().GetDistance(from->GetPosition()) > distance) {
-                    returnRefs.push_back(refs[i]);
-                }
+    // main thread only
+    static void Notify(std::uint32_t ticket, Status status, int count, RE::FormID callbackFormId, const std::string& eventName) {
+        RE::BSFixedString event = eventName.empty() ? "SkyPal_Query_Done" : eventName.c_str();
+        RE::BSFixedString statusName = StatusName(status);
+        SendCallbackEvent(callbackFormId, event, statusName, static_cast<float>(ticket), static_cast<std::int32_t>(ticket), static_cast<std::int32_t>(count), statusName);
+    }
+
+    std::mutex mutex;
+    std::condition_variable wakePacer;
+    std::atomic<bool> pacerStarted = false;
+    bool sliceDone = false;
+    bool hasActive = false;
+    std::optional<Active> active;  // main thread only
+    std::uint32_t lastTicket = 0;
+    std::unordered_map<std::uint32_t, Job> jobs;
+    std::deque<std::uint32_t> order;
+    std::deque<std::uint32_t> finished;
+};
+
+// Watch handles: a query whose last result is kept as sorted form ids, so each poll returns only
+// what entered or left it, found with a sorted merge. Handles last until Unwatch or the game quits.
+// Grid watches don't scan the form map: the attach and detach sinks keep the set of loaded refs,
+// seeded by one grid scan after a load, and each poll runs the query on that set. All_ watches
+// still scan the whole form map on every poll.
+class WatchRegistry :
+    public RE::BSTEventSink<RE::TESCellAttachDetachEvent>,
+    public RE::BSTEventSink<RE::TESCellFullyLoadedEvent>,
+    public RE::BSTEventSink<RE::TESMoveAttachDetachEvent> {
+public:
+    static WatchRegistry* GetSingleton() {
+        static WatchRegistry singleton;
+        return &singleton;
+    }
+
+    // once the data is loaded
+    void RegisterSinks() {
+        auto* eventSources = RE::ScriptEventSourceHolder::GetSingleton();
+        if (!eventSources) {
+            logger::error("{} couldn't get the script event sources", __func__);
+            return;
+        }
+        eventSources->AddEventSink<RE::TESCellAttachDetachEvent>(this);
+        eventSources->AddEventSink<RE::TESCellFullyLoadedEvent>(this);
+        eventSources->AddEventSink<RE::TESMoveAttachDetachEvent>(this);
+    }
+
+    std::uint32_t Add(Query query) {
+        std::lock_guard lock(mutex);
+        auto handle = ++lastHandle;
+        watches[handle].query = std::move(query);
+        active.store(true, std::memory_order_relaxed);
+        return handle;
+    }
+
+    bool Remove(std::uint32_t handle) {
+        std::lock_guard lock(mutex);
+        bool removed = watches.erase(handle) > 0;
+        active.store(!watches.empty(), std::memory_order_relaxed);
+        if (watches.empty()) {
+            loaded.clear();
+            seeded = false;
+        }
+        return removed;
+    }
+
+    // before a load or a new game: the loaded set is seeded again by the next grid poll
+    void Revert() {
+        std::lock_guard lock(mutex);
+        loaded.clear();
+        seeded = false;
+    }
+
+    // Runs the query and returns the refs that weren't in the previous result, all of them on
+    // the first poll. false if handle isn't a watch or its query failed.
+    bool Poll(std::uint32_t handle, std::vector<RE::TESObjectREFR*>& added) {
+        Query query;
+        {
+            std::lock_guard lock(mutex);
+            auto it = watches.find(handle);
+            if (it == watches.end()) {
+                return false;
             }
+            query = it->second.query;
         }
-    }
-    else {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (refs[i]->GetPosition().GetDistance(from->GetPosition()) < distance) {
-                    returnRefs.push_back(refs[i]);
-                }
-            }
+
+        // Filter_ and Sort_ queries watch the grid, like Grid() followed by the filter
+        auto input = query.ScansWorld() && !query.ScansGridOnly() ? Query::Scan(false) : Loaded();
+        std::vector<RE::TESObjectREFR*> result;
+        if (!query.Run(input, result)) {
+            return false;
         }
-    }
 
-    return returnRefs;
-}
+        std::vector<RE::FormID> current;
+        current.reserve(result.size());
+        for (auto* ref : result) {
+            current.push_back(ref->GetFormID());
+        }
+        std::sort(current.begin(), current.end());
+        current.erase(std::unique(current.begin(), current.end()), current.end());
 
-std::vector<RE::TESObjectREFR*> Filter_Enabled(RE::StaticFunctionTag*, std::vector<RE::TESObjectREFR*> refs, std::string mode) {
-    std::vector<RE::TESObjectREFR*> returnRefs;
+        std::vector<RE::FormID> addedIds;
+        {
+            std::lock_guard lock(mutex);
+            auto it = watches.find(handle);
+            if (it == watches.end()) {
+                return false;
+            }
+            auto& watch = it->second;
+            watch.removed.clear();
+            std::set_difference(current.begin(), current.end(), watch.previous.begin(), watch.previous.end(), std::back_inserter(addedIds));
+            std::set_difference(watch.previous.begin(), watch.previous.end(), current.begin(), current.end(), std::back_inserter(watch.removed));
+            watch.previous = std::move(current);
+        }
 
-    int refsSize = refs.size();
-    if (refsSize == 0) {
-        logger::warn("{} no refs passed in", __func__);
-        return returnRefs;
+        added.reserve(addedIds.size());
+        for (auto id : addedIds) {
+            if (auto* ref = RE::TESForm::LookupByID<RE::TESObjectREFR>(id)) {
+                added.push_back(ref);
+            }
+        }
+        return true;
     }
 
-    if (mode == "!") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (refs[i]->IsDisabled()) {
-                    returnRefs.push_back(refs[i]);
-                }
+    // the refs the last poll found gone, as long as they still exist
+    std::vector<RE::TESObjectREFR*> GetRemoved(std::uint32_t handle) {
+        std::vector<RE::FormID> removedIds;
+        {
+            std::lock_guard lock(mutex);
+            auto it = watches.find(handle);
+            if (it == watches.end()) {
+                return {};
             }
+            removedIds = it->second.removed;
         }
-    }
-    else {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (!refs[i]->IsDisabled()) {
-                    returnRefs.push_back(refs[i]);
-                }
+
+        std::vector<RE::TESObjectREFR*> removed;
+        removed.reserve(removedIds.size());
+        for (auto id : removedIds) {
+            if (auto* ref = RE::TESForm::LookupByID<RE::TESObjectREFR>(id)) {
+                removed.push_back(ref);
             }
         }
+        return removed;
     }
 
-    return returnRefs;
-}
-
-std::vector<RE::TESObjectREFR*> Filter_3dLoaded(RE::StaticFunctionTag*, std::vector<RE::TESObjectREFR*> refs, std::string mode) {
-    std::vector<RE::TESObjectREFR*> returnRefs;
-
-    int refsSize = refs.size();
-    if (refsSize == 0) {
-        logger::warn("{} no refs passed in", __func__);
-        return returnRefs;
+    RE::BSEventNotifyControl ProcessEvent(const RE::TESCellAttachDetachEvent* event, RE::BSTEventSource<RE::TESCellAttachDetachEvent>*) override {
+        if (event && event->reference) {
+            Touch(event->reference.get(), event->attached);
+        }
+        return RE::BSEventNotifyControl::kContinue;
     }
 
-    if (mode == "!") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (!refs[i]->Is3DLoaded()) {
-                    returnRefs.push_back(refs[i]);
-                }
-            }
+    RE::BSEventNotifyControl ProcessEvent(const RE::TESCellFullyLoadedEvent* event, RE::BSTEventSource<RE::TESCellFullyLoadedEvent>*) override {
+        if (event && event->cell && active.load(std::memory_order_relaxed)) {
+            event->cell->ForEachReference([this](RE::TESObjectREFR& ref) {
+                Touch(&ref, true);
+                return RE::BSContainer::ForEachResult::kContinue;
+            });
         }
+        return RE::BSEventNotifyControl::kContinue;
     }
-    else {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (refs[i]->Is3DLoaded()) {
-                    returnRefs.push_back(refs[i]);
-                }
-            }
+
+    RE::BSEventNotifyControl ProcessEvent(const RE::TESMoveAttachDetachEvent* event, RE::BSTEventSource<RE::TESMoveAttachDetachEvent>*) override {
+        if (event && event->movedRef) {
+            Touch(event->movedRef.get(), event->isCellAttached);
         }
+        return RE::BSEventNotifyControl::kContinue;
     }
 
-    return returnRefs;
-}
+private:
+    struct Watch {
+        Query query;
+        std::vector<RE::FormID> previous;  // sorted
+        std::vector<RE::FormID> removed;   // by the last poll, sorted
+    };
 
-std::vector<RE::TESObjectREFR*> Filter_Form_Types(RE::StaticFunctionTag*, std::vector<RE::TESObjectREFR*> refs, std::vector<int> formTypes, std::string mode) {
-    std::vector<RE::TESObjectREFR*> returnRefs;
+    WatchRegistry() = default;
 
-    int refsSize = refs.size();
-    if (refsSize == 0) {
-        logger::warn("{} no refs passed in", __func__);
-        return returnRefs;
-    }
+    // kept before the set is seeded too, so a ref that attaches while the seeding scan runs isn't missed
+    void Touch(RE::TESObjectREFR* ref, bool attached) {
+        if (!ref || !active.load(std::memory_order_relaxed)) {
+            return;
+        }
 
-    if (formTypes.size() == 0) {
-        logger::warn("{} no formTypes passed in", __func__);
-        return returnRefs;
+        std::lock_guard lock(mutex);
+        if (attached) {
+            loaded.insert(ref->GetFormID());
+        }
+        else {
+            loaded.erase(ref->GetFormID());
+        }
     }
 
-    if (mode == "!") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                int formType = static_cast<int>(refs[i]->GetBaseObject()->GetFormType());
-                if (GetIndexInVector(formTypes, formType) == -1) {
-                    returnRefs.push_back(refs[i]);
-                }
-            }
+    // The refs in attached cells. The first call after a load scans the grid once; later ones look
+    // up the set the sinks kept and drop ids whose ref is gone or no longer attached.
+    std::vector<RE::TESObjectREFR*> Loaded() {
+        bool seed;
+        {
+            std::lock_guard lock(mutex);
+            seed = !seeded;
         }
-    }
-    else {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                int formType = static_cast<int>(refs[i]->GetBaseObject()->GetFormType());
-                if (GetIndexInVector(formTypes, formType) != -1) {
-                    returnRefs.push_back(refs[i]);
-                }
+        if (seed) {
+            auto refs = Query::Scan(true);
+            std::lock_guard lock(mutex);
+            for (auto* ref : refs) {
+                loaded.insert(ref->GetFormID());
             }
+            seeded = true;
+            return refs;
         }
-    }
 
-    return returnRefs;
-}
+        std::vector<RE::FormID> ids;
+        {
+            std::lock_guard lock(mutex);
+            ids.assign(loaded.begin(), loaded.end());
+        }
 
-int CountNumberOfKeywordsRefHas(RE::StaticFunctionTag* tag, RE::TESObjectREFR* ref, std::vector<RE::BGSKeyword*> keywords) {
-    int count = 0;
-    if (!ref) {
-        logger::warn("{} ref doesn't exist", __func__);
-        return count;
+        std::vector<RE::TESObjectREFR*> refs;
+        std::vector<RE::FormID> gone;
+        refs.reserve(ids.size());
+        for (auto id : ids) {
+            auto* ref = RE::TESForm::LookupByID<RE::TESObjectREFR>(id);
+            if (ref && ref->GetParentCell() && ref->GetParentCell()->IsAttached()) {
+                refs.push_back(ref);
+            }
+            else {
+                gone.push_back(id);
+            }
+        }
+        if (!gone.empty()) {
+            std::lock_guard lock(mutex);
+            for (auto id : gone) {
+                loaded.erase(id);
+            }
+        }
+        return refs;
     }
 
-    int size = keywords.size();
-
-    if (size == 0) {
-        logger::warn("{} no keywords passed in", __func__);
-        return count;
+    std::mutex mutex;
+    std::atomic<bool> active = false;  // any watches, so the sinks cost nothing without them
+    std::uint32_t lastHandle = 0;
+    std::unordered_map<std::uint32_t, Watch> watches;
+    std::unordered_set<RE::FormID> loaded;  // refs in attached cells, once seeded
+    bool seeded = false;
+};
+
+// Standing queries: a query plus a callback, run only on refs that just came into the loaded area
+// rather than on the grid. Cell attach, cell fully loaded and move attach events collect those
+// refs during the frame, then one task runs every standing query on them and sends each query that
+// matched one event. Matches wait in the query until Take_Standing_Matches.
+class StandingQueries :
+    public RE::BSTEventSink<RE::TESCellAttachDetachEvent>,
+    public RE::BSTEventSink<RE::TESCellFullyLoadedEvent>,
+    public RE::BSTEventSink<RE::TESMoveAttachDetachEvent> {
+public:
+    static StandingQueries* GetSingleton() {
+        static StandingQueries singleton;
+        return &singleton;
+    }
+
+    // once the data is loaded
+    void RegisterSinks() {
+        auto* eventSources = RE::ScriptEventSourceHolder::GetSingleton();
+        if (!eventSources) {
+            logger::error("{} couldn't get the script event sources", __func__);
+            return;
+        }
+        eventSources->AddEventSink<RE::TESCellAttachDetachEvent>(this);
+        eventSources->AddEventSink<RE::TESCellFullyLoadedEvent>(this);
+        eventSources->AddEventSink<RE::TESMoveAttachDetachEvent>(this);
+    }
+
+    std::uint32_t Add(Query query, RE::FormID callbackFormId, std::string eventName) {
+        std::lock_guard lock(mutex);
+        auto id = ++lastId;
+        auto& standing = queries[id];
+        standing.query = std::move(query);
+        standing.callbackFormId = callbackFormId;
+        standing.eventName = std::move(eventName);
+        active.store(true, std::memory_order_relaxed);
+        return id;
+    }
+
+    bool Remove(std::uint32_t id) {
+        std::lock_guard lock(mutex);
+        bool removed = queries.erase(id) > 0;
+        active.store(!queries.empty(), std::memory_order_relaxed);
+        return removed;
+    }
+
+    std::vector<RE::TESObjectREFR*> Take(std::uint32_t id) {
+        std::vector<RE::ObjectRefHandle> handles;
+        {
+            std::lock_guard lock(mutex);
+            auto it = queries.find(id);
+            if (it == queries.end()) {
+                return {};
+            }
+            handles.swap(it->second.matches);
+        }
+
+        std::vector<RE::TESObjectREFR*> refs;
+        refs.reserve(handles.size());
+        for (auto& handle : handles) {
+            auto refPtr = handle.get();
+            if (refPtr) {
+                refs.push_back(refPtr.get());
+            }
+        }
+        return refs;
     }
 
-    for (int i = 0; i < size; i++) {
-        if (keywords[i]) {
-            std::vector<RE::BGSKeyword*> keyword {keywords[i]};
-            //hasKeyword function is missing, using this function as workaround
-            if (ref->HasKeywordInArray(keyword, true)) {
-                count += 1;
-            }
+    RE::BSEventNotifyControl ProcessEvent(const RE::TESCellAttachDetachEvent* event, RE::BSTEventSource<RE::TESCellAttachDetachEvent>*) override {
+        if (event && event->reference) {
+            Touch(event->reference.get(), event->attached);
         }
+        return RE::BSEventNotifyControl::kContinue;
     }
-    return count;
-}
 
-int CountNumberOfKeywordsRefHas_cpp(RE::TESObjectREFR* ref, std::vector<RE::BGSKeyword*> keywords) {
-    int count = 0;
-    if (!ref) {
-        return count;
-    }
-
-    int size = keywords.size();
-
-    if (size == 0) {
-        logger::warn("{} no keywords passed in", __func__);
-        return count;
-    }
-
-    for (int i = 0; i < size; i++) {
-        if (keywords[i]) {
-            std::vector<RE::BGSKeyword*> keyword {keywords[i]};
-            //hasKeyword function is missing, using this function as workaround
-            if (ref->HasKeywordInArray(keyword, true)) {
-                count += 1;
-            }
+    RE::BSEventNotifyControl ProcessEvent(const RE::TESCellFullyLoadedEvent* event, RE::BSTEventSource<RE::TESCellFullyLoadedEvent>*) override {
+        if (event && event->cell && active.load(std::memory_order_relaxed)) {
+            event->cell->ForEachReference([this](RE::TESObjectREFR& ref) {
+                Touch(&ref, true);
+                return RE::BSContainer::ForEachResult::kContinue;
+            });
         }
-    }
-    return count;
-}
-
-bool refHasAtLeastOneKeyword(RE::StaticFunctionTag* tag, RE::TESObjectREFR* ref, std::vector<RE::BGSKeyword*> keywords) {
-    if (!ref) {
-        logger::warn("{} ref doesn't exist", __func__);
-        return false;
+        return RE::BSEventNotifyControl::kContinue;
     }
 
-    int size = keywords.size();
-
-    if (size == 0) {
-        logger::warn("{} no keywords passed in", __func__);
-        return false;
+    RE::BSEventNotifyControl ProcessEvent(const RE::TESMoveAttachDetachEvent* event, RE::BSTEventSource<RE::TESMoveAttachDetachEvent>*) override {
+        if (event && event->movedRef) {
+            Touch(event->movedRef.get(), event->isCellAttached);
+        }
+        return RE::BSEventNotifyControl::kContinue;
     }
 
-    return ref->HasKeywordInArray(keywords, false);
-}
+private:
+    // matches nobody takes are dropped past this many per query, oldest first
+    static constexpr std::size_t kMaxMatches = 16384;
 
-bool refHasAtLeastOneKeyword_cpp(RE::TESObjectREFR* ref, std::vector<RE::BGSKeyword*> keywords) {
-    if (!ref) {
-        return false;
-    }
-    return ref->HasKeywordInArray(keywords, false);
-}
+    struct Standing {
+        Query query;
+        RE::FormID callbackFormId = 0;
+        std::string eventName;
+        std::vector<RE::ObjectRefHandle> matches;
+    };
 
-//fix
-std::vector<RE::BGSKeyword*> filter_keywordsOnRef(RE::StaticFunctionTag* tag, RE::TESObjectREFR* ref, std::vector<RE::BGSKeyword*> keywords, std::string mode) {
-    std::vector<RE::BGSKeyword*> returnKeywords;
-    if (!ref) {
-        logger::warn("{} ref doesn't exist", __func__);
-        return returnKeywords;
-    }
+    StandingQueries() = default;
 
-    int size = keywords.size();
+    // A ref that attaches becomes a candidate for this frame, one that detaches before the
+    // frame is flushed stops being one.
+    void Touch(RE::TESObjectREFR* ref, bool attached) {
+        if (!ref || !active.load(std::memory_order_relaxed)) {
+            return;
+        }
 
-    if (size == 0) {
-        logger::warn("{} no keywords passed in", __func__);
-        return returnKeywords;
+        std::lock_guard lock(mutex);
+        if (!attached) {
+            candidates.erase(ref->GetFormID());
+            return;
+        }
+        candidates.insert(ref->GetFormID());
+        if (!flushQueued) {
+            flushQueued = true;
+            SKSE::GetTaskInterface()->AddTask([this]() { Flush(); });
+        }
     }
 
-    if (mode == "!") {
-        for (int i = 0; i < size; i++) {
-            if (keywords[i]) {
-                std::vector<RE::BGSKeyword*> keyword {keywords[i]};
-                //hasKeyword function is missing, using this function as workaround
-                if (!ref->HasKeywordInArray(keyword, true)) {
-                    returnKeywords.push_back(keywords[i]);
+    // main thread
+    void Flush() {
+        std::vector<RE::TESObjectREFR*> refs;
+        std::vector<std::pair<std::uint32_t, Query>> toRun;
+        {
+            std::lock_guard lock(mutex);
+            flushQueued = false;
+            refs.reserve(candidates.size());
+            for (auto id : candidates) {
+                if (auto* ref = RE::TESForm::LookupByID<RE::TESObjectREFR>(id)) {
+                    refs.push_back(ref);
                 }
             }
-        }
-    }
-    else {
-        for (int i = 0; i < size; i++) {
-            if (keywords[i]) {
-                std::vector<RE::BGSKeyword*> keyword {keywords[i]};
-                //hasKeyword function is missing, using this function as workaround
-                if (ref->HasKeywordInArray(keyword, true)) {
-                    returnKeywords.push_back(keywords[i]);
-                }
+            candidates.clear();
+            for (auto& [id, standing] : queries) {
+                toRun.emplace_back(id, standing.query);
             }
         }
-    }
-
-    return returnKeywords;
-}
-
-// if (keywords == none) : Passes an empty array.
-// if (mode == "|") : Passes refs that match any keyword. (OR Gate) //default
-// if (mode == "&") : Passes refs that match all keywords. (AND Gate)
-// if (mode == "^") : Passes refs that match exactly one keyword. (XOR Gate)
-// if (mode == "!|") : Passes refs that match no keywords. (NOR Gate)
-// if (mode == "!&") : Passes refs that do not match all of the keywords. (NAND Gate)
-// if (mode == "!^") : Passes refs that match 0 or more than 1 keyword. (XNOR Gate)
-std::vector<RE::TESObjectREFR*> Filter_Keywords(RE::StaticFunctionTag*, std::vector<RE::TESObjectREFR*> refs, std::vector<RE::BGSKeyword*> keywords, std::string mode) {
-    std::vector<RE::TESObjectREFR*> returnRefs;
-
-    int refsSize = refs.size();
-    if (refsSize == 0) {
-        logger::warn("{} no refs passed in", __func__);
-        return returnRefs;
-    }
+        if (refs.empty()) {
+            return;
+        }
 
-    if (keywords.size() == 0) {
-        logger::warn("{} no keywords passed in", __func__);
-        return returnRefs;
-    }
+        for (auto& [id, query] : toRun) {
+            std::vector<RE::TESObjectREFR*> matched;
+            if (!query.Run(refs, matched) || matched.empty()) {
+                continue;
+            }
 
-    if (mode == "&") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (refs[i]->HasKeywordInArray(keywords, true)) {
-                    returnRefs.push_back(refs[i]);
+            RE::FormID callbackFormId;
+            RE::BSFixedString event;
+            {
+                std::lock_guard lock(mutex);
+                auto it = queries.find(id);
+                if (it == queries.end()) {
+                    continue;
                 }
-            }
-        }
-    }
-    else if (mode == "^") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (CountNumberOfKeywordsRefHas_cpp(refs[i], keywords) == 1) {
-                    returnRefs.push_back(refs[i]);
+                auto& standing = it->second;
+                for (auto* ref : matched) {
+                    standing.matches.push_back(ref->CreateRefHandle());
                 }
-            }
-        }
-    }
-    else if (mode == "!|") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (!refs[i]->HasKeywordInArray(keywords, false)) {
-                    returnRefs.push_back(refs[i]);
+                if (standing.matches.size() > kMaxMatches) {
+                    standing.matches.erase(standing.matches.begin(), standing.matches.end() - kMaxMatches);
                 }
-            }
-        }
-    }
-    else if (mode == "!&") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (!refs[i]->HasKeywordInArray(keywords, true)) {
-                    returnRefs.push_back(refs[i]);
+                callbackFormId = standing.callbackFormId;
+                event = standing.eventName.empty() ? "SkyPal_Standing_Matches" : standing.eventName.c_str();
+            }
+            SendCallbackEvent(callbackFormId, event, RE::BSFixedString(query.function.c_str()), static_cast<float>(id),
+                static_cast<std::int32_t>(id), static_cast<std::int32_t>(matched.size()));
+        }
+        SPDLOG_DEBUG("{} {} refs against {} standing queries", __func__, refs.size(), toRun.size());
+    }
+
+    std::mutex mutex;
+    std::atomic<bool> active = false;  // any queries, so the sinks cost nothing without them
+    std::uint32_t lastId = 0;
+    std::unordered_map<std::uint32_t, Standing> queries;
+    std::unordered_set<RE::FormID> candidates;
+    bool flushQueued = false;
+};
+
+// a hash of the names of the loaded plugins in load order, full plugins first
+std::uint64_t GetLoadOrderHash() {
+    std::vector<std::string_view> files;
+    if (auto* dataHandler = RE::TESDataHandler::GetSingleton()) {
+        for (auto* file : dataHandler->compiledFileCollection.files) {
+            files.push_back(file->GetFilename());
+        }
+        for (auto* file : dataHandler->compiledFileCollection.smallFiles) {
+            files.push_back(file->GetFilename());
+        }
+    }
+    return skypal::ref_index::HashLoadOrder(files);
+}
+
+// The base -> refs index behind All_Filter_Bases and All_Filter_Bases_Form_List
+// (skypal/ref_index.h). It's built by one form map scan the first time it's needed, written to
+// the co-save and read back on load under the same load order. The warm-up then checks the read
+// index against the form map before it's used: per plugin it must hold as many refs, up to an id
+// as high, and it must hold every ref made in game. That's still a pass over the form map, but one
+// that only counts form ids, several times cheaper than a build; the price is that a plugin which
+// lost as many refs as it gained below its old highest id slips through. Refs that load or are
+// placed in a loaded cell after the index was built are kept aside by the sinks until the next
+// save folds them in. If the form map grows past what the sinks account for, the index is stale:
+// those natives scan, and the index is rebuilt instead of saved. Every ref the index hands out is
+// found in the form map again and its base checked, so refs that unloaded or were deleted since
+// drop out.
+class RefIndex :
+    public RE::BSTEventSink<RE::TESCellAttachDetachEvent>,
+    public RE::BSTEventSink<RE::TESCellFullyLoadedEvent>,
+    public RE::BSTEventSink<RE::TESMoveAttachDetachEvent> {
+public:
+    static constexpr std::uint32_t kRecordType = 0x52494458;  // 'RIDX'
+
+    static RefIndex* GetSingleton() {
+        static RefIndex singleton;
+        return &singleton;
+    }
+
+    // once the data is loaded
+    void RegisterSinks() {
+        auto* eventSources = RE::ScriptEventSourceHolder::GetSingleton();
+        if (!eventSources) {
+            logger::error("{} couldn't get the script event sources", __func__);
+            return;
+        }
+        eventSources->AddEventSink<RE::TESCellAttachDetachEvent>(this);
+        eventSources->AddEventSink<RE::TESCellFullyLoadedEvent>(this);
+        eventSources->AddEventSink<RE::TESMoveAttachDetachEvent>(this);
+    }
+
+    // fn(ref) for every loaded ref with one of bases, building the index first if there is none.
+    // False without calling fn when the bases have so many refs that scanning the form map is
+    // faster than looking each one up, or when the index went stale.
+    template <class Fn>
+    bool ForEachRef(std::vector<RE::FormID> bases, Fn&& fn) {
+        if (!ready.load(std::memory_order_acquire)) {
+            Build();
+        }
+        std::sort(bases.begin(), bases.end());
+        bases.erase(std::unique(bases.begin(), bases.end()), bases.end());
+
+        auto index = published.Read();
+        std::vector<std::pair<RE::FormID, RE::FormID>> recentRefs;
+        {
+            std::lock_guard lock(mutex);
+            for (auto [ref, base] : recent) {
+                if (std::binary_search(bases.begin(), bases.end(), base) && !index->Contains(base, ref)) {
+                    recentRefs.emplace_back(base, ref);
                 }
             }
         }
-    }
-    else if (mode == "!^") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                int count = CountNumberOfKeywordsRefHas_cpp(refs[i], keywords);
-                if (count == 0 || count > 1) {
-                    returnRefs.push_back(refs[i]);
-                }
+
+        std::size_t candidates = recentRefs.size();
+        for (auto baseId : bases) {
+            candidates += index->RefsOf(baseId).size();
+        }
+        const auto& [allForms, lock] = RE::TESForm::GetAllForms();
+        RE::BSReadLockGuard formsLock(lock.get());
+        if (IsStale(allForms->size())) {
+            ready.store(false, std::memory_order_release);
+            logger::info("{} forms were created that no sink saw, the ref index will be rebuilt", __func__);
+            return false;
+        }
+        if (candidates > allForms->size() / kMaxLookupShare) {
+            return false;
+        }
+
+        auto visit = [&](RE::FormID baseId, RE::FormID refId) {
+            auto it = allForms->find(refId);
+            if (it == allForms->end() || !it->second) {
+                return;
+            }
+            auto* ref = it->second->AsReference();
+            auto* base = ref ? ref->GetBaseObject() : nullptr;
+            if (base && base->GetFormID() == baseId) {
+                fn(ref);
+            }
+        };
+        for (auto baseId : bases) {
+            for (auto refId : index->RefsOf(baseId)) {
+                visit(baseId, refId);
             }
         }
+        for (auto [baseId, refId] : recentRefs) {
+            visit(baseId, refId);
+        }
+        return true;
     }
-    else {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (refs[i]->HasKeywordInArray(keywords, false)) {
-                    returnRefs.push_back(refs[i]);
+
+    void Build() {
+        std::lock_guard buildLock(buildMutex);
+        if (ready.load(std::memory_order_acquire)) {
+            return;
+        }
+
+        // refs that load while the form map is scanned are caught by the sinks
+        tracking.store(true, std::memory_order_release);
+        auto start = std::chrono::steady_clock::now();
+        if (restored) {
+            auto index = std::move(*restored);
+            restored.reset();
+            if (Covers(index)) {
+                Publish(std::move(index));
+                auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+                logger::info("{} checked the restored index of {} refs against the form map in {}ms", __func__, published.Read()->refs.size(), elapsed);
+                return;
+            }
+            logger::info("{} the form map has refs the restored index doesn't, rebuilding it", __func__);
+        }
+        std::vector<std::pair<RE::FormID, RE::FormID>> pairs;
+        {
+            // the warm-up builds on its own thread while the game may be adding forms
+            const auto& [allForms, lock] = RE::TESForm::GetAllForms();
+            RE::BSReadLockGuard formsLock(lock.get());
+            for (auto& [id, form] : *allForms) {
+                auto* ref = form ? form->AsReference() : nullptr;
+                auto* base = ref ? ref->GetBaseObject() : nullptr;
+                if (base) {
+                    pairs.emplace_back(base->GetFormID(), id);
                 }
             }
+            Scanned(allForms->size());
         }
+        Publish(skypal::ref_index::Index::Build(std::move(pairs)));
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        logger::info("{} indexed {} refs of {} bases in {}ms", __func__, published.Read()->refs.size(), published.Read()->bases.size(), elapsed);
     }
-    return returnRefs;
-}
 
-int GetFactionRank(RE::Actor* akActor, RE::TESFaction* faction) {
-    int returnRank = -2;
-    if (!akActor) {
-        return returnRank;
-    }
-    if (!faction) {
-        return returnRank;
-    }
-    akActor->VisitFactions([&](RE::TESFaction* akfaction, int8_t rank) -> bool {
-        if (akfaction == faction) {
-            returnRank = rank;
-            return true;
+    // co-save callbacks, on the main thread
+
+    void Save(SKSE::SerializationInterface* serialization) {
+        if (!ready.load(std::memory_order_acquire)) {
+            return;
+        }
+        bool stale;
+        {
+            const auto& [allForms, lock] = RE::TESForm::GetAllForms();
+            RE::BSReadLockGuard formsLock(lock.get());
+            stale = IsStale(allForms->size());
+        }
+        if (stale) {
+            ready.store(false, std::memory_order_release);
+            logger::info("{} forms were created that no sink saw, the ref index isn't saved", __func__);
+            return;
         }
-        return true;
-        });
-    return returnRank;
-}
 
-bool IsActorOwnerOfEncounterZone_cpp(RE::Actor* akActor, RE::BGSEncounterZone* encounterZone, bool& hasOwner) {
-    if (!akActor) {
-        //logger::warn("{} akActor doesn't exist", __func__);
-        return false;
-    }
-    if (!encounterZone) {
-        //logger::warn("{} encounterZone doesn't exist", __func__);
-        return false;
+        Publish(Merged());
+        auto bytes = skypal::ref_index::Encode(*published.Read(), GetLoadOrderHash());
+        if (!serialization->OpenRecord(kRecordType, skypal::ref_index::kVersion) ||
+            !serialization->WriteRecordData(bytes.data(), static_cast<std::uint32_t>(bytes.size()))) {
+            logger::error("{} couldn't write the ref index", __func__);
+            return;
+        }
+        logger::info("{} wrote {} refs in {} bytes", __func__, published.Read()->refs.size(), bytes.size());
     }
 
-    RE::TESForm* ownerForm = encounterZone->data.zoneOwner;
-
-    if (ownerForm) {
-        hasOwner = true;
-        RE::TESFaction* ownerFaction = ownerForm->As<RE::TESFaction>();
+    void Load(SKSE::SerializationInterface* serialization) {
+        std::uint32_t type = 0;
+        std::uint32_t version = 0;
+        std::uint32_t length = 0;
+        while (serialization->GetNextRecordInfo(type, version, length)) {
+            if (type != kRecordType) {
+                continue;
+            }
 
-        if (ownerFaction) {
-            //logger::info("{} owner {} ID {:x} is a faction", __func__, GetFormName(ownerFaction), ownerFaction->GetFormID());
-            return (GetFactionRank(akActor, ownerFaction) >= encounterZone->data.ownerRank);
-        }
+            std::vector<std::uint8_t> bytes(length);
+            skypal::ref_index::Index index;
+            std::uint64_t loadOrder = 0;
+            if (serialization->ReadRecordData(bytes.data(), length) != length || !skypal::ref_index::Decode(bytes, index, loadOrder)) {
+                logger::warn("{} ref index record version {} unreadable, it will be rebuilt", __func__, version);
+                continue;
+            }
 
-        RE::TESNPC* ownerNpc = ownerForm->As<RE::TESNPC>();
-        if (ownerNpc) {
-            //logger::info("{} owner {} ID {:x} is an npc", __func__, GetFormName(ownerNpc), ownerNpc->GetFormID());
-            return (ownerNpc == akActor->GetBaseObject());
+            // Build checks it against the form map on the warm-up thread before it's used
+            if (loadOrder != GetLoadOrderHash()) {
+                logger::info("{} load order changed, the ref index will be rebuilt", __func__);
+                continue;
+            }
+            std::lock_guard buildLock(buildMutex);
+            tracking.store(true, std::memory_order_release);
+            logger::info("{} read {} refs of {} bases", __func__, index.refs.size(), index.bases.size());
+            restored = std::move(index);
         }
     }
-    return false;
-}
 
-bool ActorIsOwnerOfRef(RE::StaticFunctionTag*, RE::TESObjectREFR* akRef, RE::Actor* akActor) {
-    if (!akRef) {
-        logger::warn("{} akRef doesn't exist", __func__);
-        return false;
+    // before a load or a new game
+    void Revert() {
+        std::lock_guard buildLock(buildMutex);
+        restored.reset();
+        ready.store(false, std::memory_order_release);
+        tracking.store(false, std::memory_order_release);
+        published.Publish(std::make_unique<skypal::ref_index::Index>());
+        std::lock_guard lock(mutex);
+        recent.clear();
     }
 
-    if (!akActor) {
-        logger::warn("{} akActor doesn't exist", __func__);
-        return false;
+    RE::BSEventNotifyControl ProcessEvent(const RE::TESCellAttachDetachEvent* event, RE::BSTEventSource<RE::TESCellAttachDetachEvent>*) override {
+        if (event && event->reference && event->attached && tracking.load(std::memory_order_acquire)) {
+            auto index = published.Read();
+            Track(*index, event->reference.get());
+        }
+        return RE::BSEventNotifyControl::kContinue;
     }
 
-    bool hasOwner;
-    auto* ownerBase = akActor->GetActorBase();
-    auto* refActorOwner = akRef->GetActorOwner();
-
-    if (refActorOwner) {
-        if (refActorOwner == ownerBase) {
-            return true;
+    RE::BSEventNotifyControl ProcessEvent(const RE::TESCellFullyLoadedEvent* event, RE::BSTEventSource<RE::TESCellFullyLoadedEvent>*) override {
+        if (event && event->cell && tracking.load(std::memory_order_acquire)) {
+            auto index = published.Read();
+            event->cell->ForEachReference([&](RE::TESObjectREFR& ref) {
+                Track(*index, &ref);
+                return RE::BSContainer::ForEachResult::kContinue;
+            });
         }
+        return RE::BSEventNotifyControl::kContinue;
     }
 
-    //logger::info("{} {}: getting ref factionOwner", __func__, i);
-
-    auto* factionOwner = akRef->GetFactionOwner();
-    if (factionOwner) {
-        if (GetFactionRank(akActor, factionOwner) > -1) {
-            return true;
+    // refs placed in game into an attached cell, which no cell event reports
+    RE::BSEventNotifyControl ProcessEvent(const RE::TESMoveAttachDetachEvent* event, RE::BSTEventSource<RE::TESMoveAttachDetachEvent>*) override {
+        if (event && event->movedRef && event->isCellAttached && tracking.load(std::memory_order_acquire)) {
+            auto index = published.Read();
+            Track(*index, event->movedRef.get());
         }
+        return RE::BSEventNotifyControl::kContinue;
     }
 
-    //logger::info("{} {}: getting akRef encounter zone", __func__, i);
+private:
+    // refs kept aside past this are folded into a new index
+    static constexpr std::size_t kMaxRecent = 16384;
 
-    RE::BGSEncounterZone* encounterZone = akRef->extraList.GetEncounterZone();
-    if (IsActorOwnerOfEncounterZone_cpp(akActor, encounterZone, hasOwner)) {
-        return true;
-    }
+    // bases with more refs than 1 / kMaxLookupShare of the form map are left to the scan
+    static constexpr std::size_t kMaxLookupShare = 8;
 
-    //logger::info("{} {}: getting cell", __func__, i);
+    RefIndex() = default;
 
-    auto* cell = akRef->GetParentCell();
-    if (cell) {
-        auto* cellOwner = cell->GetActorOwner();
-        if (cellOwner) {
-            if (cellOwner == ownerBase) {
-                return true;
+    // Whether index can hold the refs in the form map, see ref_index::Covers. One pass that only
+    // reads form ids, except for refs made in game, which are few and looked up in index each.
+    bool Covers(const skypal::ref_index::Index& index) {
+        skypal::ref_index::Census census;
+        const auto& [allForms, lock] = RE::TESForm::GetAllForms();
+        RE::BSReadLockGuard formsLock(lock.get());
+        for (auto& [id, form] : *allForms) {
+            auto* ref = form ? form->AsReference() : nullptr;
+            if (!ref) {
+                continue;
             }
-        }
-
-        //logger::info("{} {}: getting cellFactionOwner", __func__, i);
-
-        auto* cellFactionOwner = cell->GetFactionOwner();
-        if (cellFactionOwner) {
-            if (GetFactionRank(akActor, cellFactionOwner) > -1) {
-                return true;
+            auto key = skypal::ref_index::PluginKey(id);
+            if (key != skypal::ref_index::kDynamicKey) {
+                census[key].Add(id);
+                continue;
+            }
+            auto* base = ref->GetBaseObject();
+            if (base && !index.Contains(base->GetFormID(), id)) {
+                return false;
             }
         }
-
-        //::info("{} {}: getting cell encounterZone", __func__, i);
-
-        auto* cellEncounterZone = cell->extraList.GetEncounterZone();
-        if (IsActorOwnerOfEncounterZone_cpp(akActor, cellEncounterZone, hasOwner)) {
-            return true;
+        if (!skypal::ref_index::Covers(index, census)) {
+            return false;
         }
+        Scanned(allForms->size());
+        return true;
     }
-    //logger::info("{} {}: getting worldSpace", __func__, i);
 
-    auto* worldSpace = akRef->GetWorldspace();
-    if (worldSpace) {
-
-        //logger::info("{} {}: getting worldEncounterZone", __func__, i);
+    void Track(const skypal::ref_index::Index& index, RE::TESObjectREFR* ref) {
+        auto* base = ref ? ref->GetBaseObject() : nullptr;
+        if (!base || index.Contains(base->GetFormID(), ref->GetFormID())) {
+            return;
+        }
 
-        auto* worldEncounterZone = worldSpace->encounterZone;
-        if (IsActorOwnerOfEncounterZone_cpp(akActor, worldEncounterZone, hasOwner)) {
-            return true;
+        std::lock_guard lock(mutex);
+        if (recent.insert_or_assign(ref->GetFormID(), base->GetFormID()).second) {
+            seen += 1;
+        }
+        if (recent.size() >= kMaxRecent && ready.load(std::memory_order_acquire) && !foldQueued) {
+            foldQueued = true;
+            SKSE::GetTaskInterface()->AddTask([this]() { Publish(Merged()); });
         }
     }
-    return false;
-}
 
-bool ActorIsOwnerOfRef_cpp(RE::TESObjectREFR* akRef, RE::Actor* akActor) {
-    if (!akRef) {
-        //logger::warn("{} akRef doesn't exist", __func__);
-        return false;
+    // the published index with the refs kept aside
+    skypal::ref_index::Index Merged() {
+        std::vector<std::pair<RE::FormID, RE::FormID>> pairs;
+        auto index = published.Read();
+        pairs.reserve(index->refs.size());
+        index->ForEach([&](RE::FormID base, RE::FormID ref) { pairs.emplace_back(base, ref); });
+        {
+            std::lock_guard lock(mutex);
+            for (auto [ref, base] : recent) {
+                pairs.emplace_back(base, ref);
+            }
+        }
+        return skypal::ref_index::Index::Build(std::move(pairs));
     }
 
-    if (!akActor) {
-        //logger::warn("{} akActor doesn't exist", __func__);
-        return false;
+    // the index's scan saw forms forms, and the sinks start counting the refs they keep aside anew
+    void Scanned(std::size_t forms) {
+        std::lock_guard lock(mutex);
+        formCount = forms;
+        seen = 0;
     }
 
-    bool hasOwner;
-    auto* ownerBase = akActor->GetActorBase();
-    auto* refActorOwner = akRef->GetActorOwner();
+    // Whether the form map grew past what the index's scan saw plus the refs the sinks kept aside
+    // since, so forms were created that no sink reported: refs placed in an unloaded cell, or forms
+    // of any kind made in game, which rebuild the index to be safe. Refs unloading make room that
+    // a form created later hides in until the next build.
+    bool IsStale(std::size_t forms) {
+        std::lock_guard lock(mutex);
+        return forms > formCount + seen;
+    }
 
-    if (refActorOwner) {
-        if (refActorOwner == ownerBase) {
-            return true;
+    // Publishes index and drops the refs kept aside that it has.
+    void Publish(skypal::ref_index::Index index) {
+        auto next = std::make_unique<skypal::ref_index::Index>(std::move(index));
+        {
+            std::lock_guard lock(mutex);
+            std::erase_if(recent, [&](const auto& entry) { return next->Contains(entry.second, entry.first); });
+            foldQueued = false;
         }
+        published.Publish(std::move(next));
+        ready.store(true, std::memory_order_release);
     }
 
-    //logger::info("{} {}: getting ref factionOwner", __func__, i);
+    std::mutex buildMutex;  // one build at a time, and no revert during one
+    std::atomic<bool> ready = false;  // an index was built or restored
+    std::atomic<bool> tracking = false;  // the sinks keep loaded refs aside
+    std::optional<skypal::ref_index::Index> restored;  // read from the co-save, not checked yet
+    skypal::rcu::Published<skypal::ref_index::Index> published;
 
-    auto* factionOwner = akRef->GetFactionOwner();
-    if (factionOwner) {
-        if (GetFactionRank(akActor, factionOwner) > -1) {
-            return true;
-        }
-    }
+    std::mutex mutex;  // recent, foldQueued, formCount, seen
+    std::unordered_map<RE::FormID, RE::FormID> recent;  // ref -> base, loaded since the index was published
+    bool foldQueued = false;
+    std::size_t formCount = 0;  // the form map's size at the index's scan
+    std::size_t seen = 0;  // refs the sinks kept aside since that scan
+};
 
-    //logger::info("{} {}: getting akRef encounter zone", __func__, i);
+// The name table behind Filter_Name and All_Named (skypal/names.h): the lowercased name of every
+// base object loaded from a plugin, so those natives match each distinct name once instead of
+// asking every ref for its name. Bases are only named by their plugins, so it's built once, by
+// the warm-up or by the first native that needs it. Refs with a base made in game or a name of
+// their own are matched one by one.
+class NameIndex {
+public:
+    static NameIndex* GetSingleton() {
+        static NameIndex singleton;
+        return &singleton;
+    }
 
-    RE::BGSEncounterZone* encounterZone = akRef->extraList.GetEncounterZone();
-    if (IsActorOwnerOfEncounterZone_cpp(akActor, encounterZone, hasOwner)) {
-        return true;
+    // the table, building it first if there is none
+    skypal::rcu::Published<skypal::names::NameTable>::Reader Get() {
+        if (!ready.load(std::memory_order_acquire)) {
+            Build();
+        }
+        return published.Read();
     }
 
-    //logger::info("{} {}: getting cell", __func__, i);
+    void Build() {
+        std::lock_guard buildLock(buildMutex);
+        if (ready.load(std::memory_order_acquire)) {
+            return;
+        }
 
-    auto* cell = akRef->GetParentCell();
-    if (cell) {
-        auto* cellOwner = cell->GetActorOwner();
-        if (cellOwner) {
-            if (cellOwner == ownerBase) {
-                return true;
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::pair<const void*, std::string>> named;
+        {
+            const auto& [allForms, lock] = RE::TESForm::GetAllForms();
+            RE::BSReadLockGuard formsLock(lock.get());
+            for (auto& [id, form] : *allForms) {
+                // forms made in game can be deleted, so the table never holds on to one
+                if (!form || (id >> 24) == 0xFF || !form->As<RE::TESBoundObject>()) {
+                    continue;
+                }
+                std::string_view name = form->GetName();
+                if (!name.empty()) {
+                    named.emplace_back(form, std::string(name));
+                }
             }
         }
+        published.Publish(std::make_unique<skypal::names::NameTable>(skypal::names::NameTable::Build(std::move(named), nameTrigramsEnabled)));
+        ready.store(true, std::memory_order_release);
 
-        //logger::info("{} {}: getting cellFactionOwner", __func__, i);
+        auto table = published.Read();
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        logger::info("{} {} names in {} bytes, trigrams: {}, in {}ms", __func__, table->NameCount(), table->PoolBytes(), table->HasTrigrams(), elapsed);
+    }
 
-        auto* cellFactionOwner = cell->GetFactionOwner();
-        if (cellFactionOwner) {
-            if (GetFactionRank(akActor, cellFactionOwner) > -1) {
-                return true;
-            }
-        }
+private:
+    NameIndex() = default;
 
-        //::info("{} {}: getting cell encounterZone", __func__, i);
+    std::mutex buildMutex;
+    std::atomic<bool> ready = false;
+    skypal::rcu::Published<skypal::names::NameTable> published;
+};
 
-        auto* cellEncounterZone = cell->extraList.GetEncounterZone();
-        if (IsActorOwnerOfEncounterZone_cpp(akActor, cellEncounterZone, hasOwner)) {
-            return true;
-        }
+// The plugin name -> slot map behind Filter_Plugins and All_From_Plugin (skypal/plugins.h), kept
+// for the load order it was built from. The warm-up checks the load order's hash and only builds
+// it again when that changed.
+class PluginIndex {
+public:
+    static PluginIndex* GetSingleton() {
+        static PluginIndex singleton;
+        return &singleton;
     }
-    //logger::info("{} {}: getting worldSpace", __func__, i);
 
-    auto* worldSpace = akRef->GetWorldspace();
-    if (worldSpace) {
+    // the map, building it first if there is none
+    skypal::rcu::Published<skypal::plugins::LoadOrder>::Reader Get() {
+        if (!ready.load(std::memory_order_acquire)) {
+            Build();
+        }
+        return published.Read();
+    }
 
-        //logger::info("{} {}: getting worldEncounterZone", __func__, i);
+    void Build() {
+        std::lock_guard buildLock(buildMutex);
+        auto loadOrderHash = GetLoadOrderHash();
+        if (ready.load(std::memory_order_acquire) && loadOrderHash == builtFor) {
+            return;
+        }
 
-        auto* worldEncounterZone = worldSpace->encounterZone;
-        if (IsActorOwnerOfEncounterZone_cpp(akActor, worldEncounterZone, hasOwner)) {
-            return true;
+        auto loadOrder = std::make_unique<skypal::plugins::LoadOrder>();
+        if (auto* dataHandler = RE::TESDataHandler::GetSingleton()) {
+            for (auto* file : dataHandler->compiledFileCollection.files) {
+                loadOrder->Add(file->GetFilename(), { false, file->GetCompileIndex() });
+            }
+            for (auto* file : dataHandler->compiledFileCollection.smallFiles) {
+                loadOrder->Add(file->GetFilename(), { true, file->GetSmallFileCompileIndex() });
+            }
         }
+        logger::info("{} {} plugins", __func__, loadOrder->Size());
+        published.Publish(std::move(loadOrder));
+        builtFor = loadOrderHash;
+        ready.store(true, std::memory_order_release);
     }
-    return false;
-}
 
-int CountOwnersForRef(RE::StaticFunctionTag*, RE::TESObjectREFR* akRef, std::vector<RE::Actor*> owners) {
-    int count = 0;
-    if (!akRef) {
-        logger::warn("{} akRef doesn't exist", __func__);
-        return count;
-    }
+private:
+    PluginIndex() = default;
 
-    int size = owners.size();
-    if (size == 0) {
-        logger::warn("{} no owners passed in", __func__);
-        return count;
-    }
+    std::mutex buildMutex;  // builtFor
+    std::atomic<bool> ready = false;
+    std::uint64_t builtFor = 0;
+    skypal::rcu::Published<skypal::plugins::LoadOrder> published;
+};
 
+// Working sets for chains of filters: Begin copies the refs in once, every Keep_ native compacts
+// the same buffer in place and Take hands what's left back, so a chain costs one array in and one
+// out however many steps it has. A set is taken out of the map while a step runs on it, so
+// different sets never wait on each other's filters.
+class WorkingSets {
+public:
+    static WorkingSets* GetSingleton() {
+        static WorkingSets singleton;
+        return &singleton;
+    }
 
-    for (int i = 0; i < size; i++) {
-        if (ActorIsOwnerOfRef_cpp(akRef, owners[i])) {
-            count += 1;
+    std::uint32_t Begin(std::vector<RE::TESObjectREFR*> refs) {
+        std::lock_guard lock(mutex);
+        auto handle = ++lastHandle;
+        sets[handle] = std::move(refs);
+        order.push_back(handle);
+        while (order.size() > kMaxSets) {
+            if (sets.erase(order.front()) > 0) {
+                logger::warn("{} working set {} was never taken, dropped it", __func__, order.front());
+            }
+            order.pop_front();
         }
+        return handle;
     }
-    return count;
-}
 
-int CountOwnersForRef_cpp(RE::TESObjectREFR* akRef, std::vector<RE::Actor*> owners) {
-    int count = 0;
-    if (!akRef) {
-        //logger::warn("{} akRef doesn't exist", __func__);
-        return count;
-    }
+    // the number of refs left, or -1 if handle isn't a set or another step is running on it
+    template <class Pred>
+    int Keep(std::uint32_t handle, Pred&& pred) {
+        std::vector<RE::TESObjectREFR*> refs;
+        {
+            std::lock_guard lock(mutex);
+            auto it = sets.find(handle);
+            if (it == sets.end()) {
+                return -1;
+            }
+            refs = std::move(it->second);
+            sets.erase(it);
+        }
 
-    int size = owners.size();
-    if (size == 0) {
-        //logger::warn("{} no owners passed in", __func__);
-        return count;
-    }
+        auto left = core::KeepIf<Engine>(refs, pred);
 
+        std::lock_guard lock(mutex);
+        sets[handle] = std::move(refs);
+        return static_cast<int>(left);
+    }
 
-    for (int i = 0; i < size; i++) {
-        if (ActorIsOwnerOfRef_cpp(akRef, owners[i])) {
-            count += 1;
+    // false if handle isn't a set
+    bool Take(std::uint32_t handle, std::vector<RE::TESObjectREFR*>& refs) {
+        std::lock_guard lock(mutex);
+        auto it = sets.find(handle);
+        if (it == sets.end()) {
+            return false;
         }
+        refs = std::move(it->second);
+        sets.erase(it);
+        return true;
     }
-    return count;
-}
 
-bool RefHasAtLeastOneOwner(RE::StaticFunctionTag* tag, RE::TESObjectREFR* akRef, std::vector<RE::Actor*> owners) {
-    if (!akRef) {
-        logger::warn("{} akRef doesn't exist", __func__);
-        return false;
-    }
+private:
+    // sets that scripts never take are dropped oldest first past this
+    static constexpr std::size_t kMaxSets = 64;
 
-    int size = owners.size();
-    if (size == 0) {
-        logger::warn("{} no owners passed in", __func__);
+    WorkingSets() = default;
+
+    std::mutex mutex;
+    std::uint32_t lastHandle = 0;
+    std::unordered_map<std::uint32_t, std::vector<RE::TESObjectREFR*>> sets;
+    std::deque<std::uint32_t> order;  // handles in Begin order, some already taken
+};
+
+// Two phase mode for Filter_Keywords, Filter_Distance, Filter_Form_Types and Sort_Distance:
+// the refs are captured on the calling thread, then filtered or sorted on the worker pool.
+// Any_ and First_ natives stop early on their own, so they skip the capture.
+template <class Out = core::Collect>
+bool UseTwoPhase(std::size_t refCount) {
+    if constexpr (Out::kShortCircuits) {
         return false;
     }
+    return twoPhaseEnabled && refCount >= static_cast<std::size_t>(twoPhaseMinRefs);
+}
 
-    for (int i = 0; i < size; i++) {
-        if (owners[i]) {
-            if (ActorIsOwnerOfRef_cpp(akRef, owners[i])) {
-                return true;
-            }
-        }
-    }
-    return false;
+// iThreads workers, or one less than the cores so the calling thread has one too
+skypal::ThreadPool& GetWorkerPool() {
+    static skypal::ThreadPool pool(twoPhaseThreads > 0 ? static_cast<std::size_t>(twoPhaseThreads) : std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return pool;
 }
 
-bool RefHasAtLeastOneOwner_cpp(RE::TESObjectREFR* akRef, std::vector<RE::Actor*> owners) {
-    if (!akRef) {
-        //logger::warn("{} akRef doesn't exist", __func__);
-        return false;
+// Builds what the first queries would otherwise build, on a background thread: the static steps
+// once the data is loaded, all of them again after a load or a new game. Steps that find their
+// structure already built (the ref index restored from the co-save) return right away. A Start
+// while the steps are running runs them again once they finish.
+class WarmUp {
+public:
+    static WarmUp* GetSingleton() {
+        static WarmUp singleton;
+        return &singleton;
     }
 
-    int size = owners.size();
-    if (size == 0) {
-        //logger::warn("{} no owners passed in", __func__);
-        return false;
+    // before the first Start; perSave steps build from the loaded game and wait for one
+    void AddStep(std::string name, bool perSave, std::function<void()> build) {
+        std::lock_guard lock(mutex);
+        steps.push_back({ std::move(name), perSave, std::move(build) });
     }
 
-    for (int i = 0; i < size; i++) {
-        if (owners[i]) {
-            if (ActorIsOwnerOfRef_cpp(akRef, owners[i])) {
-                return true;
-            }
+    void Start(std::string reason, bool perSave) {
+        std::lock_guard lock(mutex);
+        if (running) {
+            rerun = true;
+            rerunPerSave = rerunPerSave || perSave;
+            rerunReason = std::move(reason);
+            return;
         }
+        running = true;
+        std::thread([this, reason = std::move(reason), perSave]() { Run(reason, perSave); }).detach();
     }
-    return false;
-}
 
-std::vector<RE::Actor*> filter_OwnersOnRef(RE::StaticFunctionTag* tag, RE::TESObjectREFR* akRef, std::vector<RE::Actor*> owners, std::string mode) {
-    std::vector<RE::Actor*> returnActors;
-    if (!akRef) {
-        logger::warn("{} akRef doesn't exist", __func__);
-        return returnActors;
+    // [running (0 or 1), steps done, steps in this run, milliseconds of the last finished run]
+    std::vector<float> Progress() {
+        std::lock_guard lock(mutex);
+        return { running ? 1.0f : 0.0f, static_cast<float>(stepsDone), static_cast<float>(stepsInRun), lastRunMs };
     }
 
-    int size = owners.size();
-    if (size == 0) {
-        logger::warn("{} no owners passed in", __func__);
-        return returnActors;
-    }
+private:
+    struct Step {
+        std::string name;
+        bool perSave = false;
+        std::function<void()> build;
+    };
 
-    if (mode == "!") {
-        for (int i = 0; i < size; i++) {
-            if (owners[i]) {
-                if (!ActorIsOwnerOfRef_cpp(akRef, owners[i])) {
-                    returnActors.push_back(owners[i]);
+    WarmUp() = default;
+
+    void Run(std::string reason, bool perSave) {
+        while (true) {
+            std::vector<Step*> toRun;
+            {
+                std::lock_guard lock(mutex);
+                for (auto& step : steps) {
+                    if (perSave || !step.perSave) {
+                        toRun.push_back(&step);
+                    }
                 }
+                stepsDone = 0;
+                stepsInRun = toRun.size();
             }
-        }
-    }
-    else {
-        for (int i = 0; i < size; i++) {
-            if (owners[i]) {
-                if (ActorIsOwnerOfRef_cpp(akRef, owners[i])) {
-                    returnActors.push_back(owners[i]);
+
+            logger::info("{} {} steps after {}", __func__, toRun.size(), reason);
+            auto start = std::chrono::steady_clock::now();
+            for (auto* step : toRun) {
+                auto stepStart = std::chrono::steady_clock::now();
+                try {
+                    step->build();
                 }
+                catch (...) {
+                    logger::error("{} {} failed", __func__, step->name);
+                }
+                logger::info("{} {} took {}ms", __func__, step->name, MillisecondsSince(stepStart));
+
+                std::lock_guard lock(mutex);
+                stepsDone++;
+            }
+            auto elapsed = MillisecondsSince(start);
+            logger::info("{} done after {} in {}ms", __func__, reason, elapsed);
+
+            std::lock_guard lock(mutex);
+            lastRunMs = elapsed;
+            if (!rerun) {
+                running = false;
+                return;
             }
+            rerun = false;
+            perSave = std::exchange(rerunPerSave, false);
+            reason = std::move(rerunReason);
         }
     }
-    return returnActors;
-}
 
-std::vector<RE::TESObjectREFR*> Filter_Owners(RE::StaticFunctionTag*, std::vector<RE::TESObjectREFR*> refs, std::vector<RE::Actor*> owners, std::string mode) {
-    std::vector<RE::TESObjectREFR*> returnRefs;
+    static float MillisecondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
 
-    int refsSize = refs.size();
-    if (refsSize == 0) {
-        logger::warn("{} no refs passed in.", __func__);
-        return returnRefs;
+    std::mutex mutex;
+    std::deque<Step> steps;  // a deque so a running warm-up's pointers survive AddStep
+    bool running = false;
+    bool rerun = false;
+    bool rerunPerSave = false;
+    std::string rerunReason;
+    std::size_t stepsDone = 0;
+    std::size_t stepsInRun = 0;
+    float lastRunMs = 0.0f;
+};
+
+// The capture is the part still on the calling thread, so it's kept in the stats and trace as
+// its own entry, like "Filter_Keywords.capture".
+skypal::snapshot::Snapshot<Engine> CaptureSnapshot(skypal::stats::FunctionStats* captureStats, core::RefSpan<Engine> refs, std::uint8_t fields) {
+    bool recordStats = skypal::stats::enabled.load(std::memory_order_relaxed);
+    bool recordTrace = skypal::trace::enabled.load(std::memory_order_relaxed);
+    if (recordTrace) {
+        skypal::trace::Tracer::GetSingleton()->Begin(captureStats->name.c_str(), refs.size());
     }
 
-    int owners_size = owners.size();
-    if (owners_size == 0) {
-        logger::warn("{} no owners passed in", __func__);
-        return returnRefs;
+    auto start = std::chrono::steady_clock::now();
+    auto snapshot = skypal::snapshot::Capture<Engine>(refs, fields);
+    if (recordStats) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        captureStats->Record(static_cast<std::uint64_t>(elapsed), refs.size(), snapshot.entries.size());
+    }
+    if (recordTrace) {
+        skypal::trace::Tracer::GetSingleton()->End(captureStats->name.c_str(), snapshot.entries.size());
+    }
+    return snapshot;
+}
+
+std::vector<RE::TESObjectREFR*> All(RE::StaticFunctionTag*) {
+    std::vector<RE::TESObjectREFR*> refs;
+    const auto& [allForms, lock] = RE::TESForm::GetAllForms();
+    for (auto& [id, form] : *allForms) {
+        auto* ref = form->AsReference();
+        if (ref) {
+            refs.push_back(ref);
+        }
     }
 
-    if (mode == "&") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (CountOwnersForRef_cpp(refs[i], owners) == owners_size) {
-                    returnRefs.push_back(refs[i]);
+    return refs;
+}
+
+std::vector<RE::TESObjectREFR*> Grid(RE::StaticFunctionTag*) {
+    std::vector<RE::TESObjectREFR*> refs;
+    const auto& [allForms, lock] = RE::TESForm::GetAllForms();
+    for (auto& [id, form] : *allForms) {
+        auto* ref = form->AsReference();
+        if (ref) {
+            auto* cell = ref->GetParentCell();
+            if (cell) {
+                if (cell->IsAttached()) {
+                    refs.push_back(ref);
                 }
             }
         }
     }
-    else if (mode == "^") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (CountOwnersForRef_cpp(refs[i], owners) == 1) {
-                    returnRefs.push_back(refs[i]);
-                }
+
+    return refs;
+}
+
+// the form ids of a list's forms, and of the forms in the lists it holds, like HasForm searches
+void GetListFormIds(const RE::BGSListForm* list, std::vector<RE::FormID>& formIds, std::vector<const RE::BGSListForm*>& visited) {
+    if (!list || std::find(visited.begin(), visited.end(), list) != visited.end()) {
+        return;
+    }
+    visited.push_back(list);
+    list->ForEachForm([&](RE::TESForm& form) {
+        if (auto* nested = form.As<RE::BGSListForm>()) {
+            GetListFormIds(nested, formIds, visited);
+        }
+        else {
+            formIds.push_back(form.GetFormID());
+        }
+        return RE::BSContainer::ForEachResult::kContinue;
+    });
+}
+
+std::vector<RE::TESObjectREFR*> All_Filter_Bases(RE::StaticFunctionTag*, std::vector<RE::TESForm*> bases, std::string mode) {
+    std::vector<RE::TESObjectREFR*> refs;
+    if (refIndexEnabled && mode != "!") {
+        std::vector<RE::FormID> baseIds;
+        baseIds.reserve(bases.size());
+        for (auto* base : bases) {
+            if (base) {
+                baseIds.push_back(base->GetFormID());
             }
         }
+        if (RefIndex::GetSingleton()->ForEachRef(std::move(baseIds), [&](RE::TESObjectREFR* ref) { refs.push_back(ref); })) {
+            return refs;
+        }
     }
-    else if (mode == "!|") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (CountOwnersForRef_cpp(refs[i], owners) == 0) {
-                    returnRefs.push_back(refs[i]);
+
+    const auto& [allForms, lock] = RE::TESForm::GetAllForms();
+    if (mode == "!") {
+        for (auto& [id, form] : *allForms) {
+            auto* ref = form->AsReference();
+            if (ref) {
+                if (std::find(bases.begin(), bases.end(), ref->GetBaseObject()) == bases.end()) {
+                    refs.push_back(ref);
                 }
             }
         }
     }
-    else if (mode == "!&") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (CountOwnersForRef_cpp(refs[i], owners) < owners_size) {
-                    returnRefs.push_back(refs[i]);
+    else {
+        for (auto& [id, form] : *allForms) {
+            auto* ref = form->AsReference();
+            if (ref) {
+                if (std::find(bases.begin(), bases.end(), ref->GetBaseObject()) != bases.end()) {
+                    refs.push_back(ref);
                 }
             }
         }
     }
-    else if (mode == "!^") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                int count = CountOwnersForRef_cpp(refs[i], owners);
-                if (count == 0 || count > 1) {
-                    returnRefs.push_back(refs[i]);
+
+    return refs;
+}
+
+std::vector<RE::TESObjectREFR*> All_Filter_Bases_Form_List(RE::StaticFunctionTag*, RE::BGSListForm* akFormlist, std::string mode) {
+    std::vector<RE::TESObjectREFR*> refs;
+    if (refIndexEnabled && mode != "!") {
+        std::vector<RE::FormID> baseIds;
+        std::vector<const RE::BGSListForm*> visited;
+        GetListFormIds(akFormlist, baseIds, visited);
+        if (RefIndex::GetSingleton()->ForEachRef(std::move(baseIds), [&](RE::TESObjectREFR* ref) { refs.push_back(ref); })) {
+            return refs;
+        }
+    }
+
+    const auto& [allForms, lock] = RE::TESForm::GetAllForms();
+    if (mode == "!") {
+        for (auto& [id, form] : *allForms) {
+            auto* ref = form->AsReference();
+            if (ref) {
+                if (!akFormlist->HasForm(ref->GetBaseObject())) {
+                    refs.push_back(ref);
                 }
             }
         }
     }
     else {
-        logger::info("{} | {}", __func__, refsSize);
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (RefHasAtLeastOneOwner_cpp(refs[i], owners)) {
-                    returnRefs.push_back(refs[i]);
+        for (auto& [id, form] : *allForms) {
+            auto* ref = form->AsReference();
+            if (ref) {
+                if (akFormlist->HasForm(ref->GetBaseObject())) {
+                    refs.push_back(ref);
                 }
             }
         }
     }
-    return returnRefs;
+
+    return refs;
 }
 
-bool ActorIsPotentialThiefOfRef(RE::StaticFunctionTag*, RE::TESObjectREFR* akRef, RE::Actor* akActor) {
-    if (!akRef) {
-        logger::warn("{} akRef doesn't exist", __func__);
-        return false;
+// Passes every loaded ref whose name contains pattern, case-insensitive, among the refs whose
+// base's name does. The names are looked up in the name table, then the refs of the matching bases
+// in the ref index; without the index, or when the bases have too many refs, it scans the form
+// map for them. Either way a ref renamed to pattern from a base named otherwise isn't found, since
+// nothing lists renamed refs without a scan; Filter_Name on refs from elsewhere finds those. A ref
+// renamed away from pattern is dropped.
+std::vector<RE::TESObjectREFR*> All_Named(RE::StaticFunctionTag*, std::string pattern) {
+    std::vector<RE::TESObjectREFR*> refs;
+    if (pattern.empty()) {
+        logger::warn("{} no pattern passed in", __func__);
+        return refs;
     }
 
-    if (!akActor) {
-        logger::warn("{} akActor doesn't exist", __func__);
-        return false;
+    auto table = NameIndex::GetSingleton()->Get();
+    auto parsed = skypal::names::ParsePattern(pattern, "");
+    auto nameIds = table->Lookup(parsed);
+    skypal::names::RefMatcher<Engine> matcher(*table, std::move(parsed), nameIds);
+    std::vector<RE::FormID> baseIds;
+    for (auto nameId : nameIds) {
+        for (auto* key : table->KeysOf(nameId)) {
+            baseIds.push_back(static_cast<const RE::TESForm*>(key)->GetFormID());
+        }
     }
+    std::sort(baseIds.begin(), baseIds.end());
 
-    bool hasOwner = false;
-    auto* ownerBase = akActor->GetActorBase();
-    auto* refActorOwner = akRef->GetActorOwner();
-
-    if (refActorOwner) {
-        if (refActorOwner == ownerBase) {
-            return false;
-        }
-        else {
-            hasOwner = true;
+    if (refIndexEnabled) {
+        bool indexed = RefIndex::GetSingleton()->ForEachRef(baseIds, [&](RE::TESObjectREFR* ref) {
+            if (matcher(ref)) {
+                refs.push_back(ref);
+            }
+        });
+        if (indexed) {
+            return refs;
         }
     }
 
-    //logger::info("{} {}: getting ref factionOwner", __func__, i);
-
-    auto* factionOwner = akRef->GetFactionOwner();
-    if (factionOwner) {
-        if (GetFactionRank(akActor, factionOwner) > -1) {
-            return false;
-        }
-        else {
-            hasOwner = true;
+    const auto& [allForms, lock] = RE::TESForm::GetAllForms();
+    RE::BSReadLockGuard formsLock(lock.get());
+    for (auto& [id, form] : *allForms) {
+        auto* ref = form ? form->AsReference() : nullptr;
+        auto* base = ref ? ref->GetBaseObject() : nullptr;
+        if (base && std::binary_search(baseIds.begin(), baseIds.end(), base->GetFormID()) && matcher(ref)) {
+            refs.push_back(ref);
         }
     }
 
-    //logger::info("{} {}: getting akRef encounter zone", __func__, i);
+    return refs;
+}
 
-    RE::BGSEncounterZone* encounterZone = akRef->extraList.GetEncounterZone();
-    if (IsActorOwnerOfEncounterZone_cpp(akActor, encounterZone, hasOwner)) {
-        return false;
+// Passes every loaded ref that plugin added, the plugin's file name with its extension, like
+// "Skyrim.esm". Refs are told apart by form id, so only the refs of that plugin are touched.
+std::vector<RE::TESObjectREFR*> All_From_Plugin(RE::StaticFunctionTag*, std::string plugin) {
+    std::vector<RE::TESObjectREFR*> refs;
+    std::vector<std::string_view> unknown;
+    auto mask = PluginIndex::GetSingleton()->Get()->Resolve(std::span(&plugin, 1), unknown);
+    if (mask.Empty()) {
+        logger::warn("{} {} isn't loaded", __func__, plugin);
+        return refs;
     }
 
-    //logger::info("{} {}: getting cell", __func__, i);
-
-    auto* cell = akRef->GetParentCell();
-    if (cell) {
-        auto* cellOwner = cell->GetActorOwner();
-        if (cellOwner) {
-            if (cellOwner == ownerBase) {
-                return false;
-            }
-            else {
-                hasOwner = true;
+    const auto& [allForms, lock] = RE::TESForm::GetAllForms();
+    for (auto& [id, form] : *allForms) {
+        if (mask.Contains(id)) {
+            auto* ref = form->AsReference();
+            if (ref) {
+                refs.push_back(ref);
             }
         }
+    }
 
-        //logger::info("{} {}: getting cellFactionOwner", __func__, i);
+    return refs;
+}
 
-        auto* cellFactionOwner = cell->GetFactionOwner();
-        if (cellFactionOwner) {
-            if (GetFactionRank(akActor, cellFactionOwner) > -1) {
-                return false;
-            }
-            else {
-                hasOwner = true;
-            }
-        }
+std::vector<RE::TESObjectREFR*> Grid_Filter_Bases(RE::StaticFunctionTag*, std::vector<RE::TESForm*> bases, std::string mode) {
+    std::vector<RE::TESObjectREFR*> refs;
 
-        //::info("{} {}: getting cell encounterZone", __func__, i);
+    auto* tes = RE::TES::GetSingleton();
+    if (!tes) {
+        logger::error("{} couldn't get TES singleton", __func__);
+        return refs;
+    }
 
-        auto* cellEncounterZone = cell->extraList.GetEncounterZone();
-        if (IsActorOwnerOfEncounterZone_cpp(akActor, cellEncounterZone, hasOwner)) {
-            return false;
-        }
+    if (mode == "!") {
+        tes->ForEachReference([&](RE::TESObjectREFR& akRef) {
+            RE::TESObjectREFR* ref = &akRef;
+            if (ref) {
+                if (std::find(bases.begin(), bases.end(), ref->GetBaseObject()) == bases.end()) {
+                    refs.push_back(ref);
+                }
+            }
+            return RE::BSContainer::ForEachResult::kContinue;
+            });
+    }
+    else {
+        tes->ForEachReference([&](RE::TESObjectREFR& akRef) {
+            RE::TESObjectREFR* ref = &akRef;
+            if (ref) {
+                if (std::find(bases.begin(), bases.end(), ref->GetBaseObject()) != bases.end()) {
+                    refs.push_back(ref);
+                }
+            }
+            return RE::BSContainer::ForEachResult::kContinue;
+            });
     }
-    //logger::info("{} {}: getting worldSpace", __func__, i);
 
-    auto* worldSpace = akRef->GetWorldspace();
-    if (worldSpace) {
+    return refs;
+}
 
-        //logger::info("{} {}: getting worldEncounterZone", __func__, i);
+std::vector<RE::TESObjectREFR*> Grid_Filter_Bases_Form_List(RE::StaticFunctionTag*, RE::BGSListForm* bases, std::string mode) {
+    std::vector<RE::TESObjectREFR*> refs;
 
-        auto* worldEncounterZone = worldSpace->encounterZone;
-        if (IsActorOwnerOfEncounterZone_cpp(akActor, worldEncounterZone, hasOwner)) {
-            return false;
-        }
+    auto* tes = RE::TES::GetSingleton();
+    if (!tes) {
+        logger::error("{} couldn't get TES singleton", __func__);
+        return refs;
+    }
+
+    if (mode == "!") {
+        tes->ForEachReference([&](RE::TESObjectREFR& akRef) {
+            RE::TESObjectREFR* ref = &akRef;
+            if (ref) {
+                if (!bases->HasForm(ref->GetBaseObject())) {
+                    refs.push_back(ref);
+                }
+            }
+            return RE::BSContainer::ForEachResult::kContinue;
+            });
     }
-    if (hasOwner) {
-        return true; //ref has owner and it is not the current owners[i] reference
+    else {
+        tes->ForEachReference([&](RE::TESObjectREFR& akRef) {
+            RE::TESObjectREFR* ref = &akRef;
+            if (ref) {
+                if (bases->HasForm(ref->GetBaseObject())) {
+                    refs.push_back(ref);
+                }
+            }
+            return RE::BSContainer::ForEachResult::kContinue;
+            });
     }
-    return false;
+
+    return refs;
 }
 
-bool ActorIsPotentialThiefOfRef_cpp(RE::TESObjectREFR* akRef, RE::Actor* akActor) {
-    if (!akRef) {
-        //logger::warn("{} akRef doesn't exist", __func__);
-        return false;
-    }
+int Count_Disabled(RE::StaticFunctionTag*, RefArray refs) {
+    return core::CountDisabled<Engine>(refs);
+}
 
-    if (!akActor) {
-        //logger::warn("{} akActor doesn't exist", __func__);
-        return false;
-    }
+int Count_Enabled(RE::StaticFunctionTag*, RefArray refs) {
+    return core::CountEnabled<Engine>(refs);
+}
 
-    bool hasOwner = false;
-    auto* ownerBase = akActor->GetActorBase();
-    auto* refActorOwner = akRef->GetActorOwner();
+void Disable(RE::StaticFunctionTag*, std::vector<RE::TESObjectREFR*> refs) {
+    if (static_cast<int>(refs.size()) >= bulkQueueThreshold) {
+        BulkMutationQueue::GetSingleton()->Enqueue(refs, BulkMutationQueue::Operation::kDisable, 0, "Disable");
+        return;
+    }
 
-    if (refActorOwner) {
-        if (refActorOwner == ownerBase) {
-            return false;
-        }
-        else {
-            hasOwner = true;
+    for (int i = 0; i < refs.size(); i++) {
+        if (refs[i]) {
+            refs[i]->Disable();
         }
     }
+}
 
-    //logger::info("{} {}: getting ref factionOwner", __func__, i);
+void Enable(RE::StaticFunctionTag*, std::vector<RE::TESObjectREFR*> refs) {
+    if (static_cast<int>(refs.size()) >= bulkQueueThreshold) {
+        BulkMutationQueue::GetSingleton()->Enqueue(refs, BulkMutationQueue::Operation::kEnable, 0, "Enable");
+        return;
+    }
 
-    auto* factionOwner = akRef->GetFactionOwner();
-    if (factionOwner) {
-        if (GetFactionRank(akActor, factionOwner) > -1) {
-            return false;
-        }
-        else {
-            hasOwner = true;
+    for (int i = 0; i < refs.size(); i++) {
+        if (refs[i]) {
+            //didn't see an Enable function in TESObjectREFR, so using console command as workaround.
+            ExecuteConsoleCommand("enable", refs[i]);
         }
     }
+}
 
-    //logger::info("{} {}: getting akRef encounter zone", __func__, i);
+int Get_Last_Bulk_Batch(RE::StaticFunctionTag*) {
+    return static_cast<int>(BulkMutationQueue::GetSingleton()->GetLastBatchId());
+}
 
-    RE::BGSEncounterZone* encounterZone = akRef->extraList.GetEncounterZone();
-    if (IsActorOwnerOfEncounterZone_cpp(akActor, encounterZone, hasOwner)) {
-        return false;
+int Count_Pending_Bulk(RE::StaticFunctionTag*) {
+    return BulkMutationQueue::GetSingleton()->GetPendingCount();
+}
+
+// Runs a query on a worker thread and returns its ticket, or 0 if spec isn't a query.
+// spec is the native's name, optionally followed by :mode, like "Filter_Keywords:&" or "Sort_Distance:>".
+// refs is the input of the Filter_ and Sort_ natives, All_ and Grid_ queries scan the world instead.
+// forms is the native's array argument (bases, keywords, actors), or its single form in forms[0]
+// (the formlist, or the ref to measure distance from, which defaults to the player).
+// When the query ends, eventName (default "SkyPal_Query_Done") is sent to callbackForm's scripts
+// as eventName(int ticket, int count, string status), or as a mod event with strArg = status and
+// numArg = ticket if callbackForm is none. status is "done", "cancelled", "timeout" or "failed".
+int Query_Async(RE::StaticFunctionTag*, std::string spec, std::vector<RE::TESObjectREFR*> refs, std::vector<RE::TESForm*> forms, float distance, RE::TESForm* callbackForm, std::string eventName) {
+    auto query = Query::Parse(spec, std::move(forms), distance);
+    if (!query) {
+        logger::warn("{} {} isn't a query", __func__, spec);
+        return 0;
     }
 
-    //logger::info("{} {}: getting cell", __func__, i);
+    AsyncQueryQueue::Request request;
+    request.query = std::move(*query);
 
-    auto* cell = akRef->GetParentCell();
-    if (cell) {
-        auto* cellOwner = cell->GetActorOwner();
-        if (cellOwner) {
-            if (cellOwner == ownerBase) {
-                return false;
-            }
-            else {
-                hasOwner = true;
-            }
+    request.refs.reserve(refs.size());
+    for (auto* ref : refs) {
+        if (ref) {
+            request.refs.push_back(ref->CreateRefHandle());
         }
+    }
+    request.callbackFormId = callbackForm ? callbackForm->GetFormID() : 0;
+    request.eventName = eventName;
 
-        //logger::info("{} {}: getting cellFactionOwner", __func__, i);
+    return static_cast<int>(AsyncQueryQueue::GetSingleton()->Enqueue(std::move(request)));
+}
 
-        auto* cellFactionOwner = cell->GetFactionOwner();
-        if (cellFactionOwner) {
-            if (GetFactionRank(akActor, cellFactionOwner) > -1) {
-                return false;
-            }
-            else {
-                hasOwner = true;
-            }
-        }
+bool Cancel_Async(RE::StaticFunctionTag*, int ticket) {
+    return AsyncQueryQueue::GetSingleton()->Cancel(static_cast<std::uint32_t>(ticket));
+}
 
-        //::info("{} {}: getting cell encounterZone", __func__, i);
+// "pending", "running", "done", "cancelled", "timeout", "failed", or "unknown" once taken or dropped
+std::string Get_Async_Status(RE::StaticFunctionTag*, int ticket) {
+    return AsyncQueryQueue::GetSingleton()->GetStatus(static_cast<std::uint32_t>(ticket));
+}
 
-        auto* cellEncounterZone = cell->extraList.GetEncounterZone();
-        if (IsActorOwnerOfEncounterZone_cpp(akActor, cellEncounterZone, hasOwner)) {
-            return false;
-        }
-    }
-    //logger::info("{} {}: getting worldSpace", __func__, i);
+// the refs of a done query, which can only be taken once
+std::vector<RE::TESObjectREFR*> Take_Async_Result(RE::StaticFunctionTag*, int ticket) {
+    return AsyncQueryQueue::GetSingleton()->Take(static_cast<std::uint32_t>(ticket));
+}
 
-    auto* worldSpace = akRef->GetWorldspace();
-    if (worldSpace) {
+// Returns a watch handle for spec, or 0 if spec isn't a query. spec and forms are as in
+// Query_Async; All_ specs scan the world, the others filter the grid. A grid watch polls the
+// loaded refs the cell attach and detach events keep track of, but an All_ watch rescans the
+// whole form map on every Poll_Delta, so poll those sparingly.
+int Watch(RE::StaticFunctionTag*, std::string spec, std::vector<RE::TESForm*> forms, float distance) {
+    auto query = Query::Parse(spec, std::move(forms), distance);
+    if (!query) {
+        logger::warn("{} {} isn't a query", __func__, spec);
+        return 0;
+    }
+    return static_cast<int>(WatchRegistry::GetSingleton()->Add(std::move(*query)));
+}
 
-        //logger::info("{} {}: getting worldEncounterZone", __func__, i);
+bool Unwatch(RE::StaticFunctionTag*, int handle) {
+    return WatchRegistry::GetSingleton()->Remove(static_cast<std::uint32_t>(handle));
+}
 
-        auto* worldEncounterZone = worldSpace->encounterZone;
-        if (IsActorOwnerOfEncounterZone_cpp(akActor, worldEncounterZone, hasOwner)) {
-            return false;
-        }
-    }
-    if (hasOwner) {
-        return true; //ref has owner and it is not the current owners[i] reference
+// the refs that entered the watch's result since the previous poll, everything on the first one
+std::vector<RE::TESObjectREFR*> Poll_Delta(RE::StaticFunctionTag*, int handle) {
+    std::vector<RE::TESObjectREFR*> added;
+    if (!WatchRegistry::GetSingleton()->Poll(static_cast<std::uint32_t>(handle), added)) {
+        logger::warn("{} {} isn't a watch or its query failed", __func__, handle);
     }
-    return false;
+    return added;
 }
 
-int CountPotentialThievesForRef(RE::StaticFunctionTag* tag, RE::TESObjectREFR* akRef, std::vector<RE::Actor*> potential_thieves) {
-    int count = 0;
+// the refs that left the watch's result at the last Poll_Delta
+std::vector<RE::TESObjectREFR*> Get_Delta_Removed(RE::StaticFunctionTag*, int handle) {
+    return WatchRegistry::GetSingleton()->GetRemoved(static_cast<std::uint32_t>(handle));
+}
+
+// Runs spec on every ref that attaches or loads from now on and returns the standing query's id,
+// or 0 if spec isn't a query. spec and forms are as in Query_Async. Each frame with matches sends
+// eventName (default "SkyPal_Standing_Matches") to callbackForm's scripts as eventName(int id,
+// int count), or as a mod event with numArg = id if callbackForm is none. Take_Standing_Matches
+// then hands over the refs.
+int Add_Standing_Query(RE::StaticFunctionTag*, std::string spec, std::vector<RE::TESForm*> forms, float distance, RE::TESForm* callbackForm, std::string eventName) {
+    auto query = Query::Parse(spec, std::move(forms), distance);
+    if (!query) {
+        logger::warn("{} {} isn't a query", __func__, spec);
+        return 0;
+    }
+    return static_cast<int>(StandingQueries::GetSingleton()->Add(std::move(*query), callbackForm ? callbackForm->GetFormID() : 0, eventName));
+}
+
+bool Remove_Standing_Query(RE::StaticFunctionTag*, int id) {
+    return StandingQueries::GetSingleton()->Remove(static_cast<std::uint32_t>(id));
+}
+
+// the refs the standing query matched since the last take
+std::vector<RE::TESObjectREFR*> Take_Standing_Matches(RE::StaticFunctionTag*, int id) {
+    return StandingQueries::GetSingleton()->Take(static_cast<std::uint32_t>(id));
+}
+
+// Returns a working set handle holding refs. The Keep_ natives then filter the set in place and
+// Take returns what's left and frees the set.
+int Begin(RE::StaticFunctionTag*, RefArray refs) {
+    return static_cast<int>(WorkingSets::GetSingleton()->Begin({ refs.begin(), refs.end() }));
+}
+
+// a working set of every loaded ref, like All() without the array
+int Begin_All(RE::StaticFunctionTag*) {
+    return static_cast<int>(WorkingSets::GetSingleton()->Begin(Query::Scan(false)));
+}
+
+// a working set of the refs in attached cells, like Grid() without the array
+int Begin_Grid(RE::StaticFunctionTag*) {
+    return static_cast<int>(WorkingSets::GetSingleton()->Begin(Query::Scan(true)));
+}
+
+std::vector<RE::TESObjectREFR*> Take(RE::StaticFunctionTag*, int handle) {
+    std::vector<RE::TESObjectREFR*> refs;
+    if (!WorkingSets::GetSingleton()->Take(static_cast<std::uint32_t>(handle), refs)) {
+        logger::warn("{} {} isn't a working set", __func__, handle);
+    }
+    return refs;
+}
+
+// Keep_ natives take their Filter_ native's arguments with a working set in place of refs, with
+// the same modes, and return how many refs are left. The mode is parsed once per call, like the
+// Filter_ kernels do, and the predicate it picks goes straight to core::KeepIf.
+template <class Pred>
+int KeepWith(const char* function, int handle, Pred&& pred) {
+    auto left = WorkingSets::GetSingleton()->Keep(static_cast<std::uint32_t>(handle), pred);
+    if (left < 0) {
+        logger::warn("{} {} isn't a working set or is in use", function, handle);
+        return 0;
+    }
+    return left;
+}
+
+// as core::FilterMode
+template <class Pred>
+int KeepMode(const char* function, int handle, std::string_view mode, Pred&& pred) {
+    if (core::ParseNegate(mode) == core::Negate::kNoMatch) {
+        return KeepWith(function, handle, [&](RE::TESObjectREFR* ref) { return !pred(ref); });
+    }
+    return KeepWith(function, handle, pred);
+}
+
+// as core::FilterGate
+template <class Item, class Match>
+int KeepGate(const char* function, int handle, std::span<const Item> items, std::string_view mode, Match&& match) {
+    return core::WithGate(core::ParseGate(mode), [&](auto gate) {
+        return KeepWith(function, handle, [&](RE::TESObjectREFR* ref) {
+            return core::PassesGate<gate()>(items, [&](const Item& item) { return match(ref, item); });
+        });
+    });
+}
+
+int Keep_Bases(RE::StaticFunctionTag*, int handle, std::vector<RE::TESForm*> bases, std::string mode) {
+    return KeepMode(__func__, handle, mode, [&](RE::TESObjectREFR* ref) { return core::BaseIsIn<Engine>(ref, bases); });
+}
+
+int Keep_Bases_Form_List(RE::StaticFunctionTag*, int handle, RE::BGSListForm* akFormlist, std::string mode) {
+    if (!akFormlist) {
+        logger::warn("{} akFormlist doesn't exist", __func__);
+        return 0;
+    }
+    return KeepMode(__func__, handle, mode, [&](RE::TESObjectREFR* ref) { return Engine::ListHasForm(akFormlist, Engine::GetBase(ref)); });
+}
+
+int Keep_Form_Types(RE::StaticFunctionTag*, int handle, std::vector<int> formTypes, std::string mode) {
+    return KeepMode(__func__, handle, mode, [&](RE::TESObjectREFR* ref) {
+        return std::find(formTypes.begin(), formTypes.end(), Engine::GetBaseFormType(ref)) != formTypes.end();
+    });
+}
+
+int Keep_Collision_Layer_Types(RE::StaticFunctionTag*, int handle, std::vector<int> collision_layer_types, std::string mode) {
+    return KeepMode(__func__, handle, mode, [&](RE::TESObjectREFR* ref) {
+        return std::find(collision_layer_types.begin(), collision_layer_types.end(), Engine::GetCollisionLayer(ref)) != collision_layer_types.end();
+    });
+}
+
+int Keep_Enabled(RE::StaticFunctionTag*, int handle, std::string mode) {
+    return KeepMode(__func__, handle, mode, [](RE::TESObjectREFR* ref) { return !Engine::IsDisabled(ref); });
+}
+
+int Keep_Deleted(RE::StaticFunctionTag*, int handle, std::string mode) {
+    return KeepMode(__func__, handle, mode, [](RE::TESObjectREFR* ref) { return Engine::IsDeleted(ref); });
+}
+
+int Keep_3dLoaded(RE::StaticFunctionTag*, int handle, std::string mode) {
+    return KeepMode(__func__, handle, mode, [](RE::TESObjectREFR* ref) { return Engine::Is3DLoaded(ref); });
+}
+
+int Keep_OffLimits(RE::StaticFunctionTag*, int handle, std::string mode) {
+    return KeepMode(__func__, handle, mode, [](RE::TESObjectREFR* ref) { return Engine::IsOffLimits(ref); });
+}
+
+int Keep_InventoryObjects(RE::StaticFunctionTag*, int handle, std::string mode) {
+    return KeepMode(__func__, handle, mode, [](RE::TESObjectREFR* ref) { return Engine::IsInventoryObject(ref); });
+}
+
+int Keep_PlayableObjects(RE::StaticFunctionTag*, int handle, std::string mode) {
+    return KeepMode(__func__, handle, mode, [](RE::TESObjectREFR* ref) { return Engine::IsPlayable(ref); });
+}
+
+int Keep_QuestObjects(RE::StaticFunctionTag*, int handle, std::string mode) {
+    return KeepMode(__func__, handle, mode, [](RE::TESObjectREFR* ref) { return Engine::IsQuestObject(ref); });
+}
+
+int Keep_WorldSpace(RE::StaticFunctionTag*, int handle, RE::TESWorldSpace* akWorldSpace, std::string mode) {
+    if (!akWorldSpace) {
+        logger::warn("{} akWorldSpace doesn't exist", __func__);
+        return 0;
+    }
+    return KeepMode(__func__, handle, mode, [&](RE::TESObjectREFR* ref) {
+        auto* worldspace = Engine::GetWorldspace(ref);
+        return worldspace && worldspace == akWorldSpace;
+    });
+}
+
+int Keep_Distance(RE::StaticFunctionTag*, int handle, float distance, RE::TESObjectREFR* from, std::string mode) {
+    if (!from) {
+        from = RE::PlayerCharacter::GetSingleton();
+    }
+    if (!from) {
+        logger::error("{} from ref is none and couldn't find playerRef", __func__);
+        return 0;
+    }
+    distance = std::max(distance, 0.0f);
+    auto fromPosition = Engine::GetPosition(from);
+    float distanceSquared = distance * distance;
+    if (mode == ">") {
+        return KeepWith(__func__, handle, [&](RE::TESObjectREFR* ref) { return core::DistanceSquared(Engine::GetPosition(ref), fromPosition) > distanceSquared; });
+    }
+    return KeepWith(__func__, handle, [&](RE::TESObjectREFR* ref) { return core::DistanceSquared(Engine::GetPosition(ref), fromPosition) < distanceSquared; });
+}
+
+int Keep_Keywords(RE::StaticFunctionTag*, int handle, std::vector<RE::BGSKeyword*> keywords, std::string mode) {
+    return KeepGate(__func__, handle, std::span<RE::BGSKeyword* const>(keywords), mode, [](RE::TESObjectREFR* ref, RE::BGSKeyword* keyword) {
+        return Engine::HasKeyword(ref, keyword);
+    });
+}
+
+int Keep_Owners(RE::StaticFunctionTag*, int handle, std::vector<RE::Actor*> owners, std::string mode) {
+    return KeepGate(__func__, handle, std::span<RE::Actor* const>(owners), mode, [](RE::TESObjectREFR* ref, RE::Actor* actor) {
+        return core::ActorIsOwner<Engine>(ref, actor);
+    });
+}
+
+int Keep_Potential_Thieves(RE::StaticFunctionTag*, int handle, std::vector<RE::Actor*> potential_thieves, std::string mode) {
+    return KeepGate(__func__, handle, std::span<RE::Actor* const>(potential_thieves), mode, [](RE::TESObjectREFR* ref, RE::Actor* actor) {
+        return core::ActorIsPotentialThief<Engine>(ref, actor);
+    });
+}
+
+// The first ref in refs that passes spec, or none. spec and forms are as in Query_Async; All and
+// Grid pass any ref and Sort_Distance the closest (or with ":>" the farthest).
+RE::TESObjectREFR* Find(RE::StaticFunctionTag*, RefArray refs, std::string spec, std::vector<RE::TESForm*> forms, float distance) {
+    auto query = Query::Parse(spec, std::move(forms), distance);
+    if (!query) {
+        logger::warn("{} {} isn't a query", __func__, spec);
+        return nullptr;
+    }
+
+    RE::TESObjectREFR* found = nullptr;
+    if (!query->Filter<core::First>(refs, found)) {
+        logger::warn("{} {} doesn't fit its forms", __func__, spec);
+    }
+    return found;
+}
+
+// The closest ref to from (default the player) in refs that passes spec, or none. Refs are tested
+// outward from from, so the search usually ends after a few of them rather than a full sort.
+RE::TESObjectREFR* Find_Closest(RE::StaticFunctionTag*, RefArray refs, std::string spec, std::vector<RE::TESForm*> forms, float distance, RE::TESObjectREFR* from) {
+    auto query = Query::Parse(spec, std::move(forms), distance);
+    if (!query) {
+        logger::warn("{} {} isn't a query", __func__, spec);
+        return nullptr;
+    }
+
+    if (!from) {
+        from = RE::PlayerCharacter::GetSingleton();
+    }
+    return core::FindClosest<Engine>(refs, from, "", [&](RE::TESObjectREFR* ref) { return query->Test(ref); });
+}
+
+template <class Out = core::Collect>
+core::ResultOf<Out, Engine> Filter_Base_Form_Types(RE::StaticFunctionTag*, RefArray refs, std::vector<int> formTypes, std::string mode) {
+    core::ResultOf<Out, Engine> returnRefs{};
+
+    int refsSize = refs.size();
+    if (refsSize == 0) {
+        logger::warn("{} no refs passed in", __func__);
+        return returnRefs;
+    }
+
+    if (formTypes.size() == 0) {
+        logger::warn("{} no formTypes passed in", __func__);
+        return returnRefs;
+    }
+
+    if (UseTwoPhase<Out>(refs.size())) {
+        static auto* captureStats = skypal::stats::Registry::GetSingleton()->Get(std::string(__func__) + ".capture");
+        auto snapshot = CaptureSnapshot(captureStats, refs, skypal::snapshot::kFormType);
+        return skypal::snapshot::FilterFormTypes<Engine, Out>(snapshot, GetWorkerPool(), formTypes, mode);
+    }
+
+    return core::FilterFormTypes<Engine, Out>(refs, formTypes, mode);
+}
+
+template <class Out = core::Collect>
+core::ResultOf<Out, Engine> Filter_Bases(RE::StaticFunctionTag*, RefArray refs, std::vector<RE::TESForm*> bases, std::string mode) {
+    core::ResultOf<Out, Engine> returnRefs{};
+
+    int refsSize = refs.size();
+    if (refsSize == 0) {
+        logger::warn("{} no refs passed in", __func__);
+        return returnRefs;
+    }
+
+    if (bases.size() == 0) {
+        logger::warn("{} no bases passed in", __func__);
+        return returnRefs;
+    }
+
+    return core::FilterBases<Engine, Out>(refs, bases, mode);
+}
+
+int GetFormlistSize(RE::BGSListForm* akFormList) {
+    if (!akFormList) {
+        return 0;
+    }
+    return(akFormList->forms.size() + akFormList->scriptAddedFormCount);
+}
+
+template <class Out = core::Collect>
+core::ResultOf<Out, Engine> Filter_Bases_Form_List(RE::StaticFunctionTag*, RefArray refs, RE::BGSListForm* akFormlist, std::string mode) {
+    core::ResultOf<Out, Engine> returnRefs{};
+
+    int refsSize = refs.size();
+    if (refsSize == 0) {
+        logger::warn("{} no refs passed in", __func__);
+        return returnRefs;
+    }
+
+    if (GetFormlistSize(akFormlist) == 0) {
+        logger::warn("{} no bases passed in", __func__);
+        return returnRefs;
+    }
+
+    return core::FilterBasesFormList<Engine, Out>(refs, akFormlist, mode);
+}
+
+// must be called on the main thread
+void ApplyCollisionLayerType(RE::TESObjectREFR* ref, RE::COL_LAYER coLayer) {
+    RE::NiAVObject* nav = ref->Get3D();
+    if (!nav) {
+        SPDLOG_TRACE("{} 3d for ref Id {:x} not found", __func__, ref->GetFormID());
+        return;
+    }
+
+    SPDLOG_TRACE("{} ref Id {:x} collision layer {} -> {}", __func__, ref->GetFormID(), int(nav->GetCollisionLayer()), int(coLayer));
+
+    RE::Actor* akActor = ref->As<RE::Actor>();
+    if (akActor) {
+        uint32_t filter;
+        akActor->GetCollisionFilterInfo(filter);
+        nav->SetCollisionLayerAndGroup(coLayer, filter);
+        nav->UpdateRigidConstraints(true);
+    }
+    else {
+        nav->SetCollisionLayer(coLayer);
+        //nav->SetCollisionLayerAndGroup(coLayer, filterInfo + 1);
+        //nav->UpdateRigidConstraints(true);
+    }
+}
+
+template <class Out = core::Collect>
+core::ResultOf<Out, Engine> Filter_Collision_Layer_Types(RE::StaticFunctionTag*, RefArray refs, std::vector<int> collision_layer_types, std::string mode) {
+    core::ResultOf<Out, Engine> returnRefs{};
+
+    int refsSize = refs.size();
+    if (refsSize == 0) {
+        logger::warn("{} no refs passed in", __func__);
+        return returnRefs;
+    }
+
+    if (collision_layer_types.size() == 0) {
+        logger::warn("{} no collision_layer_types passed in", __func__);
+        return returnRefs;
+    }
+
+    return core::FilterCollisionLayerTypes<Engine, Out>(refs, collision_layer_types, mode);
+}
+
+void Change_Collision_Layer_Type(RE::StaticFunctionTag*, std::vector<RE::TESObjectREFR*> refs, int collision_layer_type) {
+    if (collision_layer_type < 1 || collision_layer_type > 46) {
+        logger::error("{} collision_layer_type {} is invalid", __func__, collision_layer_type);
+        return;
+    }
+
+    int refsSize = refs.size();
+    if (refsSize == 0) {
+        logger::warn("{} no refs passed in", __func__);
+        return;
+    }
+
+    RE::COL_LAYER akLayer = static_cast<RE::COL_LAYER>(collision_layer_type);
+
+    if (refsSize >= bulkQueueThreshold) {
+        BulkMutationQueue::GetSingleton()->Enqueue(refs, BulkMutationQueue::Operation::kCollisionLayer, collision_layer_type, "Change_Collision_Layer_Type");
+        return;
+    }
+
+    // one task for the whole call, refs are resolved again on the main thread in case they unloaded
+    std::vector<RE::ObjectRefHandle> handles;
+    handles.reserve(refsSize);
+    for (int i = 0; i < refsSize; i++) {
+        if (refs[i]) {
+            handles.push_back(refs[i]->CreateRefHandle());
+        }
+    }
+
+    SKSE::GetTaskInterface()->AddTask([handles = std::move(handles), akLayer]() {
+        for (auto& handle : handles) {
+            auto refPtr = handle.get();
+            if (refPtr) {
+                ApplyCollisionLayerType(refPtr.get(), akLayer);
+            }
+        }
+        SPDLOG_DEBUG("Change_Collision_Layer_Type collision layer set on {} refs", handles.size());
+    });
+}
+
+template <class Out = core::Collect>
+core::ResultOf<Out, Engine> Filter_Deleted(RE::StaticFunctionTag*, RefArray refs, std::string mode) {
+    core::ResultOf<Out, Engine> returnRefs{};
+
+    int refsSize = refs.size();
+    if (refsSize == 0) {
+        logger::warn("{} no refs passed in", __func__);
+        return returnRefs;
+    }
+
+    return core::FilterDeleted<Engine, Out>(refs, mode);
+}
+
+template <class Out = core::Collect>
+core::ResultOf<Out, Engine> Filter_Distance(RE::StaticFunctionTag*, RefArray refs, float distance, RE::TESObjectREFR* from, std::string mode) {
+    core::ResultOf<Out, Engine> returnRefs{};
+    int refsSize = refs.size();
+    if (refsSize == 0) {
+        logger::warn("{} no refs passed in", __func__);
+        return returnRefs;
+    }
+
+    if (!from) {
+        from = RE::TESForm::LookupByID<RE::TESForm>(20)->As<RE::TESObjectREFR>();
+    }
+
+    if (!from) {
+        logger::error("{} from ref is none and couldn't find playerRef", __func__);
+        return returnRefs;
+    }
+
+    if (distance < 0.0) {
+        distance = 0.0;
+    }
+
+    if (UseTwoPhase<Out>(refs.size())) {
+        static auto* captureStats = skypal::stats::Registry::GetSingleton()->Get("Filter_Distance.capture");
+        auto snapshot = CaptureSnapshot(captureStats, refs, skypal::snapshot::kPosition);
+        return skypal::snapshot::FilterDistance<Engine, Out>(snapshot, GetWorkerPool(), distance, from, mode);
+    }
+
+    return core::FilterDistance<Engine, Out>(refs, distance, from, mode);
+}
+
+template <class Out = core::Collect>
+core::ResultOf<Out, Engine> Filter_Enabled(RE::StaticFunctionTag*, RefArray refs, std::string mode) {
+    core::ResultOf<Out, Engine> returnRefs{};
+
+    int refsSize = refs.size();
+    if (refsSize == 0) {
+        logger::warn("{} no refs passed in", __func__);
+        return returnRefs;
+    }
+
+    return core::FilterEnabled<Engine, Out>(refs, mode);
+}
+
+template <class Out = core::Collect>
+core::ResultOf<Out, Engine> Filter_3dLoaded(RE::StaticFunctionTag*, RefArray refs, std::string mode) {
+    core::ResultOf<Out, Engine> returnRefs{};
+
+    int refsSize = refs.size();
+    if (refsSize == 0) {
+        logger::warn("{} no refs passed in", __func__);
+        return returnRefs;
+    }
+
+    return core::Filter3DLoaded<Engine, Out>(refs, mode);
+}
+
+template <class Out = core::Collect>
+core::ResultOf<Out, Engine> Filter_Form_Types(RE::StaticFunctionTag*, RefArray refs, std::vector<int> formTypes, std::string mode) {
+    core::ResultOf<Out, Engine> returnRefs{};
+
+    int refsSize = refs.size();
+    if (refsSize == 0) {
+        logger::warn("{} no refs passed in", __func__);
+        return returnRefs;
+    }
+
+    if (formTypes.size() == 0) {
+        logger::warn("{} no formTypes passed in", __func__);
+        return returnRefs;
+    }
+
+    if (UseTwoPhase<Out>(refs.size())) {
+        static auto* captureStats = skypal::stats::Registry::GetSingleton()->Get(std::string(__func__) + ".capture");
+        auto snapshot = CaptureSnapshot(captureStats, refs, skypal::snapshot::kFormType);
+        return skypal::snapshot::FilterFormTypes<Engine, Out>(snapshot, GetWorkerPool(), formTypes, mode);
+    }
+
+    return core::FilterFormTypes<Engine, Out>(refs, formTypes, mode);
+}
+
+int CountNumberOfKeywordsRefHas(RE::StaticFunctionTag* tag, RE::TESObjectREFR* ref, std::vector<RE::BGSKeyword*> keywords) {
+    int count = 0;
+    if (!ref) {
+        logger::warn("{} ref doesn't exist", __func__);
+        return count;
+    }
+
+    int size = keywords.size();
+
+    if (size == 0) {
+        logger::warn("{} no keywords passed in", __func__);
+        return count;
+    }
+
+    return core::CountKeywords<Engine>(ref, keywords);
+}
+
+bool refHasAtLeastOneKeyword(RE::StaticFunctionTag* tag, RE::TESObjectREFR* ref, std::vector<RE::BGSKeyword*> keywords) {
+    if (!ref) {
+        logger::warn("{} ref doesn't exist", __func__);
+        return false;
+    }
+
+    int size = keywords.size();
+
+    if (size == 0) {
+        logger::warn("{} no keywords passed in", __func__);
+        return false;
+    }
+
+    return core::HasAnyKeyword<Engine>(ref, keywords);
+}
+
+//fix
+std::vector<RE::BGSKeyword*> filter_keywordsOnRef(RE::StaticFunctionTag* tag, RE::TESObjectREFR* ref, std::vector<RE::BGSKeyword*> keywords, std::string mode) {
+    std::vector<RE::BGSKeyword*> returnKeywords;
+    if (!ref) {
+        logger::warn("{} ref doesn't exist", __func__);
+        return returnKeywords;
+    }
+
+    int size = keywords.size();
+
+    if (size == 0) {
+        logger::warn("{} no keywords passed in", __func__);
+        return returnKeywords;
+    }
+
+    bool negate = (mode == "!");
+    for (auto* keyword : keywords) {
+        if (keyword && Engine::HasKeyword(ref, keyword) != negate) {
+            returnKeywords.push_back(keyword);
+        }
+    }
+
+    return returnKeywords;
+}
+
+// if (keywords == none) : Passes an empty array.
+// if (mode == "|") : Passes refs that match any keyword. (OR Gate) //default
+// if (mode == "&") : Passes refs that match all keywords. (AND Gate)
+// if (mode == "^") : Passes refs that match exactly one keyword. (XOR Gate)
+// if (mode == "!|") : Passes refs that match no keywords. (NOR Gate)
+// if (mode == "!&") : Passes refs that do not match all of the keywords. (NAND Gate)
+// if (mode == "!^") : Passes refs that match 0 or more than 1 keyword. (XNOR Gate)
+template <class Out = core::Collect>
+core::ResultOf<Out, Engine> Filter_Keywords(RE::StaticFunctionTag*, RefArray refs, std::vector<RE::BGSKeyword*> keywords, std::string mode) {
+    core::ResultOf<Out, Engine> returnRefs{};
+
+    int refsSize = refs.size();
+    if (refsSize == 0) {
+        logger::warn("{} no refs passed in", __func__);
+        return returnRefs;
+    }
+
+    if (keywords.size() == 0) {
+        logger::warn("{} no keywords passed in", __func__);
+        return returnRefs;
+    }
+
+    if (UseTwoPhase<Out>(refs.size())) {
+        static auto* captureStats = skypal::stats::Registry::GetSingleton()->Get("Filter_Keywords.capture");
+        auto snapshot = CaptureSnapshot(captureStats, refs, skypal::snapshot::kKeywords);
+        return skypal::snapshot::FilterKeywords<Engine, Out>(snapshot, GetWorkerPool(), keywords, mode);
+    }
+
+    return core::FilterKeywords<Engine, Out>(refs, keywords, mode);
+}
+
+// Names are compared case-insensitive, a ref's name is the one GetDisplayName shows.
+// if (mode == "^") : Passes refs whose name starts with pattern.
+// if (mode == "=") : Passes refs whose name is pattern.
+// else : Passes refs whose name contains pattern. //default
+// A "!" in front passes the refs that don't: "!", "!^", "!=".
+template <class Out = core::Collect>
+core::ResultOf<Out, Engine> Filter_Name(RE::StaticFunctionTag*, RefArray refs, std::string pattern, std::string mode) {
+    core::ResultOf<Out, Engine> returnRefs{};
+
+    int refsSize = refs.size();
+    if (refsSize == 0) {
+        logger::warn("{} no refs passed in", __func__);
+        return returnRefs;
+    }
+
+    auto table = NameIndex::GetSingleton()->Get();
+    return skypal::names::FilterName<Engine, Out>(refs, *table, pattern, mode);
+}
+
+// Plugins are file names with their extension, like "Skyrim.esm", and a ref belongs to the
+// plugin that added it, not to the ones that edit it.
+// if (mode == "!") : Passes refs that none of the plugins added.
+// else : Passes refs that one of the plugins added. //default
+template <class Out = core::Collect>
+core::ResultOf<Out, Engine> Filter_Plugins(RE::StaticFunctionTag*, RefArray refs, std::vector<std::string> plugins, std::string mode) {
+    core::ResultOf<Out, Engine> returnRefs{};
+
+    int refsSize = refs.size();
+    if (refsSize == 0) {
+        logger::warn("{} no refs passed in", __func__);
+        return returnRefs;
+    }
+
+    if (plugins.size() == 0) {
+        logger::warn("{} no plugins passed in", __func__);
+        return returnRefs;
+    }
+
+    std::vector<std::string_view> unknown;
+    auto mask = PluginIndex::GetSingleton()->Get()->Resolve(plugins, unknown);
+    for (auto plugin : unknown) {
+        logger::warn("{} {} isn't loaded", __func__, plugin);
+    }
+    return skypal::plugins::FilterPlugins<Engine, Out>(refs, mask, mode);
+}
+
+bool ActorIsOwnerOfRef(RE::StaticFunctionTag*, RE::TESObjectREFR* akRef, RE::Actor* akActor) {
+    if (!akRef) {
+        logger::warn("{} akRef doesn't exist", __func__);
+        return false;
+    }
+
+    if (!akActor) {
+        logger::warn("{} akActor doesn't exist", __func__);
+        return false;
+    }
+
+    return core::ActorIsOwner<Engine>(akRef, akActor);
+}
+
+int CountOwnersForRef(RE::StaticFunctionTag*, RE::TESObjectREFR* akRef, std::vector<RE::Actor*> owners) {
+    int count = 0;
     if (!akRef) {
         logger::warn("{} akRef doesn't exist", __func__);
         return count;
     }
 
-    int size = potential_thieves.size();
+    int size = owners.size();
     if (size == 0) {
-        logger::warn("{} no potential_thieves passed in", __func__);
+        logger::warn("{} no owners passed in", __func__);
         return count;
     }
 
-    for (int i = 0; i < size; i++) {
-        if (ActorIsPotentialThiefOfRef_cpp(akRef, potential_thieves[i])) {
-            count += 1;
-        }
-    }
-    return count;
+    return core::CountOwners<Engine>(akRef, owners);
+}
+
+bool RefHasAtLeastOneOwner(RE::StaticFunctionTag* tag, RE::TESObjectREFR* akRef, std::vector<RE::Actor*> owners) {
+    if (!akRef) {
+        logger::warn("{} akRef doesn't exist", __func__);
+        return false;
+    }
+
+    int size = owners.size();
+    if (size == 0) {
+        logger::warn("{} no owners passed in", __func__);
+        return false;
+    }
+
+    return core::AnyActor<Engine>(owners, [&](RE::Actor* akActor) { return core::ActorIsOwner<Engine>(akRef, akActor); });
+}
+
+std::vector<RE::Actor*> filter_OwnersOnRef(RE::StaticFunctionTag* tag, RE::TESObjectREFR* akRef, std::vector<RE::Actor*> owners, std::string mode) {
+    std::vector<RE::Actor*> returnActors;
+    if (!akRef) {
+        logger::warn("{} akRef doesn't exist", __func__);
+        return returnActors;
+    }
+
+    int size = owners.size();
+    if (size == 0) {
+        logger::warn("{} no owners passed in", __func__);
+        return returnActors;
+    }
+
+    bool negate = (mode == "!");
+    for (auto* akActor : owners) {
+        if (akActor && core::ActorIsOwner<Engine>(akRef, akActor) != negate) {
+            returnActors.push_back(akActor);
+        }
+    }
+    return returnActors;
+}
+
+template <class Out = core::Collect>
+core::ResultOf<Out, Engine> Filter_Owners(RE::StaticFunctionTag*, RefArray refs, std::vector<RE::Actor*> owners, std::string mode) {
+    core::ResultOf<Out, Engine> returnRefs{};
+
+    int refsSize = refs.size();
+    if (refsSize == 0) {
+        logger::warn("{} no refs passed in.", __func__);
+        return returnRefs;
+    }
+
+    int owners_size = owners.size();
+    if (owners_size == 0) {
+        logger::warn("{} no owners passed in", __func__);
+        return returnRefs;
+    }
+
+    SPDLOG_DEBUG("{} {} | {}", __func__, mode, refsSize);
+    return core::FilterOwners<Engine, Out>(refs, owners, mode);
 }
 
-int CountPotentialThievesForRef_cpp(RE::TESObjectREFR* akRef, std::vector<RE::Actor*> potential_thieves) {
-    int count = 0;
+bool ActorIsPotentialThiefOfRef(RE::StaticFunctionTag*, RE::TESObjectREFR* akRef, RE::Actor* akActor) {
     if (!akRef) {
-        //logger::warn("{} akRef doesn't exist", __func__);
-        return count;
+        logger::warn("{} akRef doesn't exist", __func__);
+        return false;
     }
 
-    int size = potential_thieves.size();
-    if (size == 0) {
-        //logger::warn("{} no potential_thieves passed in", __func__);
-        return count;
+    if (!akActor) {
+        logger::warn("{} akActor doesn't exist", __func__);
+        return false;
     }
 
-    for (int i = 0; i < size; i++) {
-        if (ActorIsPotentialThiefOfRef_cpp(akRef, potential_thieves[i])) {
-            count += 1;
-        }
-    }
-    return count;
+    return core::ActorIsPotentialThief<Engine>(akRef, akActor);
 }
 
-bool RefHasAtLeastOnePotentialThief(RE::StaticFunctionTag* tag, RE::TESObjectREFR* akRef, std::vector<RE::Actor*> potential_thieves) {
+int CountPotentialThievesForRef(RE::StaticFunctionTag* tag, RE::TESObjectREFR* akRef, std::vector<RE::Actor*> potential_thieves) {
+    int count = 0;
     if (!akRef) {
         logger::warn("{} akRef doesn't exist", __func__);
-        return false;
+        return count;
     }
 
     int size = potential_thieves.size();
     if (size == 0) {
         logger::warn("{} no potential_thieves passed in", __func__);
-        return false;
+        return count;
     }
 
-    for (int i = 0; i < size; i++) {
-        if (ActorIsPotentialThiefOfRef_cpp(akRef, potential_thieves[i])) {
-            return true;
-        }
-    }
-    return false;
+    return core::CountPotentialThieves<Engine>(akRef, potential_thieves);
 }
 
-bool RefHasAtLeastOnePotentialThief_cpp(RE::TESObjectREFR* akRef, std::vector<RE::Actor*> potential_thieves) {
+bool RefHasAtLeastOnePotentialThief(RE::StaticFunctionTag* tag, RE::TESObjectREFR* akRef, std::vector<RE::Actor*> potential_thieves) {
     if (!akRef) {
         logger::warn("{} akRef doesn't exist", __func__);
-        //return false;
+        return false;
     }
 
     int size = potential_thieves.size();
     if (size == 0) {
         logger::warn("{} no potential_thieves passed in", __func__);
-        //return false;
+        return false;
     }
 
-    for (int i = 0; i < size; i++) {
-        if (ActorIsPotentialThiefOfRef_cpp(akRef, potential_thieves[i])) {
-            return true;
-        }
-    }
-    return false;
+    return core::AnyActor<Engine>(potential_thieves, [&](RE::Actor* akActor) { return core::ActorIsPotentialThief<Engine>(akRef, akActor); });
 }
 
 std::vector<RE::Actor*> filter_PotentialThievesOnRef(RE::StaticFunctionTag* tag, RE::TESObjectREFR* akRef, std::vector<RE::Actor*> potential_thieves, std::string mode) {
@@ -1619,25 +3138,18 @@ std::vector<RE::Actor*> filter_PotentialThievesOnRef(RE::StaticFunctionTag* tag,
         return returnActors;
     }
 
-    if (mode == "!") {
-        for (int i = 0; i < size; i++) {
-            if (!ActorIsPotentialThiefOfRef_cpp(akRef, potential_thieves[i])) {
-                returnActors.push_back(potential_thieves[i]);
-            }
-        }
-    }
-    else {
-        for (int i = 0; i < size; i++) {
-            if (ActorIsPotentialThiefOfRef_cpp(akRef, potential_thieves[i])) {
-                returnActors.push_back(potential_thieves[i]);
-            }
+    bool negate = (mode == "!");
+    for (auto* akActor : potential_thieves) {
+        if (core::ActorIsPotentialThief<Engine>(akRef, akActor) != negate) {
+            returnActors.push_back(akActor);
         }
     }
     return returnActors;
 }
 
-std::vector<RE::TESObjectREFR*> Filter_Potential_Thieves(RE::StaticFunctionTag*, std::vector<RE::TESObjectREFR*> refs, std::vector<RE::Actor*> potenital_thieves, std::string mode) {
-    std::vector<RE::TESObjectREFR*> returnRefs;
+template <class Out = core::Collect>
+core::ResultOf<Out, Engine> Filter_Potential_Thieves(RE::StaticFunctionTag*, RefArray refs, std::vector<RE::Actor*> potenital_thieves, std::string mode) {
+    core::ResultOf<Out, Engine> returnRefs{};
 
     int refsSize = refs.size();
     if (refsSize == 0) {
@@ -1651,66 +3163,12 @@ std::vector<RE::TESObjectREFR*> Filter_Potential_Thieves(RE::StaticFunctionTag*,
         return returnRefs;
     }
 
-    if (mode == "&") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (CountPotentialThievesForRef_cpp(refs[i], potenital_thieves) == potenital_thieves_size) {
-                    returnRefs.push_back(refs[i]);
-                }
-            }
-        }
-    }
-    else if (mode == "^") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (CountPotentialThievesForRef_cpp(refs[i], potenital_thieves) == 1) {
-                    returnRefs.push_back(refs[i]);
-                }
-            }
-        }
-    }
-    else if (mode == "!|") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (CountPotentialThievesForRef_cpp(refs[i], potenital_thieves) == 0) {
-                    returnRefs.push_back(refs[i]);
-                }
-            }
-        }
-    }
-    else if (mode == "!&") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (CountPotentialThievesForRef_cpp(refs[i], potenital_thieves) < potenital_thieves_size) {
-                    returnRefs.push_back(refs[i]);
-                }
-            }
-        }
-    }
-    else if (mode == "!^") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                int count = CountPotentialThievesForRef_cpp(refs[i], potenital_thieves);
-                if (count == 0 || count > 1) {
-                    returnRefs.push_back(refs[i]);
-                }
-            }
-        }
-    }
-    else {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (RefHasAtLeastOnePotentialThief_cpp(refs[i], potenital_thieves)) {
-                    returnRefs.push_back(refs[i]);
-                }
-            }
-        }
-    }
-    return returnRefs;
+    return core::FilterPotentialThieves<Engine, Out>(refs, potenital_thieves, mode);
 }
 
-std::vector<RE::TESObjectREFR*> Filter_WorldSpace(RE::StaticFunctionTag*, std::vector<RE::TESObjectREFR*> refs, RE::TESWorldSpace* akWorldSpace, std::string mode) {
-    std::vector<RE::TESObjectREFR*> returnRefs;
+template <class Out = core::Collect>
+core::ResultOf<Out, Engine> Filter_WorldSpace(RE::StaticFunctionTag*, RefArray refs, RE::TESWorldSpace* akWorldSpace, std::string mode) {
+    core::ResultOf<Out, Engine> returnRefs{};
 
     int refsSize = refs.size();
     if (refsSize == 0) {
@@ -1723,36 +3181,12 @@ std::vector<RE::TESObjectREFR*> Filter_WorldSpace(RE::StaticFunctionTag*, std::v
         return returnRefs;
     }
 
-    if (mode == "!") {
-        for (int i = 0; i < refs.size(); i++) {
-            if (refs[i]) {
-                auto* worldSpace = refs[i]->GetWorldspace();
-                if (worldSpace) {
-                    if (worldSpace != akWorldSpace) {
-                        returnRefs.push_back(refs[i]);
-                    }
-                }
-                else {
-                    returnRefs.push_back(refs[i]);
-                }
-            }
-        }
-    }
-    else {
-        for (int i = 0; i < refs.size(); i++) {
-            auto* worldSpace = refs[i]->GetWorldspace();
-            if (worldSpace) {
-                if (worldSpace == akWorldSpace) {
-                    returnRefs.push_back(refs[i]);
-                }
-            }
-        }
-    }
-    return returnRefs;
+    return core::FilterWorldspace<Engine, Out>(refs, akWorldSpace, mode);
 }
 
-std::vector<RE::TESObjectREFR*> Filter_OffLimits(RE::StaticFunctionTag*, std::vector<RE::TESObjectREFR*> refs, std::string mode) {
-    std::vector<RE::TESObjectREFR*> returnRefs;
+template <class Out = core::Collect>
+core::ResultOf<Out, Engine> Filter_OffLimits(RE::StaticFunctionTag*, RefArray refs, std::string mode) {
+    core::ResultOf<Out, Engine> returnRefs{};
 
     int refsSize = refs.size();
     if (refsSize == 0) {
@@ -1760,29 +3194,12 @@ std::vector<RE::TESObjectREFR*> Filter_OffLimits(RE::StaticFunctionTag*, std::ve
         return returnRefs;
     }
 
-    if (mode == "!") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (!refs[i]->IsOffLimits()) {
-                    returnRefs.push_back(refs[i]);
-                }
-            }
-        }
-    }
-    else {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (refs[i]->IsOffLimits()) {
-                    returnRefs.push_back(refs[i]);
-                }
-            }
-        }
-    }
-    return returnRefs;
+    return core::FilterOffLimits<Engine, Out>(refs, mode);
 }
 
-std::vector<RE::TESObjectREFR*> Filter_InventoryObjects(RE::StaticFunctionTag*, std::vector<RE::TESObjectREFR*> refs, std::string mode) {
-    std::vector<RE::TESObjectREFR*> returnRefs;
+template <class Out = core::Collect>
+core::ResultOf<Out, Engine> Filter_InventoryObjects(RE::StaticFunctionTag*, RefArray refs, std::string mode) {
+    core::ResultOf<Out, Engine> returnRefs{};
 
     int refsSize = refs.size();
     if (refsSize == 0) {
@@ -1790,29 +3207,12 @@ std::vector<RE::TESObjectREFR*> Filter_InventoryObjects(RE::StaticFunctionTag*,
         return returnRefs;
     }
 
-    if (mode == "!") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (!refs[i]->IsInventoryObject()) {
-                    returnRefs.push_back(refs[i]);
-                }
-            }
-        }
-    }
-    else {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (refs[i]->IsInventoryObject()) {
-                    returnRefs.push_back(refs[i]);
-                }
-            }
-        }
-    }
-    return returnRefs;
+    return core::FilterInventoryObjects<Engine, Out>(refs, mode);
 }
 
-std::vector<RE::TESObjectREFR*> Filter_PlayableObjects(RE::StaticFunctionTag*, std::vector<RE::TESObjectREFR*> refs, std::string mode) {
-    std::vector<RE::TESObjectREFR*> returnRefs;
+template <class Out = core::Collect>
+core::ResultOf<Out, Engine> Filter_PlayableObjects(RE::StaticFunctionTag*, RefArray refs, std::string mode) {
+    core::ResultOf<Out, Engine> returnRefs{};
 
     int refsSize = refs.size();
     if (refsSize == 0) {
@@ -1820,47 +3220,12 @@ std::vector<RE::TESObjectREFR*> Filter_PlayableObjects(RE::StaticFunctionTag*, s
         return returnRefs;
     }
 
-    if (mode == "!") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (!refs[i]->GetPlayable()) {
-                    returnRefs.push_back(refs[i]);
-                }
-            }
-        }
-    }
-    else {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (refs[i]->GetPlayable()) {
-                    returnRefs.push_back(refs[i]);
-                }
-            }
-        }
-    }
-    return returnRefs;
-}
-
-bool RefIsAQuestObject(RE::TESObjectREFR* ref) {
-    auto* refAliases = ref->extraList.GetByType<RE::ExtraAliasInstanceArray>();
-    if (refAliases) {
-        auto aliases = refAliases->aliases;
-        for (int ii = 0; ii < aliases.size(); ii++) {
-            if (aliases[ii]) {
-                if (aliases[ii]->alias) {
-                    if (aliases[ii]->alias->IsQuestObject()) {
-                        return true;
-                    }
-                }
-            }
-        }
-    }
-
-    return false;
+    return core::FilterPlayableObjects<Engine, Out>(refs, mode);
 }
 
-std::vector<RE::TESObjectREFR*> Filter_QuestObjects(RE::StaticFunctionTag*, std::vector<RE::TESObjectREFR*> refs, std::string mode) {
-    std::vector<RE::TESObjectREFR*> returnRefs;
+template <class Out = core::Collect>
+core::ResultOf<Out, Engine> Filter_QuestObjects(RE::StaticFunctionTag*, RefArray refs, std::string mode) {
+    core::ResultOf<Out, Engine> returnRefs{};
 
     int refsSize = refs.size();
     if (refsSize == 0) {
@@ -1868,28 +3233,10 @@ std::vector<RE::TESObjectREFR*> Filter_QuestObjects(RE::StaticFunctionTag*, std:
         return returnRefs;
     }
 
-    if (mode == "!") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (!RefIsAQuestObject(refs[i])) {
-                    returnRefs.push_back(refs[i]);
-                }
-            }
-        }
-    }
-    else {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                if (RefIsAQuestObject(refs[i])) {
-                    returnRefs.push_back(refs[i]);
-                }
-            }
-        }
-    }
-    return returnRefs;
+    return core::FilterQuestObjects<Engine, Out>(refs, mode);
 }
 
-std::vector<RE::TESObjectREFR*> Sort_Distance(RE::StaticFunctionTag*, std::vector<RE::TESObjectREFR*> refs, RE::TESObjectREFR* from, std::string mode) {
+std::vector<RE::TESObjectREFR*> Sort_Distance(RE::StaticFunctionTag*, RefArray refs, RE::TESObjectREFR* from, std::string mode) {
     std::vector<RE::TESObjectREFR*> returnRefs;
 
     int refsSize = refs.size();
@@ -1904,48 +3251,19 @@ std::vector<RE::TESObjectREFR*> Sort_Distance(RE::StaticFunctionTag*, std::vecto
 
     if (!from) {
         logger::error("{} from ref is none and couldn't find playerRef", __func__);
-        return refs;
-    }
-
-    std::map<float, std::vector<RE::TESObjectREFR*>> refsMap;
-    std::vector<float> distances;
-    for (int i = 0; i < refsSize; i++) {
-        if (refs[i]) {
-            float distance = (refs[i]->GetPosition().GetDistance(from->GetPosition()));
-            distances.push_back(distance);
-            auto it = refsMap.find(distance);
-            if (it == refsMap.end()) {
-                std::vector<RE::TESObjectREFR*> distanceRefs;
-                distanceRefs.push_back(refs[i]);
-                refsMap[distance] = distanceRefs;
-            }
-            else {
-                auto& distanceRefs = it->second;
-                distanceRefs.push_back(refs[i]);
-            }
-        }
-    }
-
-    std::sort(distances.begin(), distances.end());
-    if (mode == ">") {
-        std::reverse(distances.begin(), distances.end());
+        return { refs.begin(), refs.end() };
     }
-    distances.erase(std::unique(distances.begin(), distances.end()), distances.end());
 
-    for (int i = 0; i < distances.size(); i++) {
-        auto it = refsMap.find(distances[i]);
-        if (it != refsMap.end()) {
-            auto& v = it->second;
-            for (auto* akRef : v) {
-                returnRefs.push_back(akRef);
-            }
-        }
+    if (UseTwoPhase(refs.size())) {
+        static auto* captureStats = skypal::stats::Registry::GetSingleton()->Get("Sort_Distance.capture");
+        auto snapshot = CaptureSnapshot(captureStats, refs, skypal::snapshot::kPosition);
+        return skypal::snapshot::SortDistance<Engine>(snapshot, GetWorkerPool(), from, mode);
     }
 
-    return returnRefs;
+    return core::SortDistance<Engine>(refs, from, mode);
 }
 
-std::vector<RE::TESForm*> From_References(RE::StaticFunctionTag*, std::vector<RE::TESObjectREFR*> refs, std::string mode) {
+std::vector<RE::TESForm*> From_References(RE::StaticFunctionTag*, RefArray refs, std::string mode) {
     std::vector<RE::TESForm*> returnForms;
 
     int refsSize = refs.size();
@@ -1954,30 +3272,7 @@ std::vector<RE::TESForm*> From_References(RE::StaticFunctionTag*, std::vector<RE
         return returnForms;
     }
 
-    if (mode == "...") {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                RE::TESForm* akForm = refs[i]->GetBaseObject();
-                if (akForm) {
-                    returnForms.push_back(akForm);
-                }
-            }
-        }
-    }
-    else {
-        for (int i = 0; i < refsSize; i++) {
-            if (refs[i]) {
-                RE::TESForm* akForm = refs[i]->GetBaseObject();
-                if (akForm) {
-                    if (std::find(returnForms.begin(), returnForms.end(), akForm) == returnForms.end()) {
-                        returnForms.push_back(akForm);
-                    }
-                }
-            }
-        }
-    }
-
-    return returnForms;
+    return core::FromReferences<Engine>(refs, mode);
 }
 
 bool Has_DLL(RE::StaticFunctionTag*) {
@@ -2032,60 +3327,407 @@ float Seconds(RE::StaticFunctionTag*) {
     return float(duration.count());
 }
 
+std::vector<float> Get_Stats(RE::StaticFunctionTag*, std::string name) {
+    std::vector<float> returnStats;
+
+    auto* stats = skypal::stats::Registry::GetSingleton()->Find(name);
+    if (!stats) {
+        logger::warn("{} no native function named {}", __func__, name);
+        return returnStats;
+    }
+
+    // [calls, mean, p50, p95, p99, max (microseconds), average input size, average output size]
+    auto summary = skypal::stats::Summarize(*stats);
+    returnStats = { static_cast<float>(summary.calls), summary.meanUs, summary.p50Us, summary.p95Us, summary.p99Us, summary.maxUs, summary.averageInput, summary.averageOutput };
+    return returnStats;
+}
+
+// if (mode == "csv") : writes doticu_skypal_stats.csv next to the plugin log.
+// else : writes one line per called function to the plugin log. //default
+bool Dump_Stats(RE::StaticFunctionTag*, std::string mode) {
+    auto* registry = skypal::stats::Registry::GetSingleton();
+
+    if (mode == "csv") {
+        auto logsFolder = SKSE::log::log_directory();
+        if (!logsFolder) {
+            logger::error("{} couldn't get the log directory", __func__);
+            return false;
+        }
+
+        auto csvPath = (*logsFolder / "doticu_skypal_stats.csv").string();
+        if (!registry->WriteCsv(csvPath)) {
+            logger::error("{} couldn't write {}", __func__, csvPath);
+            return false;
+        }
+        logger::info("{} wrote {}", __func__, csvPath);
+        return true;
+    }
+
+    for (auto& summary : registry->Summaries()) {
+        if (summary.calls > 0) {
+            logger::info("{}: calls {} mean {:.1f}us p50 {:.1f}us p95 {:.1f}us p99 {:.1f}us max {:.1f}us in {:.1f} out {:.1f}",
+                summary.name, summary.calls, summary.meanUs, summary.p50Us, summary.p95Us, summary.p99Us, summary.maxUs, summary.averageInput, summary.averageOutput);
+        }
+    }
+    return true;
+}
+
+// [running (0 or 1), steps done, steps in this run, milliseconds of the last finished run]
+std::vector<float> Get_Warm_Up(RE::StaticFunctionTag*) {
+    return WarmUp::GetSingleton()->Progress();
+}
+
+void Reset_Stats(RE::StaticFunctionTag*) {
+    skypal::stats::Registry::GetSingleton()->Reset();
+}
+
+bool Start_Trace(RE::StaticFunctionTag*) {
+    skypal::trace::Tracer::GetSingleton()->Start();
+    logger::info("{} native call tracing started", __func__);
+    return true;
+}
+
+// stops tracing and writes doticu_skypal_trace.json next to the plugin log, returns its path or "" on failure
+std::string Stop_Trace(RE::StaticFunctionTag*) {
+    auto* tracer = skypal::trace::Tracer::GetSingleton();
+    tracer->Stop();
+
+    auto logsFolder = SKSE::log::log_directory();
+    if (!logsFolder) {
+        logger::error("{} couldn't get the log directory", __func__);
+        return "";
+    }
+
+    auto tracePath = (*logsFolder / "doticu_skypal_trace.json").string();
+    if (!tracer->WriteJson(tracePath)) {
+        logger::error("{} couldn't write {}", __func__, tracePath);
+        return "";
+    }
+
+    auto dropped = tracer->DroppedEvents();
+    if (dropped > 0) {
+        logger::warn("{} {} events didn't fit in the per thread buffers", __func__, dropped);
+    }
+    logger::info("{} wrote {}", __func__, tracePath);
+    return tracePath;
+}
+
+// starts writing every native call to doticu_skypal_calls.skpr next to the plugin log, for bench/skypal_replay
+bool Start_Recording(RE::StaticFunctionTag*) {
+    auto recordPath = GetRecordingPath();
+    if (recordPath == "" || !skypal::record::Recorder::GetSingleton()->Start(recordPath)) {
+        logger::error("{} couldn't open {}", __func__, recordPath);
+        return false;
+    }
+    logger::info("{} recording native calls to {}", __func__, recordPath);
+    return true;
+}
+
+// returns the path of the recording
+std::string Stop_Recording(RE::StaticFunctionTag*) {
+    auto calls = skypal::record::Recorder::GetSingleton()->Stop();
+    auto recordPath = GetRecordingPath();
+    logger::info("{} recorded {} calls to {}", __func__, calls, recordPath);
+    return recordPath;
+}
+
+template <class T>
+std::size_t ElementCount(const T&) {
+    return 0;
+}
+
+template <class T>
+std::size_t ElementCount(const std::vector<T>& v) {
+    return v.size();
+}
+
+inline std::size_t FirstArrayCount() {
+    return 0;
+}
+
+// Papyrus array arguments: a std::vector or a papyrus::Array view. Strings have a size() too,
+// but they aren't input.
+template <class T>
+struct IsArrayArg : skypal::papyrus::IsArray<T> {};
+
+template <class T>
+struct IsArrayArg<std::vector<T>> : std::true_type {};
+
+// size of the first array argument, which is the refs array for every filter
+template <class T, class... Rest>
+std::size_t FirstArrayCount(const T& first, const Rest&... rest) {
+    if constexpr (IsArrayArg<T>::value) {
+        return first.size();
+    }
+    else {
+        return FirstArrayCount(rest...);
+    }
+}
+
+// Wraps a native so every call is recorded in skypal::stats and skypal::trace when they are enabled.
+// Each call also runs in a skypal::arena scope, and its result vector reserves what the native's
+// selectivity so far predicts for this input.
+template <auto Fn>
+struct Native;
+
+template <class R, class... Args, R (*Fn)(RE::StaticFunctionTag*, Args...)>
+struct Native<Fn> {
+    static inline skypal::stats::FunctionStats* stats = nullptr;
+    static inline std::uint16_t recordId = 0;
+    static inline skypal::arena::Selectivity selectivity;
+
+    static R Call(RE::StaticFunctionTag* tag, Args... args) {
+        bool useArena = skypal::arena::enabled.load(std::memory_order_relaxed);
+        bool recordStats = skypal::stats::enabled.load(std::memory_order_relaxed);
+        bool recordTrace = skypal::trace::enabled.load(std::memory_order_relaxed);
+        bool recordCalls = skypal::record::enabled.load(std::memory_order_relaxed);
+        if (!useArena && !recordStats && !recordTrace && !recordCalls) {
+            return Fn(tag, std::move(args)...);
+        }
+
+        // the arena and the size prediction are only set up when they're enabled
+        std::optional<skypal::arena::Scope> scope;
+        std::size_t inputSize = FirstArrayCount(args...);
+        if (useArena) {
+            scope.emplace();
+            skypal::arena::ExpectOutput(selectivity.Predict(inputSize));
+        }
+        if (!recordStats && !recordTrace && !recordCalls) {
+            if constexpr (std::is_void_v<R>) {
+                Fn(tag, std::move(args)...);
+                return;
+            }
+            else {
+                R result = Fn(tag, std::move(args)...);
+                selectivity.Observe(inputSize, ElementCount(result));
+                return result;
+            }
+        }
+
+        const char* name = stats->name.c_str();
+        if (recordTrace) {
+            skypal::trace::Tracer::GetSingleton()->Begin(name, inputSize);
+        }
+        if (recordCalls) {
+            // the arguments are moved into Fn, so they're written before the call
+            auto& call = skypal::record::LocalWriter();
+            call.Begin(recordId, skypal::record::Recorder::GetSingleton()->Now());
+            (call.Arg(args), ...);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        if constexpr (std::is_void_v<R>) {
+            Fn(tag, std::move(args)...);
+            Finish(recordStats, recordTrace, recordCalls, start, inputSize, 0);
+        }
+        else {
+            R result = Fn(tag, std::move(args)...);
+            if (useArena) {
+                selectivity.Observe(inputSize, ElementCount(result));
+            }
+            Finish(recordStats, recordTrace, recordCalls, start, inputSize, ElementCount(result));
+            return result;
+        }
+    }
+
+    static void Finish(bool recordStats, bool recordTrace, bool recordCalls, std::chrono::steady_clock::time_point start, std::size_t inputSize, std::size_t outputSize) {
+        auto elapsed = ElapsedNanoseconds(start);
+        if (recordStats) {
+            stats->Record(elapsed, inputSize, outputSize);
+        }
+        if (recordTrace) {
+            skypal::trace::Tracer::GetSingleton()->End(stats->name.c_str(), outputSize);
+        }
+        if (recordCalls) {
+            auto& call = skypal::record::LocalWriter();
+            call.End(elapsed, outputSize);
+            skypal::record::Recorder::GetSingleton()->Write(recordId, call);
+        }
+    }
+
+    static std::uint64_t ElapsedNanoseconds(std::chrono::steady_clock::time_point start) {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+};
+
+template <class R, class... Args>
+constexpr bool TakesArray(R (*)(RE::StaticFunctionTag*, Args...)) {
+    return skypal::papyrus::kTakesArray<Args...>;
+}
+
+// natives with a RefArray argument are bound through papyrus::ArrayFunction, which reads the
+// array in place instead of copying it into a std::vector first
+template <auto Fn>
+void RegisterNative(RE::BSScript::IVirtualMachine* vm, std::string_view name, std::string_view className) {
+    Native<Fn>::stats = skypal::stats::Registry::GetSingleton()->Get(name);
+    Native<Fn>::recordId = skypal::record::Recorder::GetSingleton()->RegisterFunction(name);
+    if constexpr (TakesArray(Fn)) {
+        vm->BindNativeMethod(new skypal::papyrus::ArrayFunction<Native<Fn>::Call>(name, className));
+    }
+    else {
+        vm->RegisterFunction(name, className, Native<Fn>::Call);
+    }
+}
+
 bool BindPapyrusFunctions(RE::BSScript::IVirtualMachine* vm) {
     logger::info("Binding Papyrus Functions");
 
     //functions 
-    vm->RegisterFunction("All", "SkyPal_References", All);
-    vm->RegisterFunction("All_Filter_Bases", "SkyPal_References", All_Filter_Bases);
-    vm->RegisterFunction("All_Filter_Bases_Form_List", "SkyPal_References", All_Filter_Bases_Form_List);
-    vm->RegisterFunction("Grid", "SkyPal_References", Grid);
-    vm->RegisterFunction("Grid_Filter_Bases", "SkyPal_References", Grid_Filter_Bases);
-    vm->RegisterFunction("Grid_Filter_Bases_Form_List", "SkyPal_References", Grid_Filter_Bases_Form_List);
-    vm->RegisterFunction("Count_Disabled", "SkyPal_References", Count_Disabled);
-    vm->RegisterFunction("Count_Enabled", "SkyPal_References", Count_Enabled);
-    vm->RegisterFunction("Disable", "SkyPal_References", Disable);
-    vm->RegisterFunction("Enable", "SkyPal_References", Enable);
-    vm->RegisterFunction("Filter_Bases", "SkyPal_References", Filter_Bases);
-    vm->RegisterFunction("Filter_Base_Form_Types", "SkyPal_References", Filter_Base_Form_Types);
-    vm->RegisterFunction("Filter_Bases_Form_List", "SkyPal_References", Filter_Bases_Form_List);
-    vm->RegisterFunction("Filter_Collision_Layer_Types", "SkyPal_References", Filter_Collision_Layer_Types);
-    vm->RegisterFunction("Change_Collision_Layer_Type", "SkyPal_References", Change_Collision_Layer_Type);
-    vm->RegisterFunction("Filter_Deleted", "SkyPal_References", Filter_Deleted);
-    vm->RegisterFunction("Filter_Distance", "SkyPal_References", Filter_Distance);
-    vm->RegisterFunction("Filter_Enabled", "SkyPal_References", Filter_Enabled);
-    vm->RegisterFunction("Filter_Form_Types", "SkyPal_References", Filter_Form_Types);
-    vm->RegisterFunction("Filter_Keywords", "SkyPal_References", Filter_Keywords);
-    vm->RegisterFunction("Filter_Owners", "SkyPal_References", Filter_Owners);
-    vm->RegisterFunction("Filter_Potential_Thieves", "SkyPal_References", Filter_Potential_Thieves);
-    vm->RegisterFunction("Sort_Distance", "SkyPal_References", Sort_Distance);
-
-    vm->RegisterFunction("From_References", "SkyPal_Bases", From_References);
-
-    vm->RegisterFunction("Has_DLL", "SkyPal", Has_DLL);
-    vm->RegisterFunction("Has_Version", "SkyPal", Has_Version);
-    vm->RegisterFunction("Microseconds", "SkyPal", Microseconds);
-    vm->RegisterFunction("Milliseconds", "SkyPal", Milliseconds);
-    vm->RegisterFunction("Seconds", "SkyPal", Seconds);
-
-    vm->RegisterFunction("Get_Version", "skypal_refs_ng", Get_Version);
-    vm->RegisterFunction("Filter_WorldSpace", "skypal_refs_ng", Filter_WorldSpace);
-    vm->RegisterFunction("Filter_3dLoaded", "skypal_refs_ng", Filter_3dLoaded);
-    vm->RegisterFunction("Filter_OffLimits", "skypal_refs_ng", Filter_OffLimits);
-    vm->RegisterFunction("Filter_InventoryObjects", "skypal_refs_ng", Filter_InventoryObjects);
-    vm->RegisterFunction("Filter_PlayableObjects", "skypal_refs_ng", Filter_PlayableObjects);
-    vm->RegisterFunction("Filter_QuestObjects", "skypal_refs_ng", Filter_QuestObjects);
-    vm->RegisterFunction("CountNumberOfKeywordsRefHas", "skypal_refs_ng", CountNumberOfKeywordsRefHas);
-    vm->RegisterFunction("refHasAtLeastOneKeyword", "skypal_refs_ng", refHasAtLeastOneKeyword);
-    vm->RegisterFunction("filter_keywordsOnRef", "skypal_refs_ng", filter_keywordsOnRef);
-    vm->RegisterFunction("ActorIsOwnerOfRef", "skypal_refs_ng", ActorIsOwnerOfRef);
-    vm->RegisterFunction("CountOwnersForRef", "skypal_refs_ng", CountOwnersForRef);
-    vm->RegisterFunction("RefHasAtLeastOneOwner", "skypal_refs_ng", RefHasAtLeastOneOwner);
-    vm->RegisterFunction("filter_OwnersOnRef", "skypal_refs_ng", filter_OwnersOnRef);
-    vm->RegisterFunction("ActorIsPotentialThiefOfRef", "skypal_refs_ng", ActorIsPotentialThiefOfRef);
-    vm->RegisterFunction("CountPotentialThievesForRef", "skypal_refs_ng", CountPotentialThievesForRef);
-    vm->RegisterFunction("RefHasAtLeastOnePotentialThief", "skypal_refs_ng", RefHasAtLeastOnePotentialThief);
-    vm->RegisterFunction("filter_PotentialThievesOnRef", "skypal_refs_ng", filter_PotentialThievesOnRef);
+    RegisterNative<All>(vm, "All", "SkyPal_References");
+    RegisterNative<All_Filter_Bases>(vm, "All_Filter_Bases", "SkyPal_References");
+    RegisterNative<All_Filter_Bases_Form_List>(vm, "All_Filter_Bases_Form_List", "SkyPal_References");
+    RegisterNative<All_Named>(vm, "All_Named", "SkyPal_References");
+    RegisterNative<All_From_Plugin>(vm, "All_From_Plugin", "SkyPal_References");
+    RegisterNative<Grid>(vm, "Grid", "SkyPal_References");
+    RegisterNative<Grid_Filter_Bases>(vm, "Grid_Filter_Bases", "SkyPal_References");
+    RegisterNative<Grid_Filter_Bases_Form_List>(vm, "Grid_Filter_Bases_Form_List", "SkyPal_References");
+    RegisterNative<Count_Disabled>(vm, "Count_Disabled", "SkyPal_References");
+    RegisterNative<Count_Enabled>(vm, "Count_Enabled", "SkyPal_References");
+    RegisterNative<Disable>(vm, "Disable", "SkyPal_References");
+    RegisterNative<Enable>(vm, "Enable", "SkyPal_References");
+    // Count_, Any_ and First_ natives are their Filter_ native with another core output policy:
+    // same arguments and modes, returning how many refs pass, whether any does or the first one
+    RegisterNative<Filter_Bases<>>(vm, "Filter_Bases", "SkyPal_References");
+    RegisterNative<Filter_Bases<core::Count>>(vm, "Count_Bases", "SkyPal_References");
+    RegisterNative<Filter_Bases<core::Any>>(vm, "Any_Bases", "SkyPal_References");
+    RegisterNative<Filter_Bases<core::First>>(vm, "First_Bases", "SkyPal_References");
+    RegisterNative<Filter_Base_Form_Types<>>(vm, "Filter_Base_Form_Types", "SkyPal_References");
+    RegisterNative<Filter_Base_Form_Types<core::Count>>(vm, "Count_Base_Form_Types", "SkyPal_References");
+    RegisterNative<Filter_Base_Form_Types<core::Any>>(vm, "Any_Base_Form_Types", "SkyPal_References");
+    RegisterNative<Filter_Base_Form_Types<core::First>>(vm, "First_Base_Form_Types", "SkyPal_References");
+    RegisterNative<Filter_Bases_Form_List<>>(vm, "Filter_Bases_Form_List", "SkyPal_References");
+    RegisterNative<Filter_Bases_Form_List<core::Count>>(vm, "Count_Bases_Form_List", "SkyPal_References");
+    RegisterNative<Filter_Bases_Form_List<core::Any>>(vm, "Any_Bases_Form_List", "SkyPal_References");
+    RegisterNative<Filter_Bases_Form_List<core::First>>(vm, "First_Bases_Form_List", "SkyPal_References");
+    RegisterNative<Filter_Collision_Layer_Types<>>(vm, "Filter_Collision_Layer_Types", "SkyPal_References");
+    RegisterNative<Filter_Collision_Layer_Types<core::Count>>(vm, "Count_Collision_Layer_Types", "SkyPal_References");
+    RegisterNative<Filter_Collision_Layer_Types<core::Any>>(vm, "Any_Collision_Layer_Types", "SkyPal_References");
+    RegisterNative<Filter_Collision_Layer_Types<core::First>>(vm, "First_Collision_Layer_Types", "SkyPal_References");
+    RegisterNative<Change_Collision_Layer_Type>(vm, "Change_Collision_Layer_Type", "SkyPal_References");
+    RegisterNative<Filter_Deleted<>>(vm, "Filter_Deleted", "SkyPal_References");
+    RegisterNative<Filter_Deleted<core::Count>>(vm, "Count_Deleted", "SkyPal_References");
+    RegisterNative<Filter_Deleted<core::Any>>(vm, "Any_Deleted", "SkyPal_References");
+    RegisterNative<Filter_Deleted<core::First>>(vm, "First_Deleted", "SkyPal_References");
+    RegisterNative<Filter_Distance<>>(vm, "Filter_Distance", "SkyPal_References");
+    RegisterNative<Filter_Distance<core::Count>>(vm, "Count_Distance", "SkyPal_References");
+    RegisterNative<Filter_Distance<core::Any>>(vm, "Any_Distance", "SkyPal_References");
+    RegisterNative<Filter_Distance<core::First>>(vm, "First_Distance", "SkyPal_References");
+    RegisterNative<Filter_Enabled<>>(vm, "Filter_Enabled", "SkyPal_References");
+    RegisterNative<Filter_Enabled<core::Any>>(vm, "Any_Enabled", "SkyPal_References");
+    RegisterNative<Filter_Enabled<core::First>>(vm, "First_Enabled", "SkyPal_References");
+    RegisterNative<Filter_Form_Types<>>(vm, "Filter_Form_Types", "SkyPal_References");
+    RegisterNative<Filter_Form_Types<core::Count>>(vm, "Count_Form_Types", "SkyPal_References");
+    RegisterNative<Filter_Form_Types<core::Any>>(vm, "Any_Form_Types", "SkyPal_References");
+    RegisterNative<Filter_Form_Types<core::First>>(vm, "First_Form_Types", "SkyPal_References");
+    RegisterNative<Filter_Keywords<>>(vm, "Filter_Keywords", "SkyPal_References");
+    RegisterNative<Filter_Keywords<core::Count>>(vm, "Count_Keywords", "SkyPal_References");
+    RegisterNative<Filter_Keywords<core::Any>>(vm, "Any_Keywords", "SkyPal_References");
+    RegisterNative<Filter_Keywords<core::First>>(vm, "First_Keywords", "SkyPal_References");
+    RegisterNative<Filter_Name<>>(vm, "Filter_Name", "SkyPal_References");
+    RegisterNative<Filter_Name<core::Count>>(vm, "Count_Name", "SkyPal_References");
+    RegisterNative<Filter_Name<core::Any>>(vm, "Any_Name", "SkyPal_References");
+    RegisterNative<Filter_Name<core::First>>(vm, "First_Name", "SkyPal_References");
+    RegisterNative<Filter_Owners<>>(vm, "Filter_Owners", "SkyPal_References");
+    RegisterNative<Filter_Owners<core::Count>>(vm, "Count_Owners", "SkyPal_References");
+    RegisterNative<Filter_Owners<core::Any>>(vm, "Any_Owners", "SkyPal_References");
+    RegisterNative<Filter_Owners<core::First>>(vm, "First_Owners", "SkyPal_References");
+    RegisterNative<Filter_Plugins<>>(vm, "Filter_Plugins", "SkyPal_References");
+    RegisterNative<Filter_Plugins<core::Count>>(vm, "Count_Plugins", "SkyPal_References");
+    RegisterNative<Filter_Plugins<core::Any>>(vm, "Any_Plugins", "SkyPal_References");
+    RegisterNative<Filter_Plugins<core::First>>(vm, "First_Plugins", "SkyPal_References");
+    RegisterNative<Filter_Potential_Thieves<>>(vm, "Filter_Potential_Thieves", "SkyPal_References");
+    RegisterNative<Filter_Potential_Thieves<core::Count>>(vm, "Count_Potential_Thieves", "SkyPal_References");
+    RegisterNative<Filter_Potential_Thieves<core::Any>>(vm, "Any_Potential_Thieves", "SkyPal_References");
+    RegisterNative<Filter_Potential_Thieves<core::First>>(vm, "First_Potential_Thieves", "SkyPal_References");
+    RegisterNative<Sort_Distance>(vm, "Sort_Distance", "SkyPal_References");
+
+    RegisterNative<From_References>(vm, "From_References", "SkyPal_Bases");
+
+    RegisterNative<Has_DLL>(vm, "Has_DLL", "SkyPal");
+    RegisterNative<Has_Version>(vm, "Has_Version", "SkyPal");
+    RegisterNative<Microseconds>(vm, "Microseconds", "SkyPal");
+    RegisterNative<Milliseconds>(vm, "Milliseconds", "SkyPal");
+    RegisterNative<Seconds>(vm, "Seconds", "SkyPal");
+    RegisterNative<Get_Stats>(vm, "Get_Stats", "SkyPal");
+    RegisterNative<Dump_Stats>(vm, "Dump_Stats", "SkyPal");
+    RegisterNative<Reset_Stats>(vm, "Reset_Stats", "SkyPal");
+    RegisterNative<Get_Warm_Up>(vm, "Get_Warm_Up", "SkyPal");
+    RegisterNative<Start_Trace>(vm, "Start_Trace", "SkyPal");
+    RegisterNative<Stop_Trace>(vm, "Stop_Trace", "SkyPal");
+    RegisterNative<Start_Recording>(vm, "Start_Recording", "SkyPal");
+    RegisterNative<Stop_Recording>(vm, "Stop_Recording", "SkyPal");
+
+    RegisterNative<Get_Version>(vm, "Get_Version", "skypal_refs_ng");
+    RegisterNative<Get_Last_Bulk_Batch>(vm, "Get_Last_Bulk_Batch", "skypal_refs_ng");
+    RegisterNative<Count_Pending_Bulk>(vm, "Count_Pending_Bulk", "skypal_refs_ng");
+    RegisterNative<Query_Async>(vm, "Query_Async", "skypal_refs_ng");
+    RegisterNative<Cancel_Async>(vm, "Cancel_Async", "skypal_refs_ng");
+    RegisterNative<Get_Async_Status>(vm, "Get_Async_Status", "skypal_refs_ng");
+    RegisterNative<Take_Async_Result>(vm, "Take_Async_Result", "skypal_refs_ng");
+    RegisterNative<Watch>(vm, "Watch", "skypal_refs_ng");
+    RegisterNative<Unwatch>(vm, "Unwatch", "skypal_refs_ng");
+    RegisterNative<Poll_Delta>(vm, "Poll_Delta", "skypal_refs_ng");
+    RegisterNative<Get_Delta_Removed>(vm, "Get_Delta_Removed", "skypal_refs_ng");
+    RegisterNative<Add_Standing_Query>(vm, "Add_Standing_Query", "skypal_refs_ng");
+    RegisterNative<Remove_Standing_Query>(vm, "Remove_Standing_Query", "skypal_refs_ng");
+    RegisterNative<Take_Standing_Matches>(vm, "Take_Standing_Matches", "skypal_refs_ng");
+    RegisterNative<Begin>(vm, "Begin", "skypal_refs_ng");
+    RegisterNative<Begin_All>(vm, "Begin_All", "skypal_refs_ng");
+    RegisterNative<Begin_Grid>(vm, "Begin_Grid", "skypal_refs_ng");
+    RegisterNative<Take>(vm, "Take", "skypal_refs_ng");
+    RegisterNative<Keep_Bases>(vm, "Keep_Bases", "skypal_refs_ng");
+    RegisterNative<Keep_Bases_Form_List>(vm, "Keep_Bases_Form_List", "skypal_refs_ng");
+    RegisterNative<Keep_Form_Types>(vm, "Keep_Form_Types", "skypal_refs_ng");
+    RegisterNative<Keep_Collision_Layer_Types>(vm, "Keep_Collision_Layer_Types", "skypal_refs_ng");
+    RegisterNative<Keep_Enabled>(vm, "Keep_Enabled", "skypal_refs_ng");
+    RegisterNative<Keep_Deleted>(vm, "Keep_Deleted", "skypal_refs_ng");
+    RegisterNative<Keep_3dLoaded>(vm, "Keep_3dLoaded", "skypal_refs_ng");
+    RegisterNative<Keep_OffLimits>(vm, "Keep_OffLimits", "skypal_refs_ng");
+    RegisterNative<Keep_InventoryObjects>(vm, "Keep_InventoryObjects", "skypal_refs_ng");
+    RegisterNative<Keep_PlayableObjects>(vm, "Keep_PlayableObjects", "skypal_refs_ng");
+    RegisterNative<Keep_QuestObjects>(vm, "Keep_QuestObjects", "skypal_refs_ng");
+    RegisterNative<Keep_WorldSpace>(vm, "Keep_WorldSpace", "skypal_refs_ng");
+    RegisterNative<Keep_Distance>(vm, "Keep_Distance", "skypal_refs_ng");
+    RegisterNative<Keep_Keywords>(vm, "Keep_Keywords", "skypal_refs_ng");
+    RegisterNative<Keep_Owners>(vm, "Keep_Owners", "skypal_refs_ng");
+    RegisterNative<Keep_Potential_Thieves>(vm, "Keep_Potential_Thieves", "skypal_refs_ng");
+    RegisterNative<Find>(vm, "Find", "skypal_refs_ng");
+    RegisterNative<Find_Closest>(vm, "Find_Closest", "skypal_refs_ng");
+    RegisterNative<Filter_WorldSpace<>>(vm, "Filter_WorldSpace", "skypal_refs_ng");
+    RegisterNative<Filter_WorldSpace<core::Count>>(vm, "Count_WorldSpace", "skypal_refs_ng");
+    RegisterNative<Filter_WorldSpace<core::Any>>(vm, "Any_WorldSpace", "skypal_refs_ng");
+    RegisterNative<Filter_WorldSpace<core::First>>(vm, "First_WorldSpace", "skypal_refs_ng");
+    RegisterNative<Filter_3dLoaded<>>(vm, "Filter_3dLoaded", "skypal_refs_ng");
+    RegisterNative<Filter_3dLoaded<core::Count>>(vm, "Count_3dLoaded", "skypal_refs_ng");
+    RegisterNative<Filter_3dLoaded<core::Any>>(vm, "Any_3dLoaded", "skypal_refs_ng");
+    RegisterNative<Filter_3dLoaded<core::First>>(vm, "First_3dLoaded", "skypal_refs_ng");
+    RegisterNative<Filter_OffLimits<>>(vm, "Filter_OffLimits", "skypal_refs_ng");
+    RegisterNative<Filter_OffLimits<core::Count>>(vm, "Count_OffLimits", "skypal_refs_ng");
+    RegisterNative<Filter_OffLimits<core::Any>>(vm, "Any_OffLimits", "skypal_refs_ng");
+    RegisterNative<Filter_OffLimits<core::First>>(vm, "First_OffLimits", "skypal_refs_ng");
+    RegisterNative<Filter_InventoryObjects<>>(vm, "Filter_InventoryObjects", "skypal_refs_ng");
+    RegisterNative<Filter_InventoryObjects<core::Count>>(vm, "Count_InventoryObjects", "skypal_refs_ng");
+    RegisterNative<Filter_InventoryObjects<core::Any>>(vm, "Any_InventoryObjects", "skypal_refs_ng");
+    RegisterNative<Filter_InventoryObjects<core::First>>(vm, "First_InventoryObjects", "skypal_refs_ng");
+    RegisterNative<Filter_PlayableObjects<>>(vm, "Filter_PlayableObjects", "skypal_refs_ng");
+    RegisterNative<Filter_PlayableObjects<core::Count>>(vm, "Count_PlayableObjects", "skypal_refs_ng");
+    RegisterNative<Filter_PlayableObjects<core::Any>>(vm, "Any_PlayableObjects", "skypal_refs_ng");
+    RegisterNative<Filter_PlayableObjects<core::First>>(vm, "First_PlayableObjects", "skypal_refs_ng");
+    RegisterNative<Filter_QuestObjects<>>(vm, "Filter_QuestObjects", "skypal_refs_ng");
+    RegisterNative<Filter_QuestObjects<core::Count>>(vm, "Count_QuestObjects", "skypal_refs_ng");
+    RegisterNative<Filter_QuestObjects<core::Any>>(vm, "Any_QuestObjects", "skypal_refs_ng");
+    RegisterNative<Filter_QuestObjects<core::First>>(vm, "First_QuestObjects", "skypal_refs_ng");
+    RegisterNative<CountNumberOfKeywordsRefHas>(vm, "CountNumberOfKeywordsRefHas", "skypal_refs_ng");
+    RegisterNative<refHasAtLeastOneKeyword>(vm, "refHasAtLeastOneKeyword", "skypal_refs_ng");
+    RegisterNative<filter_keywordsOnRef>(vm, "filter_keywordsOnRef", "skypal_refs_ng");
+    RegisterNative<ActorIsOwnerOfRef>(vm, "ActorIsOwnerOfRef", "skypal_refs_ng");
+    RegisterNative<CountOwnersForRef>(vm, "CountOwnersForRef", "skypal_refs_ng");
+    RegisterNative<RefHasAtLeastOneOwner>(vm, "RefHasAtLeastOneOwner", "skypal_refs_ng");
+    RegisterNative<filter_OwnersOnRef>(vm, "filter_OwnersOnRef", "skypal_refs_ng");
+    RegisterNative<ActorIsPotentialThiefOfRef>(vm, "ActorIsPotentialThiefOfRef", "skypal_refs_ng");
+    RegisterNative<CountPotentialThievesForRef>(vm, "CountPotentialThievesForRef", "skypal_refs_ng");
+    RegisterNative<RefHasAtLeastOnePotentialThief>(vm, "RefHasAtLeastOnePotentialThief", "skypal_refs_ng");
+    RegisterNative<filter_PotentialThievesOnRef>(vm, "filter_PotentialThievesOnRef", "skypal_refs_ng");
 
     return true;
 }
@@ -2094,14 +3736,60 @@ SKSEPluginLoad(const SKSE::LoadInterface *skse) {
     SKSE::Init(skse);
 
     SetupLog();
+    LoadSettings();
     SKSE::GetPapyrusInterface()->Register(BindPapyrusFunctions);
+
+    // the ref index goes in the co-save
+    auto* serialization = SKSE::GetSerializationInterface();
+    serialization->SetUniqueID(0x534B504C);  // 'SKPL'
+    serialization->SetSaveCallback([](SKSE::SerializationInterface* intfc) {
+        if (refIndexEnabled) {
+            RefIndex::GetSingleton()->Save(intfc);
+        }
+    });
+    serialization->SetLoadCallback([](SKSE::SerializationInterface* intfc) {
+        if (refIndexEnabled) {
+            RefIndex::GetSingleton()->Load(intfc);
+        }
+    });
+    serialization->SetRevertCallback([](SKSE::SerializationInterface*) {
+        RefIndex::GetSingleton()->Revert();
+        WatchRegistry::GetSingleton()->Revert();
+    });
     pluginStartTimePoint = std::chrono::high_resolution_clock::now();
 
     // Once all plugins and mods are loaded, then the ~ console is ready and can
     // be printed to
+    auto* warmUp = WarmUp::GetSingleton();
+    warmUp->AddStep("worker pool", false, []() {
+        if (twoPhaseEnabled) {
+            GetWorkerPool();
+        }
+    });
+    warmUp->AddStep("ref index", true, []() {
+        if (refIndexEnabled) {
+            RefIndex::GetSingleton()->Build();
+        }
+    });
+    warmUp->AddStep("names", false, []() { NameIndex::GetSingleton()->Build(); });
+    warmUp->AddStep("plugins", false, []() { PluginIndex::GetSingleton()->Build(); });
+
     SKSE::GetMessagingInterface()->RegisterListener([](SKSE::MessagingInterface::Message *message) {
-        if (message->type == SKSE::MessagingInterface::kDataLoaded)
+        if (message->type == SKSE::MessagingInterface::kDataLoaded) {
             RE::ConsoleLog::GetSingleton()->Print("Skypal NG Installed");
+            StandingQueries::GetSingleton()->RegisterSinks();
+            WatchRegistry::GetSingleton()->RegisterSinks();
+            if (refIndexEnabled) {
+                RefIndex::GetSingleton()->RegisterSinks();
+            }
+            WarmUp::GetSingleton()->Start("data loaded", false);
+        }
+        else if (message->type == SKSE::MessagingInterface::kPostLoadGame) {
+            WarmUp::GetSingleton()->Start("load game", true);
+        }
+        else if (message->type == SKSE::MessagingInterface::kNewGame) {
+            WarmUp::GetSingleton()->Start("new game", true);
+        }
     });
     return true;
 }
\ No newline at end of file